@@ -7,8 +7,18 @@
  * this file, and for a DISCLAIMER OF ALL WARRANTIES.
  */
 
+#include <stdio.h>		/* NOTE: For snprintf(). */
 #include <stdlib.h>		/* NOTE: For free(). */
-#include <string.h>		/* NOTE: For strlen(), strcmp(), strdup(). */
+#include <string.h>		/* NOTE: For strlen(), strcmp(), strdup(), memset(). */
+#include <errno.h>		/* NOTE: For EEXIST. */
+#include <sys/types.h>		/* NOTE: For struct stat. */
+#include <sys/stat.h>		/* NOTE: For stat(), S_ISDIR(). */
+#if defined(_WIN32)
+#include <process.h>		/* NOTE: For _getpid(). */
+#define getpid			_getpid
+#else
+#include <unistd.h>		/* NOTE: For getpid(). */
+#endif
 #include "tcl.h"		/* NOTE: For public Tcl API. */
 #include "sass/context.h"	/* NOTE: For public libsass API. */
 #include "pkgVersion.h"		/* NOTE: Package version information. */
@@ -29,6 +39,247 @@ enum Sass_Context_Type {
   SASS_CONTEXT_FOLDER
 };
 
+/*
+ * NOTE: These are the kinds of results supported by the [sass compile]
+ *       sub-command.  They are used to process the -result option.
+ */
+
+enum Sass_Result_Type {
+  SASS_RESULT_DICT,
+  SASS_RESULT_CSS
+};
+
+/*
+ * NOTE: These are the sub-commands handled by the ParseCompiler function,
+ *       which parse the source without executing it.
+ */
+
+enum Sass_Parse_Mode {
+  SASS_PARSE_COMPILER,
+  SASS_PARSE_CHECK,
+  SASS_PARSE_DEPS
+};
+
+/*
+ * NOTE: These are the phases of one compilation that are timed when the
+ *       -profile option is used, along with their names within its result
+ *       dictionary.
+ */
+
+enum Sass_Profile_Phase {
+  SASS_PROFILE_OPTIONS,
+  SASS_PROFILE_SETUP,
+  SASS_PROFILE_PARSE,
+  SASS_PROFILE_EXECUTE,
+  SASS_PROFILE_RESULT,
+  SASS_PROFILE_MAX
+};
+
+static const char *azProfilePhases[] = {
+  "options", "setup", "parse", "execute", "result"
+};
+
+/*
+ * NOTE: This structure holds the profile of one compilation, as reported by
+ *       the -profile option.  All times are in nanoseconds.  The heap usage
+ *       is sampled at the end of each phase, relative to the end of option
+ *       processing; therefore, the peak is a lower bound.
+ */
+
+typedef struct SassProfile {
+    Tcl_WideUInt wallTime;		/* When the current phase started. */
+    Tcl_WideUInt cpuTime;		/* CPU time when it started. */
+    Tcl_WideUInt aWall[SASS_PROFILE_MAX]; /* Wall time of each phase. */
+    Tcl_WideUInt aCpu[SASS_PROFILE_MAX]; /* CPU time of each phase. */
+    Tcl_WideInt heapBase;		/* Heap usage before compiling. */
+    Tcl_WideInt peakBytes;		/* Largest growth of heap usage. */
+    Tcl_WideUInt includedFiles;		/* Number of included files. */
+    Tcl_WideUInt inputBytes;		/* Number of source bytes. */
+    Tcl_WideUInt outputBytes;		/* Number of output bytes. */
+} SassProfile;
+
+/*
+ * NOTE: This structure holds the settings for one use of the [sass compile]
+ *       sub-command that are handled by this package itself, i.e. they are
+ *       not simply passed along to libsass via the Sass_Options struct.
+ */
+
+typedef struct SassCompileSettings {
+    enum Sass_Context_Type type;	/* The context type, from -type. */
+    int bCache;				/* Non-zero to use the compile cache. */
+    int bProfile;			/* Non-zero to add "profile" result. */
+    Tcl_Obj *commandPtr;		/* Completion callback, from -command. */
+    enum Sass_Result_Type resultType;	/* The kind of result, from -result. */
+    Tcl_Channel outputChannel;		/* From -outputChannel, if any. */
+    Tcl_Obj *outputFilePtr;		/* From -outputFile, if any. */
+    Tcl_Obj *sourceMapFilePtr;		/* Where -outputFile puts source map. */
+    Tcl_Obj *outputDirPtr;		/* From -outputDir, if any. */
+    const char *zIncludePath;		/* From "include_path", not owned. */
+    int bTclVfs;			/* From "tcl_vfs", use Tcl filesystem. */
+    SassFs *fsPtr;			/* Its importer state, if enabled. */
+    SassFuncBinding *funcsPtr;		/* Custom functions used, if any. */
+    SassVars *varsPtr;			/* From -variables, if any. */
+    Tcl_DString key;			/* Compile cache key, see below. */
+    SassProfile profile;		/* From -profile, if enabled. */
+} SassCompileSettings;
+
+/*
+ * NOTE: This structure holds one validated Sass context option, i.e. the
+ *       Sass C API function used to set it and its converted value.
+ */
+
+typedef struct SassOptionValue {
+    fn_get_any *xGetValue;		/* Tcl C API used to get value. */
+    fn_set_any *xSetOption;		/* Sass C API to set value. */
+    int iValue;				/* Boolean, integer, or enum value. */
+    char *zValue;			/* String value, if applicable. */
+} SassOptionValue;
+
+/*
+ * NOTE: This structure holds all the validated options from one options
+ *       dictionary, along with its string value, which becomes part of the
+ *       compile cache key.  It is used by the -options and -optionsHandle
+ *       options.  Applying it to a Sass_Options struct does not require any
+ *       parsing.  It is reference counted because it may be shared by any
+ *       number of Tcl objects and options handles.
+ */
+
+typedef struct SassOptionSet {
+    int refCount;			/* Number of references to this. */
+    int nValues;			/* Number of option values. */
+    SassOptionValue *aValues;		/* The option values. */
+    char *zKey;				/* Dictionary string, with NUL. */
+    int keyLength;			/* Length of above, with NUL. */
+} SassOptionSet;
+
+/*
+ * NOTE: These are the keys of the result dictionary returned by the [sass
+ *       compile] sub-command.  Each Tcl interpreter has one shared object
+ *       for each of them, see below.
+ */
+
+enum Sass_Result_Key {
+  SASS_KEY_ERROR_STATUS,
+  SASS_KEY_OUTPUT_STRING,
+  SASS_KEY_SOURCE_MAP_STRING,
+  SASS_KEY_ERROR_MESSAGE,
+  SASS_KEY_ERROR_LINE,
+  SASS_KEY_ERROR_COLUMN,
+  SASS_KEY_MAX
+};
+
+static const char *azResultKeys[] = {
+  "errorStatus", "outputString", "sourceMapString", "errorMessage",
+  "errorLine", "errorColumn"
+};
+
+/*
+ * NOTE: This structure holds the package data for one Tcl interpreter, i.e.
+ *       the option sets created by [sass options create] and the compilers
+ *       created by [sass parse], keyed by handle name, the files included
+ *       by the outputs written by [sass compile -type folder], keyed by
+ *       output file, and the shared objects used as result dictionary keys.
+ */
+
+typedef struct SassInterpData {
+    Tcl_HashTable handles;		/* Maps handle names to option sets. */
+    int nextHandleId;			/* Used to generate handle names. */
+    Tcl_HashTable compilers;		/* Maps handle names to compilers. */
+    int nextCompilerId;			/* Used to generate handle names. */
+    Tcl_HashTable outputs;		/* Maps output files to includes. */
+    Tcl_Obj *apResultKeys[SASS_KEY_MAX]; /* Result dictionary keys. */
+} SassInterpData;
+
+/*
+ * NOTE: This is the name of the Tcl interpreter association data used to
+ *       store the SassInterpData struct.
+ */
+
+#define INTERP_DATA_NAME		PACKAGE_NAME "_data"
+
+/*
+ * NOTE: This Tcl object type caches the option set for an options dictionary
+ *       passed via the -options option, so that using the same Tcl object
+ *       again does not require parsing or validating it again.  The string
+ *       representation is never invalidated; therefore, no procedure is
+ *       needed to update it.
+ */
+
+static void		FreeOptionsInternalRep(Tcl_Obj *objPtr);
+static void		DupOptionsInternalRep(Tcl_Obj *srcPtr,
+			    Tcl_Obj *dupPtr);
+
+static Tcl_ObjType sassOptionsType = {
+    "sassOptions",			/* name */
+    FreeOptionsInternalRep,		/* freeIntRepProc */
+    DupOptionsInternalRep,		/* dupIntRepProc */
+    NULL,				/* updateStringProc */
+    NULL				/* setFromAnyProc */
+};
+
+/*
+ * NOTE: This structure holds one asynchronous compilation, i.e. one use of
+ *       the [sass compile] sub-command with the -command option.  It is
+ *       created by the calling thread, compiled by a worker thread of the
+ *       pool, and then completed (and freed) by the calling thread.  While
+ *       the worker thread owns it, only the fields below the interpreter
+ *       related ones may be used, since they do not involve Tcl objects.
+ */
+
+typedef struct SassCompileJob {
+    Tcl_Interp *interp;			/* Interpreter for the callback. */
+    Tcl_Obj *commandPtr;		/* The callback command prefix. */
+    Tcl_Obj *tokenPtr;			/* Request token, for the callback. */
+    enum Sass_Context_Type type;	/* The context type. */
+    struct Sass_Options *optsPtr;	/* The context options, if unused. */
+    SassFuncBinding *funcsPtr;		/* Custom functions used, if any. */
+    SassVars *varsPtr;			/* Variables header used, if any. */
+    char *zSource;			/* The source string or file. */
+    char *zKey;				/* Compile cache key, or NULL. */
+    int keyLength;			/* Length of cache key. */
+    SassCacheEntry *entryPtr;		/* OUT: Compile cache hit, if any. */
+    struct Sass_Context *ctxPtr;	/* OUT: The compiled context, if any. */
+    SassResult result;			/* OUT: Its status/result, if any. */
+    char *zDup;				/* OUT: Source copy for data context. */
+    const char *zError;			/* OUT: Why there is no context. */
+} SassCompileJob;
+
+/*
+ * NOTE: This is used to generate the request tokens returned by the [sass
+ *       compile] sub-command when the -command option is used.
+ */
+
+static Tcl_WideInt nextJobId = 0;
+TCL_DECLARE_MUTEX(jobIdMutex)
+
+/*
+ * NOTE: This structure holds one parsed compilation, i.e. one use of the
+ *       [sass parse] sub-command, until it is executed or discarded.  The
+ *       libsass compiler refers to the context, which owns the options.
+ *       The state used by the custom importers and functions is kept as
+ *       well, since they may still be called while executing.
+ */
+
+typedef struct SassParsed {
+    enum Sass_Context_Type type;	/* The context type. */
+    enum Sass_Result_Type resultType;	/* The kind of result, from -result. */
+    struct Sass_Context *ctxPtr;	/* The parsed context. */
+    struct Sass_Compiler *compiler;	/* Its libsass compiler. */
+    char *zDup;				/* Source copy for data context. */
+    SassFs *fsPtr;			/* Tcl filesystem importer, if any. */
+    SassFuncBinding *funcsPtr;		/* Custom functions used, if any. */
+    SassVars *varsPtr;			/* Variables header used, if any. */
+    Tcl_WideUInt inputLength;		/* Source bytes, for [sass stats]. */
+    Tcl_WideUInt parseTime;		/* Parse latency, in nanoseconds. */
+} SassParsed;
+
+/*
+ * NOTE: This is the stubs table for the public functions of this package,
+ *       which is defined in "tclsassStubInit.c".
+ */
+
+MODULE_SCOPE const SassStubs sassStubs;
+
 /*
  * NOTE: Private functions defined in this file.
  */
@@ -39,19 +290,149 @@ static int		GetContextTypeFromObj(Tcl_Interp *interp,
 			    Tcl_Obj *objPtr, enum Sass_Context_Type *typePtr);
 static int		GetOutputStyleFromObj(Tcl_Interp *interp,
 			    Tcl_Obj *objPtr, enum Sass_Output_Style *stylePtr);
-static int		FindAndSetContextOption(Tcl_Interp *interp,
+static int		FindContextOption(Tcl_Interp *interp,
 			    int nameLength, const char *zName, Tcl_Obj *objPtr,
+			    SassOptionValue *valuePtr);
+static SassOptionSet *	NewOptionSet(Tcl_Interp *interp, Tcl_Obj *dictPtr);
+static void		SetTclVfsOption(struct Sass_Options *optsPtr,
+			    bool bValue);
+static void		ApplyOptionSet(const SassOptionSet *setPtr,
+			    struct Sass_Options *optsPtr,
+			    SassCompileSettings *settingsPtr);
+static void		ReleaseOptionSet(SassOptionSet *setPtr);
+static SassOptionSet *	GetOptionSetFromDictObj(Tcl_Interp *interp,
+			    Tcl_Obj *dictPtr);
+static int		GetResultTypeFromObj(Tcl_Interp *interp,
+			    Tcl_Obj *objPtr, enum Sass_Result_Type *typePtr);
+static SassInterpData *	GetInterpData(Tcl_Interp *interp, int bCreate);
+static void		InterpDataDeleteProc(ClientData clientData,
+			    Tcl_Interp *interp);
+static int		GetOptionSetFromObj(Tcl_Interp *interp,
+			    Tcl_Obj *objPtr, SassOptionSet **setPtrPtr);
+static int		SassOptionsObjCmd(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+static int		ApplyContextOptions(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[], int *idxPtr,
+			    SassCompileSettings *settingsPtr,
 			    struct Sass_Options *optsPtr);
 static int		ProcessContextOptions(Tcl_Interp *interp, int objc,
 			    Tcl_Obj *CONST objv[], int *idxPtr,
-			    enum Sass_Context_Type *typePtr,
+			    SassCompileSettings *settingsPtr,
 			    struct Sass_Options *optsPtr);
+static void		GetResultFromContext(struct Sass_Context *ctxPtr,
+			    SassResult *resultPtr);
+static int		SetResultFromSassResult(Tcl_Interp *interp,
+			    const SassResult *resultPtr,
+			    enum Sass_Result_Type resultType);
+static int		SetCompileResult(Tcl_Interp *interp,
+			    SassCompileSettings *settingsPtr,
+			    const SassResult *resultPtr);
 static int		SetResultFromContext(Tcl_Interp *interp,
-			    struct Sass_Context *ctxPtr);
+			    struct Sass_Context *ctxPtr,
+			    const SassResult *resultPtr, const char *zKey,
+			    int keyLength, const Tcl_Time *startTimePtr,
+			    SassCompileSettings *settingsPtr);
+static void		DeleteOptions(struct Sass_Options *optsPtr);
+static struct Sass_Context *NewContext(enum Sass_Context_Type type,
+			    struct Sass_Options **pOptsPtr,
+			    const char *zSource, char **pzDup,
+			    Tcl_WideUInt *pDataLength, const char **pzError);
+static Tcl_WideUInt	GetInputLength(enum Sass_Context_Type type,
+			    const char *zSource, Tcl_WideUInt dataLength,
+			    int bForce);
+static void		CountCompile(struct Sass_Context *ctxPtr,
+			    enum Sass_Context_Type type,
+			    Tcl_WideUInt inputLength, Tcl_WideUInt startTime,
+			    SassResult *resultPtr);
+static struct Sass_Context *CompileContext(enum Sass_Context_Type type,
+			    struct Sass_Options **pOptsPtr,
+			    const char *zSource, char **pzDup,
+			    const char **pzError, SassResult *resultPtr);
+static void		StartProfile(SassProfile *profilePtr);
+static void		MarkProfile(SassProfile *profilePtr,
+			    enum Sass_Profile_Phase phase);
+static struct Sass_Context *ProfileContext(enum Sass_Context_Type type,
+			    struct Sass_Options **pOptsPtr,
+			    const char *zSource, char **pzDup,
+			    const char **pzError, SassResult *resultPtr,
+			    SassProfile *profilePtr);
+static void		AppendProfile(Tcl_Interp *interp,
+			    const SassProfile *profilePtr);
+static void		SetContextImporters(struct Sass_Options *optsPtr,
+			    SassCompileSettings *settingsPtr);
+static void		DeleteContext(enum Sass_Context_Type type,
+			    struct Sass_Context *ctxPtr, char *zDup);
+static int		ReadTclVfsEntry(Tcl_Interp *interp,
+			    SassCompileSettings *settingsPtr,
+			    struct Sass_Options *optsPtr,
+			    enum Sass_Context_Type *typePtr,
+			    const char **pzSource);
 static int		CompileForType(Tcl_Interp *interp,
 			    enum Sass_Context_Type type,
 			    struct Sass_Options **pOptsPtr,
-			    const char* zSource);
+			    const char* zSource, const char *zKey,
+			    int keyLength, SassCompileSettings *settingsPtr);
+static const char *	GetCacheKey(Tcl_Interp *interp,
+			    SassCompileSettings *settingsPtr,
+			    const char *zSource, int sourceLength);
+static SassCompileJob *	NewCompileJob(Tcl_Interp *interp,
+			    enum Sass_Context_Type type,
+			    struct Sass_Options **pOptsPtr,
+			    const char *zSource, int sourceLength,
+			    const char *zKey, int keyLength);
+static SassCompileJob *	PrepareCompileJob(Tcl_Interp *interp,
+			    Tcl_Obj *jobObjPtr);
+static int		SubmitCompileJob(Tcl_Interp *interp,
+			    SassCompileSettings *settingsPtr,
+			    struct Sass_Options **pOptsPtr,
+			    const char *zSource, int sourceLength,
+			    const char *zKey, int keyLength);
+static void		CompileJobWorkProc(ClientData clientData);
+static int		SetResultFromCompileJob(Tcl_Interp *interp,
+			    SassCompileJob *jobPtr);
+static void		CompileJobDoneProc(ClientData clientData);
+static void		CompileJobDiscardProc(ClientData clientData);
+static void		FreeCompileJob(SassCompileJob *jobPtr);
+static SassParsed *	ParseSource(Tcl_Interp *interp,
+			    SassCompileSettings *settingsPtr,
+			    struct Sass_Options **pOptsPtr,
+			    const char *zSource);
+static void		FreeParsed(SassParsed *parsedPtr);
+static Tcl_Obj *	GetIncludedFiles(struct Sass_Context *ctxPtr);
+static int		ParseCompiler(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[], int skip,
+			    enum Sass_Parse_Mode mode);
+static int		ExecuteCompiler(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[], int bDiscard);
+static int		CompileBatch(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+static int		ComparePaths(const void *pLeft,
+			    const void *pRight);
+static Tcl_Obj *	GetPathTail(Tcl_Obj *pathPtr);
+static int		FindFolderEntries(Tcl_Interp *interp,
+			    Tcl_Obj *dirPtr, Tcl_Obj *outputDirPtr,
+			    Tcl_Obj *prefixPtr, Tcl_Obj *listPtr);
+static int		GetFileTime(const char *zPath, Tcl_WideInt *secPtr,
+			    long *nsecPtr);
+static const char *	GetOutputRecordKey(Tcl_Interp *interp,
+			    Tcl_Obj *outputPtr);
+static int		IsOutputCurrent(Tcl_Interp *interp,
+			    SassInterpData *dataPtr, Tcl_Obj *outputPtr,
+			    const char *zKey, int keyLength);
+static void		RecordOutput(Tcl_Interp *interp,
+			    SassInterpData *dataPtr, Tcl_Obj *outputPtr,
+			    const char *zKey, int keyLength,
+			    char **azIncluded, const Tcl_Time *startTimePtr);
+static int		CreateParentDirectory(Tcl_Interp *interp,
+			    Tcl_Obj *pathPtr);
+static SassCompileJob *	PrepareFileJob(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[], int index,
+			    Tcl_Obj *sourcePtr, Tcl_Obj *outputPtr);
+static int		CompileFolder(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[],
+			    SassCompileSettings *settingsPtr,
+			    struct Sass_Options *optsPtr,
+			    Tcl_Obj *sourceDirPtr);
 static void		SassExitProc(ClientData clientData);
 static int		SassObjCmd(ClientData clientData, Tcl_Interp *interp,
 			    int objc, Tcl_Obj *CONST objv[]);
@@ -122,6 +503,7 @@ static int GetStringFromObj(
  *
  *		data
  *		file
+ *		folder
  *
  *	If the string context type name does not conform to one of the
  *	above values, it will be rejected and a script error will be
@@ -175,12 +557,87 @@ static int GetContextTypeFromObj(
 	return TCL_OK;
     }
 
+    if (CheckString(typeLength, zType, "folder")) {
+	*typePtr = SASS_CONTEXT_FOLDER;
+	return TCL_OK;
+    }
+
     Tcl_AppendResult(interp,
-	"unsupported context type, must be: data or file\n", NULL);
+	"unsupported context type, must be: data, file, or folder\n", NULL);
 
     return TCL_ERROR;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetResultTypeFromObj --
+ *
+ *	This function attempts to convert a string result type name
+ *	into an actual Sass_Result_Type value.  The valid values for
+ *	the string result type name are:
+ *
+ *		css
+ *		dict
+ *
+ *	If the string result type name does not conform to one of the
+ *	above values, it will be rejected and a script error will be
+ *	generated.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int GetResultTypeFromObj(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *objPtr,			/* The string to convert. */
+    enum Sass_Result_Type *typePtr)	/* OUT: The result type. */
+{
+    int code;
+    int typeLength;
+    char *zType;
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("GetResultTypeFromObj: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objPtr == NULL) {
+	Tcl_AppendResult(interp, "no result type object\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (typePtr == NULL) {
+	Tcl_AppendResult(interp, "no result type pointer\n", NULL);
+	return TCL_ERROR;
+    }
+
+    code = GetStringFromObj(interp, objPtr, &typeLength, &zType);
+
+    if (code != TCL_OK)
+	return code;
+
+    if (CheckString(typeLength, zType, "css")) {
+	*typePtr = SASS_RESULT_CSS;
+	return TCL_OK;
+    }
+
+    if (CheckString(typeLength, zType, "dict")) {
+	*typePtr = SASS_RESULT_DICT;
+	return TCL_OK;
+    }
+
+    Tcl_AppendResult(interp,
+	"unsupported result type, must be: css or dict\n", NULL);
+
+    return TCL_ERROR;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -267,10 +724,12 @@ static int GetOutputStyleFromObj(
 /*
  *----------------------------------------------------------------------
  *
- * FindAndSetContextOption --
+ * FindContextOption --
  *
  *	This function attempts to locate the specified Sass context
- *	option and set its value based on the specified Tcl object.
+ *	option and convert the specified Tcl object into its value.
+ *	String values are copied.  The value is not set until it is
+ *	applied, e.g. via ApplyOptionSet.
  *
  * Results:
  *	A standard Tcl result.
@@ -281,12 +740,12 @@ static int GetOutputStyleFromObj(
  *----------------------------------------------------------------------
  */
 
-static int FindAndSetContextOption(
+static int FindContextOption(
     Tcl_Interp *interp,			/* Current Tcl interpreter. */
     int nameLength,			/* IN: Length of option name. */
     const char *zName,			/* IN: The option name. */
     Tcl_Obj *objPtr,			/* IN: The option value. */
-    struct Sass_Options *optsPtr)	/* IN/OUT: The context options. */
+    SassOptionValue *valuePtr)		/* OUT: The converted value. */
 {
     static struct sOptions {
 	const char *zName;              /* Name of the option. */
@@ -348,6 +807,10 @@ static int FindAndSetContextOption(
 	/* zName:      */ "source_map_file",
 	/* xGetValue:  */ NULL,
 	/* xSetOption: */ NULL
+    }, {
+	/* zName:      */ "tcl_vfs",
+	/* xGetValue:  */ NULL,
+	/* xSetOption: */ NULL
     }};
 
     int code = TCL_ERROR;
@@ -356,7 +819,7 @@ static int FindAndSetContextOption(
     int index;
 
     if (interp == NULL) {
-	PACKAGE_TRACE(("FindAndSetContextOption: no Tcl interpreter\n"));
+	PACKAGE_TRACE(("FindContextOption: no Tcl interpreter\n"));
 	return TCL_ERROR;
     }
 
@@ -370,11 +833,13 @@ static int FindAndSetContextOption(
 	return TCL_ERROR;
     }
 
-    if (optsPtr == NULL) {
-	Tcl_AppendResult(interp, "no options pointer\n", NULL);
+    if (valuePtr == NULL) {
+	Tcl_AppendResult(interp, "no option value pointer\n", NULL);
 	return TCL_ERROR;
     }
 
+    memset(valuePtr, 0, sizeof(SassOptionValue));
+
     aOptions[0].xGetValue = (fn_get_any *)Tcl_GetIntFromObj;
     aOptions[0].xSetOption = (fn_set_any *)sass_option_set_precision;
     aOptions[1].xGetValue = (fn_get_any *)GetOutputStyleFromObj;
@@ -403,6 +868,8 @@ static int FindAndSetContextOption(
     aOptions[12].xSetOption = (fn_set_any *)sass_option_set_include_path;
     aOptions[13].xGetValue = (fn_get_any *)GetStringFromObj;
     aOptions[13].xSetOption = (fn_set_any *)sass_option_set_source_map_file;
+    aOptions[14].xGetValue = (fn_get_any *)Tcl_GetBooleanFromObj;
+    aOptions[14].xSetOption = (fn_set_any *)SetTclVfsOption;
 
     namesPtr = Tcl_NewObj();
 
@@ -418,12 +885,15 @@ static int FindAndSetContextOption(
 	    fn_get_any *xGetValue = aOptions[index].xGetValue;
 	    fn_set_any *xSetOption = aOptions[index].xSetOption;
 
+	    valuePtr->xGetValue = xGetValue;
+	    valuePtr->xSetOption = xSetOption;
+
 	    if (xGetValue == Tcl_GetBooleanFromObj) {
 		int iValue;
 
 		if (xGetValue(interp, objPtr, &iValue) == TCL_OK) {
 		    if (xSetOption != NULL) {
-			xSetOption(optsPtr, (bool)iValue);
+			valuePtr->iValue = iValue;
 			code = TCL_OK;
 		    } else {
 			Tcl_AppendResult(interp,
@@ -435,7 +905,7 @@ static int FindAndSetContextOption(
 
 		if (xGetValue(interp, objPtr, &iValue) == TCL_OK) {
 		    if (xSetOption != NULL) {
-			xSetOption(optsPtr, iValue);
+			valuePtr->iValue = iValue;
 			code = TCL_OK;
 		    } else {
 			Tcl_AppendResult(interp,
@@ -447,7 +917,7 @@ static int FindAndSetContextOption(
 
 		if (xGetValue(interp, objPtr, &eValue) == TCL_OK) {
 		    if (xSetOption != NULL) {
-			xSetOption(optsPtr, eValue);
+			valuePtr->iValue = (int)eValue;
 			code = TCL_OK;
 		    } else {
 			Tcl_AppendResult(interp,
@@ -461,7 +931,8 @@ static int FindAndSetContextOption(
 		if (xGetValue(interp, objPtr, &valueLength,
 			&zValue) == TCL_OK) {
 		    if (xSetOption != NULL) {
-			xSetOption(optsPtr, zValue);
+			valuePtr->zValue = ckalloc(valueLength + 1);
+			memcpy(valuePtr->zValue, zValue, valueLength + 1);
 			code = TCL_OK;
 		    } else {
 			Tcl_AppendResult(interp,
@@ -504,23 +975,16 @@ static int FindAndSetContextOption(
 /*
  *----------------------------------------------------------------------
  *
- * ProcessContextOptions --
+ * NewOptionSet --
  *
- *	This function processes options supported by the [sass compile]
- *	sub-command.  If an option does not coform to the expected type
- *	-OR- an unknown option is encountered, a script error will be
- *	generated.  All valid options, except -type, are processed by
- *	setting the appropriate field within the Sass_Options struct,
- *	using the public API.  The -type option is handled by processing
- *	the resulting Sass_Context_Type into the provided value pointer.
- *	The first option argument index to check is queried from the
- *	idxPtr argument.  Furthermore, the first non-option argument
- *	index after all options are processed will be stored into the
- *	idxPtr argument, if applicable.  If there are no more arguments
- *	after processing the options, a value of -1 will be stored.
+ *	This function validates all the options in the specified options
+ *	dictionary and stores their converted values into a new option
+ *	set.  A script error will be generated if the dictionary is not
+ *	well-formed -OR- any option is unknown or has an invalid value.
  *
  * Results:
- *	A standard Tcl result.
+ *	The new option set, with one reference -OR- NULL on failure.  The
+ *	option set must be released via ReleaseOptionSet.
  *
  * Side effects:
  *	None.
@@ -528,141 +992,73 @@ static int FindAndSetContextOption(
  *----------------------------------------------------------------------
  */
 
-static int ProcessContextOptions(
+static SassOptionSet *NewOptionSet(
     Tcl_Interp *interp,			/* Current Tcl interpreter. */
-    int objc,				/* Number of arguments. */
-    Tcl_Obj *CONST objv[],		/* The array of arguments. */
-    int *idxPtr,			/* IN/OUT: 1st [non-]option argument. */
-    enum Sass_Context_Type *typePtr,	/* OUT: The context type. */
-    struct Sass_Options *optsPtr)	/* IN/OUT: The context options. */
+    Tcl_Obj *dictPtr)			/* IN: The options dictionary. */
 {
-    int index;
-
-    if (interp == NULL) {
-	PACKAGE_TRACE(("ProcessContextOptions: no Tcl interpreter\n"));
-	return TCL_ERROR;
-    }
-
-    if (objv == NULL) {
-	Tcl_AppendResult(interp, "no arguments array\n", NULL);
-	return TCL_ERROR;
-    }
-
-    if (idxPtr == NULL) {
-	Tcl_AppendResult(interp, "no argument index pointer\n", NULL);
-	return TCL_ERROR;
-    }
-
-    if (typePtr == NULL) {
-	Tcl_AppendResult(interp, "no context type pointer\n", NULL);
-	return TCL_ERROR;
+    SassOptionSet *setPtr;
+    int dictObjc;
+    Tcl_Obj **dictObjv;
+    int dictIndex;
+    int dictLength;
+    char *zDict;
+
+    if (Tcl_ListObjGetElements(interp, dictPtr, &dictObjc,
+	    &dictObjv) != TCL_OK) {
+	return NULL;
     }
 
-    if (optsPtr == NULL) {
-	Tcl_AppendResult(interp, "no options pointer\n", NULL);
-	return TCL_ERROR;
+    if ((dictObjc % 2) != 0) {
+	Tcl_AppendResult(interp, "malformed dictionary\n", NULL);
+	return NULL;
     }
 
-    *typePtr = SASS_CONTEXT_DATA; /* TODO: Good default? */
-
-    for (index = *idxPtr; index < objc; index++) {
-	int code;
-	int argLength;
-	char *zArg;
-
-	if (objv[index] == NULL) {
-	    Tcl_AppendResult(interp, "no argument object\n", NULL);
-	    return TCL_ERROR;
-	}
-
-	code = GetStringFromObj(interp, objv[index], &argLength, &zArg);
-
-	if (code != TCL_OK)
-	    return code;
-
-	if (CheckString(argLength, zArg, "--")) {
-	    index++;
-
-	    *idxPtr = (index < objc) ? index : -1;
-	    return TCL_OK;
-	}
+    zDict = Tcl_GetStringFromObj(dictPtr, &dictLength);
 
-	if (CheckString(argLength, zArg, "-type")) {
-	    index++;
+    setPtr = (SassOptionSet *)ckalloc(sizeof(SassOptionSet) +
+	(sizeof(SassOptionValue) * (dictObjc / 2)) + dictLength + 1);
 
-	    if (index >= objc) {
-		Tcl_AppendResult(interp, "missing context type\n", NULL);
-		return TCL_ERROR;
-	    }
+    memset(setPtr, 0, sizeof(SassOptionSet));
+    setPtr->refCount = 1;
+    setPtr->aValues = (SassOptionValue *)(setPtr + 1);
+    setPtr->zKey = (char *)(setPtr->aValues + (dictObjc / 2));
+    setPtr->keyLength = dictLength + 1;
+    memcpy(setPtr->zKey, zDict, dictLength + 1);
 
-	    if (GetContextTypeFromObj(interp, objv[index], typePtr) != TCL_OK) {
-		return TCL_ERROR;
-	    }
+    for (dictIndex = 0; dictIndex < dictObjc; dictIndex += 2) {
+	int nameLength;
+	char *zName;
 
-	    continue;
+	if (GetStringFromObj(interp, dictObjv[dictIndex], &nameLength,
+		&zName) != TCL_OK) {
+	    ReleaseOptionSet(setPtr);
+	    return NULL;
 	}
 
-	if (CheckString(argLength, zArg, "-options")) {
-	    int dictObjc;
-	    Tcl_Obj **dictObjv;
-	    int dictIndex;
-
-	    index++;
-
-	    if (index >= objc) {
-		Tcl_AppendResult(interp, "missing options dictionary\n", NULL);
-		return TCL_ERROR;
-	    }
-
-	    if (Tcl_ListObjGetElements(interp, objv[index], &dictObjc,
-		    &dictObjv) != TCL_OK) {
-		return TCL_ERROR;
-	    }
-
-	    if ((dictObjc % 2) != 0) {
-		Tcl_AppendResult(interp, "malformed dictionary\n", NULL);
-		return TCL_ERROR;
-	    }
-
-	    for (dictIndex = 0; dictIndex < dictObjc; dictIndex += 2) {
-		int nameLength;
-		char *zName;
-
-		code = GetStringFromObj(interp, dictObjv[dictIndex],
-		    &nameLength, &zName);
-
-		if (code != TCL_OK)
-		    return code;
-
-		code = FindAndSetContextOption(interp, nameLength, zName,
-		    dictObjv[dictIndex + 1], optsPtr);
-
-		if (code != TCL_OK)
-		    return code;
-	    }
-
-	    continue;
+	if (FindContextOption(interp, nameLength, zName,
+		dictObjv[dictIndex + 1],
+		&setPtr->aValues[setPtr->nValues]) != TCL_OK) {
+	    ReleaseOptionSet(setPtr);
+	    return NULL;
 	}
 
-	*idxPtr = index;
-	return TCL_OK;
+	setPtr->nValues++;
     }
 
-    *idxPtr = -1;
-    return TCL_OK;
+    return setPtr;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * SetResultFromContext --
+ * SetTclVfsOption --
  *
- *	This function quries the specified Sass_Context and uses the
- *	error status and output string to modify the result of the Tcl
- *	interpreter.
+ *	This function is the setter for the "tcl_vfs" option.  It does
+ *	nothing, because the option is handled by this package itself,
+ *	see ApplyOptionSet.
  *
  * Results:
- *	A standard Tcl result.
+ *	None.
  *
  * Side effects:
  *	None.
@@ -670,255 +1066,4497 @@ static int ProcessContextOptions(
  *----------------------------------------------------------------------
  */
 
-static int SetResultFromContext(
-    Tcl_Interp *interp,			/* Current Tcl interpreter. */
-    struct Sass_Context *ctxPtr)	/* IN: Get status/result from here. */
+static void SetTclVfsOption(
+    struct Sass_Options *optsPtr,	/* IN: The context options, unused. */
+    bool bValue)			/* IN: The option value, unused. */
 {
-    int code;
-    int rc;
-    struct Sass_Options *optsPtr;
-    const char *zSourceMapFile;
-    Tcl_Obj *listPtr = NULL;
-    Tcl_Obj *objPtr;
-
-    if (interp == NULL) {
-	PACKAGE_TRACE(("SetResultFromContext: no Tcl interpreter\n"));
-	return TCL_ERROR;
-    }
-
-    if (ctxPtr == NULL) {
-	Tcl_AppendResult(interp, "no context\n", NULL);
-	return TCL_ERROR;
-    }
+    /* do nothing */
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ApplyOptionSet --
+ *
+ *	This function sets all the options in the specified option set
+ *	into the specified Sass_Options struct, in their original order.
+ *	The options also needed by this package, i.e. "include_path" and
+ *	"tcl_vfs", are recorded into the specified settings.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ApplyOptionSet(
+    const SassOptionSet *setPtr,	/* IN: The option set. */
+    struct Sass_Options *optsPtr,	/* IN/OUT: The context options. */
+    SassCompileSettings *settingsPtr)	/* IN/OUT: The package settings. */
+{
+    int index;
+
+    for (index = 0; index < setPtr->nValues; index++) {
+	const SassOptionValue *valuePtr = &setPtr->aValues[index];
+	fn_get_any *xGetValue = valuePtr->xGetValue;
+	fn_set_any *xSetOption = valuePtr->xSetOption;
+
+	if (xGetValue == Tcl_GetBooleanFromObj) {
+	    xSetOption(optsPtr, (bool)valuePtr->iValue);
+
+	    if (xSetOption == (fn_set_any *)SetTclVfsOption)
+		settingsPtr->bTclVfs = valuePtr->iValue;
+	} else if (xGetValue == GetOutputStyleFromObj) {
+	    xSetOption(optsPtr, (enum Sass_Output_Style)valuePtr->iValue);
+	} else if (xGetValue == GetStringFromObj) {
+	    xSetOption(optsPtr, valuePtr->zValue);
+
+	    if (xSetOption == (fn_set_any *)sass_option_set_include_path)
+		settingsPtr->zIncludePath = valuePtr->zValue;
+	} else {
+	    xSetOption(optsPtr, valuePtr->iValue);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReleaseOptionSet --
+ *
+ *	This function releases a reference to an option set created by
+ *	NewOptionSet.  The option set is freed when its last reference
+ *	is released.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ReleaseOptionSet(
+    SassOptionSet *setPtr)		/* IN: The option set to release. */
+{
+    int index;
+
+    if ((setPtr == NULL) || (--setPtr->refCount > 0))
+	return;
+
+    for (index = 0; index < setPtr->nValues; index++) {
+	if (setPtr->aValues[index].zValue != NULL)
+	    ckfree(setPtr->aValues[index].zValue);
+    }
+
+    ckfree((char *)setPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeOptionsInternalRep --
+ *
+ *	This function releases the option set cached within the internal
+ *	representation of a Tcl object of the "sassOptions" type.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FreeOptionsInternalRep(
+    Tcl_Obj *objPtr)			/* IN: The Tcl object. */
+{
+    ReleaseOptionSet((SassOptionSet *)objPtr->internalRep.otherValuePtr);
+    objPtr->internalRep.otherValuePtr = NULL;
+    objPtr->typePtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DupOptionsInternalRep --
+ *
+ *	This function shares the option set cached within the internal
+ *	representation of a Tcl object of the "sassOptions" type with a
+ *	copy of that object.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void DupOptionsInternalRep(
+    Tcl_Obj *srcPtr,			/* IN: The original Tcl object. */
+    Tcl_Obj *dupPtr)			/* OUT: The copied Tcl object. */
+{
+    SassOptionSet *setPtr;
+
+    setPtr = (SassOptionSet *)srcPtr->internalRep.otherValuePtr;
+    setPtr->refCount++;
+
+    dupPtr->internalRep.otherValuePtr = setPtr;
+    dupPtr->typePtr = &sassOptionsType;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetOptionSetFromDictObj --
+ *
+ *	This function returns the option set for the specified options
+ *	dictionary.  If the Tcl object already has one cached within its
+ *	internal representation, it is used as is.  Otherwise, a new one
+ *	is created and cached there, replacing any other internal
+ *	representation.  Failures are not cached.
+ *
+ * Results:
+ *	The option set, which is owned by the Tcl object -OR- NULL on
+ *	failure.
+ *
+ * Side effects:
+ *	The internal representation of the Tcl object may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassOptionSet *GetOptionSetFromDictObj(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *dictPtr)			/* IN: The options dictionary. */
+{
+    SassOptionSet *setPtr;
+
+    if (dictPtr->typePtr == &sassOptionsType)
+	return (SassOptionSet *)dictPtr->internalRep.otherValuePtr;
+
+    /*
+     * NOTE: The string representation is always valid at this point, since
+     *       NewOptionSet needs it for the compile cache key.
+     */
+
+    setPtr = NewOptionSet(interp, dictPtr);
+
+    if (setPtr == NULL)
+	return NULL;
+
+    if ((dictPtr->typePtr != NULL) &&
+	    (dictPtr->typePtr->freeIntRepProc != NULL)) {
+	dictPtr->typePtr->freeIntRepProc(dictPtr);
+    }
+
+    dictPtr->internalRep.otherValuePtr = setPtr;
+    dictPtr->typePtr = &sassOptionsType;
+
+    return setPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetInterpData --
+ *
+ *	This function returns the package data for the specified Tcl
+ *	interpreter, optionally creating it.
+ *
+ * Results:
+ *	The package data -OR- NULL if it does not exist.
+ *
+ * Side effects:
+ *	The package data may be created and associated with the Tcl
+ *	interpreter.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassInterpData *GetInterpData(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int bCreate)			/* IN: Non-zero to create the data. */
+{
+    SassInterpData *dataPtr;
+
+    dataPtr = (SassInterpData *)Tcl_GetAssocData(interp, INTERP_DATA_NAME,
+	NULL);
+
+    if ((dataPtr == NULL) && bCreate) {
+	int index;
+
+	dataPtr = (SassInterpData *)ckalloc(sizeof(SassInterpData));
+	memset(dataPtr, 0, sizeof(SassInterpData));
+	Tcl_InitHashTable(&dataPtr->handles, TCL_STRING_KEYS);
+	Tcl_InitHashTable(&dataPtr->compilers, TCL_STRING_KEYS);
+	Tcl_InitHashTable(&dataPtr->outputs, TCL_STRING_KEYS);
+
+	for (index = 0; index < SASS_KEY_MAX; index++) {
+	    dataPtr->apResultKeys[index] = Tcl_NewStringObj(
+		azResultKeys[index], -1);
+
+	    Tcl_IncrRefCount(dataPtr->apResultKeys[index]);
+	}
+
+	Tcl_SetAssocData(interp, INTERP_DATA_NAME, InterpDataDeleteProc,
+	    dataPtr);
+    }
+
+    return dataPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterpDataDeleteProc --
+ *
+ *	This function frees the package data for a Tcl interpreter,
+ *	including all the option sets for its options handles, all the
+ *	compilers that were parsed but not executed, and the recorded
+ *	includes of the folder compilation outputs, when the Tcl
+ *	interpreter is being deleted -OR- the package is being unloaded
+ *	from it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void InterpDataDeleteProc(
+    ClientData clientData,		/* IN: The package data. */
+    Tcl_Interp *interp)			/* Not used. */
+{
+    SassInterpData *dataPtr = (SassInterpData *)clientData;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    int index;
+
+    for (hPtr = Tcl_FirstHashEntry(&dataPtr->handles, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	ReleaseOptionSet((SassOptionSet *)Tcl_GetHashValue(hPtr));
+    }
+
+    Tcl_DeleteHashTable(&dataPtr->handles);
+
+    for (hPtr = Tcl_FirstHashEntry(&dataPtr->compilers, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	FreeParsed((SassParsed *)Tcl_GetHashValue(hPtr));
+    }
+
+    Tcl_DeleteHashTable(&dataPtr->compilers);
+
+    for (hPtr = Tcl_FirstHashEntry(&dataPtr->outputs, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	Tcl_DecrRefCount((Tcl_Obj *)Tcl_GetHashValue(hPtr));
+    }
+
+    Tcl_DeleteHashTable(&dataPtr->outputs);
+
+    for (index = 0; index < SASS_KEY_MAX; index++)
+	Tcl_DecrRefCount(dataPtr->apResultKeys[index]);
+
+    ckfree((char *)dataPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetOptionSetFromObj --
+ *
+ *	This function looks up the option set for the specified handle,
+ *	as returned by [sass options create].
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int GetOptionSetFromObj(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *objPtr,			/* IN: The handle name. */
+    SassOptionSet **setPtrPtr)		/* OUT: The option set. */
+{
+    SassInterpData *dataPtr = GetInterpData(interp, 0);
+    Tcl_HashEntry *hPtr = NULL;
+
+    if (dataPtr != NULL) {
+	hPtr = Tcl_FindHashEntry(&dataPtr->handles, Tcl_GetString(objPtr));
+    }
+
+    if (hPtr == NULL) {
+	Tcl_AppendResult(interp, "invalid options handle \"",
+	    Tcl_GetString(objPtr), "\"\n", NULL);
+
+	return TCL_ERROR;
+    }
+
+    *setPtrPtr = (SassOptionSet *)Tcl_GetHashValue(hPtr);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassOptionsObjCmd --
+ *
+ *	Handles the [sass options] sub-command.  The sub-commands supported
+ *	are "create" and "delete".  An options handle holds a validated
+ *	option set, which can be used with the -optionsHandle option of
+ *	the [sass compile] sub-command without parsing it again.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SassOptionsObjCmd(
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int option;
+    SassInterpData *dataPtr;
+
+    static const char *cmdOptions[] = {
+	"create", "delete", (char *) NULL
+    };
+
+    enum options {
+	OPT_CREATE, OPT_DELETE
+    };
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_CREATE: {
+	    SassOptionSet *setPtr;
+	    Tcl_Obj *dictPtr;
+	    Tcl_HashEntry *hPtr;
+	    int bNew;
+	    char buffer[TCL_INTEGER_SPACE + 12];
+
+	    if ((objc != 3) && (objc != 4)) {
+		Tcl_WrongNumArgs(interp, 3, objv, "?dictionary?");
+		return TCL_ERROR;
+	    }
+
+	    dictPtr = (objc == 4) ? objv[3] : Tcl_NewObj();
+	    Tcl_IncrRefCount(dictPtr);
+	    setPtr = GetOptionSetFromDictObj(interp, dictPtr);
+
+	    if (setPtr != NULL)
+		setPtr->refCount++;
+
+	    Tcl_DecrRefCount(dictPtr);
+
+	    if (setPtr == NULL)
+		return TCL_ERROR;
+
+	    dataPtr = GetInterpData(interp, 1);
+
+	    do {
+		snprintf(buffer, sizeof(buffer), "sassOptions%d",
+		    ++dataPtr->nextHandleId);
+
+		hPtr = Tcl_CreateHashEntry(&dataPtr->handles, buffer, &bNew);
+	    } while (!bNew);
+
+	    Tcl_SetHashValue(hPtr, (ClientData)setPtr);
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(buffer, -1));
+
+	    return TCL_OK;
+	}
+	case OPT_DELETE: {
+	    Tcl_HashEntry *hPtr = NULL;
+
+	    if (objc != 4) {
+		Tcl_WrongNumArgs(interp, 3, objv, "handle");
+		return TCL_ERROR;
+	    }
+
+	    dataPtr = GetInterpData(interp, 0);
+
+	    if (dataPtr != NULL) {
+		hPtr = Tcl_FindHashEntry(&dataPtr->handles,
+		    Tcl_GetString(objv[3]));
+	    }
+
+	    if (hPtr == NULL) {
+		Tcl_AppendResult(interp, "invalid options handle \"",
+		    Tcl_GetString(objv[3]), "\"\n", NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    ReleaseOptionSet((SassOptionSet *)Tcl_GetHashValue(hPtr));
+	    Tcl_DeleteHashEntry(hPtr);
+
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	default: {
+	    Tcl_AppendResult(interp, "bad option index\n", NULL);
+	    return TCL_ERROR;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ApplyContextOptions --
+ *
+ *	This function processes options supported by the [sass compile]
+ *	sub-command.  If an option does not coform to the expected type
+ *	-OR- an unknown option is encountered, a script error will be
+ *	generated.  The -options and -optionsHandle options are processed
+ *	by setting the appropriate fields within the Sass_Options struct,
+ *	using the public API; the latter uses a previously validated
+ *	option set.  All other options are handled by storing their values
+ *	into the provided settings.  The string value of each options
+ *	dictionary is also appended to the compile cache key within the
+ *	settings.  Once all options are processed, the custom importers
+ *	are set, using the final "include_path" option, along with the
+ *	custom header for the -variables option.  The first option
+ *	argument index to check is queried from the idxPtr argument.
+ *	Furthermore, the first non-option argument index after all
+ *	options are processed will be stored into the idxPtr argument,
+ *	if applicable.  If there are no more arguments after processing
+ *	the options, a value of -1 will be stored.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ApplyContextOptions(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[],		/* The array of arguments. */
+    int *idxPtr,			/* IN/OUT: 1st [non-]option argument. */
+    SassCompileSettings *settingsPtr,	/* IN/OUT: The package settings. */
+    struct Sass_Options *optsPtr)	/* IN/OUT: The context options. */
+{
+    int index;
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("ApplyContextOptions: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objv == NULL) {
+	Tcl_AppendResult(interp, "no arguments array\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (idxPtr == NULL) {
+	Tcl_AppendResult(interp, "no argument index pointer\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (settingsPtr == NULL) {
+	Tcl_AppendResult(interp, "no settings pointer\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (optsPtr == NULL) {
+	Tcl_AppendResult(interp, "no options pointer\n", NULL);
+	return TCL_ERROR;
+    }
+
+    settingsPtr->type = SASS_CONTEXT_DATA; /* TODO: Good default? */
+
+    for (index = *idxPtr; index < objc; index++) {
+	int code;
+	int argLength;
+	char *zArg;
+
+	if (objv[index] == NULL) {
+	    Tcl_AppendResult(interp, "no argument object\n", NULL);
+	    return TCL_ERROR;
+	}
+
+	code = GetStringFromObj(interp, objv[index], &argLength, &zArg);
+
+	if (code != TCL_OK)
+	    return code;
+
+	if (CheckString(argLength, zArg, "--")) {
+	    index++;
+	    break;
+	}
+
+	if (CheckString(argLength, zArg, "-type")) {
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing context type\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    if (GetContextTypeFromObj(interp, objv[index],
+		    &settingsPtr->type) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-cache")) {
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing cache flag\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    if (Tcl_GetBooleanFromObj(interp, objv[index],
+		    &settingsPtr->bCache) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-profile")) {
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing profile flag\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    if (Tcl_GetBooleanFromObj(interp, objv[index],
+		    &settingsPtr->bProfile) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-result")) {
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing result type\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    if (GetResultTypeFromObj(interp, objv[index],
+		    &settingsPtr->resultType) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-outputChannel")) {
+	    int mode;
+
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing output channel\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    settingsPtr->outputChannel = Tcl_GetChannel(interp,
+		Tcl_GetString(objv[index]), &mode);
+
+	    if (settingsPtr->outputChannel == NULL)
+		return TCL_ERROR;
+
+	    if (!(mode & TCL_WRITABLE)) {
+		Tcl_AppendResult(interp, "channel \"",
+		    Tcl_GetString(objv[index]),
+		    "\" wasn't opened for writing\n", NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-outputFile")) {
+	    if (Tcl_IsSafe(interp)) {
+		Tcl_AppendResult(interp, "option -outputFile is not allowed in a "
+		    "safe interpreter\n", NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing output file name\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    settingsPtr->outputFilePtr = objv[index];
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-outputDir")) {
+	    if (Tcl_IsSafe(interp)) {
+		Tcl_AppendResult(interp, "option -outputDir is not allowed in a "
+		    "safe interpreter\n", NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing output directory\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    settingsPtr->outputDirPtr = objv[index];
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-command")) {
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing callback command\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    settingsPtr->commandPtr = objv[index];
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-options")) {
+	    SassOptionSet *setPtr;
+
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing options dictionary\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    setPtr = GetOptionSetFromDictObj(interp, objv[index]);
+
+	    if (setPtr == NULL)
+		return TCL_ERROR;
+
+	    /*
+	     * NOTE: Every option within the dictionary was valid.  Append its
+	     *       string value, including the terminating NUL character, to
+	     *       the compile cache key.
+	     */
+
+	    ApplyOptionSet(setPtr, optsPtr, settingsPtr);
+
+	    Tcl_DStringAppend(&settingsPtr->key, setPtr->zKey,
+		setPtr->keyLength);
+
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-optionsHandle")) {
+	    SassOptionSet *setPtr;
+
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing options handle\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    if (GetOptionSetFromObj(interp, objv[index], &setPtr) != TCL_OK)
+		return TCL_ERROR;
+
+	    /*
+	     * NOTE: The compile cache key is the same as it would be for the
+	     *       -options option with the original dictionary.
+	     */
+
+	    ApplyOptionSet(setPtr, optsPtr, settingsPtr);
+
+	    Tcl_DStringAppend(&settingsPtr->key, setPtr->zKey,
+		setPtr->keyLength);
+
+	    continue;
+	}
+
+	if (CheckString(argLength, zArg, "-variables")) {
+	    SassVars *varsPtr;
+
+	    index++;
+
+	    if (index >= objc) {
+		Tcl_AppendResult(interp, "missing variables dictionary\n",
+		    NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    varsPtr = SassVarsGetFromObj(interp, objv[index]);
+
+	    if (varsPtr == NULL)
+		return TCL_ERROR;
+
+	    SassVarsRelease(settingsPtr->varsPtr);
+	    settingsPtr->varsPtr = varsPtr;
+
+	    continue;
+	}
+
+	break;
+    }
+
+    /*
+     * NOTE: The importers and the variables header depend on the options,
+     *       so they can only be set once all of them have been processed.
+     *       This must be done for every way out of the loop above, i.e. the
+     *       first non-option argument, the "--" option, or running out of
+     *       arguments.
+     */
+
+    SetContextImporters(optsPtr, settingsPtr);
+
+    if (settingsPtr->varsPtr != NULL)
+	SassVarsBind(settingsPtr->varsPtr, optsPtr, &settingsPtr->key);
+
+    *idxPtr = (index < objc) ? index : -1;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcessContextOptions --
+ *
+ *	This function processes options supported by the [sass compile]
+ *	sub-command, via ApplyContextOptions, and records how long that
+ *	took for [sass stats].
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ProcessContextOptions(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[],		/* The array of arguments. */
+    int *idxPtr,			/* IN/OUT: 1st [non-]option argument. */
+    SassCompileSettings *settingsPtr,	/* IN/OUT: The package settings. */
+    struct Sass_Options *optsPtr)	/* IN/OUT: The context options. */
+{
+    Tcl_WideUInt startTime = SassStatsNow();
+    int code;
+
+    code = ApplyContextOptions(interp, objc, objv, idxPtr, settingsPtr,
+	optsPtr);
+
+    SassStatsRecord(SASS_PHASE_OPTIONS, startTime);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetResultFromContext --
+ *
+ *	This function queries the specified Sass_Context and stores its
+ *	error status, output string, source map string, and error details
+ *	into the specified SassResult.  The source map string is only
+ *	included when the "source_map_file" option was set.  No strings
+ *	are copied; therefore, the SassResult is only valid while the
+ *	Sass_Context exists.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void GetResultFromContext(
+    struct Sass_Context *ctxPtr,	/* IN: Get status/result from here. */
+    SassResult *resultPtr)		/* OUT: The status/result. */
+{
+    struct Sass_Options *optsPtr;
+    const char *zSourceMapFile;
+    const char *zValue;
+
+    memset(resultPtr, 0, sizeof(SassResult));
+    resultPtr->errorStatus = sass_context_get_error_status(ctxPtr);
+
+    if (resultPtr->errorStatus == 0) {
+	zValue = sass_context_get_output_string(ctxPtr);
+
+	if (zValue == NULL)
+	    zValue = "";
+
+	resultPtr->zOutput = zValue;
+	resultPtr->outputLength = (int)strlen(zValue);
+
+	optsPtr = sass_context_get_options(ctxPtr);
+
+	zSourceMapFile = (optsPtr != NULL) ?
+	    sass_option_get_source_map_file(optsPtr) : NULL;
+
+	if ((zSourceMapFile != NULL) && (strlen(zSourceMapFile) > 0)) {
+	    zValue = sass_context_get_source_map_string(ctxPtr);
+
+	    if (zValue == NULL)
+		zValue = "";
+
+	    resultPtr->zSourceMap = zValue;
+	    resultPtr->sourceMapLength = (int)strlen(zValue);
+	}
+    } else {
+	zValue = sass_context_get_error_message(ctxPtr);
+
+	if (zValue == NULL)
+	    zValue = "";
+
+	resultPtr->zErrorMessage = zValue;
+	resultPtr->errorMessageLength = (int)strlen(zValue);
+	resultPtr->errorLine = sass_context_get_error_line(ctxPtr);
+	resultPtr->errorColumn = sass_context_get_error_column(ctxPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetResultFromSassResult --
+ *
+ *	This function uses the error status and output string from the
+ *	specified SassResult to modify the result of the Tcl interpreter.
+ *	For the "dict" result type, the result is a dictionary, which uses
+ *	the shared key objects of the Tcl interpreter.  Strings that are
+ *	not available, i.e. NULL, are omitted.  For the "css"
+ *	result type, the result is the output string on success; on
+ *	failure, a script error is generated with the error message and
+ *	an error code of the form: SASS COMPILE line column.  The time
+ *	taken is recorded for [sass stats].
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SetResultFromSassResult(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    const SassResult *resultPtr,	/* IN: Get status/result from here. */
+    enum Sass_Result_Type resultType)	/* IN: The kind of result. */
+{
+    SassInterpData *dataPtr;
+    Tcl_Obj *objv[8];
+    int objc = 0;
+    Tcl_WideUInt startTime = SassStatsNow();
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SetResultFromSassResult: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (resultPtr == NULL) {
+	Tcl_AppendResult(interp, "no result\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (resultType == SASS_RESULT_CSS) {
+	if (resultPtr->errorStatus == 0) {
+	    if (resultPtr->zOutput != NULL) {
+		Tcl_SetObjResult(interp, Tcl_NewStringObj(resultPtr->zOutput,
+		    resultPtr->outputLength));
+	    } else {
+		Tcl_ResetResult(interp);
+	    }
+
+	    SassStatsRecord(SASS_PHASE_RESULT, startTime);
+	    return TCL_OK;
+	}
+
+	objv[0] = Tcl_NewStringObj("SASS", -1);
+	objv[1] = Tcl_NewStringObj("COMPILE", -1);
+	objv[2] = Tcl_NewWideIntObj(resultPtr->errorLine);
+	objv[3] = Tcl_NewWideIntObj(resultPtr->errorColumn);
+
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(resultPtr->zErrorMessage,
+	    resultPtr->errorMessageLength));
+
+	Tcl_SetObjErrorCode(interp, Tcl_NewListObj(4, objv));
+	SassStatsRecord(SASS_PHASE_RESULT, startTime);
+	return TCL_ERROR;
+    }
+
+    dataPtr = GetInterpData(interp, 1);
+
+    objv[objc++] = dataPtr->apResultKeys[SASS_KEY_ERROR_STATUS];
+    objv[objc++] = Tcl_NewIntObj(resultPtr->errorStatus);
+
+    if (resultPtr->errorStatus == 0) {
+	if (resultPtr->zOutput != NULL) {
+	    objv[objc++] = dataPtr->apResultKeys[SASS_KEY_OUTPUT_STRING];
+
+	    objv[objc++] = Tcl_NewStringObj(resultPtr->zOutput,
+		resultPtr->outputLength);
+	}
+
+	if (resultPtr->zSourceMap != NULL) {
+	    objv[objc++] = dataPtr->apResultKeys[SASS_KEY_SOURCE_MAP_STRING];
+
+	    objv[objc++] = Tcl_NewStringObj(resultPtr->zSourceMap,
+		resultPtr->sourceMapLength);
+	}
+    } else {
+	objv[objc++] = dataPtr->apResultKeys[SASS_KEY_ERROR_MESSAGE];
+
+	objv[objc++] = Tcl_NewStringObj(resultPtr->zErrorMessage,
+	    resultPtr->errorMessageLength);
+
+	objv[objc++] = dataPtr->apResultKeys[SASS_KEY_ERROR_LINE];
+	objv[objc++] = Tcl_NewWideIntObj(resultPtr->errorLine);
+	objv[objc++] = dataPtr->apResultKeys[SASS_KEY_ERROR_COLUMN];
+	objv[objc++] = Tcl_NewWideIntObj(resultPtr->errorColumn);
+    }
+
+    Tcl_SetObjResult(interp, Tcl_NewListObj(objc, objv));
+    SassStatsRecord(SASS_PHASE_RESULT, startTime);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassWriteFile --
+ *
+ *	This function atomically replaces the contents of the specified
+ *	file with the specified data, without any translation.  The data
+ *	is written to a temporary file in the same directory, which is
+ *	then renamed.  If the rename fails because the file exists, e.g.
+ *	on Windows, the file is deleted and the rename is retried, which
+ *	is not atomic.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The file is created or replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassWriteFile(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *pathPtr,			/* IN: The file to write. */
+    const char *zData,			/* IN: The data to write. */
+    int dataLength)			/* IN: Length of the data. */
+{
+    int code = TCL_ERROR;
+    Tcl_Obj *tempPathPtr;
+    Tcl_Channel channel;
+    char buffer[64] = {0};
+
+    /*
+     * NOTE: The temporary file name must be unique across all processes and
+     *       threads that may be writing the same file.
+     */
+
+    snprintf(buffer, sizeof(buffer) - 1, ".%ld.%p.tmp", (long)getpid(),
+	(void *)Tcl_GetCurrentThread());
+
+    tempPathPtr = Tcl_DuplicateObj(pathPtr);
+    Tcl_IncrRefCount(tempPathPtr);
+    Tcl_AppendToObj(tempPathPtr, buffer, -1);
+
+    channel = Tcl_FSOpenFileChannel(interp, tempPathPtr, "w", 0666);
+
+    if (channel == NULL)
+	goto done;
+
+    if ((Tcl_SetChannelOption(interp, channel, "-translation",
+	    "binary") != TCL_OK) ||
+	    (Tcl_Write(channel, zData, dataLength) != dataLength)) {
+	Tcl_AppendResult(interp, "error writing \"",
+	    Tcl_GetString(tempPathPtr), "\": ", Tcl_PosixError(interp),
+	    "\n", NULL);
+
+	Tcl_Close(NULL, channel);
+	Tcl_FSDeleteFile(tempPathPtr);
+	goto done;
+    }
+
+    if (Tcl_Close(interp, channel) != TCL_OK) {
+	Tcl_FSDeleteFile(tempPathPtr);
+	goto done;
+    }
+
+    if ((Tcl_FSRenameFile(tempPathPtr, pathPtr) != TCL_OK) &&
+	    ((Tcl_FSDeleteFile(pathPtr) != TCL_OK) ||
+	    (Tcl_FSRenameFile(tempPathPtr, pathPtr) != TCL_OK))) {
+	Tcl_AppendResult(interp, "error renaming \"",
+	    Tcl_GetString(tempPathPtr), "\" to \"", Tcl_GetString(pathPtr),
+	    "\": ", Tcl_PosixError(interp), "\n", NULL);
+
+	Tcl_FSDeleteFile(tempPathPtr);
+	goto done;
+    }
+
+    code = TCL_OK;
+
+done:
+    Tcl_DecrRefCount(tempPathPtr);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetCompileResult --
+ *
+ *	This function sets the result of the Tcl interpreter for one use
+ *	of the [sass compile] sub-command, based on the specified
+ *	SassResult.  When the compilation succeeded and the -outputChannel
+ *	or -outputFile option was used, the output string is written there
+ *	directly and omitted from the result.  For -outputFile, the source
+ *	map string, if any, is written to the file named by the
+ *	"source_map_file" option and omitted as well.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Output may be written to a channel or file(s).
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SetCompileResult(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassCompileSettings *settingsPtr,	/* IN: The package settings. */
+    const SassResult *resultPtr)	/* IN: Get status/result from here. */
+{
+    SassResult result;
+
+    memcpy(&result, resultPtr, sizeof(SassResult));
+
+    if (result.errorStatus == 0) {
+	if (settingsPtr->outputChannel != NULL) {
+	    if (Tcl_WriteChars(settingsPtr->outputChannel, result.zOutput,
+		    result.outputLength) < 0) {
+		Tcl_AppendResult(interp, "error writing \"",
+		    Tcl_GetChannelName(settingsPtr->outputChannel), "\": ",
+		    Tcl_PosixError(interp), "\n", NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    result.zOutput = NULL;
+	    result.outputLength = 0;
+	} else if (settingsPtr->outputFilePtr != NULL) {
+	    if ((result.zSourceMap != NULL) &&
+		    (settingsPtr->sourceMapFilePtr != NULL)) {
+		if (SassWriteFile(interp, settingsPtr->sourceMapFilePtr,
+			result.zSourceMap, result.sourceMapLength) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+
+		result.zSourceMap = NULL;
+		result.sourceMapLength = 0;
+	    }
+
+	    if (SassWriteFile(interp, settingsPtr->outputFilePtr,
+		    result.zOutput, result.outputLength) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    result.zOutput = NULL;
+	    result.outputLength = 0;
+	}
+    }
+
+    return SetResultFromSassResult(interp, &result, settingsPtr->resultType);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetResultFromContext --
+ *
+ *	This function uses the error status and output string of the
+ *	specified Sass_Context, which were already queried by the compile
+ *	path, to modify the result of the Tcl interpreter, according to
+ *	the settings.  If a compile cache key is specified, a successful
+ *	result is also added to the compile cache, along with the list of
+ *	files that it included.  Failed results are never cached, since
+ *	they may be caused by an imported file that does not exist yet,
+ *	which cannot be recorded as an included file.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SetResultFromContext(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    struct Sass_Context *ctxPtr,	/* IN: Get included files from here. */
+    const SassResult *resultPtr,	/* IN: The status/result of above. */
+    const char *zKey,			/* IN: Compile cache key, or NULL. */
+    int keyLength,			/* IN: Length of cache key. */
+    const Tcl_Time *startTimePtr,	/* IN: When compilation started. */
+    SassCompileSettings *settingsPtr)	/* IN: The package settings. */
+{
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SetResultFromContext: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if ((ctxPtr == NULL) || (resultPtr == NULL)) {
+	Tcl_AppendResult(interp, "no context\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if ((zKey != NULL) && (resultPtr->errorStatus == 0)) {
+	SassCacheStore(zKey, keyLength, resultPtr,
+	    sass_context_get_included_files(ctxPtr), startTimePtr,
+	    settingsPtr->funcsPtr != NULL);
+    }
+
+    return SetCompileResult(interp, settingsPtr, resultPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DeleteOptions --
+ *
+ *	This function frees a Sass_Options struct that was never handed
+ *	over to a Sass_Context.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void DeleteOptions(
+    struct Sass_Options *optsPtr)	/* IN: The options to free. */
+{
+    if (optsPtr == NULL)
+	return;
+
+#ifdef HAVE_SASS_DELETE_OPTIONS
+    /* libsass 3.5.x adds the delete function to match the make function. */
+    sass_delete_options(optsPtr);
+#else
+    free(optsPtr);
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetContextImporters --
+ *
+ *	This function sets the list of custom importers used by libsass
+ *	for one compilation.  These are for the in-memory virtual file
+ *	system, which is not needed when it is empty, for the Tcl virtual
+ *	filesystem, which is only used when the "tcl_vfs" option is set,
+ *	and for the import cache, which needs the "include_path" option.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The list is owned by the options, and then by the context.  The
+ *	state of the importer for the Tcl virtual filesystem is owned by
+ *	the settings.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void SetContextImporters(
+    struct Sass_Options *optsPtr,	/* IN/OUT: The context options. */
+    SassCompileSettings *settingsPtr)	/* IN/OUT: The package settings. */
+{
+    const char *zIncludePath = settingsPtr->zIncludePath;
+    Sass_Importer_Entry aImporters[3];
+    Sass_Importer_List list;
+    int nImporters = 0;
+    int index;
+
+    aImporters[nImporters] = SassVfsMakeImporter();
+
+    if (aImporters[nImporters] != NULL)
+	nImporters++;
+
+    if (settingsPtr->bTclVfs) {
+	if (settingsPtr->fsPtr == NULL)
+	    settingsPtr->fsPtr = SassFsCreate(zIncludePath);
+
+	aImporters[nImporters] = SassFsMakeImporter(settingsPtr->fsPtr);
+
+	if (aImporters[nImporters] != NULL)
+	    nImporters++;
+    }
+
+    aImporters[nImporters] = SassImportMakeImporter(zIncludePath);
+
+    if (aImporters[nImporters] != NULL)
+	nImporters++;
+
+    if (nImporters == 0)
+	return;
+
+    list = sass_make_importer_list(nImporters);
+
+    if (list == NULL) {
+	for (index = 0; index < nImporters; index++)
+	    sass_delete_importer(aImporters[index]);
+
+	return;
+    }
+
+    for (index = 0; index < nImporters; index++)
+	sass_importer_set_list_entry(list, index, aImporters[index]);
+
+    sass_option_set_c_importers(optsPtr, list);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewContext --
+ *
+ *	This function attempts to create a Sass_Context based on the
+ *	specified Sass_Context_Type, without compiling it.  The options,
+ *	if any, are transferred to the new context.  This function does
+ *	not use the Tcl interpreter; therefore, it may be called by any
+ *	thread, e.g. a worker thread of the pool.
+ *
+ * Results:
+ *	The new context -OR- NULL if it could not be created, in which
+ *	case the reason is stored into the pzError argument.  The context
+ *	must be freed via DeleteContext.  For data contexts, the length
+ *	of the source string is stored into the pDataLength argument;
+ *	otherwise, it is set to zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct Sass_Context *NewContext(
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    struct Sass_Options **pOptsPtr,	/* IN/OUT: The context options. */
+    const char *zSource,		/* IN: The source string or file. */
+    char **pzDup,			/* OUT: Source copy, for DeleteContext. */
+    Tcl_WideUInt *pDataLength,		/* OUT: Length of source string. */
+    const char **pzError)		/* OUT: Error message, if any. */
+{
+    *pzDup = NULL;
+    *pDataLength = 0;
+
+    switch (type) {
+	case SASS_CONTEXT_FILE: {
+	    struct Sass_File_Context *ctxPtr;
+
+	    ctxPtr = sass_make_file_context(zSource);
+
+	    if (ctxPtr == NULL) {
+		*pzError = "out of memory: ctxPtr\n";
+		return NULL;
+	    }
+
+	    if (*pOptsPtr != NULL) {
+		sass_file_context_set_options(ctxPtr, *pOptsPtr);
+		*pOptsPtr = NULL;
+	    }
+
+	    return (struct Sass_Context *)ctxPtr;
+	}
+	case SASS_CONTEXT_DATA: {
+	    struct Sass_Data_Context *ctxPtr;
+	    size_t length = strlen(zSource);
+	    char *zDup = malloc(length + 1);
+
+	    if (zDup == NULL) {
+		*pzError = "out of memory: zDup\n";
+		return NULL;
+	    }
+
+	    memcpy(zDup, zSource, length + 1);
+
+	    ctxPtr = sass_make_data_context(zDup);
+
+	    if (ctxPtr == NULL) {
+		free(zDup);
+		*pzError = "out of memory: ctxPtr\n";
+		return NULL;
+	    }
+
+	    if (*pOptsPtr != NULL) {
+		sass_data_context_set_options(ctxPtr, *pOptsPtr);
+		*pOptsPtr = NULL;
+	    }
+
+	    *pzDup = zDup;
+	    *pDataLength = (Tcl_WideUInt)length;
+
+	    return (struct Sass_Context *)ctxPtr;
+	}
+	default: {
+	    *pzError = "cannot compile, unsupported type\n";
+	    return NULL;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetInputLength --
+ *
+ *	This function returns the number of source bytes for a context,
+ *	as reported by [sass stats].  For data contexts, this is the length
+ *	already known from copying the source string.  For file contexts,
+ *	this is the size of the source file itself, not including any
+ *	imported files, which needs a stat() call; therefore, it is only
+ *	done when forced (i.e. for -profile), when [sass stats -files] is
+ *	enabled, or when [sass trace] is on.
+ *
+ * Results:
+ *	The number of bytes, or zero if unknown.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideUInt GetInputLength(
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    const char *zSource,		/* IN: The source string or file. */
+    Tcl_WideUInt dataLength,		/* IN: Length of source string. */
+    int bForce)				/* IN: Non-zero to always stat files. */
+{
+    struct stat statBuf;
+
+    if (type != SASS_CONTEXT_FILE)
+	return dataLength;
+
+    if (!bForce && !sassStatsFiles && !sassTraceEnabled)
+	return 0;
+
+    if (stat(zSource, &statBuf) != 0)
+	return 0;
+
+    return (Tcl_WideUInt)statBuf.st_size;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountCompile --
+ *
+ *	This function updates the metrics reported by [sass stats] for a
+ *	compiled context, including its latency from the specified start
+ *	time until now, and records the end of the compilation for [sass
+ *	trace].  The status and result are queried from the context once,
+ *	here, and then used by the caller as well.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void CountCompile(
+    struct Sass_Context *ctxPtr,	/* IN: The compiled context. */
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    Tcl_WideUInt inputLength,		/* IN: Number of source bytes. */
+    Tcl_WideUInt startTime,		/* IN: Start time, in nanoseconds. */
+    SassResult *resultPtr)		/* OUT: The status/result. */
+{
+    Tcl_WideUInt outputLength = 0;
+
+    SassStatsRecord(SASS_PHASE_COMPILE, startTime);
+
+    SassStatsCount((type == SASS_CONTEXT_FILE) ?
+	SASS_STAT_COMPILES_FILE : SASS_STAT_COMPILES_DATA, 1);
+
+    SassStatsCount(SASS_STAT_INPUT_BYTES, inputLength);
+
+    GetResultFromContext(ctxPtr, resultPtr);
+
+    if (resultPtr->errorStatus != 0) {
+	SassStatsCount(SASS_STAT_ERRORS, 1);
+    } else {
+	outputLength = (Tcl_WideUInt)resultPtr->outputLength;
+	SassStatsCount(SASS_STAT_OUTPUT_BYTES, outputLength);
+    }
+
+    SASS_TRACE(SASS_TRACE_COMPILE_END, resultPtr->errorStatus,
+	outputLength);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileContext --
+ *
+ *	This function attempts to create a Sass_Context based on the
+ *	specified Sass_Context_Type and then compile it.  The options,
+ *	if any, are transferred to the new context.  This function does
+ *	not use the Tcl interpreter; therefore, it may be called by any
+ *	thread, e.g. a worker thread of the pool.
+ *
+ * Results:
+ *	The compiled context -OR- NULL if it could not be created, in
+ *	which case the reason is stored into the pzError argument.  The
+ *	context must be freed via DeleteContext.  Its status and result
+ *	are stored into the resultPtr argument, which is only valid while
+ *	the context exists.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct Sass_Context *CompileContext(
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    struct Sass_Options **pOptsPtr,	/* IN/OUT: The context options. */
+    const char *zSource,		/* IN: The source string or file. */
+    char **pzDup,			/* OUT: Source copy, for DeleteContext. */
+    const char **pzError,		/* OUT: Error message, if any. */
+    SassResult *resultPtr)		/* OUT: The status/result. */
+{
+    struct Sass_Context *ctxPtr;
+    Tcl_WideUInt inputLength;
+    Tcl_WideUInt startTime;
+
+    ctxPtr = NewContext(type, pOptsPtr, zSource, pzDup, &inputLength,
+	pzError);
+
+    if (ctxPtr == NULL)
+	return NULL;
+
+    inputLength = GetInputLength(type, zSource, inputLength, 0);
+    SASS_TRACE(SASS_TRACE_COMPILE_START, type, inputLength);
+    startTime = SassStatsNow();
+
+    if (type == SASS_CONTEXT_FILE)
+	sass_compile_file_context((struct Sass_File_Context *)ctxPtr);
+    else
+	sass_compile_data_context((struct Sass_Data_Context *)ctxPtr);
+
+    CountCompile(ctxPtr, type, inputLength, startTime, resultPtr);
+
+    return ctxPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartProfile --
+ *
+ *	This function resets the specified profile and starts timing its
+ *	first phase.  It is cheap enough to be called for every compile,
+ *	before it is known whether the -profile option is used.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void StartProfile(
+    SassProfile *profilePtr)		/* OUT: The profile to start. */
+{
+    memset(profilePtr, 0, sizeof(SassProfile));
+    profilePtr->heapBase = -1;
+    profilePtr->peakBytes = -1;
+    profilePtr->wallTime = SassStatsNow();
+    profilePtr->cpuTime = SassStatsCpuNow();
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MarkProfile --
+ *
+ *	This function adds the wall and CPU time elapsed since the end of
+ *	the previous phase to the specified phase and then samples the
+ *	heap usage.  The end of option processing is the baseline for the
+ *	heap usage.  The time spent sampling the heap is not included in
+ *	any phase.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void MarkProfile(
+    SassProfile *profilePtr,		/* IN/OUT: The profile to update. */
+    enum Sass_Profile_Phase phase)	/* IN: The phase that just ended. */
+{
+    Tcl_WideUInt wallTime = SassStatsNow();
+    Tcl_WideUInt cpuTime = SassStatsCpuNow();
+    Tcl_WideInt heapBytes;
+
+    if (wallTime > profilePtr->wallTime)
+	profilePtr->aWall[phase] += wallTime - profilePtr->wallTime;
+
+    if (cpuTime > profilePtr->cpuTime)
+	profilePtr->aCpu[phase] += cpuTime - profilePtr->cpuTime;
+
+    if (phase != SASS_PROFILE_RESULT) {
+	heapBytes = SassStatsHeapBytes();
+
+	if (phase == SASS_PROFILE_OPTIONS) {
+	    profilePtr->heapBase = heapBytes;
+
+	    if (heapBytes >= 0)
+		profilePtr->peakBytes = 0;
+	} else if ((heapBytes >= 0) && (profilePtr->heapBase >= 0) &&
+		(heapBytes - profilePtr->heapBase > profilePtr->peakBytes)) {
+	    profilePtr->peakBytes = heapBytes - profilePtr->heapBase;
+	}
+    }
+
+    profilePtr->wallTime = SassStatsNow();
+    profilePtr->cpuTime = SassStatsCpuNow();
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProfileContext --
+ *
+ *	This function is the same as CompileContext, except that it uses
+ *	the two-phase compiler API of libsass, so that the context setup,
+ *	parse, and execute phases can be recorded into the specified
+ *	profile separately.  The counts of included files, source bytes,
+ *	and output bytes are recorded as well.
+ *
+ * Results:
+ *	The compiled context -OR- NULL if it could not be created, in
+ *	which case the reason is stored into the pzError argument.  The
+ *	context must be freed via DeleteContext.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct Sass_Context *ProfileContext(
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    struct Sass_Options **pOptsPtr,	/* IN/OUT: The context options. */
+    const char *zSource,		/* IN: The source string or file. */
+    char **pzDup,			/* OUT: Source copy, for DeleteContext. */
+    const char **pzError,		/* OUT: Error message, if any. */
+    SassResult *resultPtr,		/* OUT: The status/result. */
+    SassProfile *profilePtr)		/* IN/OUT: The profile to update. */
+{
+    struct Sass_Context *ctxPtr;
+    struct Sass_Compiler *compiler;
+    char **azIncludedFiles;
+    Tcl_WideUInt dataLength;
+    Tcl_WideUInt startTime;
+
+    ctxPtr = NewContext(type, pOptsPtr, zSource, pzDup, &dataLength,
+	pzError);
+
+    if (ctxPtr == NULL)
+	return NULL;
+
+    if (type == SASS_CONTEXT_FILE) {
+	compiler = sass_make_file_compiler(
+	    (struct Sass_File_Context *)ctxPtr);
+    } else {
+	compiler = sass_make_data_compiler(
+	    (struct Sass_Data_Context *)ctxPtr);
+    }
+
+    if (compiler == NULL) {
+	DeleteContext(type, ctxPtr, *pzDup);
+	*pzDup = NULL;
+	*pzError = "out of memory: compiler\n";
+	return NULL;
+    }
+
+    profilePtr->inputBytes = GetInputLength(type, zSource, dataLength, 1);
+    MarkProfile(profilePtr, SASS_PROFILE_SETUP);
+
+    SASS_TRACE(SASS_TRACE_COMPILE_START, type, profilePtr->inputBytes);
+    startTime = SassStatsNow();
+    sass_compiler_parse(compiler);
+    MarkProfile(profilePtr, SASS_PROFILE_PARSE);
+
+    sass_compiler_execute(compiler);
+    MarkProfile(profilePtr, SASS_PROFILE_EXECUTE);
+
+    CountCompile(ctxPtr, type, profilePtr->inputBytes, startTime,
+	resultPtr);
+
+    sass_delete_compiler(compiler);
+
+    azIncludedFiles = sass_context_get_included_files(ctxPtr);
+
+    if (azIncludedFiles != NULL) {
+	while (azIncludedFiles[profilePtr->includedFiles] != NULL)
+	    profilePtr->includedFiles++;
+    }
+
+    if (resultPtr->errorStatus == 0)
+	profilePtr->outputBytes = (Tcl_WideUInt)resultPtr->outputLength;
+
+    return ctxPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendProfile --
+ *
+ *	This function appends the "profile" key and the dictionary built
+ *	from the specified profile to the result dictionary of the Tcl
+ *	interpreter.  Times are in microseconds.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void AppendProfile(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    const SassProfile *profilePtr)	/* IN: The profile to append. */
+{
+    Tcl_Obj *resultPtr = Tcl_GetObjResult(interp);
+    Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+    int index;
+
+    for (index = 0; index < SASS_PROFILE_MAX; index++) {
+	Tcl_Obj *phasePtr = Tcl_NewListObj(0, NULL);
+
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewStringObj("wall", -1));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt)(profilePtr->aWall[index] / 1000)));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewStringObj("cpu", -1));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt)(profilePtr->aCpu[index] / 1000)));
+
+	Tcl_ListObjAppendElement(NULL, listPtr,
+	    Tcl_NewStringObj(azProfilePhases[index], -1));
+	Tcl_ListObjAppendElement(NULL, listPtr, phasePtr);
+    }
+
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewStringObj("includedFiles", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewWideIntObj((Tcl_WideInt)profilePtr->includedFiles));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewStringObj("inputBytes", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewWideIntObj((Tcl_WideInt)profilePtr->inputBytes));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewStringObj("outputBytes", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewWideIntObj((Tcl_WideInt)profilePtr->outputBytes));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewStringObj("peakBytes", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewWideIntObj(profilePtr->peakBytes));
+
+    if (Tcl_IsShared(resultPtr)) {
+	resultPtr = Tcl_DuplicateObj(resultPtr);
+	Tcl_SetObjResult(interp, resultPtr);
+    }
+
+    Tcl_ListObjAppendElement(NULL, resultPtr,
+	Tcl_NewStringObj("profile", -1));
+    Tcl_ListObjAppendElement(NULL, resultPtr, listPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DeleteContext --
+ *
+ *	This function frees a Sass_Context created by CompileContext.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void DeleteContext(
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    struct Sass_Context *ctxPtr,	/* IN: The context to free. */
+    char *zDup)				/* IN: Source copy, if any. */
+{
+    if (ctxPtr == NULL)
+	return;
+
+    switch (type) {
+	case SASS_CONTEXT_FILE: {
+	    sass_delete_file_context((struct Sass_File_Context *)ctxPtr);
+	    break;
+	}
+	case SASS_CONTEXT_DATA: {
+	    sass_delete_data_context((struct Sass_Data_Context *)ctxPtr);
+#ifdef TCLSASS_CALLER_FREE
+	    free(zDup);
+#endif
+	    break;
+	}
+	default: {
+	    break;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadTclVfsEntry --
+ *
+ *	This function reads the source file for a file context via the
+ *	Tcl virtual filesystem layer, when the "tcl_vfs" option is set,
+ *	so that it can be compiled as a data context instead.  The input
+ *	path is still set to the file name, so that libsass uses it within
+ *	error messages and source maps.  Otherwise, nothing is changed.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The file contents are owned by the importer state within the
+ *	settings.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ReadTclVfsEntry(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassCompileSettings *settingsPtr,	/* IN: The package settings. */
+    struct Sass_Options *optsPtr,	/* IN/OUT: The context options. */
+    enum Sass_Context_Type *typePtr,	/* IN/OUT: The context type. */
+    const char **pzSource)		/* IN/OUT: The source file/string. */
+{
+    const char *zSource = *pzSource;
+    size_t sourceLength;
+
+    if ((*typePtr != SASS_CONTEXT_FILE) || (settingsPtr == NULL) ||
+	    (settingsPtr->fsPtr == NULL)) {
+	return TCL_OK;
+    }
+
+    if (optsPtr == NULL) {
+	Tcl_AppendResult(interp, "no options\n", NULL);
+	return TCL_ERROR;
+    }
+
+    sourceLength = strlen(zSource);
+    sass_option_set_input_path(optsPtr, zSource);
+
+    if ((sourceLength > 5) &&
+	    (strcmp(zSource + sourceLength - 5, ".sass") == 0)) {
+	sass_option_set_is_indented_syntax_src(optsPtr, true);
+    }
+
+    if (SassFsReadEntry(interp, settingsPtr->fsPtr, zSource,
+	    pzSource) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    *typePtr = SASS_CONTEXT_DATA;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileForType --
+ *
+ *	This function attempts to create a Sass_Context based on the
+ *	specified Sass_Context_Type, compile it, and then set the Tcl
+ *	interpreter result based on its output.  A script error will
+ *	be generated if the context type is unsupported -OR- context
+ *	creation fails -OR- context compilation fails and the result
+ *	type is "css".  If a compile
+ *	cache key is specified, the result is added to the compile
+ *	cache as well.  When the "tcl_vfs" option is set, file contexts
+ *	are read via the Tcl virtual filesystem layer and compiled as
+ *	data contexts instead.  When the -profile option is set, the
+ *	compilation is profiled and the profile is added to the result.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CompileForType(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    struct Sass_Options **pOptsPtr,	/* IN/OUT: The context options. */
+    const char* zSource,		/* IN: The source string or file. */
+    const char *zKey,			/* IN: Compile cache key, or NULL. */
+    int keyLength,			/* IN: Length of cache key. */
+    SassCompileSettings *settingsPtr)	/* IN: The package settings. */
+{
+    int code;
+    int bProfile = (settingsPtr != NULL) && settingsPtr->bProfile;
+    Tcl_Time startTime;
+    struct Sass_Context *ctxPtr;
+    SassResult result;
+    char *zDup = NULL;
+    const char *zError = NULL;
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("CompileForType: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (pOptsPtr == NULL) {
+	Tcl_AppendResult(interp, "no options pointer\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (zSource == NULL) {
+	Tcl_AppendResult(interp, "no source\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if ((type != SASS_CONTEXT_FILE) && (type != SASS_CONTEXT_DATA)) {
+	char buffer[50] = {0};
+
+	snprintf(buffer, sizeof(buffer) - 1,
+	    "cannot compile, unsupported type %d\n", type);
+
+	Tcl_AppendResult(interp, buffer, NULL);
+	return TCL_ERROR;
+    }
+
+    if (ReadTclVfsEntry(interp, settingsPtr, *pOptsPtr, &type,
+	    &zSource) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    /*
+     * NOTE: The compile cache uses the start time to detect included files
+     *       that may have been modified during compilation.
+     */
+
+    Tcl_GetTime(&startTime);
+
+    if (bProfile) {
+	ctxPtr = ProfileContext(type, pOptsPtr, zSource, &zDup, &zError,
+	    &result, &settingsPtr->profile);
+    } else {
+	ctxPtr = CompileContext(type, pOptsPtr, zSource, &zDup, &zError,
+	    &result);
+    }
+
+    if (ctxPtr == NULL) {
+	Tcl_AppendResult(interp, zError, NULL);
+	return TCL_ERROR;
+    }
+
+    code = SetResultFromContext(interp, ctxPtr, &result, zKey, keyLength,
+	&startTime, settingsPtr);
+
+    if (bProfile) {
+	MarkProfile(&settingsPtr->profile, SASS_PROFILE_RESULT);
+
+	if (code == TCL_OK)
+	    AppendProfile(interp, &settingsPtr->profile);
+    }
+
+    DeleteContext(type, ctxPtr, zDup);
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetCacheKey --
+ *
+ *	This function finishes the compile cache key within the specified
+ *	settings, if the compile cache is enabled and supported for the
+ *	context type.  The cache key consists of the options dictionaries,
+ *	the context type, the current directory, and then the source
+ *	string itself, which is the file name for file contexts.  The
+ *	current directory is needed because relative file names (and
+ *	include paths) are resolved against it.  The contents of the
+ *	included files are not part of the key; instead, the cache checks
+ *	them for changes on lookup.  The compile cache is not used with
+ *	the "tcl_vfs" option, because it cannot check files that are only
+ *	visible via the Tcl virtual filesystem layer.
+ *
+ * Results:
+ *	The cache key, which is owned by the settings -OR- NULL if the
+ *	compile cache should not be used.  The length of the key is the
+ *	length of the Tcl_DString within the settings.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *GetCacheKey(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassCompileSettings *settingsPtr,	/* IN/OUT: The package settings. */
+    const char *zSource,		/* IN: The source string or file. */
+    int sourceLength)			/* IN: Length of source string. */
+{
+    char typeChar;
+    Tcl_Obj *cwdPtr;
+
+    if (!settingsPtr->bCache || settingsPtr->bTclVfs ||
+	    ((settingsPtr->type != SASS_CONTEXT_DATA) &&
+	    (settingsPtr->type != SASS_CONTEXT_FILE))) {
+	return NULL;
+    }
+
+    typeChar = (char)('0' + settingsPtr->type);
+    cwdPtr = Tcl_FSGetCwd(interp);
+
+    Tcl_DStringAppend(&settingsPtr->key, &typeChar, 1);
+
+    if (cwdPtr != NULL) {
+	Tcl_DStringAppend(&settingsPtr->key, Tcl_GetString(cwdPtr), -1);
+	Tcl_DecrRefCount(cwdPtr);
+    }
+
+    Tcl_DStringAppend(&settingsPtr->key, "", 1);
+    Tcl_DStringAppend(&settingsPtr->key, zSource, sourceLength);
+
+    return Tcl_DStringValue(&settingsPtr->key);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewCompileJob --
+ *
+ *	This function creates a job for compiling the specified source
+ *	on another thread.  The source string and compile cache key are
+ *	copied.  The options, if any, are transferred to the job.
+ *
+ * Results:
+ *	The new job -OR- NULL if it could not be created.  The job must
+ *	be freed via FreeCompileJob.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCompileJob *NewCompileJob(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    struct Sass_Options **pOptsPtr,	/* IN/OUT: The context options. */
+    const char *zSource,		/* IN: The source string or file. */
+    int sourceLength,			/* IN: Length of source string. */
+    const char *zKey,			/* IN: Compile cache key, or NULL. */
+    int keyLength)			/* IN: Length of cache key. */
+{
+    SassCompileJob *jobPtr;
+
+    jobPtr = (SassCompileJob *)attemptckalloc(sizeof(SassCompileJob));
+
+    if (jobPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: jobPtr\n", NULL);
+	return NULL;
+    }
+
+    memset(jobPtr, 0, sizeof(SassCompileJob));
+    jobPtr->type = type;
+    jobPtr->zSource = attemptckalloc(sourceLength + 1);
+
+    if (jobPtr->zSource == NULL) {
+	FreeCompileJob(jobPtr);
+	Tcl_AppendResult(interp, "out of memory: zSource\n", NULL);
+	return NULL;
+    }
+
+    memcpy(jobPtr->zSource, zSource, sourceLength);
+    jobPtr->zSource[sourceLength] = '\0';
+
+    if (zKey != NULL) {
+	jobPtr->zKey = attemptckalloc(keyLength);
+
+	if (jobPtr->zKey == NULL) {
+	    FreeCompileJob(jobPtr);
+	    Tcl_AppendResult(interp, "out of memory: zKey\n", NULL);
+	    return NULL;
+	}
+
+	memcpy(jobPtr->zKey, zKey, keyLength);
+	jobPtr->keyLength = keyLength;
+    }
+
+    jobPtr->optsPtr = *pOptsPtr;
+    *pOptsPtr = NULL;
+
+    return jobPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrepareCompileJob --
+ *
+ *	This function creates a job from one element of the job list
+ *	passed to the [sass compileBatch] sub-command.  Each element is
+ *	a list containing the same options accepted by [sass compile],
+ *	except -command, followed by the source.
+ *
+ * Results:
+ *	The new job -OR- NULL if the element is invalid, in which case
+ *	the Tcl interpreter result contains the reason.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCompileJob *PrepareCompileJob(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *jobObjPtr)			/* IN: List of options and source. */
+{
+    SassCompileJob *jobPtr = NULL;
+    SassCompileSettings settings;
+    struct Sass_Options *optsPtr = NULL;
+    int jobObjc;
+    Tcl_Obj **jobObjv;
+    int index = 0;
+    int sourceLength;
+    char *zSource;
+    const char *zKey;
+
+    memset(&settings, 0, sizeof(SassCompileSettings));
+    settings.type = SASS_CONTEXT_NULL;
+    Tcl_DStringInit(&settings.key);
+
+    if (Tcl_ListObjGetElements(interp, jobObjPtr, &jobObjc,
+	    &jobObjv) != TCL_OK) {
+	goto done;
+    }
+
+    if (jobObjc < 1) {
+	Tcl_AppendResult(interp, "malformed job, must be: ?options? source\n",
+	    NULL);
+
+	goto done;
+    }
+
+    optsPtr = sass_make_options();
+
+    if (optsPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: optsPtr\n", NULL);
+	goto done;
+    }
+
+    if (ProcessContextOptions(interp, jobObjc, jobObjv, &index, &settings,
+	    optsPtr) != TCL_OK) {
+	goto done;
+    }
+
+    if ((index < 0) || ((index + 1) != jobObjc)) {
+	Tcl_AppendResult(interp, "malformed job, must be: ?options? source\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.commandPtr != NULL) {
+	Tcl_AppendResult(interp, "option -command is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.bProfile) {
+	Tcl_AppendResult(interp, "option -profile is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if ((settings.type == SASS_CONTEXT_FOLDER) ||
+	    (settings.outputDirPtr != NULL)) {
+	Tcl_AppendResult(interp,
+	    "options -type folder and -outputDir are not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.bTclVfs) {
+	Tcl_AppendResult(interp, "option tcl_vfs is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.resultType != SASS_RESULT_DICT) {
+	Tcl_AppendResult(interp, "option -result is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if ((settings.outputChannel != NULL) ||
+	    (settings.outputFilePtr != NULL)) {
+	Tcl_AppendResult(interp,
+	    "options -outputChannel and -outputFile are not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    settings.funcsPtr = SassFuncBind(interp, optsPtr, 1, &settings.key);
+
+    zSource = Tcl_GetStringFromObj(jobObjv[index], &sourceLength);
+    zKey = GetCacheKey(interp, &settings, zSource, sourceLength);
+
+    jobPtr = NewCompileJob(interp, settings.type, &optsPtr, zSource,
+	sourceLength, zKey, Tcl_DStringLength(&settings.key));
+
+    if (jobPtr != NULL) {
+	jobPtr->funcsPtr = settings.funcsPtr;
+	settings.funcsPtr = NULL;
+	jobPtr->varsPtr = settings.varsPtr;
+	settings.varsPtr = NULL;
+    }
+
+done:
+    Tcl_DStringFree(&settings.key);
+    DeleteOptions(optsPtr);
+    SassFsDelete(settings.fsPtr);
+    SassFuncUnbind(settings.funcsPtr);
+    SassVarsRelease(settings.varsPtr);
+
+    return jobPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SubmitCompileJob --
+ *
+ *	This function handles the [sass compile] sub-command when the
+ *	-command option is used.  It submits the compilation to the pool
+ *	of worker threads and then sets the Tcl interpreter result to a
+ *	new request token.  Once the compilation is complete, the callback
+ *	command is evaluated, from the event loop of the current thread,
+ *	with the request token and result dictionary appended to it.  The
+ *	options, if any, are transferred to the submitted job.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Worker threads may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SubmitCompileJob(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassCompileSettings *settingsPtr,	/* IN: The package settings. */
+    struct Sass_Options **pOptsPtr,	/* IN/OUT: The context options. */
+    const char *zSource,		/* IN: The source string or file. */
+    int sourceLength,			/* IN: Length of source string. */
+    const char *zKey,			/* IN: Compile cache key, or NULL. */
+    int keyLength)			/* IN: Length of cache key. */
+{
+    SassCompileJob *jobPtr;
+    Tcl_WideInt jobId;
+    char buffer[TCL_INTEGER_SPACE + 5];
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SubmitCompileJob: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    jobPtr = NewCompileJob(interp, settingsPtr->type, pOptsPtr, zSource,
+	sourceLength, zKey, keyLength);
+
+    if (jobPtr == NULL)
+	return TCL_ERROR;
+
+    Tcl_MutexLock(&jobIdMutex);
+    jobId = ++nextJobId;
+    Tcl_MutexUnlock(&jobIdMutex);
+
+    snprintf(buffer, sizeof(buffer), "sass%" TCL_LL_MODIFIER "d", jobId);
+
+    jobPtr->interp = interp;
+    jobPtr->commandPtr = settingsPtr->commandPtr;
+    Tcl_IncrRefCount(jobPtr->commandPtr);
+    jobPtr->funcsPtr = settingsPtr->funcsPtr;
+    settingsPtr->funcsPtr = NULL;
+    jobPtr->varsPtr = settingsPtr->varsPtr;
+    settingsPtr->varsPtr = NULL;
+    jobPtr->tokenPtr = Tcl_NewStringObj(buffer, -1);
+    Tcl_IncrRefCount(jobPtr->tokenPtr);
+
+    if (SassPoolSubmit(interp, CompileJobWorkProc, CompileJobDoneProc,
+	    CompileJobDiscardProc, jobPtr) != TCL_OK) {
+	FreeCompileJob(jobPtr);
+	return TCL_ERROR;
+    }
+
+    /*
+     * NOTE: The interpreter must remain usable until the job is complete,
+     *       i.e. when CompileJobDoneProc -OR- CompileJobDiscardProc releases
+     *       it.
+     */
+
+    Tcl_Preserve(interp);
+    Tcl_SetObjResult(interp, jobPtr->tokenPtr);
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileJobWorkProc --
+ *
+ *	This function is called by a worker thread of the pool in order
+ *	to compile an asynchronous job.  The compile cache is checked
+ *	first, if applicable.  Otherwise, a new context is compiled and,
+ *	if successful, its result is added to the compile cache.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void CompileJobWorkProc(
+    ClientData clientData)		/* IN: The job to compile. */
+{
+    SassCompileJob *jobPtr = (SassCompileJob *)clientData;
+    Tcl_Time startTime;
+
+    if (jobPtr->zKey != NULL) {
+	jobPtr->entryPtr = SassCacheFind(jobPtr->zKey, jobPtr->keyLength,
+	    jobPtr->funcsPtr != NULL);
+
+	if (jobPtr->entryPtr != NULL)
+	    return;
+    }
+
+    Tcl_GetTime(&startTime);
+
+    jobPtr->ctxPtr = CompileContext(jobPtr->type, &jobPtr->optsPtr,
+	jobPtr->zSource, &jobPtr->zDup, &jobPtr->zError, &jobPtr->result);
+
+    if ((jobPtr->ctxPtr != NULL) && (jobPtr->zKey != NULL) &&
+	    (jobPtr->result.errorStatus == 0)) {
+	SassCacheStore(jobPtr->zKey, jobPtr->keyLength, &jobPtr->result,
+	    sass_context_get_included_files(jobPtr->ctxPtr), &startTime,
+	    jobPtr->funcsPtr != NULL);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetResultFromCompileJob --
+ *
+ *	This function uses the outcome of a compiled job to modify the
+ *	result of the Tcl interpreter, in the same way as the synchronous
+ *	[sass compile] sub-command.  If the context could not be created,
+ *	the result reports the reason as the error message.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SetResultFromCompileJob(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassCompileJob *jobPtr)		/* IN: The compiled job. */
+{
+    SassResult result;
+
+    if (jobPtr->entryPtr != NULL) {
+	return SetResultFromSassResult(interp,
+	    SassCacheGetResult(jobPtr->entryPtr), SASS_RESULT_DICT);
+    }
+
+    if (jobPtr->ctxPtr != NULL) {
+	return SetResultFromSassResult(interp, &jobPtr->result,
+	    SASS_RESULT_DICT);
+    }
+
+    memset(&result, 0, sizeof(SassResult));
+    result.errorStatus = 1;
+    result.zErrorMessage = jobPtr->zError;
+    result.errorMessageLength = (int)strlen(jobPtr->zError);
+
+    return SetResultFromSassResult(interp, &result, SASS_RESULT_DICT);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileJobDoneProc --
+ *
+ *	This function is called by the event loop of the thread that
+ *	submitted an asynchronous job, after it has been compiled.  It
+ *	builds the same result dictionary returned by the synchronous
+ *	[sass compile] sub-command and then evaluates the callback, at
+ *	the global level.  Errors in the callback are reported as
+ *	background errors.  If the Tcl interpreter has been deleted,
+ *	nothing is evaluated.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the callback does.  The job is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void CompileJobDoneProc(
+    ClientData clientData)		/* IN: The job to complete. */
+{
+    SassCompileJob *jobPtr = (SassCompileJob *)clientData;
+    Tcl_Interp *interp = jobPtr->interp;
+    int code;
+
+    if (Tcl_InterpDeleted(interp))
+	goto done;
+
+    code = SetResultFromCompileJob(interp, jobPtr);
+
+    if (code == TCL_OK) {
+	Tcl_Obj *scriptPtr = Tcl_DuplicateObj(jobPtr->commandPtr);
+
+	Tcl_IncrRefCount(scriptPtr);
+	code = Tcl_ListObjAppendElement(interp, scriptPtr, jobPtr->tokenPtr);
+
+	if (code == TCL_OK) {
+	    code = Tcl_ListObjAppendElement(interp, scriptPtr,
+		Tcl_GetObjResult(interp));
+	}
+
+	if (code == TCL_OK) {
+	    Tcl_ResetResult(interp);
+	    code = Tcl_EvalObjEx(interp, scriptPtr, TCL_EVAL_GLOBAL);
+	}
+
+	Tcl_DecrRefCount(scriptPtr);
+    }
+
+    if (code != TCL_OK)
+	Tcl_BackgroundError(interp);
+
+done:
+    FreeCompileJob(jobPtr);
+    Tcl_Release(interp);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileJobDiscardProc --
+ *
+ *	This function is called by the submitting thread, instead of the
+ *	function CompileJobDoneProc, when the pool is shut down before an
+ *	asynchronous job is complete.  The callback is not evaluated.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The job is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void CompileJobDiscardProc(
+    ClientData clientData)		/* IN: The job to discard. */
+{
+    SassCompileJob *jobPtr = (SassCompileJob *)clientData;
+    Tcl_Interp *interp = jobPtr->interp;
+
+    FreeCompileJob(jobPtr);
+    Tcl_Release(interp);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeCompileJob --
+ *
+ *	This function frees an asynchronous job and everything it owns.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FreeCompileJob(
+    SassCompileJob *jobPtr)		/* IN: The job to free. */
+{
+    if (jobPtr->entryPtr != NULL)
+	SassCacheRelease(jobPtr->entryPtr);
+
+    DeleteContext(jobPtr->type, jobPtr->ctxPtr, jobPtr->zDup);
+    DeleteOptions(jobPtr->optsPtr);
+    SassFuncUnbind(jobPtr->funcsPtr);
+    SassVarsRelease(jobPtr->varsPtr);
+
+    if (jobPtr->tokenPtr != NULL)
+	Tcl_DecrRefCount(jobPtr->tokenPtr);
+
+    if (jobPtr->commandPtr != NULL)
+	Tcl_DecrRefCount(jobPtr->commandPtr);
+
+    if (jobPtr->zKey != NULL)
+	ckfree(jobPtr->zKey);
+
+    if (jobPtr->zSource != NULL)
+	ckfree(jobPtr->zSource);
+
+    ckfree((char *)jobPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseSource --
+ *
+ *	This function creates a Sass_Context based on the settings and
+ *	then parses it, via the two-phase libsass compiler API, without
+ *	executing it.  The options are transferred to the new context.
+ *	The state of the custom importers and functions is transferred
+ *	from the settings.  A failed parse is not an error; it is reported
+ *	via the error status of the context.
+ *
+ * Results:
+ *	The parsed compilation -OR- NULL if it could not be created, in
+ *	which case the Tcl interpreter result contains the reason.  It
+ *	must be freed via FreeParsed.
+ *
+ * Side effects:
+ *	The custom importers may be called.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassParsed *ParseSource(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassCompileSettings *settingsPtr,	/* IN/OUT: The package settings. */
+    struct Sass_Options **pOptsPtr,	/* IN/OUT: The context options. */
+    const char *zSource)		/* IN: The source string or file. */
+{
+    enum Sass_Context_Type type = settingsPtr->type;
+    SassParsed *parsedPtr;
+    const char *zError = NULL;
+
+    if ((type != SASS_CONTEXT_FILE) && (type != SASS_CONTEXT_DATA)) {
+	char buffer[50] = {0};
+
+	snprintf(buffer, sizeof(buffer) - 1,
+	    "cannot compile, unsupported type %d\n", type);
+
+	Tcl_AppendResult(interp, buffer, NULL);
+	return NULL;
+    }
+
+    if (ReadTclVfsEntry(interp, settingsPtr, *pOptsPtr, &type,
+	    &zSource) != TCL_OK) {
+	return NULL;
+    }
+
+    parsedPtr = (SassParsed *)attemptckalloc(sizeof(SassParsed));
+
+    if (parsedPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: parsedPtr\n", NULL);
+	return NULL;
+    }
+
+    memset(parsedPtr, 0, sizeof(SassParsed));
+    parsedPtr->type = type;
+    parsedPtr->resultType = settingsPtr->resultType;
+
+    parsedPtr->ctxPtr = NewContext(type, pOptsPtr, zSource,
+	&parsedPtr->zDup, &parsedPtr->inputLength, &zError);
+
+    if (parsedPtr->ctxPtr == NULL) {
+	FreeParsed(parsedPtr);
+	Tcl_AppendResult(interp, zError, NULL);
+	return NULL;
+    }
+
+    if (type == SASS_CONTEXT_FILE) {
+	parsedPtr->compiler = sass_make_file_compiler(
+	    (struct Sass_File_Context *)parsedPtr->ctxPtr);
+    } else {
+	parsedPtr->compiler = sass_make_data_compiler(
+	    (struct Sass_Data_Context *)parsedPtr->ctxPtr);
+    }
+
+    if (parsedPtr->compiler == NULL) {
+	FreeParsed(parsedPtr);
+	Tcl_AppendResult(interp, "out of memory: compiler\n", NULL);
+	return NULL;
+    }
+
+    parsedPtr->fsPtr = settingsPtr->fsPtr;
+    settingsPtr->fsPtr = NULL;
+    parsedPtr->funcsPtr = settingsPtr->funcsPtr;
+    settingsPtr->funcsPtr = NULL;
+    parsedPtr->varsPtr = settingsPtr->varsPtr;
+    settingsPtr->varsPtr = NULL;
+
+    parsedPtr->inputLength = GetInputLength(type, zSource,
+	parsedPtr->inputLength, 0);
+    SASS_TRACE(SASS_TRACE_COMPILE_START, type, parsedPtr->inputLength);
+    parsedPtr->parseTime = SassStatsNow();
+    sass_compiler_parse(parsedPtr->compiler);
+    parsedPtr->parseTime = SassStatsNow() - parsedPtr->parseTime;
+
+    return parsedPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeParsed --
+ *
+ *	This function frees a parsed compilation and everything it owns.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FreeParsed(
+    SassParsed *parsedPtr)		/* IN: The compilation to free. */
+{
+    if (parsedPtr->compiler != NULL)
+	sass_delete_compiler(parsedPtr->compiler);
+
+    DeleteContext(parsedPtr->type, parsedPtr->ctxPtr, parsedPtr->zDup);
+    SassFsDelete(parsedPtr->fsPtr);
+    SassFuncUnbind(parsedPtr->funcsPtr);
+    SassVarsRelease(parsedPtr->varsPtr);
+
+    ckfree((char *)parsedPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetIncludedFiles --
+ *
+ *	This function returns the files included by a parsed or compiled
+ *	context, as reported by libsass.  For file contexts, the source
+ *	file itself is included.  Files imported relative to the current
+ *	directory are reported as relative paths by libsass; they are
+ *	made absolute, except those from the virtual file system.
+ *
+ * Results:
+ *	A new list, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *GetIncludedFiles(
+    struct Sass_Context *ctxPtr)	/* IN: The parsed context. */
+{
+    Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+    char **azIncluded;
+    int index;
+
+    azIncluded = sass_context_get_included_files(ctxPtr);
+
+    for (index = 0; (azIncluded != NULL) && (azIncluded[index] != NULL);
+	    index++) {
+	Tcl_Obj *pathPtr = Tcl_NewStringObj(azIncluded[index], -1);
+	Tcl_Obj *normPtr = NULL;
+
+	Tcl_IncrRefCount(pathPtr);
+
+	if ((strncmp(azIncluded[index], SASS_VFS_PREFIX,
+		strlen(SASS_VFS_PREFIX)) != 0) &&
+		(Tcl_FSGetPathType(pathPtr) != TCL_PATH_ABSOLUTE)) {
+	    normPtr = Tcl_FSGetNormalizedPath(NULL, pathPtr);
+	}
+
+	Tcl_ListObjAppendElement(NULL, listPtr,
+	    (normPtr != NULL) ? normPtr : pathPtr);
+
+	Tcl_DecrRefCount(pathPtr);
+    }
+
+    return listPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseCompiler --
+ *
+ *	Handles the [sass parse], [sass check], and [sass deps source]
+ *	sub-commands, which accept the same options as the synchronous
+ *	[sass compile], except -cache, -outputChannel, and -outputFile.
+ *	The source is parsed, but not executed; therefore, only syntax
+ *	errors and missing imports are detected.  For [sass check], the
+ *	result is a dictionary with the error status and, on failure, the
+ *	error details.  For the others, a parse error is raised as a
+ *	script error, in the same way as for "-result css"; otherwise, the
+ *	result is a new compiler handle, for use with [sass execute], or
+ *	the list of included files, for [sass deps source].
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ParseCompiler(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[],		/* The array of arguments. */
+    int skip,				/* IN: Number of sub-command words. */
+    enum Sass_Parse_Mode mode)		/* IN: The sub-command. */
+{
+    int code = TCL_ERROR;
+    int bCheck = (mode == SASS_PARSE_CHECK);
+    int index = skip; /* NOTE: Start right after "sass parse". */
+    SassCompileSettings settings;
+    struct Sass_Options *optsPtr = NULL;
+    SassParsed *parsedPtr = NULL;
+    SassInterpData *dataPtr;
+    Tcl_HashEntry *hPtr;
+    SassResult result;
+    int bNew;
+    char buffer[TCL_INTEGER_SPACE + 13];
+
+    if (objc < skip + 1) {
+	Tcl_WrongNumArgs(interp, skip, objv, "?options? source");
+	return TCL_ERROR;
+    }
+
+    memset(&settings, 0, sizeof(SassCompileSettings));
+    settings.type = SASS_CONTEXT_NULL;
+    Tcl_DStringInit(&settings.key);
+
+    optsPtr = sass_make_options();
+
+    if (optsPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: optsPtr\n", NULL);
+	goto done;
+    }
+
+    if (ProcessContextOptions(interp, objc, objv, &index, &settings,
+	    optsPtr) != TCL_OK) {
+	goto done;
+    }
+
+    if ((index < 0) || ((index + 1) != objc)) {
+	Tcl_WrongNumArgs(interp, skip, objv, "?options? source");
+	goto done;
+    }
+
+    if (settings.commandPtr != NULL) {
+	Tcl_AppendResult(interp, "option -command is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.bProfile) {
+	Tcl_AppendResult(interp, "option -profile is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if ((settings.type == SASS_CONTEXT_FOLDER) ||
+	    (settings.outputDirPtr != NULL)) {
+	Tcl_AppendResult(interp,
+	    "options -type folder and -outputDir are not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.bCache) {
+	Tcl_AppendResult(interp, "option -cache is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if ((mode != SASS_PARSE_COMPILER) &&
+	    (settings.resultType != SASS_RESULT_DICT)) {
+	Tcl_AppendResult(interp, "option -result is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if ((settings.outputChannel != NULL) ||
+	    (settings.outputFilePtr != NULL)) {
+	Tcl_AppendResult(interp,
+	    "options -outputChannel and -outputFile are not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    settings.funcsPtr = SassFuncBind(interp, optsPtr, 0, &settings.key);
+
+    parsedPtr = ParseSource(interp, &settings, &optsPtr,
+	Tcl_GetString(objv[index]));
+
+    if (parsedPtr == NULL)
+	goto done;
+
+    GetResultFromContext(parsedPtr->ctxPtr, &result);
+
+    if (bCheck) {
+	result.zOutput = NULL;
+	result.zSourceMap = NULL;
+
+	code = SetResultFromSassResult(interp, &result, SASS_RESULT_DICT);
+	goto done;
+    }
+
+    if (result.errorStatus != 0) {
+	code = SetResultFromSassResult(interp, &result, SASS_RESULT_CSS);
+	goto done;
+    }
+
+    if (mode == SASS_PARSE_DEPS) {
+	Tcl_SetObjResult(interp, GetIncludedFiles(parsedPtr->ctxPtr));
+	code = TCL_OK;
+	goto done;
+    }
+
+    dataPtr = GetInterpData(interp, 1);
+
+    do {
+	snprintf(buffer, sizeof(buffer), "sassCompiler%d",
+	    ++dataPtr->nextCompilerId);
+
+	hPtr = Tcl_CreateHashEntry(&dataPtr->compilers, buffer, &bNew);
+    } while (!bNew);
+
+    Tcl_SetHashValue(hPtr, (ClientData)parsedPtr);
+    parsedPtr = NULL;
+
+    Tcl_SetObjResult(interp, Tcl_NewStringObj(buffer, -1));
+    code = TCL_OK;
+
+done:
+    if (parsedPtr != NULL)
+	FreeParsed(parsedPtr);
+
+    Tcl_DStringFree(&settings.key);
+    DeleteOptions(optsPtr);
+    SassFsDelete(settings.fsPtr);
+    SassFuncUnbind(settings.funcsPtr);
+    SassVarsRelease(settings.varsPtr);
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExecuteCompiler --
+ *
+ *	Handles the [sass execute] and [sass discard] sub-commands.  The
+ *	compiler handle is always deleted.  For [sass execute], the parsed
+ *	compilation is executed first and the result is the same as for
+ *	[sass compile], including the -result option given to [sass
+ *	parse].
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The custom functions may be called.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ExecuteCompiler(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[],		/* The array of arguments. */
+    int bDiscard)			/* IN: Non-zero for [sass discard]. */
+{
+    int code;
+    SassInterpData *dataPtr;
+    Tcl_HashEntry *hPtr = NULL;
+    SassParsed *parsedPtr;
+    SassResult result;
+    Tcl_WideUInt startTime;
+
+    if (objc != 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "handle");
+	return TCL_ERROR;
+    }
+
+    dataPtr = GetInterpData(interp, 0);
+
+    if (dataPtr != NULL) {
+	hPtr = Tcl_FindHashEntry(&dataPtr->compilers,
+	    Tcl_GetString(objv[2]));
+    }
+
+    if (hPtr == NULL) {
+	Tcl_AppendResult(interp, "invalid compiler handle \"",
+	    Tcl_GetString(objv[2]), "\"\n", NULL);
+
+	return TCL_ERROR;
+    }
+
+    /*
+     * NOTE: The handle is deleted first, so that a custom function called
+     *       while executing cannot use it again.
+     */
+
+    parsedPtr = (SassParsed *)Tcl_GetHashValue(hPtr);
+    Tcl_DeleteHashEntry(hPtr);
+
+    if (bDiscard) {
+	FreeParsed(parsedPtr);
+	Tcl_ResetResult(interp);
+	return TCL_OK;
+    }
+
+    /*
+     * NOTE: For [sass stats], the compile latency includes the time spent
+     *       parsing, which was recorded by [sass parse].
+     */
+
+    startTime = SassStatsNow() - parsedPtr->parseTime;
+    sass_compiler_execute(parsedPtr->compiler);
+
+    CountCompile(parsedPtr->ctxPtr, parsedPtr->type, parsedPtr->inputLength,
+	startTime, &result);
+
+    code = SetResultFromSassResult(interp, &result, parsedPtr->resultType);
+    FreeParsed(parsedPtr);
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileBatch --
+ *
+ *	Handles the [sass compileBatch] sub-command.  Each element of the
+ *	job list is compiled, concurrently, by up to the specified number
+ *	of threads.  The result is a list containing one dictionary per
+ *	job, in the same order, as returned by [sass compile].  A job that
+ *	fails, including one with invalid options, does not prevent the
+ *	others from being compiled; its dictionary reports the error.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Threads may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CompileBatch(
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int code = TCL_OK;
+    int nThreads = 0;
+    int jobObjc;
+    Tcl_Obj **jobObjv;
+    SassCompileJob **aJobs = NULL;
+    Tcl_Obj **aErrors = NULL;
+    ClientData *aItems = NULL;
+    int nItems = 0;
+    Tcl_Obj *listPtr = NULL;
+    int index;
+
+    if ((objc == 5) && (strcmp(Tcl_GetString(objv[2]), "-threads") == 0)) {
+	if (Tcl_GetIntFromObj(interp, objv[3], &nThreads) != TCL_OK)
+	    return TCL_ERROR;
+
+	if ((nThreads < 1) || (nThreads > SASS_POOL_MAX_THREADS)) {
+	    Tcl_AppendResult(interp, "thread count out of range\n", NULL);
+	    return TCL_ERROR;
+	}
+    } else if (objc != 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "?-threads count? jobs");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_ListObjGetElements(interp, objv[objc - 1], &jobObjc,
+	    &jobObjv) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    if (jobObjc > 0) {
+	aJobs = (SassCompileJob **)attemptckalloc(
+	    sizeof(SassCompileJob *) * jobObjc);
+
+	aErrors = (Tcl_Obj **)attemptckalloc(sizeof(Tcl_Obj *) * jobObjc);
+	aItems = (ClientData *)attemptckalloc(sizeof(ClientData) * jobObjc);
+
+	if ((aJobs == NULL) || (aErrors == NULL) || (aItems == NULL)) {
+	    Tcl_AppendResult(interp, "out of memory: aJobs\n", NULL);
+	    code = TCL_ERROR;
+	    goto done;
+	}
+
+	memset(aJobs, 0, sizeof(SassCompileJob *) * jobObjc);
+	memset(aErrors, 0, sizeof(Tcl_Obj *) * jobObjc);
+    }
+
+    /*
+     * NOTE: The jobs are prepared by this thread, since that requires the
+     *       Tcl interpreter.  Invalid jobs keep their error messages.
+     */
+
+    for (index = 0; index < jobObjc; index++) {
+	aJobs[index] = PrepareCompileJob(interp, jobObjv[index]);
+
+	if (aJobs[index] == NULL) {
+	    aErrors[index] = Tcl_GetObjResult(interp);
+	    Tcl_IncrRefCount(aErrors[index]);
+	    Tcl_ResetResult(interp);
+	    continue;
+	}
+
+	aItems[nItems++] = aJobs[index];
+    }
+
+    SassPoolRunAll(nThreads, CompileJobWorkProc, aItems, nItems);
 
     listPtr = Tcl_NewListObj(0, NULL);
 
-    if (listPtr == NULL) {
-	Tcl_AppendResult(interp, "out of memory: listPtr\n", NULL);
-	code = TCL_ERROR;
-	goto done;
+    if (listPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: listPtr\n", NULL);
+	code = TCL_ERROR;
+	goto done;
+    }
+
+    Tcl_IncrRefCount(listPtr);
+
+    for (index = 0; index < jobObjc; index++) {
+	if (aJobs[index] != NULL) {
+	    code = SetResultFromCompileJob(interp, aJobs[index]);
+	} else {
+	    SassResult result;
+	    int errorLength;
+
+	    memset(&result, 0, sizeof(SassResult));
+	    result.errorStatus = 1;
+
+	    result.zErrorMessage = Tcl_GetStringFromObj(aErrors[index],
+		&errorLength);
+
+	    result.errorMessageLength = errorLength;
+	    code = SetResultFromSassResult(interp, &result, SASS_RESULT_DICT);
+	}
+
+	if (code != TCL_OK)
+	    goto done;
+
+	code = Tcl_ListObjAppendElement(interp, listPtr,
+	    Tcl_GetObjResult(interp));
+
+	if (code != TCL_OK)
+	    goto done;
+    }
+
+    Tcl_SetObjResult(interp, listPtr);
+
+done:
+    if (listPtr != NULL) {
+	Tcl_DecrRefCount(listPtr);
+	listPtr = NULL;
+    }
+
+    for (index = 0; index < jobObjc; index++) {
+	if ((aJobs != NULL) && (aJobs[index] != NULL))
+	    FreeCompileJob(aJobs[index]);
+
+	if ((aErrors != NULL) && (aErrors[index] != NULL))
+	    Tcl_DecrRefCount(aErrors[index]);
+    }
+
+    if (aItems != NULL)
+	ckfree((char *)aItems);
+
+    if (aErrors != NULL)
+	ckfree((char *)aErrors);
+
+    if (aJobs != NULL)
+	ckfree((char *)aJobs);
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ComparePaths --
+ *
+ *	This function is used with qsort in order to sort an array of
+ *	Tcl objects by their string values.
+ *
+ * Results:
+ *	Negative, zero, or positive, in the same way as strcmp.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ComparePaths(
+    const void *pLeft,			/* IN: The first Tcl object. */
+    const void *pRight)			/* IN: The second Tcl object. */
+{
+    return strcmp(Tcl_GetString(*(Tcl_Obj **)pLeft),
+	Tcl_GetString(*(Tcl_Obj **)pRight));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetPathTail --
+ *
+ *	This function returns the last element of the specified path.
+ *
+ * Results:
+ *	The last element, with its reference count incremented -OR- NULL
+ *	if the path is empty.  The caller must decrement the reference
+ *	count.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *GetPathTail(
+    Tcl_Obj *pathPtr)			/* IN: The path to split. */
+{
+    Tcl_Obj *splitPtr;
+    Tcl_Obj *tailPtr = NULL;
+    int nElements;
+
+    splitPtr = Tcl_FSSplitPath(pathPtr, &nElements);
+
+    if (splitPtr == NULL)
+	return NULL;
+
+    Tcl_IncrRefCount(splitPtr);
+
+    if ((nElements > 0) && (Tcl_ListObjIndex(NULL, splitPtr, nElements - 1,
+	    &tailPtr) == TCL_OK) && (tailPtr != NULL)) {
+	Tcl_IncrRefCount(tailPtr);
+    }
+
+    Tcl_DecrRefCount(splitPtr);
+    return tailPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindFolderEntries --
+ *
+ *	This function searches the specified source folder, recursively,
+ *	for the entry points compiled by [sass compile -type folder], i.e.
+ *	the files ending with ".scss" or ".sass" whose names do not start
+ *	with an underscore.  Files starting with an underscore are partials,
+ *	which are only compiled when imported.  Hidden files and folders,
+ *	along with symbolic links to folders, are ignored.  For each entry
+ *	point, its name relative to the source folder, its source file, and
+ *	its output file are appended to the list.  The output file mirrors
+ *	the layout of the source folder within the output folder, with the
+ *	extension changed to ".css".  The entries are sorted by name within
+ *	each folder.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int FindFolderEntries(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *dirPtr,			/* IN: The source folder to search. */
+    Tcl_Obj *outputDirPtr,		/* IN: The matching output folder. */
+    Tcl_Obj *prefixPtr,			/* IN: Name of source folder, or NULL. */
+    Tcl_Obj *listPtr)			/* IN/OUT: The entry points found. */
+{
+    int code = TCL_ERROR;
+    Tcl_GlobTypeData types;
+    Tcl_Obj *filesPtr;
+    Tcl_Obj *dirsPtr;
+    int objc;
+    Tcl_Obj **objv;
+    int index;
+
+    filesPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(filesPtr);
+    dirsPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(dirsPtr);
+
+    memset(&types, 0, sizeof(Tcl_GlobTypeData));
+    types.type = TCL_GLOB_TYPE_FILE;
+
+    if (Tcl_FSMatchInDirectory(interp, filesPtr, dirPtr, "*",
+	    &types) != TCL_OK) {
+	goto done;
+    }
+
+    types.type = TCL_GLOB_TYPE_DIR;
+
+    if (Tcl_FSMatchInDirectory(interp, dirsPtr, dirPtr, "*",
+	    &types) != TCL_OK) {
+	goto done;
+    }
+
+    /*
+     * NOTE: Both lists are private to this function; therefore, their
+     *       elements may be sorted in place.
+     */
+
+    if (Tcl_ListObjGetElements(interp, filesPtr, &objc, &objv) != TCL_OK)
+	goto done;
+
+    qsort(objv, objc, sizeof(Tcl_Obj *), ComparePaths);
+
+    for (index = 0; index < objc; index++) {
+	Tcl_Obj *tailPtr = GetPathTail(objv[index]);
+	Tcl_Obj *namePtr;
+	Tcl_Obj *cssPtr;
+	int tailLength;
+	char *zTail;
+
+	if (tailPtr == NULL)
+	    continue;
+
+	zTail = Tcl_GetStringFromObj(tailPtr, &tailLength);
+
+	if ((zTail[0] == '_') || (tailLength <= 5) ||
+		((strcmp(zTail + tailLength - 5, ".scss") != 0) &&
+		(strcmp(zTail + tailLength - 5, ".sass") != 0))) {
+	    Tcl_DecrRefCount(tailPtr);
+	    continue;
+	}
+
+	if (prefixPtr != NULL) {
+	    namePtr = Tcl_DuplicateObj(prefixPtr);
+	    Tcl_AppendToObj(namePtr, "/", 1);
+	    Tcl_AppendObjToObj(namePtr, tailPtr);
+	} else {
+	    namePtr = Tcl_DuplicateObj(tailPtr);
+	}
+
+	cssPtr = Tcl_NewStringObj(zTail, tailLength - 5);
+	Tcl_AppendToObj(cssPtr, ".css", 4);
+	Tcl_IncrRefCount(cssPtr);
+
+	Tcl_ListObjAppendElement(NULL, listPtr, namePtr);
+	Tcl_ListObjAppendElement(NULL, listPtr, objv[index]);
+
+	Tcl_ListObjAppendElement(NULL, listPtr,
+	    Tcl_FSJoinToPath(outputDirPtr, 1, &cssPtr));
+
+	Tcl_DecrRefCount(cssPtr);
+	Tcl_DecrRefCount(tailPtr);
+    }
+
+    if (Tcl_ListObjGetElements(interp, dirsPtr, &objc, &objv) != TCL_OK)
+	goto done;
+
+    qsort(objv, objc, sizeof(Tcl_Obj *), ComparePaths);
+
+    for (index = 0; index < objc; index++) {
+	Tcl_Obj *tailPtr;
+	Tcl_Obj *namePtr;
+	Tcl_Obj *subDirPtr;
+	int bFailed;
+#ifdef S_ISLNK
+	Tcl_StatBuf statBuf;
+
+	/*
+	 * NOTE: Symbolic links to folders are skipped, because they could
+	 *       create a cycle.
+	 */
+
+	if ((Tcl_FSLstat(objv[index], &statBuf) == 0) &&
+		S_ISLNK(statBuf.st_mode)) {
+	    continue;
+	}
+#endif
+
+	tailPtr = GetPathTail(objv[index]);
+
+	if (tailPtr == NULL)
+	    continue;
+
+	if (prefixPtr != NULL) {
+	    namePtr = Tcl_DuplicateObj(prefixPtr);
+	    Tcl_AppendToObj(namePtr, "/", 1);
+	    Tcl_AppendObjToObj(namePtr, tailPtr);
+	} else {
+	    namePtr = Tcl_DuplicateObj(tailPtr);
+	}
+
+	Tcl_IncrRefCount(namePtr);
+	subDirPtr = Tcl_FSJoinToPath(outputDirPtr, 1, &tailPtr);
+	Tcl_IncrRefCount(subDirPtr);
+
+	bFailed = (FindFolderEntries(interp, objv[index], subDirPtr, namePtr,
+	    listPtr) != TCL_OK);
+
+	Tcl_DecrRefCount(subDirPtr);
+	Tcl_DecrRefCount(namePtr);
+	Tcl_DecrRefCount(tailPtr);
+
+	if (bFailed)
+	    goto done;
+    }
+
+    code = TCL_OK;
+
+done:
+    Tcl_DecrRefCount(dirsPtr);
+    Tcl_DecrRefCount(filesPtr);
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetFileTime --
+ *
+ *	This function queries the modification time of the specified
+ *	file, e.g. one included by a compilation.
+ *
+ * Results:
+ *	Zero on success, non-zero if the file could not be queried.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int GetFileTime(
+    const char *zPath,			/* IN: The file to query. */
+    Tcl_WideInt *secPtr,		/* OUT: Modification time, seconds. */
+    long *nsecPtr)			/* OUT: Nanoseconds portion of above. */
+{
+    struct stat statBuf;
+
+    if (stat(zPath, &statBuf) != 0)
+	return -1;
+
+    *secPtr = (Tcl_WideInt)statBuf.st_mtime;
+    *nsecPtr = STAT_MTIME_NSEC(&statBuf);
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetOutputRecordKey --
+ *
+ *	This function returns the key used for the recorded includes of
+ *	an output file, which is its normalized path, so that it does not
+ *	depend on the current directory.
+ *
+ * Results:
+ *	The key, which is owned by the output file object.
+ *
+ * Side effects:
+ *	The internal representation of the output file object may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *GetOutputRecordKey(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *outputPtr)			/* IN: The output file. */
+{
+    Tcl_Obj *normPtr = Tcl_FSGetNormalizedPath(interp, outputPtr);
+
+    return Tcl_GetString((normPtr != NULL) ? normPtr : outputPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsOutputCurrent --
+ *
+ *	This function checks whether the specified output file, which was
+ *	written by an earlier folder compilation, is still up-to-date.  It
+ *	is when it was compiled using the same options and when it is newer
+ *	than all of the files included by that compilation, including the
+ *	source file itself.  Outputs without recorded includes are never
+ *	up-to-date.
+ *
+ * Results:
+ *	Non-zero if the output file is up-to-date.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int IsOutputCurrent(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassInterpData *dataPtr,		/* IN: The package data. */
+    Tcl_Obj *outputPtr,			/* IN: The output file. */
+    const char *zKey,			/* IN: Options used for compiling. */
+    int keyLength)			/* IN: Length of options key. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_StatBuf statBuf;
+    Tcl_WideInt outputSec;
+    long outputNsec;
+    int objc;
+    Tcl_Obj **objv;
+    int recordKeyLength;
+    unsigned char *zRecordKey;
+    int index;
+
+    hPtr = Tcl_FindHashEntry(&dataPtr->outputs,
+	GetOutputRecordKey(interp, outputPtr));
+
+    if (hPtr == NULL)
+	return 0;
+
+    if ((Tcl_ListObjGetElements(NULL, (Tcl_Obj *)Tcl_GetHashValue(hPtr),
+	    &objc, &objv) != TCL_OK) || (objc < 1)) {
+	return 0;
+    }
+
+    zRecordKey = Tcl_GetByteArrayFromObj(objv[0], &recordKeyLength);
+
+    if ((recordKeyLength != keyLength) ||
+	    (memcmp(zRecordKey, zKey, keyLength) != 0)) {
+	return 0;
+    }
+
+    if (Tcl_FSStat(outputPtr, &statBuf) != 0)
+	return 0;
+
+    outputSec = (Tcl_WideInt)statBuf.st_mtime;
+    outputNsec = STAT_MTIME_NSEC(&statBuf);
+
+    for (index = 1; index < objc; index++) {
+	Tcl_WideInt sec;
+	long nsec;
+
+	if (GetFileTime(Tcl_GetString(objv[index]), &sec, &nsec) != 0)
+	    return 0;
+
+	if ((sec > outputSec) || ((sec == outputSec) && (nsec >= outputNsec)))
+	    return 0;
+    }
+
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RecordOutput --
+ *
+ *	This function records the files included by the compilation that
+ *	produced the specified output file, along with the options used,
+ *	for use by IsOutputCurrent.  If an included file may have been
+ *	modified during the compilation, i.e. its modification time is
+ *	not safely before the start time, or there are no included files,
+ *	nothing is recorded, so that the output is compiled again next
+ *	time.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void RecordOutput(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassInterpData *dataPtr,		/* IN/OUT: The package data. */
+    Tcl_Obj *outputPtr,			/* IN: The output file. */
+    const char *zKey,			/* IN: Options used for compiling. */
+    int keyLength,			/* IN: Length of options key. */
+    char **azIncluded,			/* IN: Files included, or NULL. */
+    const Tcl_Time *startTimePtr)	/* IN: When compilation started. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_Obj *recordPtr = NULL;
+    int bNew;
+    int index;
+
+    hPtr = Tcl_CreateHashEntry(&dataPtr->outputs,
+	GetOutputRecordKey(interp, outputPtr), &bNew);
+
+    if (!bNew)
+	Tcl_DecrRefCount((Tcl_Obj *)Tcl_GetHashValue(hPtr));
+
+    if ((azIncluded == NULL) || (azIncluded[0] == NULL))
+	goto done;
+
+    recordPtr = Tcl_NewListObj(0, NULL);
+
+    Tcl_ListObjAppendElement(NULL, recordPtr,
+	Tcl_NewByteArrayObj((const unsigned char *)zKey, keyLength));
+
+    for (index = 0; azIncluded[index] != NULL; index++) {
+	Tcl_WideInt sec;
+	long nsec;
+
+	if ((GetFileTime(azIncluded[index], &sec, &nsec) != 0) ||
+		SassIsRecentTime(sec, nsec, startTimePtr)) {
+	    Tcl_DecrRefCount(recordPtr);
+	    recordPtr = NULL;
+	    goto done;
+	}
+
+	Tcl_ListObjAppendElement(NULL, recordPtr,
+	    Tcl_NewStringObj(azIncluded[index], -1));
+    }
+
+done:
+    if (recordPtr != NULL) {
+	Tcl_IncrRefCount(recordPtr);
+	Tcl_SetHashValue(hPtr, (ClientData)recordPtr);
+    } else {
+	Tcl_DeleteHashEntry(hPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CreateParentDirectory --
+ *
+ *	This function creates the folder containing the specified output
+ *	file, along with any missing folders above it.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Folders may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CreateParentDirectory(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *pathPtr)			/* IN: The output file. */
+{
+    int code = TCL_OK;
+    Tcl_Obj *splitPtr;
+    Tcl_StatBuf statBuf;
+    int nElements;
+    int index;
+
+    splitPtr = Tcl_FSSplitPath(pathPtr, &nElements);
+
+    if ((splitPtr == NULL) || (nElements < 2))
+	return TCL_OK;
+
+    Tcl_IncrRefCount(splitPtr);
+
+    for (index = nElements - 1; index > 0; index--) {
+	Tcl_Obj *dirPtr = Tcl_FSJoinPath(splitPtr, index);
+	int bExists;
+
+	Tcl_IncrRefCount(dirPtr);
+	bExists = (Tcl_FSStat(dirPtr, &statBuf) == 0);
+	Tcl_DecrRefCount(dirPtr);
+
+	if (bExists)
+	    break;
+    }
+
+    /*
+     * NOTE: The first missing folder, if any, is right below the deepest
+     *       one that exists.
+     */
+
+    for (index++; index < nElements; index++) {
+	Tcl_Obj *dirPtr = Tcl_FSJoinPath(splitPtr, index);
+
+	Tcl_IncrRefCount(dirPtr);
+
+	if ((Tcl_FSCreateDirectory(dirPtr) != TCL_OK) &&
+		(Tcl_GetErrno() != EEXIST)) {
+	    Tcl_AppendResult(interp, "error creating \"",
+		Tcl_GetString(dirPtr), "\": ", Tcl_PosixError(interp),
+		"\n", NULL);
+
+	    code = TCL_ERROR;
+	}
+
+	Tcl_DecrRefCount(dirPtr);
+
+	if (code != TCL_OK)
+	    break;
+    }
+
+    Tcl_DecrRefCount(splitPtr);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrepareFileJob --
+ *
+ *	This function creates a job for compiling one source file, as a
+ *	file context, e.g. an entry point found by [sass compile -type
+ *	folder].  The options are processed again for each job, since
+ *	every job needs its own Sass_Options struct; however, the option
+ *	dictionaries are cached by their Tcl objects.  The output file,
+ *	if any, is also given to libsass, so that it can refer to the
+ *	source map, which is named after the output file when the
+ *	"source_map_file" option is set.
+ *
+ * Results:
+ *	The new job -OR- NULL if it could not be created, in which case
+ *	the Tcl interpreter result contains the reason.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCompileJob *PrepareFileJob(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[],		/* The array of arguments. */
+    int index,				/* IN: 1st option argument. */
+    Tcl_Obj *sourcePtr,			/* IN: The source file. */
+    Tcl_Obj *outputPtr)			/* IN: The output file, or NULL. */
+{
+    SassCompileJob *jobPtr = NULL;
+    SassCompileSettings settings;
+    struct Sass_Options *optsPtr = NULL;
+    int sourceLength;
+    char *zSource;
+    const char *zSourceMapFile;
+
+    memset(&settings, 0, sizeof(SassCompileSettings));
+    settings.type = SASS_CONTEXT_NULL;
+    Tcl_DStringInit(&settings.key);
+
+    optsPtr = sass_make_options();
+
+    if (optsPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: optsPtr\n", NULL);
+	goto done;
+    }
+
+    if (ProcessContextOptions(interp, objc, objv, &index, &settings,
+	    optsPtr) != TCL_OK) {
+	goto done;
+    }
+
+    zSource = Tcl_GetStringFromObj(sourcePtr, &sourceLength);
+
+    sass_option_set_input_path(optsPtr, zSource);
+
+    if (outputPtr != NULL)
+	sass_option_set_output_path(optsPtr, Tcl_GetString(outputPtr));
+
+    zSourceMapFile = sass_option_get_source_map_file(optsPtr);
+
+    if ((outputPtr != NULL) && (zSourceMapFile != NULL) &&
+	    (zSourceMapFile[0] != '\0')) {
+	Tcl_Obj *mapPtr = Tcl_DuplicateObj(outputPtr);
+
+	Tcl_IncrRefCount(mapPtr);
+	Tcl_AppendToObj(mapPtr, ".map", 4);
+	sass_option_set_source_map_file(optsPtr, Tcl_GetString(mapPtr));
+	Tcl_DecrRefCount(mapPtr);
+    }
+
+    settings.funcsPtr = SassFuncBind(interp, optsPtr, 1, &settings.key);
+
+    jobPtr = NewCompileJob(interp, SASS_CONTEXT_FILE, &optsPtr, zSource,
+	sourceLength, NULL, 0);
+
+    if (jobPtr != NULL) {
+	jobPtr->funcsPtr = settings.funcsPtr;
+	settings.funcsPtr = NULL;
+	jobPtr->varsPtr = settings.varsPtr;
+	settings.varsPtr = NULL;
+    }
+
+done:
+    Tcl_DStringFree(&settings.key);
+    DeleteOptions(optsPtr);
+    SassFsDelete(settings.fsPtr);
+    SassFuncUnbind(settings.funcsPtr);
+    SassVarsRelease(settings.varsPtr);
+
+    return jobPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileFolder --
+ *
+ *	This function handles the [sass compile] sub-command when the
+ *	-type option is "folder".  It finds all the entry points within
+ *	the source folder, skips the ones whose output files are still
+ *	up-to-date, and then compiles the rest concurrently, using the
+ *	threads of a batch, in the same way as [sass compileBatch].  The
+ *	output files, and source maps, are written by this thread, with
+ *	the output folder mirroring the layout of the source folder.  The
+ *	result is a dictionary with the names of the entry points, relative
+ *	to the source folder, that were compiled or skipped, and the names
+ *	and error messages of the ones that failed.
+ *
+ * Results:
+ *	A standard Tcl result.  A failed compilation is not an error.
+ *
+ * Side effects:
+ *	Output files and folders may be created.  Worker threads may be
+ *	created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CompileFolder(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[],		/* The array of arguments. */
+    SassCompileSettings *settingsPtr,	/* IN/OUT: The package settings. */
+    struct Sass_Options *optsPtr,	/* IN/OUT: The context options. */
+    Tcl_Obj *sourceDirPtr)		/* IN: The source folder. */
+{
+    int code = TCL_ERROR;
+    SassInterpData *dataPtr;
+    Tcl_StatBuf statBuf;
+    Tcl_Obj *entriesPtr = NULL;
+    int entryObjc;
+    Tcl_Obj **entryObjv;
+    int nEntries = 0;
+    SassCompileJob **aJobs = NULL;
+    ClientData *aItems = NULL;
+    int nItems = 0;
+    Tcl_Obj *compiledPtr = NULL;
+    Tcl_Obj *skippedPtr = NULL;
+    Tcl_Obj *failedPtr = NULL;
+    Tcl_Obj *resultPtr;
+    Tcl_Time startTime;
+    const char *zKey;
+    int keyLength;
+    int index;
+
+    if (settingsPtr->outputDirPtr == NULL) {
+	Tcl_AppendResult(interp,
+	    "option -outputDir is required with -type folder\n", NULL);
+
+	return TCL_ERROR;
     }
 
-    Tcl_IncrRefCount(listPtr);
-    objPtr = Tcl_NewStringObj("errorStatus", -1);
+    if (settingsPtr->commandPtr != NULL) {
+	Tcl_AppendResult(interp,
+	    "option -command cannot be used with -type folder\n", NULL);
 
-    if (objPtr == NULL) {
-	Tcl_AppendResult(interp, "out of memory: errorStatus1\n", NULL);
-	code = TCL_ERROR;
-	goto done;
+	return TCL_ERROR;
     }
 
-    Tcl_IncrRefCount(objPtr);
-    code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-    Tcl_DecrRefCount(objPtr);
+    if (settingsPtr->bCache) {
+	Tcl_AppendResult(interp,
+	    "option -cache cannot be used with -type folder\n", NULL);
 
-    if (code != TCL_OK)
-	goto done;
+	return TCL_ERROR;
+    }
 
-    rc = sass_context_get_error_status(ctxPtr);
-    objPtr = Tcl_NewIntObj(rc);
+    if (settingsPtr->bProfile) {
+	Tcl_AppendResult(interp,
+	    "option -profile cannot be used with -type folder\n", NULL);
 
-    if (objPtr == NULL) {
-	Tcl_AppendResult(interp, "out of memory: errorStatus2\n", NULL);
-	code = TCL_ERROR;
-	goto done;
+	return TCL_ERROR;
     }
 
-    Tcl_IncrRefCount(objPtr);
-    code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-    Tcl_DecrRefCount(objPtr);
+    if (settingsPtr->resultType != SASS_RESULT_DICT) {
+	Tcl_AppendResult(interp,
+	    "option -result cannot be used with -type folder\n", NULL);
 
-    if (code != TCL_OK)
+	return TCL_ERROR;
+    }
+
+    if ((settingsPtr->outputChannel != NULL) ||
+	    (settingsPtr->outputFilePtr != NULL)) {
+	Tcl_AppendResult(interp,
+	    "options -outputChannel and -outputFile cannot be used with "
+	    "-type folder\n", NULL);
+
+	return TCL_ERROR;
+    }
+
+    if (settingsPtr->bTclVfs) {
+	Tcl_AppendResult(interp,
+	    "option tcl_vfs cannot be used with -type folder\n", NULL);
+
+	return TCL_ERROR;
+    }
+
+    if ((Tcl_FSStat(sourceDirPtr, &statBuf) != 0) ||
+	    !S_ISDIR(statBuf.st_mode)) {
+	Tcl_AppendResult(interp, "source folder \"",
+	    Tcl_GetString(sourceDirPtr), "\" is not a directory\n", NULL);
+
+	return TCL_ERROR;
+    }
+
+    /*
+     * NOTE: The recorded includes are only used when the options, i.e. the
+     *       option dictionaries, variables, and versions of the functions,
+     *       have not changed.
+     */
+
+    settingsPtr->funcsPtr = SassFuncBind(interp, optsPtr, 1,
+	&settingsPtr->key);
+
+    zKey = Tcl_DStringValue(&settingsPtr->key);
+    keyLength = Tcl_DStringLength(&settingsPtr->key);
+    dataPtr = GetInterpData(interp, 1);
+
+    entriesPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(entriesPtr);
+
+    if (FindFolderEntries(interp, sourceDirPtr, settingsPtr->outputDirPtr,
+	    NULL, entriesPtr) != TCL_OK) {
+	goto done;
+    }
+
+    if (Tcl_ListObjGetElements(interp, entriesPtr, &entryObjc,
+	    &entryObjv) != TCL_OK) {
 	goto done;
+    }
 
-    if (rc == 0) {
-	objPtr = Tcl_NewStringObj("outputString", -1);
+    nEntries = entryObjc / 3;
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: outputString1\n", NULL);
-	    code = TCL_ERROR;
+    if (nEntries > 0) {
+	aJobs = (SassCompileJob **)attemptckalloc(
+	    sizeof(SassCompileJob *) * nEntries);
+
+	aItems = (ClientData *)attemptckalloc(sizeof(ClientData) * nEntries);
+
+	if ((aJobs == NULL) || (aItems == NULL)) {
+	    Tcl_AppendResult(interp, "out of memory: aJobs\n", NULL);
 	    goto done;
 	}
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+	memset(aJobs, 0, sizeof(SassCompileJob *) * nEntries);
+    }
 
-	if (code != TCL_OK)
-	    goto done;
+    compiledPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(compiledPtr);
+    skippedPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(skippedPtr);
+    failedPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(failedPtr);
 
-	objPtr = Tcl_NewStringObj(sass_context_get_output_string(ctxPtr), -1);
+    for (index = 0; index < nEntries; index++) {
+	Tcl_Obj *namePtr = entryObjv[index * 3];
+	Tcl_Obj *sourcePtr = entryObjv[index * 3 + 1];
+	Tcl_Obj *outputPtr = entryObjv[index * 3 + 2];
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: outputString2\n", NULL);
-	    code = TCL_ERROR;
-	    goto done;
+	if (IsOutputCurrent(interp, dataPtr, outputPtr, zKey, keyLength)) {
+	    Tcl_ListObjAppendElement(NULL, skippedPtr, namePtr);
+	    continue;
 	}
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+	aJobs[index] = PrepareFileJob(interp, objc, objv, 2, sourcePtr,
+	    outputPtr);
 
-	if (code != TCL_OK)
+	if (aJobs[index] == NULL)
 	    goto done;
 
-	optsPtr = sass_context_get_options(ctxPtr);
+	aItems[nItems++] = aJobs[index];
+    }
 
-	zSourceMapFile = (optsPtr != NULL) ?
-	    sass_option_get_source_map_file(optsPtr) : NULL;
+    /*
+     * NOTE: The start time is used to detect included files that may have
+     *       been modified during compilation, which are not recorded.
+     */
 
-	if ((zSourceMapFile != NULL) && (strlen(zSourceMapFile) > 0)) {
-	    objPtr = Tcl_NewStringObj("sourceMapString", -1);
+    Tcl_GetTime(&startTime);
+    SassPoolRunAll(0, CompileJobWorkProc, aItems, nItems);
 
-	    if (objPtr == NULL) {
-		Tcl_AppendResult(interp,
-		    "out of memory: sourceMapString1\n", NULL);
+    for (index = 0; index < nEntries; index++) {
+	SassCompileJob *jobPtr = aJobs[index];
+	Tcl_Obj *namePtr = entryObjv[index * 3];
+	Tcl_Obj *outputPtr = entryObjv[index * 3 + 2];
+	Tcl_Obj *errorPtr = NULL;
+	SassResult result;
 
-		code = TCL_ERROR;
-		goto done;
-	    }
+	if (jobPtr == NULL)
+	    continue;
 
-	    Tcl_IncrRefCount(objPtr);
-	    code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	    Tcl_DecrRefCount(objPtr);
+	if (jobPtr->ctxPtr == NULL) {
+	    errorPtr = Tcl_NewStringObj(jobPtr->zError, -1);
+	    goto next;
+	}
 
-	    if (code != TCL_OK)
-		goto done;
+	memcpy(&result, &jobPtr->result, sizeof(SassResult));
 
-	    objPtr = Tcl_NewStringObj(
-		sass_context_get_source_map_string(ctxPtr), -1);
+	if (result.errorStatus != 0) {
+	    errorPtr = Tcl_NewStringObj(result.zErrorMessage,
+		result.errorMessageLength);
 
-	    if (objPtr == NULL) {
-		Tcl_AppendResult(interp,
-		    "out of memory: sourceMapString2\n", NULL);
+	    goto next;
+	}
 
-		code = TCL_ERROR;
-		goto done;
+	if (CreateParentDirectory(interp, outputPtr) == TCL_OK) {
+	    int bWritten = 1;
+
+	    if (result.zSourceMap != NULL) {
+		Tcl_Obj *mapPtr = Tcl_DuplicateObj(outputPtr);
+
+		Tcl_IncrRefCount(mapPtr);
+		Tcl_AppendToObj(mapPtr, ".map", 4);
+
+		bWritten = (SassWriteFile(interp, mapPtr, result.zSourceMap,
+		    result.sourceMapLength) == TCL_OK);
+
+		Tcl_DecrRefCount(mapPtr);
 	    }
 
-	    Tcl_IncrRefCount(objPtr);
-	    code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	    Tcl_DecrRefCount(objPtr);
+	    if (bWritten && (SassWriteFile(interp, outputPtr,
+		    result.zOutput, result.outputLength) == TCL_OK)) {
+		RecordOutput(interp, dataPtr, outputPtr, zKey, keyLength,
+		    sass_context_get_included_files(jobPtr->ctxPtr),
+		    &startTime);
 
-	    if (code != TCL_OK)
-		goto done;
+		Tcl_ListObjAppendElement(NULL, compiledPtr, namePtr);
+		goto next;
+	    }
 	}
-    } else {
-	objPtr = Tcl_NewStringObj("errorMessage", -1);
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: errorMessage1\n", NULL);
-	    code = TCL_ERROR;
-	    goto done;
+	errorPtr = Tcl_DuplicateObj(Tcl_GetObjResult(interp));
+	Tcl_ResetResult(interp);
+
+    next:
+	if (errorPtr != NULL) {
+	    RecordOutput(interp, dataPtr, outputPtr, zKey, keyLength, NULL,
+		&startTime);
+
+	    Tcl_ListObjAppendElement(NULL, failedPtr, namePtr);
+	    Tcl_ListObjAppendElement(NULL, failedPtr, errorPtr);
 	}
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+	/*
+	 * NOTE: The output of each job is no longer needed; free it now, in
+	 *       order to reduce the peak memory use for large folders.
+	 */
+
+	FreeCompileJob(jobPtr);
+	aJobs[index] = NULL;
+    }
+
+    resultPtr = Tcl_NewListObj(0, NULL);
 
-	if (code != TCL_OK)
+    Tcl_ListObjAppendElement(NULL, resultPtr,
+	Tcl_NewStringObj("compiled", -1));
+
+    Tcl_ListObjAppendElement(NULL, resultPtr, compiledPtr);
+
+    Tcl_ListObjAppendElement(NULL, resultPtr,
+	Tcl_NewStringObj("skipped", -1));
+
+    Tcl_ListObjAppendElement(NULL, resultPtr, skippedPtr);
+
+    Tcl_ListObjAppendElement(NULL, resultPtr,
+	Tcl_NewStringObj("failed", -1));
+
+    Tcl_ListObjAppendElement(NULL, resultPtr, failedPtr);
+    Tcl_SetObjResult(interp, resultPtr);
+
+    code = TCL_OK;
+
+done:
+    for (index = 0; index < nEntries; index++) {
+	if ((aJobs != NULL) && (aJobs[index] != NULL))
+	    FreeCompileJob(aJobs[index]);
+    }
+
+    if (failedPtr != NULL)
+	Tcl_DecrRefCount(failedPtr);
+
+    if (skippedPtr != NULL)
+	Tcl_DecrRefCount(skippedPtr);
+
+    if (compiledPtr != NULL)
+	Tcl_DecrRefCount(compiledPtr);
+
+    if (aItems != NULL)
+	ckfree((char *)aItems);
+
+    if (aJobs != NULL)
+	ckfree((char *)aJobs);
+
+    if (entriesPtr != NULL)
+	Tcl_DecrRefCount(entriesPtr);
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassCompileFiles --
+ *
+ *	This function compiles the specified source files concurrently,
+ *	as file contexts, using the threads of a batch, in the same way
+ *	as [sass compile -type folder], except that nothing is written.
+ *	It is used by [sass watch] and [sass deps index].  The arguments
+ *	are the same options accepted by [sass compile], without the
+ *	source, except -cache, -command, -result, -outputChannel,
+ *	-outputFile, -outputDir, and -type folder.  When there are no
+ *	files, the options are only validated.  For each file, the result
+ *	dictionary is the same as for [sass compile].  The included files
+ *	are only available for successful compilations; they are absolute
+ *	paths, which include the source file itself.
+ *
+ * Results:
+ *	A standard Tcl result.  A failed compilation is not an error.
+ *	Upon success, the results and lists of included files, if any,
+ *	have their reference counts incremented; the caller must
+ *	decrement them.
+ *
+ * Side effects:
+ *	Worker threads may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassCompileFiles(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of option arguments. */
+    Tcl_Obj *CONST objv[],		/* The array of option arguments. */
+    int nFiles,				/* Number of source files. */
+    Tcl_Obj *CONST apFiles[],		/* IN: The source files. */
+    Tcl_Obj **apResults,		/* OUT: The result dictionaries. */
+    Tcl_Obj **apIncluded)		/* OUT: The included files, or NULL. */
+{
+    int code = TCL_ERROR;
+    SassCompileSettings settings;
+    struct Sass_Options *optsPtr = NULL;
+    Tcl_Obj **argv = NULL;
+    SassCompileJob **aJobs = NULL;
+    ClientData *aItems = NULL;
+    int argc = objc + 1;
+    int index = 0;
+
+    memset(&settings, 0, sizeof(SassCompileSettings));
+    settings.type = SASS_CONTEXT_NULL;
+    Tcl_DStringInit(&settings.key);
+
+    /*
+     * NOTE: The options are followed by each source file in turn, so that
+     *       they are processed in the same way as for [sass compile].  The
+     *       first file, if any, is used while validating them.
+     */
+
+    argv = (Tcl_Obj **)attemptckalloc(sizeof(Tcl_Obj *) * argc);
+    aJobs = (SassCompileJob **)attemptckalloc(
+	sizeof(SassCompileJob *) * (nFiles + 1));
+    aItems = (ClientData *)attemptckalloc(sizeof(ClientData) * (nFiles + 1));
+
+    if (argv != NULL)
+	argv[objc] = NULL;
+
+    if ((argv == NULL) || (aJobs == NULL) || (aItems == NULL)) {
+	Tcl_AppendResult(interp, "out of memory: argv\n", NULL);
+	goto done;
+    }
+
+    if (objc > 0)
+	memcpy(argv, objv, sizeof(Tcl_Obj *) * objc);
+
+    argv[objc] = (nFiles > 0) ? apFiles[0] : Tcl_NewObj();
+    Tcl_IncrRefCount(argv[objc]);
+
+    memset(aJobs, 0, sizeof(SassCompileJob *) * (nFiles + 1));
+
+    optsPtr = sass_make_options();
+
+    if (optsPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: optsPtr\n", NULL);
+	goto done;
+    }
+
+    if (ProcessContextOptions(interp, argc, argv, &index, &settings,
+	    optsPtr) != TCL_OK) {
+	goto done;
+    }
+
+    if (index != objc) {
+	Tcl_AppendResult(interp, "malformed options\n", NULL);
+	goto done;
+    }
+
+    if ((settings.type == SASS_CONTEXT_FOLDER) ||
+	    (settings.outputDirPtr != NULL)) {
+	Tcl_AppendResult(interp,
+	    "options -type folder and -outputDir are not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if ((settings.commandPtr != NULL) || settings.bCache) {
+	Tcl_AppendResult(interp,
+	    "options -cache and -command are not supported here\n", NULL);
+
+	goto done;
+    }
+
+    if (settings.bProfile) {
+	Tcl_AppendResult(interp, "option -profile is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.resultType != SASS_RESULT_DICT) {
+	Tcl_AppendResult(interp, "option -result is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if ((settings.outputChannel != NULL) ||
+	    (settings.outputFilePtr != NULL)) {
+	Tcl_AppendResult(interp,
+	    "options -outputChannel and -outputFile are not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    if (settings.bTclVfs) {
+	Tcl_AppendResult(interp, "option tcl_vfs is not supported here\n",
+	    NULL);
+
+	goto done;
+    }
+
+    for (index = 0; index < nFiles; index++) {
+	Tcl_DecrRefCount(argv[objc]);
+	argv[objc] = apFiles[index];
+	Tcl_IncrRefCount(argv[objc]);
+
+	aJobs[index] = PrepareFileJob(interp, argc, argv, 0, apFiles[index],
+	    NULL);
+
+	if (aJobs[index] == NULL)
 	    goto done;
 
-	objPtr = Tcl_NewStringObj(sass_context_get_error_message(ctxPtr), -1);
+	aItems[index] = aJobs[index];
+    }
+
+    SassPoolRunAll(0, CompileJobWorkProc, aItems, nFiles);
+
+    for (index = 0; index < nFiles; index++) {
+	SassCompileJob *jobPtr = aJobs[index];
+	SassResult result;
+
+	apResults[index] = NULL;
+	apIncluded[index] = NULL;
+
+	if (SetResultFromCompileJob(interp, jobPtr) != TCL_OK) {
+	    while (index-- > 0) {
+		Tcl_DecrRefCount(apResults[index]);
+
+		if (apIncluded[index] != NULL)
+		    Tcl_DecrRefCount(apIncluded[index]);
+	    }
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: errorMessage2\n", NULL);
-	    code = TCL_ERROR;
 	    goto done;
 	}
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+	apResults[index] = Tcl_GetObjResult(interp);
+	Tcl_IncrRefCount(apResults[index]);
+	Tcl_ResetResult(interp);
+
+	if (jobPtr->ctxPtr == NULL)
+	    continue;
+
+	memcpy(&result, &jobPtr->result, sizeof(SassResult));
+
+	if (result.errorStatus == 0) {
+	    apIncluded[index] = GetIncludedFiles(jobPtr->ctxPtr);
+	    Tcl_IncrRefCount(apIncluded[index]);
+	}
+    }
+
+    code = TCL_OK;
+
+done:
+    if (aJobs != NULL) {
+	for (index = 0; index < nFiles; index++) {
+	    if (aJobs[index] != NULL)
+		FreeCompileJob(aJobs[index]);
+	}
+
+	ckfree((char *)aJobs);
+    }
+
+    if (aItems != NULL)
+	ckfree((char *)aItems);
+
+    if (argv != NULL) {
+	if (argv[objc] != NULL)
+	    Tcl_DecrRefCount(argv[objc]);
+
+	ckfree((char *)argv);
+    }
+
+    Tcl_DStringFree(&settings.key);
+    DeleteOptions(optsPtr);
+    SassFsDelete(settings.fsPtr);
+    SassFuncUnbind(settings.funcsPtr);
+    SassVarsRelease(settings.varsPtr);
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassParseIncludes --
+ *
+ *	Handles the [sass deps source] sub-command, which parses the
+ *	source in the same way as [sass parse] and returns the list of
+ *	files it includes.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The custom importers may be called.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassParseIncludes(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[])		/* The array of arguments. */
+{
+    return ParseCompiler(interp, objc, objv, 3, SASS_PARSE_DEPS);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Sass_CompileEx --
+ *
+ *	This function compiles the specified source, in the same way as
+ *	the synchronous [sass compile] sub-command, without using any Tcl
+ *	commands.  The options dictionary is the same as the value of the
+ *	-options option; its validated form is cached within the Tcl
+ *	object, so using the same object again does not parse it again.
+ *	The custom functions registered for the Tcl interpreter are used,
+ *	along with the ones implemented in C.  The "tcl_vfs" option is not
+ *	supported.  If the source length is negative, the source must be
+ *	NUL terminated.
+ *
+ * Results:
+ *	A standard Tcl result.  A failed compilation is not an error;
+ *	it is reported via the result struct, which must be freed via
+ *	Sass_FreeResult.  If an error is returned, the Tcl interpreter
+ *	result contains the reason and the result struct need not be
+ *	freed.
+ *
+ * Side effects:
+ *	The internal representation of the options object may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int Sass_CompileEx(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int type,				/* IN: SASS_COMPILE_TYPE_* value. */
+    const char *zSource,		/* IN: The source string or file. */
+    int sourceLength,			/* IN: Length of source, or -1. */
+    Tcl_Obj *optionsPtr,		/* IN: Options dictionary, or NULL. */
+    int flags,				/* IN: SASS_COMPILE_* flags. */
+    Sass_CompileResult *resultPtr)	/* OUT: The compilation result. */
+{
+    int code = TCL_ERROR;
+    SassCompileSettings settings;
+    struct Sass_Options *optsPtr = NULL;
+    SassCompileJob *jobPtr;
+    const char *zKey;
+    SassResult result;
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("Sass_CompileEx: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (resultPtr == NULL) {
+	Tcl_AppendResult(interp, "no result pointer\n", NULL);
+	return TCL_ERROR;
+    }
+
+    memset(resultPtr, 0, sizeof(Sass_CompileResult));
+
+    if (zSource == NULL) {
+	Tcl_AppendResult(interp, "no source\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if ((type != SASS_COMPILE_TYPE_FILE) &&
+	    (type != SASS_COMPILE_TYPE_DATA)) {
+	char buffer[50] = {0};
+
+	snprintf(buffer, sizeof(buffer) - 1,
+	    "cannot compile, unsupported type %d\n", type);
+
+	Tcl_AppendResult(interp, buffer, NULL);
+	return TCL_ERROR;
+    }
 
-	if (code != TCL_OK)
-	    goto done;
+    if (sourceLength < 0)
+	sourceLength = (int)strlen(zSource);
 
-	objPtr = Tcl_NewStringObj("errorLine", -1);
+    memset(&settings, 0, sizeof(SassCompileSettings));
+    settings.type = (enum Sass_Context_Type)type;
+    settings.bCache = (flags & SASS_COMPILE_CACHE) ? 1 : 0;
+    Tcl_DStringInit(&settings.key);
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: errorLine1\n", NULL);
-	    code = TCL_ERROR;
-	    goto done;
-	}
+    optsPtr = sass_make_options();
+
+    if (optsPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: optsPtr\n", NULL);
+	goto done;
+    }
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+    if (optionsPtr != NULL) {
+	SassOptionSet *setPtr = GetOptionSetFromDictObj(interp, optionsPtr);
 
-	if (code != TCL_OK)
+	if (setPtr == NULL)
 	    goto done;
 
-	objPtr = Tcl_NewWideIntObj(sass_context_get_error_line(ctxPtr));
+	ApplyOptionSet(setPtr, optsPtr, &settings);
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: errorLine2\n", NULL);
-	    code = TCL_ERROR;
-	    goto done;
-	}
+	Tcl_DStringAppend(&settings.key, setPtr->zKey, setPtr->keyLength);
+    }
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+    if (settings.bTclVfs) {
+	Tcl_AppendResult(interp, "option tcl_vfs is not supported here\n",
+	    NULL);
 
-	if (code != TCL_OK)
-	    goto done;
+	goto done;
+    }
 
-	objPtr = Tcl_NewStringObj("errorColumn", -1);
+    SetContextImporters(optsPtr, &settings);
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: errorColumn1\n", NULL);
-	    code = TCL_ERROR;
-	    goto done;
-	}
+    settings.funcsPtr = SassFuncBind(interp, optsPtr, 0, &settings.key);
+    zKey = GetCacheKey(interp, &settings, zSource, sourceLength);
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+    /*
+     * NOTE: The job is compiled right here, by the calling thread, and then
+     *       kept by the result struct, since it owns the result strings.
+     */
 
-	if (code != TCL_OK)
-	    goto done;
+    jobPtr = NewCompileJob(interp, settings.type, &optsPtr, zSource,
+	sourceLength, zKey, Tcl_DStringLength(&settings.key));
 
-	objPtr = Tcl_NewWideIntObj(sass_context_get_error_column(ctxPtr));
+    if (jobPtr == NULL)
+	goto done;
 
-	if (objPtr == NULL) {
-	    Tcl_AppendResult(interp, "out of memory: errorColumn2\n", NULL);
-	    code = TCL_ERROR;
-	    goto done;
-	}
+    jobPtr->funcsPtr = settings.funcsPtr;
+    settings.funcsPtr = NULL;
 
-	Tcl_IncrRefCount(objPtr);
-	code = Tcl_ListObjAppendElement(interp, listPtr, objPtr);
-	Tcl_DecrRefCount(objPtr);
+    CompileJobWorkProc(jobPtr);
 
-	if (code != TCL_OK)
-	    goto done;
+    if (jobPtr->entryPtr != NULL) {
+	memcpy(&result, SassCacheGetResult(jobPtr->entryPtr),
+	    sizeof(SassResult));
+    } else if (jobPtr->ctxPtr != NULL) {
+	memcpy(&result, &jobPtr->result, sizeof(SassResult));
+    } else {
+	Tcl_AppendResult(interp, jobPtr->zError, NULL);
+	FreeCompileJob(jobPtr);
+	goto done;
     }
 
-    Tcl_SetObjResult(interp, listPtr);
+    resultPtr->errorStatus = result.errorStatus;
+    resultPtr->zOutput = result.zOutput;
+    resultPtr->outputLength = result.outputLength;
+    resultPtr->zSourceMap = result.zSourceMap;
+    resultPtr->sourceMapLength = result.sourceMapLength;
+    resultPtr->zErrorMessage = result.zErrorMessage;
+    resultPtr->errorMessageLength = result.errorMessageLength;
+    resultPtr->errorLine = result.errorLine;
+    resultPtr->errorColumn = result.errorColumn;
+    resultPtr->internalPtr = jobPtr;
+
+    code = TCL_OK;
 
 done:
-    if (listPtr != NULL) {
-	Tcl_DecrRefCount(listPtr);
-	listPtr = NULL;
-    }
+    Tcl_DStringFree(&settings.key);
+    DeleteOptions(optsPtr);
+    SassFuncUnbind(settings.funcsPtr);
 
     return code;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * CompileForType --
+ * Sass_FreeResult --
  *
- *	This function attempts to create a Sass_Context based on the
- *	specified Sass_Context_Type, compile it, and then set the Tcl
- *	interpreter result based on its output.  A script error will
- *	be generated if the context type is unsupported -OR- context
- *	creation fails -OR- context compilation fails.
+ *	This function frees the result of the Sass_CompileEx function.
+ *	Freeing it again is a harmless no-op.
  *
  * Results:
- *	A standard Tcl result.
+ *	None.
  *
  * Side effects:
  *	None.
@@ -926,92 +5564,69 @@ done:
  *----------------------------------------------------------------------
  */
 
-static int CompileForType(
-    Tcl_Interp *interp,
-    enum Sass_Context_Type type,
-    struct Sass_Options **pOptsPtr,
-    const char* zSource)
+void Sass_FreeResult(
+    Sass_CompileResult *resultPtr)	/* IN: The result to free. */
 {
-    if (interp == NULL) {
-	PACKAGE_TRACE(("CompileForType: no Tcl interpreter\n"));
-	return TCL_ERROR;
-    }
-
-    if (pOptsPtr == NULL) {
-	Tcl_AppendResult(interp, "no options pointer\n", NULL);
-	return TCL_ERROR;
-    }
-
-    if (zSource == NULL) {
-	Tcl_AppendResult(interp, "no source\n", NULL);
-	return TCL_ERROR;
-    }
-
-    switch (type) {
-	case SASS_CONTEXT_FILE: {
-	    struct Sass_File_Context *ctxPtr;
-
-	    ctxPtr = sass_make_file_context(zSource);
-
-	    if (ctxPtr == NULL) {
-		Tcl_AppendResult(interp, "out of memory: ctxPtr\n", NULL);
-		return TCL_ERROR;
-	    }
-
-	    if (*pOptsPtr != NULL) {
-		sass_file_context_set_options(ctxPtr, *pOptsPtr);
-		*pOptsPtr = NULL;
-	    }
-
-	    sass_compile_file_context(ctxPtr);
-	    SetResultFromContext(interp, (struct Sass_Context *)ctxPtr);
-	    sass_delete_file_context(ctxPtr);
-
-	    return TCL_OK;
-	}
-	case SASS_CONTEXT_DATA: {
-	    struct Sass_Data_Context *ctxPtr;
-	    char *zDup = strdup(zSource);
-
-	    if (zDup == NULL) {
-		Tcl_AppendResult(interp, "out of memory: zDup\n", NULL);
-		return TCL_ERROR;
-	    }
-
-	    ctxPtr = sass_make_data_context(zDup);
+    if (resultPtr == NULL)
+	return;
 
-	    if (ctxPtr == NULL) {
-		free(zDup);
-		Tcl_AppendResult(interp, "out of memory: ctxPtr\n", NULL);
-		return TCL_ERROR;
-	    }
+    if (resultPtr->internalPtr != NULL)
+	FreeCompileJob((SassCompileJob *)resultPtr->internalPtr);
 
-	    if (*pOptsPtr != NULL) {
-		sass_data_context_set_options(ctxPtr, *pOptsPtr);
-		*pOptsPtr = NULL;
-	    }
+    memset(resultPtr, 0, sizeof(Sass_CompileResult));
+}
 
-	    sass_compile_data_context(ctxPtr);
-	    SetResultFromContext(interp, (struct Sass_Context *)ctxPtr);
-	    sass_delete_data_context(ctxPtr);
-#ifdef TCLSASS_CALLER_FREE
-	    free(zDup);
-#endif
+/*
+ *----------------------------------------------------------------------
+ *
+ * Sass_RegisterFunction --
+ *
+ *	This function registers a custom Sass function implemented in C,
+ *	which is available to all compilations in the process, including
+ *	those performed by the worker threads; therefore, it must be
+ *	thread-safe.  Any existing function implemented in C with the same
+ *	name is replaced.  Functions implemented in Tcl take precedence.
+ *
+ * Results:
+ *	Zero on success, non-zero on failure.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	    return TCL_OK;
-	}
-	default: {
-	    char buffer[50] = {0};
+int Sass_RegisterFunction(
+    const char *zSignature,		/* IN: The Sass signature. */
+    Sass_FunctionProc *xProc,		/* IN: The implementation. */
+    void *clientData)			/* IN: Passed to xProc. */
+{
+    return SassFuncRegister(zSignature, xProc, clientData);
+}
 
-	    snprintf(buffer, sizeof(buffer) - 1,
-		"cannot compile, unsupported type %d\n", type);
+/*
+ *----------------------------------------------------------------------
+ *
+ * Sass_UnregisterFunction --
+ *
+ *	This function unregisters a custom Sass function implemented in C.
+ *	Compilations already in progress may still call it.
+ *
+ * Results:
+ *	Zero if the function was removed, non-zero if it was not found.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	    Tcl_AppendResult(interp, buffer, NULL);
-	    return TCL_ERROR;
-	}
-    }
+int Sass_UnregisterFunction(
+    const char *zName)			/* IN: The function name. */
+{
+    return SassFuncUnregister(zName);
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1081,7 +5696,8 @@ int Sass_Init(
      * NOTE: Finally, attempt to provide this package in the Tcl interpreter.
      */
 
-    code = Tcl_PkgProvide(interp, PACKAGE_NAME, PACKAGE_VERSION);
+    code = Tcl_PkgProvideEx(interp, PACKAGE_NAME, PACKAGE_VERSION,
+	(ClientData)&sassStubs);
 
 done:
     /*
@@ -1110,7 +5726,8 @@ done:
  * Sass_SafeInit --
  *
  *	This function initializes the package for the specified safe
- *	Tcl interpreter.
+ *	Tcl interpreter.  The options and sub-commands that would write
+ *	files chosen by the caller are rejected in a safe interpreter.
  *
  * Results:
  *	A standard Tcl result.
@@ -1151,6 +5768,21 @@ int Sass_Unload(
     int code = TCL_OK;
     int bShutdown = (flags & TCL_UNLOAD_DETACH_FROM_PROCESS);
 
+    /*
+     * NOTE: The library cannot be unloaded from the process while there are
+     *       asynchronous compilations pending, since their completion events
+     *       would call into it.  When the process is exiting, i.e. there is
+     *       no Tcl interpreter, they are discarded by SassPoolFinalize.
+     */
+
+    if (bShutdown && (interp != NULL) && (SassPoolPending() > 0)) {
+	Tcl_AppendResult(interp,
+	    "cannot unload: asynchronous compilations are pending\n", NULL);
+
+	code = TCL_ERROR;
+	goto done;
+    }
+
     /*
      * NOTE: If we have a valid Tcl interpreter, try to get the token for the
      *       command added to it when the package was being loaded.  We need to
@@ -1177,6 +5809,15 @@ int Sass_Unload(
 	 */
 
 	Tcl_DeleteAssocData(interp, PACKAGE_NAME);
+	Tcl_DeleteAssocData(interp, INTERP_DATA_NAME);
+	Tcl_DeleteAssocData(interp, SASS_FUNC_DATA_NAME);
+
+	/*
+	 * NOTE: Deleting the watches cancels them, i.e. their file handlers
+	 *       and timers are removed, since they refer to this library.
+	 */
+
+	Tcl_DeleteAssocData(interp, SASS_WATCH_DATA_NAME);
     }
 
     /*
@@ -1188,19 +5829,25 @@ int Sass_Unload(
      *       trying to delete our exit handler will be a harmless no-op.
      */
 
-    if (bShutdown)
+    if (bShutdown) {
+	SassPoolFinalize();
+	SassFuncFinalize();
+	SassImportFinalize();
+	SassVfsFinalize();
+	SassCacheFinalize();
+	SassShmFinalize();
+	SassTraceFinalize();
 	Tcl_DeleteExitHandler(SassExitProc, NULL);
+    }
 
 done:
     /*
-     * NOTE: If possible, log this attempt to unload the package, including
-     *       the saved package module handle, the associated module file name,
-     *       the current Tcl interpreter, the flags, and the return code.
+     * NOTE: If tracing is enabled, record this attempt to unload the package,
+     *       including the flags and the return code.  When the package is
+     *       being unloaded from the process, tracing was already disabled.
      */
 
-    PACKAGE_TRACE(("Sass_Unload(interp = {"
-	PACKAGE_PTR_FMT "}, flags = {" PACKAGE_HEX_FMT "}, code = {%d})\n",
-	interp, flags, code));
+    SASS_TRACE(SASS_TRACE_UNLOAD, flags, code);
 
     return code;
 }
@@ -1287,15 +5934,20 @@ static int SassObjCmd(
 {
     int code = TCL_OK;
     int option;
-    enum Sass_Context_Type type = SASS_CONTEXT_NULL;
+    SassCompileSettings settings;
     struct Sass_Options *optsPtr = NULL;
 
     static const char *cmdOptions[] = {
-	"compile", "version", (char *) NULL
+	"cache", "check", "compile", "compileBatch", "deps", "discard",
+	"execute", "function", "importcache", "options", "parse", "pool",
+	"stats", "trace", "version", "vfs", "watch", (char *) NULL
     };
 
     enum options {
-	OPT_COMPILE, OPT_VERSION
+	OPT_CACHE, OPT_CHECK, OPT_COMPILE, OPT_COMPILEBATCH, OPT_DEPS,
+	OPT_DISCARD, OPT_EXECUTE, OPT_FUNCTION, OPT_IMPORTCACHE, OPT_OPTIONS,
+	OPT_PARSE, OPT_POOL, OPT_STATS, OPT_TRACE, OPT_VERSION, OPT_VFS,
+	OPT_WATCH
     };
 
     if (interp == NULL) {
@@ -1313,15 +5965,83 @@ static int SassObjCmd(
 	return TCL_ERROR;
     }
 
+    memset(&settings, 0, sizeof(SassCompileSettings));
+    settings.type = SASS_CONTEXT_NULL;
+    Tcl_DStringInit(&settings.key);
+
     switch ((enum options)option) {
+	case OPT_CACHE: {
+	    code = SassCacheObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_CHECK: {
+	    code = ParseCompiler(interp, objc, objv, 2, SASS_PARSE_CHECK);
+	    break;
+	}
+	case OPT_COMPILEBATCH: {
+	    code = CompileBatch(interp, objc, objv);
+	    break;
+	}
+	case OPT_DEPS: {
+	    code = SassDepsObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_DISCARD: {
+	    code = ExecuteCompiler(interp, objc, objv, 1);
+	    break;
+	}
+	case OPT_EXECUTE: {
+	    code = ExecuteCompiler(interp, objc, objv, 0);
+	    break;
+	}
+	case OPT_FUNCTION: {
+	    code = SassFuncObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_IMPORTCACHE: {
+	    code = SassImportObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_OPTIONS: {
+	    code = SassOptionsObjCmd(interp, objc, objv);
+	    break;
+	}
+	case OPT_PARSE: {
+	    code = ParseCompiler(interp, objc, objv, 2, SASS_PARSE_COMPILER);
+	    break;
+	}
+	case OPT_POOL: {
+	    code = SassPoolObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_STATS: {
+	    code = SassStatsObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_TRACE: {
+	    code = SassTraceObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_VFS: {
+	    code = SassVfsObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
+	case OPT_WATCH: {
+	    code = SassWatchObjCmd(clientData, interp, objc, objv);
+	    break;
+	}
 	case OPT_COMPILE: {
 	    int index = 2; /* NOTE: Start right after "sass compile". */
+	    int sourceLength;
+	    char *zSource;
+	    const char *zKey;
 
 	    if (objc < 3) {
 		Tcl_WrongNumArgs(interp, 2, objv, "?options? source");
 		return TCL_ERROR;
 	    }
 
+	    StartProfile(&settings.profile);
 	    optsPtr = sass_make_options();
 
 	    if (optsPtr == NULL) {
@@ -1330,7 +6050,7 @@ static int SassObjCmd(
 		goto done;
 	    }
 
-	    code = ProcessContextOptions(interp, objc, objv, &index, &type,
+	    code = ProcessContextOptions(interp, objc, objv, &index, &settings,
 		optsPtr);
 
 	    if (code != TCL_OK)
@@ -1342,8 +6062,149 @@ static int SassObjCmd(
 		goto done;
 	    }
 
-	    code = CompileForType(interp, type, &optsPtr,
-		Tcl_GetString(objv[index]));
+	    if (settings.bProfile) {
+		if (settings.commandPtr != NULL) {
+		    Tcl_AppendResult(interp,
+			"option -profile cannot be used with -command\n",
+			NULL);
+
+		    code = TCL_ERROR;
+		    goto done;
+		}
+
+		if (settings.resultType != SASS_RESULT_DICT) {
+		    Tcl_AppendResult(interp,
+			"option -profile cannot be used with -result\n",
+			NULL);
+
+		    code = TCL_ERROR;
+		    goto done;
+		}
+
+		MarkProfile(&settings.profile, SASS_PROFILE_OPTIONS);
+	    }
+
+	    if ((settings.outputChannel != NULL) &&
+		    (settings.outputFilePtr != NULL)) {
+		Tcl_AppendResult(interp,
+		    "options -outputChannel and -outputFile cannot be used "
+		    "together\n", NULL);
+
+		code = TCL_ERROR;
+		goto done;
+	    }
+
+	    if (settings.type == SASS_CONTEXT_FOLDER) {
+		code = CompileFolder(interp, objc, objv, &settings, optsPtr,
+		    objv[index]);
+
+		break;
+	    }
+
+	    if (settings.outputDirPtr != NULL) {
+		Tcl_AppendResult(interp,
+		    "option -outputDir requires -type folder\n", NULL);
+
+		code = TCL_ERROR;
+		goto done;
+	    }
+
+	    if (settings.commandPtr != NULL) {
+		if (settings.resultType != SASS_RESULT_DICT) {
+		    Tcl_AppendResult(interp,
+			"option -result cannot be used with -command\n", NULL);
+
+		    code = TCL_ERROR;
+		    goto done;
+		}
+
+		if ((settings.outputChannel != NULL) ||
+			(settings.outputFilePtr != NULL)) {
+		    Tcl_AppendResult(interp,
+			"options -outputChannel and -outputFile cannot be "
+			"used with -command\n", NULL);
+
+		    code = TCL_ERROR;
+		    goto done;
+		}
+
+		/*
+		 * NOTE: Filesystems implemented in Tcl can only be used by
+		 *       the thread that owns the interpreter.
+		 */
+
+		if (settings.bTclVfs) {
+		    Tcl_AppendResult(interp,
+			"option tcl_vfs cannot be used with -command\n",
+			NULL);
+
+		    code = TCL_ERROR;
+		    goto done;
+		}
+	    }
+
+	    /*
+	     * NOTE: When writing the output to a file, the source map goes to
+	     *       the file named by the "source_map_file" option, which is
+	     *       also the name that libsass refers to within the output.
+	     */
+
+	    if (settings.outputFilePtr != NULL) {
+		const char *zSourceMapFile;
+
+		zSourceMapFile = sass_option_get_source_map_file(optsPtr);
+
+		if ((zSourceMapFile != NULL) && (zSourceMapFile[0] != '\0')) {
+		    settings.sourceMapFilePtr = Tcl_NewStringObj(
+			zSourceMapFile, -1);
+
+		    Tcl_IncrRefCount(settings.sourceMapFilePtr);
+		}
+	    }
+
+	    /*
+	     * NOTE: This must be done before the compile cache key is done,
+	     *       because it includes the versions of the functions.
+	     */
+
+	    settings.funcsPtr = SassFuncBind(interp, optsPtr,
+		settings.commandPtr != NULL, &settings.key);
+
+	    zSource = Tcl_GetStringFromObj(objv[index], &sourceLength);
+
+	    zKey = GetCacheKey(interp, &settings, zSource, sourceLength);
+
+	    /*
+	     * NOTE: For asynchronous compilations, the worker thread looks up
+	     *       the cache key instead.  Profiled compilations never use a
+	     *       cached result, since there would be nothing to profile;
+	     *       however, their results are still added to the cache.
+	     */
+
+	    if ((zKey != NULL) && (settings.commandPtr == NULL) &&
+		    !settings.bProfile) {
+		SassCacheEntry *entryPtr = SassCacheFind(zKey,
+		    Tcl_DStringLength(&settings.key),
+		    settings.funcsPtr != NULL);
+
+		if (entryPtr != NULL) {
+		    code = SetCompileResult(interp, &settings,
+			SassCacheGetResult(entryPtr));
+
+		    SassCacheRelease(entryPtr);
+		    goto done;
+		}
+	    }
+
+	    if (settings.commandPtr != NULL) {
+		code = SubmitCompileJob(interp, &settings, &optsPtr, zSource,
+		    sourceLength, zKey, Tcl_DStringLength(&settings.key));
+
+		break;
+	    }
+
+	    code = CompileForType(interp, settings.type, &optsPtr, zSource,
+		zKey, Tcl_DStringLength(&settings.key), &settings);
 
 	    break;
 	}
@@ -1421,13 +6282,30 @@ static int SassObjCmd(
     }
 
 done:
+    Tcl_DStringFree(&settings.key);
+
+    if (settings.sourceMapFilePtr != NULL) {
+	Tcl_DecrRefCount(settings.sourceMapFilePtr);
+	settings.sourceMapFilePtr = NULL;
+    }
+
+    if (settings.fsPtr != NULL) {
+	SassFsDelete(settings.fsPtr);
+	settings.fsPtr = NULL;
+    }
+
+    if (settings.funcsPtr != NULL) {
+	SassFuncUnbind(settings.funcsPtr);
+	settings.funcsPtr = NULL;
+    }
+
+    if (settings.varsPtr != NULL) {
+	SassVarsRelease(settings.varsPtr);
+	settings.varsPtr = NULL;
+    }
+
     if (optsPtr != NULL) {
-#ifdef HAVE_SASS_DELETE_OPTIONS
-	/* libsass 3.5.x adds the delete function to match the make function. */
-	sass_delete_options(optsPtr);
-#else
-	free(optsPtr);
-#endif
+	DeleteOptions(optsPtr);
 	optsPtr = NULL;
     }
 
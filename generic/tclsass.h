@@ -23,4 +23,72 @@ PACKAGE_EXTERN int	Sass_SafeInit(Tcl_Interp *interp);
 PACKAGE_EXTERN int	Sass_Unload(Tcl_Interp *interp, int flags);
 PACKAGE_EXTERN int	Sass_SafeUnload(Tcl_Interp *interp, int flags);
 
+/*
+ * NOTE: These are the context types accepted by the Sass_CompileEx function.
+ *       They have the same meaning as the values of the -type option of the
+ *       [sass compile] sub-command.
+ */
+
+#define SASS_COMPILE_TYPE_FILE		(1)
+#define SASS_COMPILE_TYPE_DATA		(2)
+
+/*
+ * NOTE: These are the flags accepted by the Sass_CompileEx function.  The
+ *       SASS_COMPILE_CACHE flag is the same as the -cache option.
+ */
+
+#define SASS_COMPILE_CACHE		(1<<0)
+
+/*
+ * NOTE: This structure holds the result of the Sass_CompileEx function, which
+ *       has the same values as the dictionary returned by [sass compile].  A
+ *       NULL string pointer means the associated value is not available.
+ *       The strings remain valid until the Sass_FreeResult function is used
+ *       to free the result.
+ */
+
+typedef struct Sass_CompileResult {
+    int errorStatus;			/* Zero means success. */
+    const char *zOutput;		/* The output string, if any. */
+    int outputLength;			/* Length of output string. */
+    const char *zSourceMap;		/* The source map string, if any. */
+    int sourceMapLength;		/* Length of source map string. */
+    const char *zErrorMessage;		/* The error message, if any. */
+    int errorMessageLength;		/* Length of error message. */
+    Tcl_WideInt errorLine;		/* Line number of the error. */
+    Tcl_WideInt errorColumn;		/* Column number of the error. */
+    void *internalPtr;			/* Private, used by Sass_FreeResult. */
+} Sass_CompileResult;
+
+/*
+ * NOTE: This is the type of the procedures implementing custom Sass functions
+ *       in C, which are registered via the Sass_RegisterFunction function.
+ *       The arguments are a Sass list.  The returned value is owned by
+ *       libsass; a Sass error value may be returned to fail the compilation.
+ *       They may be called by any thread.
+ */
+
+union Sass_Value;
+struct Sass_Compiler;
+
+typedef union Sass_Value *(Sass_FunctionProc) (
+    const union Sass_Value *argsPtr, void *clientData,
+    struct Sass_Compiler *compiler);
+
+/*
+ * NOTE: The rest of the public functions are available via the stubs table
+ *       of this package.  Other extensions should define USE_SASS_STUBS,
+ *       call Sass_InitStubs, and then link against the stub library.
+ */
+
+#include "tclsassDecls.h"
+
+#ifdef USE_SASS_STUBS
+PACKAGE_EXTERN const char *	Sass_InitStubs(Tcl_Interp *interp,
+				    const char *zVersion, int exact);
+#else
+#define Sass_InitStubs(interp, version, exact) \
+    Tcl_PkgRequire((interp), "sass", (version), (exact))
+#endif
+
 #endif /* _TCLSASS_H_ */
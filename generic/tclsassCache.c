@@ -0,0 +1,2327 @@
+/*
+ * tclsassCache.c -- Tcl Package for libsass
+ *
+ * Implements the in-process compile cache used by [sass compile -cache].
+ * Each cached result records the files that were included by it, so that
+ * it can be revalidated cheaply prior to being used.  Optionally, results
+ * are also shared with other processes via a shared memory table (see the
+ * file "tclsassShm.c") and/or persisted to an on-disk cache directory,
+ * which survives restarts.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <limits.h>		/* NOTE: For INT_MAX. */
+#include <stdio.h>		/* NOTE: For fopen(), fread(), rename(). */
+#include <stdlib.h>		/* NOTE: For size_t, malloc(), free(). */
+#include <string.h>		/* NOTE: For memcmp(), memcpy(), strlen(). */
+#include <sys/types.h>		/* NOTE: For struct stat. */
+#include <sys/stat.h>		/* NOTE: For stat(). */
+#ifndef _WIN32
+#include <fcntl.h>		/* NOTE: For open(). */
+#include <unistd.h>		/* NOTE: For write(), close(), getpid(). */
+#include <sys/mman.h>		/* NOTE: For mmap(), munmap(). */
+#endif
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "sass/base.h"		/* NOTE: For libsass_version(). */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: This is the default maximum number of bytes that may be used by all
+ *       the entries within the compile cache, combined.  It may be changed
+ *       at runtime via the [sass cache configure -maxbytes] sub-command.
+ */
+
+#ifndef SASS_CACHE_MAX_BYTES
+  #define SASS_CACHE_MAX_BYTES			(16 * 1024 * 1024)
+#endif
+
+/*
+ * NOTE: This is the default size of a new shared memory table.  It may be
+ *       changed at runtime via [sass cache configure -sharedsize].
+ */
+
+#ifndef SASS_CACHE_SHARED_BYTES
+  #define SASS_CACHE_SHARED_BYTES		(16 * 1024 * 1024)
+#endif
+
+/*
+ * NOTE: The on-disk cache uses POSIX file and memory mapping functions.  It
+ *       is not available on Windows.
+ */
+
+#if defined(_WIN32) && !defined(SASS_NO_DISK_CACHE)
+  #define SASS_NO_DISK_CACHE
+#endif
+
+/*
+ * NOTE: These are the magic bytes at the start of every serialized entry,
+ *       i.e. every on-disk cache file and shared memory record.  The last
+ *       byte is the version of the format.  It must be bumped whenever the
+ *       layout of the SassRecordHeader or SassRecordDep structures changes,
+ *       so that older records are ignored.
+ */
+
+#define SASS_RECORD_MAGIC			"TclSass\001"
+#define SASS_RECORD_MAGIC_SIZE			(8)
+
+/*
+ * NOTE: These are the methods that may be used to check whether the files
+ *       included by a cached result have changed.  The "stat" method uses
+ *       the modification time, size, and inode of each file.  The "hash"
+ *       method uses the size and a hash of the contents of each file.  It
+ *       is slower; however, it may be necessary on file systems where the
+ *       modification times are unreliable.
+ */
+
+enum Sass_Validate_Method {
+  SASS_VALIDATE_STAT,
+  SASS_VALIDATE_HASH
+};
+
+/*
+ * NOTE: This is the recorded state of one file included by a cached result.
+ */
+
+typedef struct SassCacheDep {
+    const char *zPath;			/* Full path of the included file. */
+    Tcl_WideInt mtime;			/* Modification time, seconds. */
+    long mtimeNsec;			/* Modification time, nanoseconds. */
+    Tcl_WideInt size;			/* Size of the file, in bytes. */
+    Tcl_WideUInt inode;			/* Inode number of the file. */
+    Tcl_WideUInt device;		/* Device number of the file. */
+    Tcl_WideUInt hash;			/* Hash of contents, "hash" only. */
+} SassCacheDep;
+
+/*
+ * NOTE: This is the header of a serialized entry.  It is followed by the
+ *       included file states, the full key, the result strings, and then
+ *       the included file paths, in that order.  Each string, except the
+ *       key, is followed by a NUL terminator.  A length of -1 means that
+ *       the associated string is not available.  All values are stored in
+ *       native byte order; the records are not portable between machines.
+ */
+
+typedef struct SassRecordHeader {
+    char magic[SASS_RECORD_MAGIC_SIZE];	/* See SASS_RECORD_MAGIC. */
+    Tcl_WideUInt checksum;		/* Hash of everything after header. */
+    Tcl_WideInt errorLine;		/* Line number of the error. */
+    Tcl_WideInt errorColumn;		/* Column number of the error. */
+    int errorStatus;			/* Zero means success. */
+    int validate;			/* How to check included files. */
+    int keyLength;			/* Length of the full key. */
+    int outputLength;			/* Length of output string. */
+    int sourceMapLength;		/* Length of source map string. */
+    int errorMessageLength;		/* Length of error message. */
+    int nDeps;				/* Number of included files. */
+    int reserved;			/* Padding, must be zero. */
+} SassRecordHeader;
+
+/*
+ * NOTE: This is the state of one included file within a serialized entry.
+ */
+
+typedef struct SassRecordDep {
+    Tcl_WideInt mtime;			/* Modification time, seconds. */
+    Tcl_WideInt mtimeNsec;		/* Modification time, nanoseconds. */
+    Tcl_WideInt size;			/* Size of the file, in bytes. */
+    Tcl_WideUInt inode;			/* Inode number of the file. */
+    Tcl_WideUInt device;		/* Device number of the file. */
+    Tcl_WideUInt hash;			/* Hash of contents, "hash" only. */
+    Tcl_WideInt pathLength;		/* Length of path, not including NUL. */
+} SassRecordDep;
+
+/*
+ * NOTE: This is one entry within the compile cache.  Each entry is allocated
+ *       as a single block of memory.  The included file states, the full
+ *       key, all the strings that belong to the result, and the included
+ *       file paths are stored immediately after the structure.
+ *       The entries are kept in a doubly linked list, ordered from the most
+ *       recently used to the least recently used, which is used to evict
+ *       entries when the cache exceeds its byte budget.
+ */
+
+struct SassCacheEntry {
+    Tcl_HashEntry *hPtr;		/* Hash table entry, NULL if removed. */
+    struct SassCacheEntry *prevPtr;	/* More recently used entry. */
+    struct SassCacheEntry *nextPtr;	/* Less recently used entry. */
+    int refCount;			/* Number of outstanding references. */
+    size_t nBytes;			/* Total size of this entry. */
+    char *zKey;				/* Full key, for collision checks. */
+    int keyLength;			/* Length of the full key. */
+    SassResult result;			/* The cached compilation result. */
+    enum Sass_Validate_Method validate;	/* How to check included files. */
+    int nDeps;				/* Number of included files. */
+    SassCacheDep *aDeps;		/* States of the included files. */
+};
+
+/*
+ * NOTE: This structure holds the state of the compile cache.  There is only
+ *       one instance of it per process.  It is protected by cacheMutex.
+ */
+
+typedef struct SassCache {
+    int bInitialized;			/* Non-zero if hash table is ready. */
+    Tcl_HashTable table;		/* Key hash -> SassCacheEntry. */
+    SassCacheEntry *headPtr;		/* Most recently used entry. */
+    SassCacheEntry *tailPtr;		/* Least recently used entry. */
+    int nEntries;			/* Number of entries in the cache. */
+    size_t nBytes;			/* Bytes used by all the entries. */
+    size_t maxBytes;			/* Maximum bytes for all entries. */
+    enum Sass_Validate_Method validate;	/* For newly added entries. */
+    char *zDir;				/* On-disk cache directory, or NULL. */
+    Tcl_WideInt sharedSize;		/* Size for new shared memory files. */
+    Tcl_WideInt hits;			/* Lookups that found an entry. */
+    Tcl_WideInt misses;			/* Lookups that did not. */
+    Tcl_WideInt stores;			/* Entries added to the cache. */
+    Tcl_WideInt evictions;		/* Entries evicted due to budget. */
+    Tcl_WideInt invalidations;		/* Entries with changed files. */
+    Tcl_WideInt diskHits;		/* Misses found on disk. */
+    Tcl_WideInt diskMisses;		/* Misses not found on disk. */
+    Tcl_WideInt diskStores;		/* Files written to disk. */
+    Tcl_WideInt diskErrors;		/* Unreadable or unwritable files. */
+} SassCache;
+
+static SassCache cache = {
+    0, {0}, NULL, NULL, 0, 0, SASS_CACHE_MAX_BYTES, SASS_VALIDATE_STAT,
+    NULL, SASS_CACHE_SHARED_BYTES, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/*
+ * NOTE: These are the names of the methods used to check included files.
+ *       They must be in the same order as the Sass_Validate_Method values.
+ */
+
+static const char *validateMethods[] = {
+    "stat", "hash", (char *) NULL
+};
+
+TCL_DECLARE_MUTEX(cacheMutex)
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static Tcl_WideUInt	HashBytes(Tcl_WideUInt hash, const char *zBytes,
+			    size_t nBytes);
+static Tcl_WideUInt	HashKey(const char *zKey, int keyLength);
+static int		GetFileState(const char *zPath,
+			    enum Sass_Validate_Method validate,
+			    SassCacheDep *depPtr, Tcl_WideInt *mtimePtr,
+			    long *mtimeNsecPtr);
+static int		IsEntryValid(SassCacheEntry *entryPtr);
+static SassCacheEntry *	NewEntry(const char *zKey, int keyLength,
+			    const SassResult *resultPtr,
+			    enum Sass_Validate_Method validate, int nDeps,
+			    const SassCacheDep *aDeps);
+static void		InitializeCache(void);
+static void		LinkEntry(SassCacheEntry *entryPtr);
+static void		UnlinkEntry(SassCacheEntry *entryPtr);
+static void		RemoveEntry(SassCacheEntry *entryPtr);
+static void		EvictEntries(size_t maxBytes);
+static void		RemoveAllEntries(void);
+static void		InsertEntry(SassCacheEntry *entryPtr,
+			    Tcl_WideUInt hash);
+static char *		GetDiskDir(void);
+static void		GetDiskKey(const char *zKey, int keyLength,
+			    Tcl_DString *keyPtr);
+static void		GetDiskPath(const char *zDir, const char *zDiskKey,
+			    int diskKeyLength, Tcl_DString *pathPtr);
+static char *		SerializeEntry(SassCacheEntry *entryPtr,
+			    Tcl_DString *diskKeyPtr, size_t *pnBytes);
+static SassCacheEntry *	DeserializeEntry(const char *pData, size_t nBytes,
+			    const char *zKey, int keyLength,
+			    Tcl_DString *diskKeyPtr);
+static SassCacheEntry *	ReadDiskEntry(const char *zDir, const char *zKey,
+			    int keyLength, Tcl_DString *diskKeyPtr);
+static int		WriteDiskEntry(const char *zDir,
+			    Tcl_DString *diskKeyPtr, const char *pData,
+			    size_t nBytes);
+static SassCacheEntry *	LoadExternalEntry(const char *zKey, int keyLength,
+			    Tcl_WideUInt hash);
+static void		StoreExternalEntry(SassCacheEntry *entryPtr);
+static SassCacheEntry *	CountLookup(SassCacheEntry *entryPtr,
+			    Tcl_WideUInt hash);
+static int		AppendNameAndWide(Tcl_Interp *interp,
+			    Tcl_Obj *listPtr, const char *zName,
+			    Tcl_WideInt value);
+static int		AppendNameAndString(Tcl_Interp *interp,
+			    Tcl_Obj *listPtr, const char *zName,
+			    const char *zValue);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashBytes --
+ *
+ *	This function continues calculating the 64-bit FNV-1a hash of a
+ *	sequence of bytes, starting from the specified hash value.
+ *
+ * Results:
+ *	The new hash value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideUInt HashBytes(
+    Tcl_WideUInt hash,			/* IN: The hash value so far. */
+    const char *zBytes,			/* IN: The bytes to hash. */
+    size_t nBytes)			/* IN: Number of bytes to hash. */
+{
+    size_t index;
+
+    for (index = 0; index < nBytes; index++) {
+	hash ^= (unsigned char)zBytes[index];
+	hash *= (Tcl_WideUInt)0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashKey --
+ *
+ *	This function calculates the 64-bit FNV-1a hash of the specified
+ *	cache key.  The hash is only used to locate candidate entries;
+ *	the full key is always compared before an entry is used.
+ *
+ * Results:
+ *	The hash value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideUInt HashKey(
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength)			/* IN: Number of key bytes. */
+{
+    return HashBytes((Tcl_WideUInt)0xCBF29CE484222325ULL, zKey,
+	(size_t)keyLength);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassHashBytes --
+ *
+ *	This function computes the hash of the specified bytes, using the
+ *	same hash function as the compile cache.  It is used by the other
+ *	source files of this package.
+ *
+ * Results:
+ *	The hash value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideUInt SassHashBytes(
+    const char *zBytes,			/* IN: The bytes to hash. */
+    size_t nBytes)			/* IN: Number of bytes. */
+{
+    return HashBytes((Tcl_WideUInt)0xCBF29CE484222325ULL, zBytes, nBytes);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassIsRecentTime --
+ *
+ *	This function checks whether the specified modification time of
+ *	an included file is too close to the start of a compilation, or
+ *	after it, for the file to be assumed unchanged while it was being
+ *	compiled.  See SASS_MTIME_WINDOW.
+ *
+ * Results:
+ *	Non-zero if the modification time is too recent.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassIsRecentTime(
+    Tcl_WideInt sec,			/* IN: Modification time, seconds. */
+    long nsec,				/* IN: Nanoseconds portion of above. */
+    const Tcl_Time *startTimePtr)	/* IN: When compilation started. */
+{
+    Tcl_WideInt startSec = startTimePtr->sec - SASS_MTIME_WINDOW;
+
+    return (sec > startSec) ||
+	((sec == startSec) && (nsec / 1000 >= startTimePtr->usec));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetFileState --
+ *
+ *	This function queries the current state of the specified file,
+ *	using the specified validation method.  For the "hash" method,
+ *	the entire file is read.  Files from the virtual file system are
+ *	handled by it.  The modification time is also returned, if
+ *	requested, regardless of the validation method; for the "hash"
+ *	method, it is queried after the file was read.  It is zero for
+ *	files from the virtual file system.
+ *
+ * Results:
+ *	Zero on success, non-zero if the file could not be queried.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int GetFileState(
+    const char *zPath,			/* IN: The file to query. */
+    enum Sass_Validate_Method validate,	/* IN: The validation method. */
+    SassCacheDep *depPtr,		/* OUT: The file state. */
+    Tcl_WideInt *mtimePtr,		/* OUT: Modification time, or NULL. */
+    long *mtimeNsecPtr)			/* OUT: Nanoseconds of above, or NULL. */
+{
+    struct stat statBuf;
+
+    memset(depPtr, 0, sizeof(SassCacheDep));
+    depPtr->zPath = zPath;
+
+    if (mtimePtr != NULL)
+	*mtimePtr = 0;
+
+    if (mtimeNsecPtr != NULL)
+	*mtimeNsecPtr = 0;
+
+    /*
+     * NOTE: Files from the virtual file system are always checked using the
+     *       size and hash of their contents, which are computed when they
+     *       are added.
+     */
+
+    if (strncmp(zPath, SASS_VFS_PREFIX, strlen(SASS_VFS_PREFIX)) == 0)
+	return SassVfsGetState(zPath, &depPtr->size, &depPtr->hash);
+
+    if (stat(zPath, &statBuf) != 0)
+	return -1;
+
+    depPtr->size = (Tcl_WideInt)statBuf.st_size;
+
+    if (validate == SASS_VALIDATE_HASH) {
+	char buffer[8192];
+	size_t nRead;
+	FILE *pFile = fopen(zPath, "rb");
+
+	if (pFile == NULL)
+	    return -1;
+
+	depPtr->hash = (Tcl_WideUInt)0xCBF29CE484222325ULL;
+
+	while ((nRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+	    depPtr->hash = HashBytes(depPtr->hash, buffer, nRead);
+
+	/*
+	 * NOTE: Query the modification time again, now that the contents
+	 *       were read, so that a concurrent change is not missed.
+	 */
+
+	if (fstat(fileno(pFile), &statBuf) != 0) {
+	    fclose(pFile);
+	    return -1;
+	}
+
+	fclose(pFile);
+    } else {
+	depPtr->mtime = (Tcl_WideInt)statBuf.st_mtime;
+	depPtr->mtimeNsec = STAT_MTIME_NSEC(&statBuf);
+	depPtr->inode = (Tcl_WideUInt)statBuf.st_ino;
+	depPtr->device = (Tcl_WideUInt)statBuf.st_dev;
+    }
+
+    if (mtimePtr != NULL)
+	*mtimePtr = (Tcl_WideInt)statBuf.st_mtime;
+
+    if (mtimeNsecPtr != NULL)
+	*mtimeNsecPtr = STAT_MTIME_NSEC(&statBuf);
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsEntryValid --
+ *
+ *	This function checks whether any of the files included by the
+ *	specified compile cache entry have changed since it was added.
+ *	The caller must hold a reference to the entry; however, it must
+ *	not hold the cache mutex.
+ *
+ * Results:
+ *	Non-zero if the entry is still valid.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int IsEntryValid(
+    SassCacheEntry *entryPtr)		/* IN: The entry to check. */
+{
+    int index;
+
+    for (index = 0; index < entryPtr->nDeps; index++) {
+	SassCacheDep *depPtr = &entryPtr->aDeps[index];
+	SassCacheDep state;
+
+	if (GetFileState(depPtr->zPath, entryPtr->validate, &state, NULL,
+		NULL) != 0) {
+	    return 0;
+	}
+
+	if ((state.size != depPtr->size) || (state.hash != depPtr->hash) ||
+		(state.mtime != depPtr->mtime) ||
+		(state.mtimeNsec != depPtr->mtimeNsec) ||
+		(state.inode != depPtr->inode) ||
+		(state.device != depPtr->device)) {
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewEntry --
+ *
+ *	This function allocates a new compile cache entry, as a single
+ *	block of memory, and copies the specified key, compilation result,
+ *	and included file states into it.  The new entry is not added to
+ *	the cache.
+ *
+ * Results:
+ *	The new entry -OR- NULL if out of memory.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCacheEntry *NewEntry(
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength,			/* IN: Number of key bytes. */
+    const SassResult *resultPtr,	/* IN: The result to copy. */
+    enum Sass_Validate_Method validate,	/* IN: How to check the files. */
+    int nDeps,				/* IN: Number of included files. */
+    const SassCacheDep *aDeps)		/* IN: States of included files. */
+{
+    size_t nBytes;
+    SassCacheEntry *entryPtr;
+    char *zNext;
+    int index;
+
+    nBytes = sizeof(SassCacheEntry) + (nDeps * sizeof(SassCacheDep)) +
+	keyLength;
+
+    if (resultPtr->zOutput != NULL)
+	nBytes += resultPtr->outputLength + 1;
+
+    if (resultPtr->zSourceMap != NULL)
+	nBytes += resultPtr->sourceMapLength + 1;
+
+    if (resultPtr->zErrorMessage != NULL)
+	nBytes += resultPtr->errorMessageLength + 1;
+
+    for (index = 0; index < nDeps; index++)
+	nBytes += strlen(aDeps[index].zPath) + 1;
+
+    entryPtr = (SassCacheEntry *)attemptckalloc(nBytes);
+
+    if (entryPtr == NULL)
+	return NULL;
+
+    memset(entryPtr, 0, sizeof(SassCacheEntry));
+    entryPtr->nBytes = nBytes;
+    entryPtr->result = *resultPtr;
+    entryPtr->validate = validate;
+    entryPtr->nDeps = nDeps;
+    entryPtr->aDeps = (SassCacheDep *)(entryPtr + 1);
+
+    if (nDeps > 0)
+	memcpy(entryPtr->aDeps, aDeps, nDeps * sizeof(SassCacheDep));
+
+    zNext = (char *)(entryPtr->aDeps + nDeps);
+    entryPtr->zKey = zNext;
+    entryPtr->keyLength = keyLength;
+    memcpy(zNext, zKey, keyLength);
+    zNext += keyLength;
+
+    if (resultPtr->zOutput != NULL) {
+	memcpy(zNext, resultPtr->zOutput, resultPtr->outputLength);
+	zNext[resultPtr->outputLength] = '\0';
+	entryPtr->result.zOutput = zNext;
+	zNext += resultPtr->outputLength + 1;
+    }
+
+    if (resultPtr->zSourceMap != NULL) {
+	memcpy(zNext, resultPtr->zSourceMap, resultPtr->sourceMapLength);
+	zNext[resultPtr->sourceMapLength] = '\0';
+	entryPtr->result.zSourceMap = zNext;
+	zNext += resultPtr->sourceMapLength + 1;
+    }
+
+    if (resultPtr->zErrorMessage != NULL) {
+	memcpy(zNext, resultPtr->zErrorMessage,
+	    resultPtr->errorMessageLength);
+
+	zNext[resultPtr->errorMessageLength] = '\0';
+	entryPtr->result.zErrorMessage = zNext;
+	zNext += resultPtr->errorMessageLength + 1;
+    }
+
+    for (index = 0; index < nDeps; index++) {
+	size_t pathLength = strlen(aDeps[index].zPath);
+
+	memcpy(zNext, aDeps[index].zPath, pathLength + 1);
+	entryPtr->aDeps[index].zPath = zNext;
+	zNext += pathLength + 1;
+    }
+
+    return entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitializeCache --
+ *
+ *	This function initializes the hash table for the compile cache,
+ *	if that has not already been done.  The caller must hold the
+ *	cache mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void InitializeCache(void)
+{
+    if (cache.bInitialized)
+	return;
+
+    Tcl_InitHashTable(&cache.table, TCL_ONE_WORD_KEYS);
+    cache.bInitialized = 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LinkEntry --
+ *
+ *	This function inserts the specified entry at the head of the
+ *	least recently used list.  The caller must hold the cache mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void LinkEntry(
+    SassCacheEntry *entryPtr)		/* IN: The entry to link. */
+{
+    entryPtr->prevPtr = NULL;
+    entryPtr->nextPtr = cache.headPtr;
+
+    if (cache.headPtr != NULL)
+	cache.headPtr->prevPtr = entryPtr;
+
+    cache.headPtr = entryPtr;
+
+    if (cache.tailPtr == NULL)
+	cache.tailPtr = entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UnlinkEntry --
+ *
+ *	This function removes the specified entry from the least recently
+ *	used list.  The caller must hold the cache mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void UnlinkEntry(
+    SassCacheEntry *entryPtr)		/* IN: The entry to unlink. */
+{
+    if (entryPtr->prevPtr != NULL) {
+	entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+    } else {
+	cache.headPtr = entryPtr->nextPtr;
+    }
+
+    if (entryPtr->nextPtr != NULL) {
+	entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+    } else {
+	cache.tailPtr = entryPtr->prevPtr;
+    }
+
+    entryPtr->prevPtr = NULL;
+    entryPtr->nextPtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RemoveEntry --
+ *
+ *	This function removes the specified entry from the compile cache.
+ *	If there are no outstanding references to the entry, it is freed;
+ *	otherwise, it will be freed by the final SassCacheRelease call.
+ *	The caller must hold the cache mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void RemoveEntry(
+    SassCacheEntry *entryPtr)		/* IN: The entry to remove. */
+{
+    UnlinkEntry(entryPtr);
+
+    if (entryPtr->hPtr != NULL) {
+	Tcl_DeleteHashEntry(entryPtr->hPtr);
+	entryPtr->hPtr = NULL;
+    }
+
+    cache.nEntries--;
+    cache.nBytes -= entryPtr->nBytes;
+
+    if (entryPtr->refCount <= 0)
+	ckfree((char *)entryPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EvictEntries --
+ *
+ *	This function removes the least recently used entries from the
+ *	compile cache until the total number of bytes used does not
+ *	exceed the specified maximum.  The caller must hold the cache
+ *	mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void EvictEntries(
+    size_t maxBytes)			/* IN: Byte budget to enforce. */
+{
+    while ((cache.nBytes > maxBytes) && (cache.tailPtr != NULL)) {
+	RemoveEntry(cache.tailPtr);
+	cache.evictions++;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RemoveAllEntries --
+ *
+ *	This function removes all the entries from the compile cache.
+ *	Unlike EvictEntries, the removed entries are not counted as
+ *	evictions.  The caller must hold the cache mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void RemoveAllEntries(void)
+{
+    while (cache.tailPtr != NULL)
+	RemoveEntry(cache.tailPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InsertEntry --
+ *
+ *	This function adds the specified entry to the compile cache,
+ *	replacing any existing entry with the same key hash, and then
+ *	evicts the least recently used entries until the cache fits
+ *	within its byte budget again.  The caller must hold the cache
+ *	mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void InsertEntry(
+    SassCacheEntry *entryPtr,		/* IN: The entry to add. */
+    Tcl_WideUInt hash)			/* IN: Hash of the entry key. */
+{
+    Tcl_HashEntry *hPtr;
+    int isNew;
+
+    InitializeCache();
+
+    hPtr = Tcl_CreateHashEntry(&cache.table, (char *)(size_t)hash, &isNew);
+
+    if (!isNew) {
+	SassCacheEntry *oldEntryPtr = Tcl_GetHashValue(hPtr);
+
+	/*
+	 * NOTE: The old entry (with the same key hash) is being replaced.
+	 *       Its hash table entry is reused by the new entry; therefore,
+	 *       prevent RemoveEntry from deleting it.
+	 */
+
+	oldEntryPtr->hPtr = NULL;
+	RemoveEntry(oldEntryPtr);
+    }
+
+    entryPtr->hPtr = hPtr;
+    Tcl_SetHashValue(hPtr, entryPtr);
+    LinkEntry(entryPtr);
+
+    cache.nEntries++;
+    cache.nBytes += entryPtr->nBytes;
+
+    EvictEntries(cache.maxBytes);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDiskDir --
+ *
+ *	This function returns a copy of the on-disk cache directory name.
+ *
+ * Results:
+ *	The directory name -OR- NULL if the on-disk cache is disabled.  A
+ *	non-NULL result must be freed by the caller via ckfree.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *GetDiskDir(void)
+{
+    char *zDir = NULL;
+
+    Tcl_MutexLock(&cacheMutex);
+
+    if (cache.zDir != NULL) {
+	zDir = attemptckalloc(strlen(cache.zDir) + 1);
+
+	if (zDir != NULL)
+	    strcpy(zDir, cache.zDir);
+    }
+
+    Tcl_MutexUnlock(&cacheMutex);
+    return zDir;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDiskKey --
+ *
+ *	This function builds the key used for the on-disk cache, which
+ *	consists of the libsass version, a NUL, and the in-process cache
+ *	key.  The version is included because the same on-disk cache may
+ *	be used by processes with different versions of libsass.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void GetDiskKey(
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength,			/* IN: Number of key bytes. */
+    Tcl_DString *keyPtr)		/* OUT: The on-disk cache key. */
+{
+    const char *zVersion = libsass_version();
+
+    Tcl_DStringInit(keyPtr);
+    Tcl_DStringAppend(keyPtr, (zVersion != NULL) ? zVersion : "", -1);
+    Tcl_DStringAppend(keyPtr, "", 1);
+    Tcl_DStringAppend(keyPtr, zKey, keyLength);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDiskPath --
+ *
+ *	This function builds the name of the on-disk cache file for the
+ *	specified on-disk cache key.  The file name is the hash of the
+ *	key; therefore, the on-disk cache is content-addressed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void GetDiskPath(
+    const char *zDir,			/* IN: The cache directory. */
+    const char *zDiskKey,		/* IN: The on-disk cache key. */
+    int diskKeyLength,			/* IN: Length of on-disk cache key. */
+    Tcl_DString *pathPtr)		/* OUT: The file name. */
+{
+    char buffer[50] = {0};
+
+    snprintf(buffer, sizeof(buffer) - 1, "/%016" TCL_LL_MODIFIER "x.cache",
+	HashKey(zDiskKey, diskKeyLength));
+
+    Tcl_DStringInit(pathPtr);
+    Tcl_DStringAppend(pathPtr, zDir, -1);
+    Tcl_DStringAppend(pathPtr, buffer, -1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SerializeEntry --
+ *
+ *	This function serializes the specified compile cache entry, using
+ *	the format described by the SassRecordHeader structure.  The key
+ *	of the serialized entry is the specified on-disk cache key.
+ *
+ * Results:
+ *	The serialized entry -OR- NULL if out of memory.  A non-NULL
+ *	result must be freed by the caller via ckfree.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *SerializeEntry(
+    SassCacheEntry *entryPtr,		/* IN: The entry to serialize. */
+    Tcl_DString *diskKeyPtr,		/* IN: The on-disk cache key. */
+    size_t *pnBytes)			/* OUT: Length of the result. */
+{
+    const SassResult *resultPtr = &entryPtr->result;
+    SassRecordHeader *headerPtr;
+    SassRecordDep *aRecordDeps;
+    size_t nBytes;
+    size_t offset;
+    char *pBuffer;
+    int index;
+
+    nBytes = sizeof(SassRecordHeader) +
+	(entryPtr->nDeps * sizeof(SassRecordDep)) +
+	Tcl_DStringLength(diskKeyPtr);
+
+    if (resultPtr->zOutput != NULL)
+	nBytes += resultPtr->outputLength + 1;
+
+    if (resultPtr->zSourceMap != NULL)
+	nBytes += resultPtr->sourceMapLength + 1;
+
+    if (resultPtr->zErrorMessage != NULL)
+	nBytes += resultPtr->errorMessageLength + 1;
+
+    for (index = 0; index < entryPtr->nDeps; index++)
+	nBytes += strlen(entryPtr->aDeps[index].zPath) + 1;
+
+    pBuffer = attemptckalloc(nBytes);
+
+    if (pBuffer == NULL)
+	return NULL;
+
+    memset(pBuffer, 0, sizeof(SassRecordHeader));
+    headerPtr = (SassRecordHeader *)pBuffer;
+    memcpy(headerPtr->magic, SASS_RECORD_MAGIC, SASS_RECORD_MAGIC_SIZE);
+    headerPtr->errorLine = resultPtr->errorLine;
+    headerPtr->errorColumn = resultPtr->errorColumn;
+    headerPtr->errorStatus = resultPtr->errorStatus;
+    headerPtr->validate = (int)entryPtr->validate;
+    headerPtr->keyLength = Tcl_DStringLength(diskKeyPtr);
+    headerPtr->nDeps = entryPtr->nDeps;
+
+    aRecordDeps = (SassRecordDep *)(headerPtr + 1);
+    offset = sizeof(SassRecordHeader) +
+	entryPtr->nDeps * sizeof(SassRecordDep);
+
+    memcpy(pBuffer + offset, Tcl_DStringValue(diskKeyPtr),
+	Tcl_DStringLength(diskKeyPtr));
+
+    offset += Tcl_DStringLength(diskKeyPtr);
+
+#define WRITE_RECORD_STRING(z, n, lengthVar) \
+    if ((z) != NULL) { \
+	memcpy(pBuffer + offset, (z), (n)); \
+	pBuffer[offset + (n)] = '\0'; \
+	offset += (size_t)(n) + 1; \
+	(lengthVar) = (n); \
+    } else { \
+	(lengthVar) = -1; \
+    }
+
+    WRITE_RECORD_STRING(resultPtr->zOutput, resultPtr->outputLength,
+	headerPtr->outputLength);
+    WRITE_RECORD_STRING(resultPtr->zSourceMap, resultPtr->sourceMapLength,
+	headerPtr->sourceMapLength);
+    WRITE_RECORD_STRING(resultPtr->zErrorMessage,
+	resultPtr->errorMessageLength, headerPtr->errorMessageLength);
+
+    for (index = 0; index < entryPtr->nDeps; index++) {
+	const SassCacheDep *depPtr = &entryPtr->aDeps[index];
+	SassRecordDep *recordDepPtr = &aRecordDeps[index];
+	int pathLength = (int)strlen(depPtr->zPath);
+
+	memset(recordDepPtr, 0, sizeof(SassRecordDep));
+	recordDepPtr->mtime = depPtr->mtime;
+	recordDepPtr->mtimeNsec = (Tcl_WideInt)depPtr->mtimeNsec;
+	recordDepPtr->size = depPtr->size;
+	recordDepPtr->inode = depPtr->inode;
+	recordDepPtr->device = depPtr->device;
+	recordDepPtr->hash = depPtr->hash;
+
+	WRITE_RECORD_STRING(depPtr->zPath, pathLength,
+	    recordDepPtr->pathLength);
+    }
+
+#undef WRITE_RECORD_STRING
+
+    headerPtr->checksum = HashBytes((Tcl_WideUInt)0xCBF29CE484222325ULL,
+	pBuffer + sizeof(SassRecordHeader), nBytes - sizeof(SassRecordHeader));
+
+    *pnBytes = nBytes;
+    return pBuffer;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DeserializeEntry --
+ *
+ *	This function creates a new compile cache entry from the specified
+ *	serialized entry, which was produced by SerializeEntry.  Since the
+ *	serialized entry may be truncated, corrupted, -OR- for a different
+ *	key, its magic bytes, checksum, key, and every length are verified
+ *	before anything from it is used.  The new entry is not added to
+ *	the compile cache and its included files are not checked for
+ *	changes.
+ *
+ * Results:
+ *	The new entry -OR- NULL if the serialized entry is not usable.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCacheEntry *DeserializeEntry(
+    const char *pData,			/* IN: The serialized entry. */
+    size_t nBytes,			/* IN: Length of serialized entry. */
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength,			/* IN: Number of key bytes. */
+    Tcl_DString *diskKeyPtr)		/* IN: The on-disk cache key. */
+{
+    const SassRecordHeader *headerPtr;
+    const SassRecordDep *aRecordDeps;
+    SassCacheDep *aDeps = NULL;
+    SassResult result;
+    size_t offset;
+    int index;
+    SassCacheEntry *entryPtr = NULL;
+
+    if (nBytes < sizeof(SassRecordHeader))
+	return NULL;
+
+    headerPtr = (const SassRecordHeader *)pData;
+
+    if ((memcmp(headerPtr->magic, SASS_RECORD_MAGIC,
+	    SASS_RECORD_MAGIC_SIZE) != 0) || (headerPtr->nDeps < 0) ||
+	    (headerPtr->keyLength != Tcl_DStringLength(diskKeyPtr)) ||
+	    (headerPtr->checksum != HashBytes(
+		(Tcl_WideUInt)0xCBF29CE484222325ULL,
+		pData + sizeof(SassRecordHeader),
+		nBytes - sizeof(SassRecordHeader)))) {
+	return NULL;
+    }
+
+    if ((size_t)headerPtr->nDeps >
+	    (nBytes - sizeof(SassRecordHeader)) / sizeof(SassRecordDep)) {
+	return NULL;
+    }
+
+    aRecordDeps = (const SassRecordDep *)(headerPtr + 1);
+    offset = sizeof(SassRecordHeader) +
+	headerPtr->nDeps * sizeof(SassRecordDep);
+
+    if ((nBytes - offset < (size_t)headerPtr->keyLength) || (memcmp(
+	    pData + offset, Tcl_DStringValue(diskKeyPtr),
+	    headerPtr->keyLength) != 0)) {
+	return NULL;
+    }
+
+    offset += headerPtr->keyLength;
+
+    memset(&result, 0, sizeof(SassResult));
+    result.errorStatus = headerPtr->errorStatus;
+    result.errorLine = headerPtr->errorLine;
+    result.errorColumn = headerPtr->errorColumn;
+
+#define READ_RECORD_STRING(z, n) \
+    if ((n) >= 0) { \
+	if ((nBytes - offset <= (size_t)(n)) || \
+		(pData[offset + (n)] != '\0')) { \
+	    goto done; \
+	} \
+	(z) = pData + offset; \
+	offset += (size_t)(n) + 1; \
+    }
+
+    result.outputLength = headerPtr->outputLength;
+    READ_RECORD_STRING(result.zOutput, result.outputLength);
+    result.sourceMapLength = headerPtr->sourceMapLength;
+    READ_RECORD_STRING(result.zSourceMap, result.sourceMapLength);
+    result.errorMessageLength = headerPtr->errorMessageLength;
+    READ_RECORD_STRING(result.zErrorMessage, result.errorMessageLength);
+
+    if (headerPtr->nDeps > 0) {
+	aDeps = (SassCacheDep *)attemptckalloc(
+	    headerPtr->nDeps * sizeof(SassCacheDep));
+
+	if (aDeps == NULL)
+	    goto done;
+
+	for (index = 0; index < headerPtr->nDeps; index++) {
+	    const SassRecordDep *recordDepPtr = &aRecordDeps[index];
+	    SassCacheDep *depPtr = &aDeps[index];
+
+	    if ((recordDepPtr->pathLength < 0) ||
+		    (recordDepPtr->pathLength > INT_MAX)) {
+		goto done;
+	    }
+
+	    READ_RECORD_STRING(depPtr->zPath, (int)recordDepPtr->pathLength);
+	    depPtr->mtime = recordDepPtr->mtime;
+	    depPtr->mtimeNsec = (long)recordDepPtr->mtimeNsec;
+	    depPtr->size = recordDepPtr->size;
+	    depPtr->inode = recordDepPtr->inode;
+	    depPtr->device = recordDepPtr->device;
+	    depPtr->hash = recordDepPtr->hash;
+	}
+    }
+
+#undef READ_RECORD_STRING
+
+    if (offset != nBytes)
+	goto done;
+
+    entryPtr = NewEntry(zKey, keyLength, &result,
+	(headerPtr->validate == SASS_VALIDATE_HASH) ?
+	    SASS_VALIDATE_HASH : SASS_VALIDATE_STAT,
+	headerPtr->nDeps, aDeps);
+
+done:
+    if (aDeps != NULL)
+	ckfree((char *)aDeps);
+
+    return entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadDiskEntry --
+ *
+ *	This function attempts to read the compile cache entry for the
+ *	specified key from the on-disk cache.  The file is mapped into
+ *	memory and then deserialized.  The new entry is not added to the
+ *	compile cache and its included files are not checked for changes.
+ *
+ * Results:
+ *	The new entry -OR- NULL if it was not found or is not usable.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCacheEntry *ReadDiskEntry(
+    const char *zDir,			/* IN: The cache directory. */
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength,			/* IN: Number of key bytes. */
+    Tcl_DString *diskKeyPtr)		/* IN: The on-disk cache key. */
+{
+#ifndef SASS_NO_DISK_CACHE
+    Tcl_DString path;
+    int fd;
+    struct stat statBuf;
+    char *pMap = MAP_FAILED;
+    size_t mapSize = 0;
+    SassCacheEntry *entryPtr = NULL;
+
+    GetDiskPath(zDir, Tcl_DStringValue(diskKeyPtr),
+	Tcl_DStringLength(diskKeyPtr), &path);
+
+    fd = open(Tcl_DStringValue(&path), O_RDONLY);
+
+    if (fd < 0)
+	goto done;
+
+    if ((fstat(fd, &statBuf) != 0) ||
+	    (statBuf.st_size < (off_t)sizeof(SassRecordHeader))) {
+	goto done;
+    }
+
+    mapSize = (size_t)statBuf.st_size;
+    pMap = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (pMap == MAP_FAILED)
+	goto done;
+
+    entryPtr = DeserializeEntry(pMap, mapSize, zKey, keyLength, diskKeyPtr);
+
+done:
+    if (pMap != MAP_FAILED)
+	munmap(pMap, mapSize);
+
+    if (fd >= 0)
+	close(fd);
+
+    Tcl_DStringFree(&path);
+    return entryPtr;
+#else
+    return NULL;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WriteDiskEntry --
+ *
+ *	This function writes the specified serialized entry to the on-disk
+ *	cache.  The file is written to a temporary name and then renamed;
+ *	therefore, other processes never observe a partially written file.
+ *
+ * Results:
+ *	Zero on success, non-zero on failure.
+ *
+ * Side effects:
+ *	A file may be created within the cache directory.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int WriteDiskEntry(
+    const char *zDir,			/* IN: The cache directory. */
+    Tcl_DString *diskKeyPtr,		/* IN: The on-disk cache key. */
+    const char *pData,			/* IN: The serialized entry. */
+    size_t nBytes)			/* IN: Length of serialized entry. */
+{
+#ifndef SASS_NO_DISK_CACHE
+    Tcl_DString path;
+    Tcl_DString tempPath;
+    char buffer[50] = {0};
+    size_t offset;
+    int fd = -1;
+    int rc = -1;
+
+    GetDiskPath(zDir, Tcl_DStringValue(diskKeyPtr),
+	Tcl_DStringLength(diskKeyPtr), &path);
+
+    /*
+     * NOTE: The temporary file name must be unique across all processes and
+     *       threads that may be writing to the same cache directory.
+     */
+
+    snprintf(buffer, sizeof(buffer) - 1, ".%ld.%p.tmp", (long)getpid(),
+	(void *)Tcl_GetCurrentThread());
+
+    Tcl_DStringInit(&tempPath);
+    Tcl_DStringAppend(&tempPath, Tcl_DStringValue(&path),
+	Tcl_DStringLength(&path));
+
+    Tcl_DStringAppend(&tempPath, buffer, -1);
+
+    fd = open(Tcl_DStringValue(&tempPath), O_WRONLY | O_CREAT | O_TRUNC,
+	0644);
+
+    if (fd < 0)
+	goto done;
+
+    for (offset = 0; offset < nBytes;) {
+	ssize_t nWritten = write(fd, pData + offset, nBytes - offset);
+
+	if (nWritten <= 0)
+	    goto done;
+
+	offset += (size_t)nWritten;
+    }
+
+    if (close(fd) != 0) {
+	fd = -1;
+	goto done;
+    }
+
+    fd = -1;
+
+    if (rename(Tcl_DStringValue(&tempPath), Tcl_DStringValue(&path)) != 0)
+	goto done;
+
+    rc = 0;
+
+done:
+    if (fd >= 0)
+	close(fd);
+
+    if (rc != 0)
+	unlink(Tcl_DStringValue(&tempPath));
+
+    Tcl_DStringFree(&tempPath);
+    Tcl_DStringFree(&path);
+
+    return rc;
+#else
+    return -1;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadExternalEntry --
+ *
+ *	This function attempts to find the compile cache entry for the
+ *	specified key in the shared memory table and then in the on-disk
+ *	cache, if they are enabled.  If found, the files included by the
+ *	entry are checked for changes.  If any of them changed, the entry
+ *	is ignored and the on-disk cache file, if any, is deleted.
+ *	Otherwise, the entry is added to the compile cache and a reference
+ *	to it is returned.  An entry found in the on-disk cache is also
+ *	added to the shared memory table.
+ *
+ * Results:
+ *	The entry -OR- NULL if it was not found.  A non-NULL entry must
+ *	be released via SassCacheRelease.
+ *
+ * Side effects:
+ *	The shared and disk hit and miss counts are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCacheEntry *LoadExternalEntry(
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength,			/* IN: Number of key bytes. */
+    Tcl_WideUInt hash)			/* IN: Hash of the key bytes. */
+{
+    Tcl_DString diskKey;
+    Tcl_WideUInt diskHash;
+    char *zShmPath;
+    char *zDir;
+    char *pData = NULL;
+    size_t nBytes = 0;
+    int bInvalid = 0;
+    SassCacheEntry *entryPtr = NULL;
+
+    zShmPath = SassShmGetConfig(NULL);
+    zDir = GetDiskDir();
+
+    if ((zShmPath == NULL) && (zDir == NULL))
+	return NULL;
+
+    GetDiskKey(zKey, keyLength, &diskKey);
+    diskHash = HashKey(Tcl_DStringValue(&diskKey),
+	Tcl_DStringLength(&diskKey));
+
+    if (zShmPath != NULL) {
+	if (SassShmFind(diskHash, &pData, &nBytes)) {
+	    entryPtr = DeserializeEntry(pData, nBytes, zKey, keyLength,
+		&diskKey);
+
+	    ckfree(pData);
+
+	    if ((entryPtr != NULL) && !IsEntryValid(entryPtr)) {
+		ckfree((char *)entryPtr);
+		entryPtr = NULL;
+		bInvalid = 1;
+	    }
+	}
+
+	SassShmCount(entryPtr != NULL);
+    }
+
+    if ((entryPtr == NULL) && (zDir != NULL)) {
+	entryPtr = ReadDiskEntry(zDir, zKey, keyLength, &diskKey);
+
+	if ((entryPtr != NULL) && !IsEntryValid(entryPtr)) {
+#ifndef SASS_NO_DISK_CACHE
+	    Tcl_DString path;
+
+	    GetDiskPath(zDir, Tcl_DStringValue(&diskKey),
+		Tcl_DStringLength(&diskKey), &path);
+
+	    unlink(Tcl_DStringValue(&path));
+	    Tcl_DStringFree(&path);
+#endif
+
+	    ckfree((char *)entryPtr);
+	    entryPtr = NULL;
+	    bInvalid = 1;
+	}
+
+	if ((entryPtr != NULL) && (zShmPath != NULL)) {
+	    pData = SerializeEntry(entryPtr, &diskKey, &nBytes);
+
+	    if (pData != NULL) {
+		SassShmStore(diskHash, pData, nBytes);
+		ckfree(pData);
+	    }
+	}
+
+	Tcl_MutexLock(&cacheMutex);
+
+	if (entryPtr != NULL) {
+	    cache.diskHits++;
+	} else {
+	    cache.diskMisses++;
+	}
+
+	Tcl_MutexUnlock(&cacheMutex);
+    }
+
+    Tcl_DStringFree(&diskKey);
+
+    if (zDir != NULL)
+	ckfree(zDir);
+
+    if (zShmPath != NULL)
+	ckfree(zShmPath);
+
+    Tcl_MutexLock(&cacheMutex);
+
+    if (bInvalid)
+	cache.invalidations++;
+
+    if (entryPtr != NULL) {
+	entryPtr->refCount++;
+
+	if (entryPtr->nBytes <= cache.maxBytes)
+	    InsertEntry(entryPtr, hash);
+    }
+
+    Tcl_MutexUnlock(&cacheMutex);
+    return entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StoreExternalEntry --
+ *
+ *	This function adds the specified compile cache entry to the shared
+ *	memory table and the on-disk cache, if they are enabled.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The disk store and error counts are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void StoreExternalEntry(
+    SassCacheEntry *entryPtr)		/* IN: The entry to add. */
+{
+    Tcl_DString diskKey;
+    char *zShmPath;
+    char *zDir;
+    char *pData;
+    size_t nBytes = 0;
+
+    zShmPath = SassShmGetConfig(NULL);
+    zDir = GetDiskDir();
+
+    if ((zShmPath == NULL) && (zDir == NULL))
+	return;
+
+    GetDiskKey(entryPtr->zKey, entryPtr->keyLength, &diskKey);
+    pData = SerializeEntry(entryPtr, &diskKey, &nBytes);
+
+    if (pData != NULL) {
+	if (zShmPath != NULL) {
+	    SassShmStore(HashKey(Tcl_DStringValue(&diskKey),
+		Tcl_DStringLength(&diskKey)), pData, nBytes);
+	}
+
+	if (zDir != NULL) {
+	    int rc = WriteDiskEntry(zDir, &diskKey, pData, nBytes);
+
+	    Tcl_MutexLock(&cacheMutex);
+
+	    if (rc == 0) {
+		cache.diskStores++;
+	    } else {
+		cache.diskErrors++;
+	    }
+
+	    Tcl_MutexUnlock(&cacheMutex);
+	}
+
+	ckfree(pData);
+    }
+
+    Tcl_DStringFree(&diskKey);
+
+    if (zDir != NULL)
+	ckfree(zDir);
+
+    if (zShmPath != NULL)
+	ckfree(zShmPath);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountLookup --
+ *
+ *	This function counts the final outcome of a compile cache lookup,
+ *	from all the tiers, for [sass stats] and records it for [sass
+ *	trace].
+ *
+ * Results:
+ *	The specified entry, which may be NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassCacheEntry *CountLookup(
+    SassCacheEntry *entryPtr,		/* IN: The entry found, or NULL. */
+    Tcl_WideUInt hash)			/* IN: The hash of the key. */
+{
+    SassStatsCount((entryPtr != NULL) ? SASS_STAT_CACHE_HITS :
+	SASS_STAT_CACHE_MISSES, 1);
+
+    SASS_TRACE((entryPtr != NULL) ? SASS_TRACE_CACHE_HIT :
+	SASS_TRACE_CACHE_MISS, hash, 0);
+
+    return entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassCacheFind --
+ *
+ *	This function attempts to find the compile cache entry for the
+ *	specified key.  If found, the files included by the entry are
+ *	checked for changes.  If any of them changed, the entry is removed
+ *	from the cache.  Otherwise, the entry becomes the most recently
+ *	used one and a reference to it is returned.  If the entry is not
+ *	found (or was removed), the shared memory table and then the
+ *	on-disk cache are checked next, unless the key is only valid for
+ *	this process, e.g. because it depends on custom functions.
+ *
+ * Results:
+ *	The entry -OR- NULL if it was not found.  A non-NULL entry must
+ *	be released via SassCacheRelease.
+ *
+ * Side effects:
+ *	The cache hit and miss counts are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+SassCacheEntry *SassCacheFind(
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength,			/* IN: Number of key bytes. */
+    int bLocal)				/* IN: Non-zero for this process only. */
+{
+    Tcl_WideUInt hash;
+    Tcl_HashEntry *hPtr;
+    SassCacheEntry *entryPtr = NULL;
+
+    if ((zKey == NULL) || (keyLength < 0))
+	return NULL;
+
+    hash = HashKey(zKey, keyLength);
+
+    Tcl_MutexLock(&cacheMutex);
+    InitializeCache();
+
+    hPtr = Tcl_FindHashEntry(&cache.table, (char *)(size_t)hash);
+
+    if (hPtr != NULL) {
+	entryPtr = (SassCacheEntry *)Tcl_GetHashValue(hPtr);
+
+	if ((entryPtr->keyLength != keyLength) ||
+		(memcmp(entryPtr->zKey, zKey, keyLength) != 0)) {
+	    entryPtr = NULL;
+	}
+    }
+
+    if (entryPtr == NULL) {
+	cache.misses++;
+	Tcl_MutexUnlock(&cacheMutex);
+
+	return CountLookup(bLocal ? NULL :
+	    LoadExternalEntry(zKey, keyLength, hash), hash);
+    }
+
+    /*
+     * NOTE: The included files are checked without holding the cache mutex,
+     *       because doing so requires file system access.  The reference
+     *       prevents the entry from being freed in the meantime.
+     */
+
+    entryPtr->refCount++;
+    Tcl_MutexUnlock(&cacheMutex);
+
+    if (IsEntryValid(entryPtr)) {
+	Tcl_MutexLock(&cacheMutex);
+
+	if (entryPtr->hPtr != NULL) {
+	    UnlinkEntry(entryPtr);
+	    LinkEntry(entryPtr);
+	}
+
+	cache.hits++;
+	Tcl_MutexUnlock(&cacheMutex);
+	return CountLookup(entryPtr, hash);
+    }
+
+    Tcl_MutexLock(&cacheMutex);
+
+    if (entryPtr->hPtr != NULL)
+	RemoveEntry(entryPtr);
+
+    cache.invalidations++;
+    cache.misses++;
+    Tcl_MutexUnlock(&cacheMutex);
+
+    SassCacheRelease(entryPtr);
+
+    return CountLookup(bLocal ? NULL :
+	LoadExternalEntry(zKey, keyLength, hash), hash);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassCacheGetResult --
+ *
+ *	This function returns the compilation result associated with the
+ *	specified compile cache entry.
+ *
+ * Results:
+ *	The result.  It remains valid until the entry is released.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+const SassResult *SassCacheGetResult(
+    SassCacheEntry *entryPtr)		/* IN: The entry to query. */
+{
+    return (entryPtr != NULL) ? &entryPtr->result : NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassCacheRelease --
+ *
+ *	This function releases a reference to a compile cache entry that
+ *	was returned by SassCacheFind.  If the entry has already been
+ *	removed from the cache, it will be freed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassCacheRelease(
+    SassCacheEntry *entryPtr)		/* IN: The entry to release. */
+{
+    if (entryPtr == NULL)
+	return;
+
+    Tcl_MutexLock(&cacheMutex);
+    entryPtr->refCount--;
+
+    if ((entryPtr->refCount <= 0) && (entryPtr->hPtr == NULL))
+	ckfree((char *)entryPtr);
+
+    Tcl_MutexUnlock(&cacheMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassCacheStore --
+ *
+ *	This function adds a copy of the specified compilation result to
+ *	the compile cache, replacing any existing entry with the same key
+ *	hash.  The current state of each included file is recorded.  If
+ *	the new entry alone would exceed the byte budget, it is not added.
+ *	Nothing is added if an included file cannot be queried -OR- was
+ *	modified after, or shortly before, the specified compilation start
+ *	time, because its recorded state may not match the contents that
+ *	were actually compiled.  Otherwise, the least recently used entries
+ *	are evicted until the cache fits within its byte budget again.  If the shared
+ *	memory table and/or on-disk cache are enabled, the result is also
+ *	added to them, unless the key is only valid for this process.
+ *	That is the case when custom functions were used, since their
+ *	versions within the key are not meaningful to other processes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassCacheStore(
+    const char *zKey,			/* IN: The key bytes. */
+    int keyLength,			/* IN: Number of key bytes. */
+    const SassResult *resultPtr,	/* IN: The result to copy. */
+    char **azIncluded,			/* IN: Included files, may be NULL. */
+    const Tcl_Time *startTimePtr,	/* IN: When compilation started. */
+    int bLocal)				/* IN: Non-zero for this process only. */
+{
+    enum Sass_Validate_Method validate;
+    int nDeps = 0;
+    SassCacheDep *aDeps = NULL;
+    SassCacheEntry *entryPtr;
+    Tcl_WideUInt hash;
+    int bStored = 0;
+    int index;
+
+    if ((zKey == NULL) || (keyLength < 0) || (resultPtr == NULL))
+	return;
+
+    Tcl_MutexLock(&cacheMutex);
+    validate = cache.validate;
+    Tcl_MutexUnlock(&cacheMutex);
+
+    if (azIncluded != NULL) {
+	while (azIncluded[nDeps] != NULL)
+	    nDeps++;
+    }
+
+    /*
+     * NOTE: Record the state of each included file.  If any of them are too
+     *       new, they may have been modified while being compiled; in that
+     *       case, do not add the result, because it may be stale already.
+     *       This applies to both validation methods, since the contents
+     *       hashed now may not be the ones that were compiled.
+     */
+
+    if (nDeps > 0) {
+	aDeps = (SassCacheDep *)attemptckalloc(nDeps * sizeof(SassCacheDep));
+
+	if (aDeps == NULL)
+	    return;
+
+	for (index = 0; index < nDeps; index++) {
+	    SassCacheDep *depPtr = &aDeps[index];
+	    Tcl_WideInt mtime;
+	    long mtimeNsec;
+
+	    if ((GetFileState(azIncluded[index], validate, depPtr, &mtime,
+		    &mtimeNsec) != 0) || ((startTimePtr != NULL) &&
+		    SassIsRecentTime(mtime, mtimeNsec, startTimePtr))) {
+		ckfree((char *)aDeps);
+		return;
+	    }
+	}
+    }
+
+    /*
+     * NOTE: Build the new entry (and add it to the shared memory table and
+     *       the on-disk cache) before acquiring the cache mutex again, so
+     *       that other threads are not blocked while doing so.
+     */
+
+    entryPtr = NewEntry(zKey, keyLength, resultPtr, validate, nDeps, aDeps);
+
+    if (aDeps != NULL)
+	ckfree((char *)aDeps);
+
+    if (entryPtr == NULL)
+	return;
+
+    if (!bLocal)
+	StoreExternalEntry(entryPtr);
+
+    hash = HashKey(zKey, keyLength);
+    Tcl_MutexLock(&cacheMutex);
+
+    if (entryPtr->nBytes <= cache.maxBytes) {
+	InsertEntry(entryPtr, hash);
+	cache.stores++;
+	bStored = 1;
+    } else {
+	ckfree((char *)entryPtr);
+    }
+
+    Tcl_MutexUnlock(&cacheMutex);
+
+    SASS_TRACE(SASS_TRACE_CACHE_STORE, hash, bStored);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendNameAndWide --
+ *
+ *	This function appends the specified name and wide integer value
+ *	to the specified list object.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int AppendNameAndWide(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *listPtr,			/* IN/OUT: The list to modify. */
+    const char *zName,			/* IN: The name to append. */
+    Tcl_WideInt value)			/* IN: The value to append. */
+{
+    if (Tcl_ListObjAppendElement(interp, listPtr,
+	    Tcl_NewStringObj(zName, -1)) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    return Tcl_ListObjAppendElement(interp, listPtr,
+	Tcl_NewWideIntObj(value));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendNameAndString --
+ *
+ *	This function appends the specified name and string value to the
+ *	specified list object.  A NULL value is appended as an empty
+ *	string.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int AppendNameAndString(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *listPtr,			/* IN/OUT: The list to modify. */
+    const char *zName,			/* IN: The name to append. */
+    const char *zValue)			/* IN: The value to append. */
+{
+    if (Tcl_ListObjAppendElement(interp, listPtr,
+	    Tcl_NewStringObj(zName, -1)) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    return Tcl_ListObjAppendElement(interp, listPtr,
+	Tcl_NewStringObj((zValue != NULL) ? zValue : "", -1));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassCacheObjCmd --
+ *
+ *	Handles the [sass cache] sub-command.  The sub-commands supported
+ *	are "clear", "configure", and "stats".
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The compile cache may be modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassCacheObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int code = TCL_OK;
+    int option;
+
+    static const char *cmdOptions[] = {
+	"clear", "configure", "stats", (char *) NULL
+    };
+
+    enum options {
+	OPT_CLEAR, OPT_CONFIGURE, OPT_STATS
+    };
+
+    static const char *cfgOptions[] = {
+	"-dir", "-maxbytes", "-shared", "-sharedsize", "-validate",
+	(char *) NULL
+    };
+
+    enum cfgOptions {
+	CFG_DIR, CFG_MAXBYTES, CFG_SHARED, CFG_SHAREDSIZE, CFG_VALIDATE
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassCacheObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_CLEAR: {
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    Tcl_MutexLock(&cacheMutex);
+	    RemoveAllEntries();
+	    Tcl_MutexUnlock(&cacheMutex);
+
+	    Tcl_ResetResult(interp);
+	    break;
+	}
+	case OPT_CONFIGURE: {
+	    int index;
+	    Tcl_Obj *dirPtr;
+	    Tcl_Obj *sharedPtr;
+	    Tcl_WideInt maxBytes;
+	    Tcl_WideInt sharedSize;
+	    int validate;
+
+	    if (objc == 3) {
+		Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+		char *zDir = GetDiskDir();
+		char *zShmPath = SassShmGetConfig(&sharedSize);
+
+		Tcl_MutexLock(&cacheMutex);
+		maxBytes = (Tcl_WideInt)cache.maxBytes;
+		validate = (int)cache.validate;
+
+		if (zShmPath == NULL)
+		    sharedSize = cache.sharedSize;
+
+		Tcl_MutexUnlock(&cacheMutex);
+
+		Tcl_IncrRefCount(listPtr);
+
+		if ((AppendNameAndString(interp, listPtr, "-dir",
+			zDir) != TCL_OK) ||
+		    (AppendNameAndWide(interp, listPtr, "-maxbytes",
+			maxBytes) != TCL_OK) ||
+		    (AppendNameAndString(interp, listPtr, "-shared",
+			zShmPath) != TCL_OK) ||
+		    (AppendNameAndWide(interp, listPtr, "-sharedsize",
+			sharedSize) != TCL_OK) ||
+		    (AppendNameAndString(interp, listPtr, "-validate",
+			validateMethods[validate]) != TCL_OK)) {
+		    code = TCL_ERROR;
+		} else {
+		    Tcl_SetObjResult(interp, listPtr);
+		}
+
+		if (zShmPath != NULL)
+		    ckfree(zShmPath);
+
+		if (zDir != NULL)
+		    ckfree(zDir);
+
+		Tcl_DecrRefCount(listPtr);
+		break;
+	    }
+
+	    if ((objc % 2) != 1) {
+		Tcl_WrongNumArgs(interp, 3, objv,
+		    "?-dir directory? ?-maxbytes bytes? ?-shared fileName?"
+		    " ?-sharedsize bytes? ?-validate method?");
+
+		return TCL_ERROR;
+	    }
+
+	    /*
+	     * NOTE: Validate all the options before changing anything, so
+	     *       that a bad value does not leave the cache partially
+	     *       configured.
+	     */
+
+	    dirPtr = NULL;
+	    sharedPtr = NULL;
+	    maxBytes = -1;
+	    sharedSize = -1;
+	    validate = -1;
+
+	    for (index = 3; index < objc; index += 2) {
+		int cfgOption;
+
+		if (Tcl_GetIndexFromObj(interp, objv[index], cfgOptions,
+			"option", 0, &cfgOption) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+
+		/*
+		 * NOTE: The cache directory and the shared memory file are
+		 *       written by this process; therefore, a safe interp
+		 *       is not allowed to pick them.
+		 */
+
+		if (((cfgOption == CFG_DIR) || (cfgOption == CFG_SHARED)) &&
+			Tcl_IsSafe(interp)) {
+		    Tcl_AppendResult(interp, "option ", cfgOptions[cfgOption],
+			" is not allowed in a safe interpreter\n", NULL);
+
+		    return TCL_ERROR;
+		}
+
+		switch ((enum cfgOptions)cfgOption) {
+		    case CFG_DIR: {
+			int dirLength;
+
+			Tcl_GetStringFromObj(objv[index + 1], &dirLength);
+
+			if (dirLength > 0) {
+#ifndef SASS_NO_DISK_CACHE
+			    struct stat statBuf;
+
+			    dirPtr = Tcl_FSGetNormalizedPath(interp,
+				objv[index + 1]);
+
+			    if (dirPtr == NULL)
+				return TCL_ERROR;
+
+			    if ((stat(Tcl_GetString(dirPtr), &statBuf) != 0) ||
+				    !S_ISDIR(statBuf.st_mode)) {
+				Tcl_AppendResult(interp,
+				    "cache directory does not exist\n", NULL);
+
+				return TCL_ERROR;
+			    }
+#else
+			    Tcl_AppendResult(interp,
+				"on-disk cache is not supported\n", NULL);
+
+			    return TCL_ERROR;
+#endif
+			} else {
+			    dirPtr = objv[index + 1];
+			}
+
+			break;
+		    }
+		    case CFG_MAXBYTES: {
+			if (Tcl_GetWideIntFromObj(interp, objv[index + 1],
+				&maxBytes) != TCL_OK) {
+			    return TCL_ERROR;
+			}
+
+			if (maxBytes < 0) {
+			    Tcl_AppendResult(interp,
+				"maximum bytes cannot be negative\n", NULL);
+
+			    return TCL_ERROR;
+			}
+
+			break;
+		    }
+		    case CFG_SHARED: {
+			int sharedLength;
+
+			Tcl_GetStringFromObj(objv[index + 1], &sharedLength);
+
+			if (sharedLength > 0) {
+			    sharedPtr = Tcl_FSGetNormalizedPath(interp,
+				objv[index + 1]);
+
+			    if (sharedPtr == NULL)
+				return TCL_ERROR;
+			} else {
+			    sharedPtr = objv[index + 1];
+			}
+
+			break;
+		    }
+		    case CFG_SHAREDSIZE: {
+			if (Tcl_GetWideIntFromObj(interp, objv[index + 1],
+				&sharedSize) != TCL_OK) {
+			    return TCL_ERROR;
+			}
+
+			if (sharedSize < 0) {
+			    Tcl_AppendResult(interp,
+				"shared size cannot be negative\n", NULL);
+
+			    return TCL_ERROR;
+			}
+
+			break;
+		    }
+		    case CFG_VALIDATE: {
+			if (Tcl_GetIndexFromObj(interp, objv[index + 1],
+				validateMethods, "method", 0,
+				&validate) != TCL_OK) {
+			    return TCL_ERROR;
+			}
+
+			break;
+		    }
+		}
+	    }
+
+	    /*
+	     * NOTE: Opening the shared memory file may fail; therefore, do it
+	     *       before changing any other settings.
+	     */
+
+	    if (sharedSize >= 0) {
+		Tcl_MutexLock(&cacheMutex);
+		cache.sharedSize = sharedSize;
+		Tcl_MutexUnlock(&cacheMutex);
+	    }
+
+	    if (sharedPtr != NULL) {
+		Tcl_MutexLock(&cacheMutex);
+		sharedSize = cache.sharedSize;
+		Tcl_MutexUnlock(&cacheMutex);
+
+		if (SassShmOpen(interp, Tcl_GetString(sharedPtr),
+			sharedSize) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+	    }
+
+	    Tcl_MutexLock(&cacheMutex);
+
+	    if (dirPtr != NULL) {
+		int dirLength;
+		const char *zDir = Tcl_GetStringFromObj(dirPtr, &dirLength);
+
+		if (cache.zDir != NULL) {
+		    ckfree(cache.zDir);
+		    cache.zDir = NULL;
+		}
+
+		if (dirLength > 0) {
+		    cache.zDir = ckalloc(dirLength + 1);
+		    memcpy(cache.zDir, zDir, dirLength + 1);
+		}
+	    }
+
+	    if (maxBytes >= 0) {
+		cache.maxBytes = (size_t)maxBytes;
+		EvictEntries(cache.maxBytes);
+	    }
+
+	    if (validate >= 0)
+		cache.validate = (enum Sass_Validate_Method)validate;
+
+	    Tcl_MutexUnlock(&cacheMutex);
+
+	    Tcl_ResetResult(interp);
+	    break;
+	}
+	case OPT_STATS: {
+	    SassCache stats;
+	    Tcl_WideInt sharedHits;
+	    Tcl_WideInt sharedMisses;
+	    Tcl_WideInt sharedStores;
+	    Tcl_Obj *listPtr;
+
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    Tcl_MutexLock(&cacheMutex);
+	    memcpy(&stats, &cache, sizeof(SassCache));
+	    Tcl_MutexUnlock(&cacheMutex);
+
+	    SassShmGetStats(&sharedHits, &sharedMisses, &sharedStores);
+
+	    listPtr = Tcl_NewListObj(0, NULL);
+	    Tcl_IncrRefCount(listPtr);
+
+	    if ((AppendNameAndWide(interp, listPtr, "entries",
+		    stats.nEntries) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "bytes",
+		    (Tcl_WideInt)stats.nBytes) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "maxBytes",
+		    (Tcl_WideInt)stats.maxBytes) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "hits",
+		    stats.hits) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "misses",
+		    stats.misses) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "stores",
+		    stats.stores) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "evictions",
+		    stats.evictions) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "invalidations",
+		    stats.invalidations) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "diskHits",
+		    stats.diskHits) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "diskMisses",
+		    stats.diskMisses) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "diskStores",
+		    stats.diskStores) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "diskErrors",
+		    stats.diskErrors) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "sharedHits",
+		    sharedHits) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "sharedMisses",
+		    sharedMisses) != TCL_OK) ||
+		(AppendNameAndWide(interp, listPtr, "sharedStores",
+		    sharedStores) != TCL_OK)) {
+		code = TCL_ERROR;
+	    } else {
+		Tcl_SetObjResult(interp, listPtr);
+	    }
+
+	    Tcl_DecrRefCount(listPtr);
+	    break;
+	}
+	default: {
+	    Tcl_AppendResult(interp, "bad option index\n", NULL);
+	    return TCL_ERROR;
+	}
+    }
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassCacheFinalize --
+ *
+ *	This function frees all the entries within the compile cache and
+ *	then the cache itself.  It is called when the package is being
+ *	unloaded from the process.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassCacheFinalize(void)
+{
+    Tcl_MutexLock(&cacheMutex);
+    RemoveAllEntries();
+
+    if (cache.bInitialized) {
+	Tcl_DeleteHashTable(&cache.table);
+	cache.bInitialized = 0;
+    }
+
+    if (cache.zDir != NULL) {
+	ckfree(cache.zDir);
+	cache.zDir = NULL;
+    }
+
+    Tcl_MutexUnlock(&cacheMutex);
+    Tcl_MutexFinalize(&cacheMutex);
+}
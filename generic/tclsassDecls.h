@@ -0,0 +1,83 @@
+/*
+ * tclsassDecls.h -- Tcl Package for libsass
+ *
+ * Declarations of the functions within the stubs table of this package.  The
+ * part between the markers is generated from "tclsass.decls" by the Tcl
+ * "genStubs.tcl" tool, via "make genstubs".
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifndef _TCLSASSDECLS
+#define _TCLSASSDECLS
+
+#undef TCL_STORAGE_CLASS
+#ifdef BUILD_sass
+#   define TCL_STORAGE_CLASS DLLEXPORT
+#else
+#   define TCL_STORAGE_CLASS DLLIMPORT
+#endif
+
+/* !BEGIN!: Do not edit below this line. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Exported function declarations:
+ */
+
+/* 0 */
+EXTERN int		Sass_CompileEx(Tcl_Interp *interp, int type,
+				const char *zSource, int sourceLength,
+				Tcl_Obj *optionsPtr, int flags,
+				Sass_CompileResult *resultPtr);
+/* 1 */
+EXTERN void		Sass_FreeResult(Sass_CompileResult *resultPtr);
+/* 2 */
+EXTERN int		Sass_RegisterFunction(const char *zSignature,
+				Sass_FunctionProc *xProc, void *clientData);
+/* 3 */
+EXTERN int		Sass_UnregisterFunction(const char *zName);
+
+typedef struct SassStubs {
+    int magic;
+    void *hooks;
+
+    int (*sass_CompileEx) (Tcl_Interp *interp, int type, const char *zSource, int sourceLength, Tcl_Obj *optionsPtr, int flags, Sass_CompileResult *resultPtr); /* 0 */
+    void (*sass_FreeResult) (Sass_CompileResult *resultPtr); /* 1 */
+    int (*sass_RegisterFunction) (const char *zSignature, Sass_FunctionProc *xProc, void *clientData); /* 2 */
+    int (*sass_UnregisterFunction) (const char *zName); /* 3 */
+} SassStubs;
+
+extern const SassStubs *sassStubsPtr;
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(USE_SASS_STUBS)
+
+/*
+ * Inline function declarations:
+ */
+
+#define Sass_CompileEx \
+	(sassStubsPtr->sass_CompileEx) /* 0 */
+#define Sass_FreeResult \
+	(sassStubsPtr->sass_FreeResult) /* 1 */
+#define Sass_RegisterFunction \
+	(sassStubsPtr->sass_RegisterFunction) /* 2 */
+#define Sass_UnregisterFunction \
+	(sassStubsPtr->sass_UnregisterFunction) /* 3 */
+
+#endif /* defined(USE_SASS_STUBS) */
+
+/* !END!: Do not edit above this line. */
+
+#undef TCL_STORAGE_CLASS
+#define TCL_STORAGE_CLASS DLLIMPORT
+
+#endif /* _TCLSASSDECLS */
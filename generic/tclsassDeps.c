@@ -0,0 +1,1160 @@
+/*
+ * tclsassDeps.c -- Tcl Package for libsass
+ *
+ * Implements [sass deps], which reports the files included by stylesheets.
+ * The included files of a single source are obtained by parsing it.  For
+ * build and cache purging tools, a dependency index may also be maintained
+ * within a folder; it maps each entry point stylesheet to the files that it
+ * includes and, in reverse, each included file to the entry points that must
+ * be rebuilt when it changes.  The index is persisted as a Tcl list and kept
+ * loaded by each Tcl interpreter, so that queries do not need to compile or
+ * even read anything, unless the index was changed by another process.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <errno.h>		/* NOTE: For errno. */
+#include <stdlib.h>		/* NOTE: For qsort(). */
+#include <string.h>		/* NOTE: For memset(), strcmp(). */
+#include <sys/types.h>		/* NOTE: For struct stat. */
+#include <sys/stat.h>		/* NOTE: For stat(). */
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: This is the name of the file, within the folder specified via the
+ *       -dir option, where the dependency index is persisted.
+ */
+
+#ifndef SASS_DEPS_FILE_NAME
+  #define SASS_DEPS_FILE_NAME			"tclsass.deps"
+#endif
+
+/*
+ * NOTE: The persisted dependency index starts with these two list elements,
+ *       which identify its format.  They are followed by pairs of an entry
+ *       point and the list of files that it includes.
+ */
+
+#define SASS_DEPS_MAGIC				"tclsass-deps"
+#define SASS_DEPS_VERSION			"1"
+
+/*
+ * NOTE: This is the name of the Tcl interpreter association data used to
+ *       store the dependency indexes loaded by [sass deps].
+ */
+
+#define DEPS_DATA_NAME				PACKAGE_NAME "_deps"
+
+/*
+ * NOTE: This structure holds one loaded dependency index.  The modification
+ *       time and size of its file, as of when it was last read or written,
+ *       are used to detect changes made by other processes.  The included
+ *       files of an entry point always include the entry point itself.
+ */
+
+typedef struct SassDepsIndex {
+    Tcl_Obj *pathPtr;			/* The normalized index file. */
+    int bExists;			/* Non-zero if the file existed. */
+    Tcl_WideInt sec;			/* Modification time, seconds. */
+    long nsec;				/* Nanoseconds portion of above. */
+    Tcl_WideInt size;			/* Size of the file, in bytes. */
+    Tcl_HashTable entries;		/* Maps entry points to includes. */
+    Tcl_HashTable files;		/* Maps included files to entries. */
+} SassDepsIndex;
+
+/*
+ * NOTE: This structure holds the dependency indexes loaded by one Tcl
+ *       interpreter, keyed by the normalized paths of their files.
+ */
+
+typedef struct SassDepsTable {
+    Tcl_HashTable indexes;		/* Maps index files to indexes. */
+} SassDepsTable;
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static SassDepsTable *	GetDepsTable(Tcl_Interp *interp);
+static void		DepsTableDeleteProc(ClientData clientData,
+			    Tcl_Interp *interp);
+static void		ClearIndex(SassDepsIndex *indexPtr);
+static void		FreeIndex(SassDepsIndex *indexPtr);
+static void		SetEntry(SassDepsIndex *indexPtr, Tcl_Obj *entryPtr,
+			    Tcl_Obj *includedPtr);
+static int		StatIndex(SassDepsIndex *indexPtr, int *bExistsPtr,
+			    Tcl_WideInt *secPtr, long *nsecPtr,
+			    Tcl_WideInt *sizePtr);
+static int		ReadIndex(Tcl_Interp *interp,
+			    SassDepsIndex *indexPtr);
+static SassDepsIndex *	LoadIndex(Tcl_Interp *interp, Tcl_Obj *dirPtr);
+static int		SaveIndex(Tcl_Interp *interp,
+			    SassDepsIndex *indexPtr);
+static int		CompareObjs(const void *pLeft, const void *pRight);
+static Tcl_Obj *	NewSortedList(Tcl_HashTable *tablePtr);
+static Tcl_Obj *	NormalizePath(Tcl_Obj *pathPtr);
+static int		IndexEntries(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassAddToList --
+ *
+ *	This function adds a value to the list stored within a hash table
+ *	for the specified key, unless it is already there.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassAddToList(
+    Tcl_HashTable *tablePtr,		/* IN/OUT: The hash table. */
+    const char *zKey,			/* IN: The key of the list. */
+    Tcl_Obj *valuePtr)			/* IN: The value to add. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_Obj *listPtr;
+    int objc;
+    Tcl_Obj **objv;
+    int bNew;
+    int index;
+
+    hPtr = Tcl_CreateHashEntry(tablePtr, zKey, &bNew);
+
+    if (bNew) {
+	listPtr = Tcl_NewListObj(1, &valuePtr);
+	Tcl_IncrRefCount(listPtr);
+	Tcl_SetHashValue(hPtr, listPtr);
+	return;
+    }
+
+    listPtr = (Tcl_Obj *)Tcl_GetHashValue(hPtr);
+    Tcl_ListObjGetElements(NULL, listPtr, &objc, &objv);
+
+    for (index = 0; index < objc; index++) {
+	if (strcmp(Tcl_GetString(objv[index]), Tcl_GetString(valuePtr)) == 0)
+	    return;
+    }
+
+    if (Tcl_IsShared(listPtr)) {
+	Tcl_DecrRefCount(listPtr);
+	listPtr = Tcl_DuplicateObj(listPtr);
+	Tcl_IncrRefCount(listPtr);
+	Tcl_SetHashValue(hPtr, listPtr);
+    }
+
+    Tcl_ListObjAppendElement(NULL, listPtr, valuePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassRemoveFromList --
+ *
+ *	This function removes a value from the list stored within a hash
+ *	table for the specified key.  Empty lists are removed as well.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassRemoveFromList(
+    Tcl_HashTable *tablePtr,		/* IN/OUT: The hash table. */
+    const char *zKey,			/* IN: The key of the list. */
+    const char *zValue)			/* IN: The value to remove. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_Obj *listPtr;
+    Tcl_Obj *newListPtr;
+    int objc;
+    Tcl_Obj **objv;
+    int index;
+
+    hPtr = Tcl_FindHashEntry(tablePtr, zKey);
+
+    if (hPtr == NULL)
+	return;
+
+    listPtr = (Tcl_Obj *)Tcl_GetHashValue(hPtr);
+    Tcl_ListObjGetElements(NULL, listPtr, &objc, &objv);
+    newListPtr = Tcl_NewListObj(0, NULL);
+
+    for (index = 0; index < objc; index++) {
+	if (strcmp(Tcl_GetString(objv[index]), zValue) != 0)
+	    Tcl_ListObjAppendElement(NULL, newListPtr, objv[index]);
+    }
+
+    Tcl_DecrRefCount(listPtr);
+    Tcl_ListObjLength(NULL, newListPtr, &objc);
+
+    if (objc == 0) {
+	Tcl_DecrRefCount(newListPtr);
+	Tcl_DeleteHashEntry(hPtr);
+	return;
+    }
+
+    Tcl_IncrRefCount(newListPtr);
+    Tcl_SetHashValue(hPtr, newListPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDepsTable --
+ *
+ *	This function returns the table of loaded dependency indexes for
+ *	the specified Tcl interpreter, creating it if necessary.
+ *
+ * Results:
+ *	The table.
+ *
+ * Side effects:
+ *	The table may be created and associated with the Tcl interpreter.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassDepsTable *GetDepsTable(
+    Tcl_Interp *interp)			/* Current Tcl interpreter. */
+{
+    SassDepsTable *tablePtr;
+
+    tablePtr = (SassDepsTable *)Tcl_GetAssocData(interp, DEPS_DATA_NAME,
+	NULL);
+
+    if (tablePtr == NULL) {
+	tablePtr = (SassDepsTable *)ckalloc(sizeof(SassDepsTable));
+	memset(tablePtr, 0, sizeof(SassDepsTable));
+	Tcl_InitHashTable(&tablePtr->indexes, TCL_STRING_KEYS);
+
+	Tcl_SetAssocData(interp, DEPS_DATA_NAME, DepsTableDeleteProc,
+	    tablePtr);
+    }
+
+    return tablePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DepsTableDeleteProc --
+ *
+ *	This function frees the loaded dependency indexes for a Tcl
+ *	interpreter, when it is being deleted -OR- the package is being
+ *	unloaded from it.  The persisted indexes are not affected.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void DepsTableDeleteProc(
+    ClientData clientData,		/* IN: The dependency index table. */
+    Tcl_Interp *interp)			/* Not used. */
+{
+    SassDepsTable *tablePtr = (SassDepsTable *)clientData;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    for (hPtr = Tcl_FirstHashEntry(&tablePtr->indexes, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	FreeIndex((SassDepsIndex *)Tcl_GetHashValue(hPtr));
+    }
+
+    Tcl_DeleteHashTable(&tablePtr->indexes);
+    ckfree((char *)tablePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClearIndex --
+ *
+ *	This function removes all the entry points from a loaded
+ *	dependency index.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ClearIndex(
+    SassDepsIndex *indexPtr)		/* IN/OUT: The dependency index. */
+{
+    Tcl_HashTable *aTables[2];
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    int index;
+
+    aTables[0] = &indexPtr->entries;
+    aTables[1] = &indexPtr->files;
+
+    for (index = 0; index < 2; index++) {
+	for (hPtr = Tcl_FirstHashEntry(aTables[index], &search);
+		hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	    Tcl_DecrRefCount((Tcl_Obj *)Tcl_GetHashValue(hPtr));
+	}
+
+	Tcl_DeleteHashTable(aTables[index]);
+	Tcl_InitHashTable(aTables[index], TCL_STRING_KEYS);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeIndex --
+ *
+ *	This function frees a loaded dependency index.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FreeIndex(
+    SassDepsIndex *indexPtr)		/* IN: The dependency index. */
+{
+    ClearIndex(indexPtr);
+    Tcl_DeleteHashTable(&indexPtr->entries);
+    Tcl_DeleteHashTable(&indexPtr->files);
+    Tcl_DecrRefCount(indexPtr->pathPtr);
+    ckfree((char *)indexPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetEntry --
+ *
+ *	This function replaces the included files of an entry point within
+ *	a loaded dependency index, updating the reverse index as well.  If
+ *	the list of included files is NULL, the entry point is removed.
+ *	The entry point itself is always included.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void SetEntry(
+    SassDepsIndex *indexPtr,		/* IN/OUT: The dependency index. */
+    Tcl_Obj *entryPtr,			/* IN: The entry point. */
+    Tcl_Obj *includedPtr)		/* IN: Included files, or NULL. */
+{
+    const char *zEntry = Tcl_GetString(entryPtr);
+    Tcl_HashEntry *hPtr;
+    int objc;
+    Tcl_Obj **objv;
+    int bNew;
+    int index;
+
+    hPtr = Tcl_FindHashEntry(&indexPtr->entries, zEntry);
+
+    if (hPtr != NULL) {
+	Tcl_Obj *oldPtr = (Tcl_Obj *)Tcl_GetHashValue(hPtr);
+
+	Tcl_ListObjGetElements(NULL, oldPtr, &objc, &objv);
+
+	for (index = 0; index < objc; index++) {
+	    SassRemoveFromList(&indexPtr->files, Tcl_GetString(objv[index]),
+		zEntry);
+	}
+
+	SassRemoveFromList(&indexPtr->files, zEntry, zEntry);
+	Tcl_DecrRefCount(oldPtr);
+	Tcl_DeleteHashEntry(hPtr);
+    }
+
+    if (includedPtr == NULL)
+	return;
+
+    Tcl_IncrRefCount(includedPtr);
+    Tcl_ListObjGetElements(NULL, includedPtr, &objc, &objv);
+
+    for (index = 0; index < objc; index++)
+	SassAddToList(&indexPtr->files, Tcl_GetString(objv[index]), entryPtr);
+
+    SassAddToList(&indexPtr->files, zEntry, entryPtr);
+
+    hPtr = Tcl_CreateHashEntry(&indexPtr->entries, zEntry, &bNew);
+    Tcl_SetHashValue(hPtr, includedPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StatIndex --
+ *
+ *	This function queries the modification time and size of the file
+ *	for a dependency index.  A missing file is not an error.
+ *
+ * Results:
+ *	Zero on success, non-zero if the file could not be queried.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int StatIndex(
+    SassDepsIndex *indexPtr,		/* IN: The dependency index. */
+    int *bExistsPtr,			/* OUT: Non-zero if the file exists. */
+    Tcl_WideInt *secPtr,		/* OUT: Modification time, seconds. */
+    long *nsecPtr,			/* OUT: Nanoseconds portion of above. */
+    Tcl_WideInt *sizePtr)		/* OUT: Size of the file, in bytes. */
+{
+    struct stat statBuf;
+
+    *bExistsPtr = 0;
+    *secPtr = 0;
+    *nsecPtr = 0;
+    *sizePtr = 0;
+
+    if (stat(Tcl_GetString(indexPtr->pathPtr), &statBuf) != 0)
+	return (errno == ENOENT) ? 0 : -1;
+
+    *bExistsPtr = 1;
+    *secPtr = (Tcl_WideInt)statBuf.st_mtime;
+    *nsecPtr = STAT_MTIME_NSEC(&statBuf);
+    *sizePtr = (Tcl_WideInt)statBuf.st_size;
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadIndex --
+ *
+ *	This function reads the file for a dependency index, replacing
+ *	its loaded entry points.
+ *
+ * Results:
+ *	A standard Tcl result.  Upon failure, the loaded index is empty.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ReadIndex(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassDepsIndex *indexPtr)		/* IN/OUT: The dependency index. */
+{
+    int code = TCL_ERROR;
+    Tcl_Channel channel;
+    Tcl_Obj *dataPtr;
+    int objc;
+    Tcl_Obj **objv;
+    int index;
+
+    ClearIndex(indexPtr);
+
+    channel = Tcl_FSOpenFileChannel(interp, indexPtr->pathPtr, "r", 0);
+
+    if (channel == NULL)
+	return TCL_ERROR;
+
+    dataPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(dataPtr);
+
+    if ((Tcl_SetChannelOption(interp, channel, "-encoding",
+	    "utf-8") != TCL_OK) ||
+	    (Tcl_ReadChars(channel, dataPtr, -1, 0) < 0)) {
+	Tcl_AppendResult(interp, "error reading \"",
+	    Tcl_GetString(indexPtr->pathPtr), "\": ", Tcl_PosixError(interp),
+	    "\n", NULL);
+
+	Tcl_Close(NULL, channel);
+	goto done;
+    }
+
+    if (Tcl_Close(interp, channel) != TCL_OK)
+	goto done;
+
+    if ((Tcl_ListObjGetElements(NULL, dataPtr, &objc, &objv) != TCL_OK) ||
+	    (objc < 2) || (objc % 2 != 0) ||
+	    (strcmp(Tcl_GetString(objv[0]), SASS_DEPS_MAGIC) != 0) ||
+	    (strcmp(Tcl_GetString(objv[1]), SASS_DEPS_VERSION) != 0)) {
+	Tcl_AppendResult(interp, "malformed dependency index \"",
+	    Tcl_GetString(indexPtr->pathPtr), "\"\n", NULL);
+
+	goto done;
+    }
+
+    for (index = 2; index < objc; index += 2) {
+	int length;
+
+	if (Tcl_ListObjLength(NULL, objv[index + 1], &length) != TCL_OK) {
+	    ClearIndex(indexPtr);
+
+	    Tcl_AppendResult(interp, "malformed dependency index \"",
+		Tcl_GetString(indexPtr->pathPtr), "\"\n", NULL);
+
+	    goto done;
+	}
+
+	SetEntry(indexPtr, objv[index], objv[index + 1]);
+    }
+
+    code = TCL_OK;
+
+done:
+    Tcl_DecrRefCount(dataPtr);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadIndex --
+ *
+ *	This function returns the dependency index persisted within the
+ *	specified folder, reading it unless it is already loaded and its
+ *	file has not changed since.  If the file does not exist, the index
+ *	is empty.
+ *
+ * Results:
+ *	The dependency index -OR- NULL if it could not be read.
+ *
+ * Side effects:
+ *	The index may be loaded or reloaded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassDepsIndex *LoadIndex(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *dirPtr)			/* IN: The folder for the index. */
+{
+    SassDepsTable *tablePtr = GetDepsTable(interp);
+    SassDepsIndex *indexPtr;
+    Tcl_Obj *namePtr;
+    Tcl_Obj *pathPtr;
+    Tcl_HashEntry *hPtr;
+    Tcl_WideInt sec;
+    long nsec;
+    Tcl_WideInt size;
+    int bExists;
+    int bNew;
+
+    namePtr = Tcl_NewStringObj(SASS_DEPS_FILE_NAME, -1);
+    Tcl_IncrRefCount(namePtr);
+    pathPtr = Tcl_FSJoinToPath(dirPtr, 1, &namePtr);
+    Tcl_DecrRefCount(namePtr);
+    Tcl_IncrRefCount(pathPtr);
+
+    if (Tcl_FSGetNormalizedPath(interp, pathPtr) == NULL) {
+	Tcl_DecrRefCount(pathPtr);
+	return NULL;
+    }
+
+    hPtr = Tcl_CreateHashEntry(&tablePtr->indexes,
+	Tcl_GetString(Tcl_FSGetNormalizedPath(NULL, pathPtr)), &bNew);
+
+    if (bNew) {
+	indexPtr = (SassDepsIndex *)ckalloc(sizeof(SassDepsIndex));
+	memset(indexPtr, 0, sizeof(SassDepsIndex));
+
+	indexPtr->pathPtr = Tcl_FSGetNormalizedPath(NULL, pathPtr);
+	Tcl_IncrRefCount(indexPtr->pathPtr);
+	Tcl_InitHashTable(&indexPtr->entries, TCL_STRING_KEYS);
+	Tcl_InitHashTable(&indexPtr->files, TCL_STRING_KEYS);
+
+	Tcl_SetHashValue(hPtr, indexPtr);
+    } else {
+	indexPtr = (SassDepsIndex *)Tcl_GetHashValue(hPtr);
+    }
+
+    Tcl_DecrRefCount(pathPtr);
+
+    if (StatIndex(indexPtr, &bExists, &sec, &nsec, &size) != 0) {
+	Tcl_SetErrno(errno);
+
+	Tcl_AppendResult(interp, "error querying \"",
+	    Tcl_GetString(indexPtr->pathPtr), "\": ", Tcl_PosixError(interp),
+	    "\n", NULL);
+
+	return NULL;
+    }
+
+    /*
+     * NOTE: When the file is unchanged, the loaded index is current.  The
+     *       first time around, a missing file means an empty index, which
+     *       is already the case.
+     */
+
+    if (!bNew && (bExists == indexPtr->bExists) && (sec == indexPtr->sec) &&
+	    (nsec == indexPtr->nsec) && (size == indexPtr->size)) {
+	return indexPtr;
+    }
+
+    indexPtr->bExists = 0;
+
+    if (!bExists) {
+	ClearIndex(indexPtr);
+	return indexPtr;
+    }
+
+    if (ReadIndex(interp, indexPtr) != TCL_OK)
+	return NULL;
+
+    indexPtr->bExists = 1;
+    indexPtr->sec = sec;
+    indexPtr->nsec = nsec;
+    indexPtr->size = size;
+
+    return indexPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SaveIndex --
+ *
+ *	This function persists a loaded dependency index, replacing its
+ *	file atomically.  Each entry point is written on its own line,
+ *	sorted, so that the file may be compared and inspected easily.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The file is created or replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SaveIndex(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassDepsIndex *indexPtr)		/* IN/OUT: The dependency index. */
+{
+    int code;
+    Tcl_Obj *entriesPtr;
+    Tcl_Encoding encoding;
+    Tcl_DString data;
+    Tcl_DString buffer;
+    int objc;
+    Tcl_Obj **objv;
+    int index;
+
+    Tcl_DStringInit(&data);
+    Tcl_DStringAppendElement(&data, SASS_DEPS_MAGIC);
+    Tcl_DStringAppendElement(&data, SASS_DEPS_VERSION);
+    Tcl_DStringAppend(&data, "\n", 1);
+
+    entriesPtr = NewSortedList(&indexPtr->entries);
+    Tcl_IncrRefCount(entriesPtr);
+    Tcl_ListObjGetElements(NULL, entriesPtr, &objc, &objv);
+
+    for (index = 0; index < objc; index++) {
+	const char *zEntry = Tcl_GetString(objv[index]);
+	Tcl_HashEntry *hPtr = Tcl_FindHashEntry(&indexPtr->entries, zEntry);
+
+	Tcl_DStringAppendElement(&data, zEntry);
+	Tcl_DStringAppendElement(&data,
+	    Tcl_GetString((Tcl_Obj *)Tcl_GetHashValue(hPtr)));
+	Tcl_DStringAppend(&data, "\n", 1);
+    }
+
+    Tcl_DecrRefCount(entriesPtr);
+
+    encoding = Tcl_GetEncoding(NULL, "utf-8");
+    Tcl_UtfToExternalDString(encoding, Tcl_DStringValue(&data),
+	Tcl_DStringLength(&data), &buffer);
+    Tcl_FreeEncoding(encoding);
+
+    code = SassWriteFile(interp, indexPtr->pathPtr, Tcl_DStringValue(&buffer),
+	Tcl_DStringLength(&buffer));
+
+    Tcl_DStringFree(&buffer);
+    Tcl_DStringFree(&data);
+
+    if (code != TCL_OK)
+	return code;
+
+    /*
+     * NOTE: The index was just written; therefore, it need not be read
+     *       again, unless another process changes it.
+     */
+
+    if (StatIndex(indexPtr, &indexPtr->bExists, &indexPtr->sec,
+	    &indexPtr->nsec, &indexPtr->size) != 0) {
+	indexPtr->bExists = 0;
+    }
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareObjs --
+ *
+ *	This function compares the string representations of two Tcl
+ *	objects, for use with qsort().
+ *
+ * Results:
+ *	Negative, zero, or positive, like strcmp().
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CompareObjs(
+    const void *pLeft,			/* IN: Pointer to the first object. */
+    const void *pRight)			/* IN: Pointer to the second object. */
+{
+    return strcmp(Tcl_GetString(*(Tcl_Obj **)pLeft),
+	Tcl_GetString(*(Tcl_Obj **)pRight));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewSortedList --
+ *
+ *	This function returns the sorted keys of a hash table.
+ *
+ * Results:
+ *	A new list, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NewSortedList(
+    Tcl_HashTable *tablePtr)		/* IN: The hash table. */
+{
+    Tcl_Obj *listPtr;
+    Tcl_Obj **objv;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    int objc = 0;
+
+    if (tablePtr->numEntries == 0)
+	return Tcl_NewListObj(0, NULL);
+
+    objv = (Tcl_Obj **)ckalloc(sizeof(Tcl_Obj *) * tablePtr->numEntries);
+
+    for (hPtr = Tcl_FirstHashEntry(tablePtr, &search); hPtr != NULL;
+	    hPtr = Tcl_NextHashEntry(&search)) {
+	objv[objc++] = Tcl_NewStringObj(Tcl_GetHashKey(tablePtr, hPtr), -1);
+    }
+
+    qsort(objv, objc, sizeof(Tcl_Obj *), CompareObjs);
+
+    listPtr = Tcl_NewListObj(objc, objv);
+    ckfree((char *)objv);
+
+    return listPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NormalizePath --
+ *
+ *	This function returns the normalized form of a path, so that the
+ *	index does not depend on the current directory.  Paths from the
+ *	in-memory virtual file system are returned unchanged.
+ *
+ * Results:
+ *	The normalized path, which is owned by the path object.
+ *
+ * Side effects:
+ *	The internal representation of the path object may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NormalizePath(
+    Tcl_Obj *pathPtr)			/* IN: The path to normalize. */
+{
+    Tcl_Obj *normPtr;
+
+    if (strncmp(Tcl_GetString(pathPtr), SASS_VFS_PREFIX,
+	    strlen(SASS_VFS_PREFIX)) == 0) {
+	return pathPtr;
+    }
+
+    normPtr = Tcl_FSGetNormalizedPath(NULL, pathPtr);
+
+    return (normPtr != NULL) ? normPtr : pathPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexEntries --
+ *
+ *	Handles the [sass deps index] sub-command.  The entry points are
+ *	compiled concurrently, in the same way as [sass compile -type
+ *	file], and their included files replace those recorded within the
+ *	dependency index, which is then persisted.  Without any entry
+ *	points, all the ones already recorded are compiled again.  When an
+ *	entry point fails to compile, its previously recorded files are
+ *	kept; if there are none, it only depends on itself.
+ *
+ * Results:
+ *	A standard Tcl result.  A failed compilation is not an error; the
+ *	result is a dictionary with the list of the entry points that were
+ *	indexed and, for those that failed, their error messages.
+ *
+ * Side effects:
+ *	The dependency index is created or replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int IndexEntries(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[])		/* The array of arguments. */
+{
+    int code = TCL_ERROR;
+    SassDepsIndex *indexPtr;
+    Tcl_Obj *dirPtr = NULL;
+    Tcl_Obj *optionsPtr;
+    Tcl_Obj *entriesPtr = NULL;
+    Tcl_Obj **apResults = NULL;
+    Tcl_Obj **apIncluded = NULL;
+    Tcl_Obj *indexedPtr;
+    Tcl_Obj *failedPtr;
+    Tcl_Obj *resultPtr;
+    int optc;
+    Tcl_Obj **optv;
+    int entryc;
+    Tcl_Obj **entryv;
+    int index;
+
+    optionsPtr = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(optionsPtr);
+
+    for (index = 3; index < objc; index++) {
+	const char *zArg = Tcl_GetString(objv[index]);
+
+	if (strcmp(zArg, "--") == 0) {
+	    index++;
+	    break;
+	}
+
+	if (zArg[0] != '-')
+	    break;
+
+	if ((index + 1) >= objc) {
+	    Tcl_AppendResult(interp, "missing value for option \"", zArg,
+		"\"\n", NULL);
+
+	    goto done;
+	}
+
+	if (strcmp(zArg, "-dir") == 0) {
+	    dirPtr = objv[++index];
+	    continue;
+	}
+
+	Tcl_ListObjAppendElement(NULL, optionsPtr, objv[index++]);
+	Tcl_ListObjAppendElement(NULL, optionsPtr, objv[index]);
+    }
+
+    if (dirPtr == NULL) {
+	Tcl_WrongNumArgs(interp, 3, objv,
+	    "?options? -dir directory ?entry ...?");
+
+	goto done;
+    }
+
+    indexPtr = LoadIndex(interp, dirPtr);
+
+    if (indexPtr == NULL)
+	goto done;
+
+    if (index < objc) {
+	entriesPtr = Tcl_NewListObj(0, NULL);
+
+	for (; index < objc; index++) {
+	    Tcl_ListObjAppendElement(NULL, entriesPtr,
+		NormalizePath(objv[index]));
+	}
+    } else {
+	entriesPtr = NewSortedList(&indexPtr->entries);
+    }
+
+    Tcl_IncrRefCount(entriesPtr);
+    Tcl_ListObjGetElements(NULL, entriesPtr, &entryc, &entryv);
+    Tcl_ListObjGetElements(NULL, optionsPtr, &optc, &optv);
+
+    apResults = (Tcl_Obj **)attemptckalloc(sizeof(Tcl_Obj *) * (entryc + 1));
+    apIncluded = (Tcl_Obj **)attemptckalloc(sizeof(Tcl_Obj *) * (entryc + 1));
+
+    if ((apResults == NULL) || (apIncluded == NULL)) {
+	Tcl_AppendResult(interp, "out of memory: apResults\n", NULL);
+	goto done;
+    }
+
+    if (SassCompileFiles(interp, optc, optv, entryc, entryv, apResults,
+	    apIncluded) != TCL_OK) {
+	goto done;
+    }
+
+    indexedPtr = Tcl_NewListObj(0, NULL);
+    failedPtr = Tcl_NewListObj(0, NULL);
+
+    for (index = 0; index < entryc; index++) {
+	if (apIncluded[index] != NULL) {
+	    SetEntry(indexPtr, entryv[index], apIncluded[index]);
+	    Tcl_ListObjAppendElement(NULL, indexedPtr, entryv[index]);
+	    Tcl_DecrRefCount(apIncluded[index]);
+	} else {
+	    Tcl_Obj *messagePtr = NULL;
+	    int resultc;
+	    Tcl_Obj **resultv;
+	    int element;
+
+	    if (Tcl_FindHashEntry(&indexPtr->entries,
+		    Tcl_GetString(entryv[index])) == NULL) {
+		SetEntry(indexPtr, entryv[index],
+		    Tcl_NewListObj(1, &entryv[index]));
+	    }
+
+	    Tcl_ListObjGetElements(NULL, apResults[index], &resultc,
+		&resultv);
+
+	    for (element = 0; element + 1 < resultc; element += 2) {
+		if (strcmp(Tcl_GetString(resultv[element]),
+			"errorMessage") == 0) {
+		    messagePtr = resultv[element + 1];
+		    break;
+		}
+	    }
+
+	    Tcl_ListObjAppendElement(NULL, failedPtr, entryv[index]);
+	    Tcl_ListObjAppendElement(NULL, failedPtr,
+		(messagePtr != NULL) ? messagePtr : Tcl_NewObj());
+	}
+
+	Tcl_DecrRefCount(apResults[index]);
+    }
+
+    resultPtr = Tcl_NewListObj(0, NULL);
+    Tcl_ListObjAppendElement(NULL, resultPtr,
+	Tcl_NewStringObj("indexed", -1));
+    Tcl_ListObjAppendElement(NULL, resultPtr, indexedPtr);
+    Tcl_ListObjAppendElement(NULL, resultPtr,
+	Tcl_NewStringObj("failed", -1));
+    Tcl_ListObjAppendElement(NULL, resultPtr, failedPtr);
+    Tcl_IncrRefCount(resultPtr);
+
+    code = SaveIndex(interp, indexPtr);
+
+    if (code == TCL_OK)
+	Tcl_SetObjResult(interp, resultPtr);
+
+    Tcl_DecrRefCount(resultPtr);
+
+done:
+    if (apIncluded != NULL)
+	ckfree((char *)apIncluded);
+
+    if (apResults != NULL)
+	ckfree((char *)apResults);
+
+    if (entriesPtr != NULL)
+	Tcl_DecrRefCount(entriesPtr);
+
+    Tcl_DecrRefCount(optionsPtr);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassDepsObjCmd --
+ *
+ *	Handles the [sass deps] sub-command.  The "source" form parses the
+ *	source and returns the files that it includes.  The others use the
+ *	dependency index within the folder specified via -dir: "index"
+ *	(re)compiles entry points and records their included files, while
+ *	"includes" and "dependents" query the recorded files of an entry
+ *	point and the entry points that depend on any of the specified
+ *	files, respectively, and "forget" removes entry points.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The dependency index may be created or replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassDepsObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int option;
+    SassDepsIndex *indexPtr;
+    Tcl_HashEntry *hPtr;
+    int index;
+
+    static const char *cmdOptions[] = {
+	"dependents", "forget", "includes", "index", "source", (char *) NULL
+    };
+
+    enum options {
+	OPT_DEPENDENTS, OPT_FORGET, OPT_INCLUDES, OPT_INDEX, OPT_SOURCE
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassDepsObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    /*
+     * NOTE: Every sub-command other than "source" reads or writes an index
+     *       file in a caller supplied directory, which a safe interp must
+     *       not be able to do.
+     */
+
+    if ((option != OPT_SOURCE) && Tcl_IsSafe(interp)) {
+	Tcl_AppendResult(interp, "option \"", cmdOptions[option],
+	    "\" is not allowed in a safe interpreter\n", NULL);
+
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_SOURCE: {
+	    return SassParseIncludes(interp, objc, objv);
+	}
+	case OPT_INDEX: {
+	    return IndexEntries(interp, objc, objv);
+	}
+	case OPT_DEPENDENTS:
+	case OPT_FORGET:
+	case OPT_INCLUDES: {
+	    if ((objc < 6) || ((option == OPT_INCLUDES) && (objc != 6)) ||
+		    (strcmp(Tcl_GetString(objv[3]), "-dir") != 0)) {
+		Tcl_WrongNumArgs(interp, 3, objv, (option == OPT_INCLUDES) ?
+		    "-dir directory entry" : (option == OPT_FORGET) ?
+		    "-dir directory entry ?entry ...?" :
+		    "-dir directory file ?file ...?");
+
+		return TCL_ERROR;
+	    }
+
+	    indexPtr = LoadIndex(interp, objv[4]);
+
+	    if (indexPtr == NULL)
+		return TCL_ERROR;
+
+	    break;
+	}
+	default: {
+	    Tcl_AppendResult(interp, "bad option index\n", NULL);
+	    return TCL_ERROR;
+	}
+    }
+
+    if (option == OPT_INCLUDES) {
+	hPtr = Tcl_FindHashEntry(&indexPtr->entries,
+	    Tcl_GetString(NormalizePath(objv[5])));
+
+	if (hPtr != NULL)
+	    Tcl_SetObjResult(interp, (Tcl_Obj *)Tcl_GetHashValue(hPtr));
+
+	return TCL_OK;
+    }
+
+    if (option == OPT_FORGET) {
+	for (index = 5; index < objc; index++)
+	    SetEntry(indexPtr, NormalizePath(objv[index]), NULL);
+
+	return SaveIndex(interp, indexPtr);
+    } else {
+	Tcl_HashTable dependents;
+	int listc;
+	Tcl_Obj **listv;
+	int element;
+	int bNew;
+
+	/*
+	 * NOTE: The included files of an entry point are already transitive,
+	 *       since libsass reports all of them; therefore, one lookup per
+	 *       file is enough.
+	 */
+
+	Tcl_InitHashTable(&dependents, TCL_STRING_KEYS);
+
+	for (index = 5; index < objc; index++) {
+	    hPtr = Tcl_FindHashEntry(&indexPtr->files,
+		Tcl_GetString(NormalizePath(objv[index])));
+
+	    if (hPtr == NULL)
+		continue;
+
+	    Tcl_ListObjGetElements(NULL, (Tcl_Obj *)Tcl_GetHashValue(hPtr),
+		&listc, &listv);
+
+	    for (element = 0; element < listc; element++) {
+		Tcl_CreateHashEntry(&dependents,
+		    Tcl_GetString(listv[element]), &bNew);
+	    }
+	}
+
+	Tcl_SetObjResult(interp, NewSortedList(&dependents));
+	Tcl_DeleteHashTable(&dependents);
+
+	return TCL_OK;
+    }
+}
@@ -0,0 +1,780 @@
+/*
+ * tclsassFs.c -- Tcl Package for libsass
+ *
+ * Implements the custom importer used to resolve imports through the Tcl
+ * virtual filesystem layer, e.g. zipfs, starkits, or tclvfs mounts, which
+ * libsass cannot see on its own.  It is only used when the "tcl_vfs" option
+ * is enabled.  Unlike the other importers, its state belongs to a single
+ * compilation, which must be performed by the thread that owns the Tcl
+ * interpreter, because filesystems implemented in Tcl may need it.  File
+ * contents are cached for the duration of the compilation.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdlib.h>		/* NOTE: For malloc(), free(). */
+#include <string.h>		/* NOTE: For strlen(), strrchr(), memcpy(). */
+#include <sys/stat.h>		/* NOTE: For S_ISREG(). */
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "sass/context.h"	/* NOTE: For public Sass API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: The MSVC runtime library does not define this macro.
+ */
+
+#ifndef S_ISREG
+  #define S_ISREG(m)				(((m) & S_IFMT) == S_IFREG)
+#endif
+
+/*
+ * NOTE: This is the priority of the custom importer used for the Tcl virtual
+ *       filesystem.  It is checked after the in-memory virtual file system
+ *       and before the import cache.
+ */
+
+#ifndef SASS_FS_PRIORITY
+  #define SASS_FS_PRIORITY			(-0.5)
+#endif
+
+/*
+ * NOTE: This is the path separator used within the "include_path" option.
+ */
+
+#ifdef _WIN32
+  #define SASS_FS_PATH_SEPARATOR		';'
+#else
+  #define SASS_FS_PATH_SEPARATOR		':'
+#endif
+
+/*
+ * NOTE: This structure holds the state of the importer for one compilation.
+ *       The lookups table maps "<base directory>\001<url>" to the normalized
+ *       path of the file found, which is NULL if none was found.  The files
+ *       table maps normalized paths to their contents, as byte arrays.
+ */
+
+struct SassFs {
+    char *zIncludePath;			/* Copy of "include_path", or NULL. */
+    Tcl_Obj *entryPathPtr;		/* Normalized entry file name. */
+    Tcl_HashTable lookups;		/* Resolved imports. */
+    Tcl_HashTable files;		/* File contents. */
+};
+
+/*
+ * NOTE: These are the prefixes and extensions tried, in order, when resolving
+ *       an import.  They are the same as the ones used by libsass.
+ */
+
+static const char *azPrefixes[] = {
+    "_", "", (char *) NULL
+};
+
+static const char *azExtensions[] = {
+    ".scss", ".sass", ".css", (char *) NULL
+};
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static int		IsRegularFile(const char *zPath, int pathLength);
+static int		AddCandidate(Tcl_DString *pathPtr, int baseLength,
+			    const char *zPrefix, const char *zName,
+			    const char *zSuffix, int nFound,
+			    Tcl_Obj **pFoundPtr);
+static int		ResolveInDir(const char *zDir, int dirLength,
+			    const char *zUrl, Tcl_Obj **pFoundPtr);
+static int		ResolveImport(SassFs *fsPtr, const char *zBase,
+			    int baseLength, const char *zUrl,
+			    Tcl_Obj **pFoundPtr);
+static Tcl_Obj *	ReadFile(Tcl_Interp *interp, SassFs *fsPtr,
+			    Tcl_Obj *pathPtr);
+static Sass_Import_List	FsImporterProc(const char *zUrl,
+			    Sass_Importer_Entry cb,
+			    struct Sass_Compiler *compiler);
+static Sass_Import_List	FsImporterTraceProc(const char *zUrl,
+			    Sass_Importer_Entry cb,
+			    struct Sass_Compiler *compiler);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsRegularFile --
+ *
+ *	This function checks if the specified path refers to a regular
+ *	file, using the Tcl virtual filesystem layer.
+ *
+ * Results:
+ *	Non-zero if the path is a regular file.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int IsRegularFile(
+    const char *zPath,			/* IN: The path to check. */
+    int pathLength)			/* IN: Length of the path. */
+{
+    Tcl_Obj *pathPtr = Tcl_NewStringObj(zPath, pathLength);
+    Tcl_StatBuf statBuf;
+    int bResult;
+
+    Tcl_IncrRefCount(pathPtr);
+
+    bResult = (Tcl_FSStat(pathPtr, &statBuf) == 0) &&
+	S_ISREG(statBuf.st_mode);
+
+    Tcl_DecrRefCount(pathPtr);
+    return bResult;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddCandidate --
+ *
+ *	This function appends one candidate file name to the directory
+ *	within the specified buffer and checks if it exists.  The buffer
+ *	is restored to the directory afterward.
+ *
+ * Results:
+ *	The number of candidates found so far, including this one.  The
+ *	first one found is stored into the pFoundPtr argument, with a
+ *	reference.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int AddCandidate(
+    Tcl_DString *pathPtr,		/* IN/OUT: Directory, with separator. */
+    int baseLength,			/* IN: Length of the directory. */
+    const char *zPrefix,		/* IN: Prefix of the file name. */
+    const char *zName,			/* IN: The file name. */
+    const char *zSuffix,		/* IN: Suffix of the file name. */
+    int nFound,				/* IN: Candidates found so far. */
+    Tcl_Obj **pFoundPtr)		/* IN/OUT: First candidate found. */
+{
+    Tcl_DStringAppend(pathPtr, zPrefix, -1);
+    Tcl_DStringAppend(pathPtr, zName, -1);
+    Tcl_DStringAppend(pathPtr, zSuffix, -1);
+
+    if (IsRegularFile(Tcl_DStringValue(pathPtr),
+	    Tcl_DStringLength(pathPtr))) {
+	if (nFound == 0) {
+	    *pFoundPtr = Tcl_NewStringObj(Tcl_DStringValue(pathPtr),
+		Tcl_DStringLength(pathPtr));
+
+	    Tcl_IncrRefCount(*pFoundPtr);
+	}
+
+	nFound++;
+    }
+
+    Tcl_DStringSetLength(pathPtr, baseLength);
+    return nFound;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResolveInDir --
+ *
+ *	This function attempts to resolve the specified URL within one
+ *	directory, using the same rules as libsass.  First, the partial
+ *	and non-partial names with each supported extension are checked,
+ *	then the name as is, and then the index files within the directory
+ *	by that name.
+ *
+ * Results:
+ *	The number of matching files, when there are any among the first
+ *	group of candidates checked.  When more than one file matches, the
+ *	import is ambiguous.  The first match is stored into the pFoundPtr
+ *	argument, with a reference.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ResolveInDir(
+    const char *zDir,			/* IN: The directory, may be empty. */
+    int dirLength,			/* IN: Length of the directory. */
+    const char *zUrl,			/* IN: The URL being imported. */
+    Tcl_Obj **pFoundPtr)		/* OUT: The first match, if any. */
+{
+    Tcl_DString path;
+    const char *zName = strrchr(zUrl, '/');
+    int baseLength;
+    int nFound = 0;
+    int index1;
+    int index2;
+
+    *pFoundPtr = NULL;
+    Tcl_DStringInit(&path);
+
+    if (dirLength > 0) {
+	Tcl_DStringAppend(&path, zDir, dirLength);
+
+	if (zDir[dirLength - 1] != '/')
+	    Tcl_DStringAppend(&path, "/", 1);
+    }
+
+    if (zName != NULL) {
+	zName++;
+	Tcl_DStringAppend(&path, zUrl, (int)(zName - zUrl));
+    } else {
+	zName = zUrl;
+    }
+
+    baseLength = Tcl_DStringLength(&path);
+
+    for (index1 = 0; azPrefixes[index1] != NULL; index1++) {
+	for (index2 = 0; azExtensions[index2] != NULL; index2++) {
+	    nFound = AddCandidate(&path, baseLength, azPrefixes[index1],
+		zName, azExtensions[index2], nFound, pFoundPtr);
+	}
+    }
+
+    if (nFound == 0)
+	nFound = AddCandidate(&path, baseLength, "", zName, "", 0, pFoundPtr);
+
+    if (nFound == 0) {
+	Tcl_DStringAppend(&path, zName, -1);
+	Tcl_DStringAppend(&path, "/", 1);
+	baseLength = Tcl_DStringLength(&path);
+
+	for (index1 = 0; azPrefixes[index1] != NULL; index1++) {
+	    for (index2 = 0; azExtensions[index2] != NULL; index2++) {
+		nFound = AddCandidate(&path, baseLength, azPrefixes[index1],
+		    "index", azExtensions[index2], nFound, pFoundPtr);
+	    }
+	}
+    }
+
+    Tcl_DStringFree(&path);
+    return nFound;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResolveImport --
+ *
+ *	This function attempts to resolve the specified URL, relative to
+ *	the directory of the importing file first, then the current
+ *	directory, and then each of the include paths, in that order.  The
+ *	results are memoized for the duration of the compilation.
+ *
+ * Results:
+ *	Zero if the URL was resolved -OR- it could not be found, in which
+ *	case NULL is stored into the pFoundPtr argument.  Non-zero if the
+ *	URL is ambiguous.  The normalized path of the file found is stored
+ *	into the pFoundPtr argument, without a reference.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ResolveImport(
+    SassFs *fsPtr,			/* IN: The importer state. */
+    const char *zBase,			/* IN: The base directory. */
+    int baseLength,			/* IN: Length of base directory. */
+    const char *zUrl,			/* IN: The URL being imported. */
+    Tcl_Obj **pFoundPtr)		/* OUT: The file found, if any. */
+{
+    Tcl_DString key;
+    Tcl_HashEntry *hPtr;
+    Tcl_Obj *foundPtr = NULL;
+    const char *zDir;
+    int nFound;
+    int isNew;
+
+    Tcl_DStringInit(&key);
+    Tcl_DStringAppend(&key, zBase, baseLength);
+    Tcl_DStringAppend(&key, "\001", 1);
+    Tcl_DStringAppend(&key, zUrl, -1);
+
+    hPtr = Tcl_CreateHashEntry(&fsPtr->lookups, Tcl_DStringValue(&key),
+	&isNew);
+
+    Tcl_DStringFree(&key);
+
+    if (!isNew) {
+	*pFoundPtr = (Tcl_Obj *)Tcl_GetHashValue(hPtr);
+	return 0;
+    }
+
+    nFound = ResolveInDir(zBase, baseLength, zUrl, &foundPtr);
+
+    if (nFound == 0)
+	nFound = ResolveInDir("", 0, zUrl, &foundPtr);
+
+    zDir = fsPtr->zIncludePath;
+
+    while ((nFound == 0) && (zDir != NULL) && (zDir[0] != '\0')) {
+	const char *zEnd = strchr(zDir, SASS_FS_PATH_SEPARATOR);
+	int dirLength = (zEnd != NULL) ? (int)(zEnd - zDir) :
+	    (int)strlen(zDir);
+
+	if (dirLength > 0)
+	    nFound = ResolveInDir(zDir, dirLength, zUrl, &foundPtr);
+
+	zDir = (zEnd != NULL) ? zEnd + 1 : NULL;
+    }
+
+    /*
+     * NOTE: Ambiguous imports are not memoized.  They are an error, which
+     *       ends the compilation.
+     */
+
+    if (nFound > 1) {
+	Tcl_DecrRefCount(foundPtr);
+	Tcl_DeleteHashEntry(hPtr);
+	*pFoundPtr = NULL;
+	return 1;
+    }
+
+    /*
+     * NOTE: The normalized path is used as the absolute path of the import,
+     *       so that nested imports are resolved relative to it, even if the
+     *       current directory changes.
+     */
+
+    if (foundPtr != NULL) {
+	Tcl_Obj *normPtr = Tcl_FSGetNormalizedPath(NULL, foundPtr);
+
+	if (normPtr != NULL) {
+	    Tcl_IncrRefCount(normPtr);
+	    Tcl_DecrRefCount(foundPtr);
+	    foundPtr = normPtr;
+	}
+    }
+
+    Tcl_SetHashValue(hPtr, (ClientData)foundPtr);
+    *pFoundPtr = foundPtr;
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadFile --
+ *
+ *	This function reads the entire contents of the specified file,
+ *	using the Tcl virtual filesystem layer, unless they were already
+ *	read during the compilation.
+ *
+ * Results:
+ *	The contents, as a byte array owned by the importer state -OR- NULL
+ *	if the file could not be read, in which case an error message is
+ *	left in the Tcl interpreter result, if any.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *ReadFile(
+    Tcl_Interp *interp,			/* Current Tcl interpreter, or NULL. */
+    SassFs *fsPtr,			/* IN: The importer state. */
+    Tcl_Obj *pathPtr)			/* IN: The normalized path. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_Channel channel;
+    Tcl_Obj *dataPtr;
+    int isNew;
+
+    hPtr = Tcl_CreateHashEntry(&fsPtr->files, Tcl_GetString(pathPtr),
+	&isNew);
+
+    if (!isNew)
+	return (Tcl_Obj *)Tcl_GetHashValue(hPtr);
+
+    channel = Tcl_FSOpenFileChannel(interp, pathPtr, "r", 0);
+
+    if (channel == NULL) {
+	Tcl_DeleteHashEntry(hPtr);
+	return NULL;
+    }
+
+    dataPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(dataPtr);
+
+    if ((Tcl_SetChannelOption(interp, channel, "-translation",
+	    "binary") != TCL_OK) ||
+	    (Tcl_ReadChars(channel, dataPtr, -1, 0) < 0)) {
+	if (interp != NULL) {
+	    Tcl_AppendResult(interp, "error reading \"",
+		Tcl_GetString(pathPtr), "\": ", Tcl_PosixError(interp),
+		"\n", NULL);
+	}
+
+	Tcl_Close(NULL, channel);
+	Tcl_DecrRefCount(dataPtr);
+	Tcl_DeleteHashEntry(hPtr);
+	return NULL;
+    }
+
+    Tcl_Close(NULL, channel);
+    Tcl_SetHashValue(hPtr, (ClientData)dataPtr);
+
+    return dataPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FsImporterProc --
+ *
+ *	This function is the custom importer used by libsass to resolve
+ *	imports through the Tcl virtual filesystem layer.  Imports of plain
+ *	CSS and imports from the in-memory virtual file system are not
+ *	handled.  Files using the indented syntax are not handled either,
+ *	because libsass does not convert them when they are returned by a
+ *	custom importer.
+ *
+ * Results:
+ *	The list of imports, with one entry -OR- NULL if the URL could not
+ *	be resolved, in which case libsass will try the next importer and
+ *	then the include paths.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_Import_List FsImporterProc(
+    const char *zUrl,			/* IN: The URL being imported. */
+    Sass_Importer_Entry cb,		/* IN: The importer. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    SassFs *fsPtr = (SassFs *)sass_importer_get_cookie(cb);
+    Sass_Import_List list;
+    Tcl_Obj *foundPtr;
+    Tcl_Obj *dataPtr;
+    const char *zBase = "";
+    const char *zFound;
+    unsigned char *zData;
+    char *zSource;
+    int baseLength = 0;
+    int foundLength;
+    int dataLength;
+
+    if ((zUrl == NULL) || (compiler == NULL) || (fsPtr == NULL) ||
+	    SassIsCssImport(zUrl)) {
+	return NULL;
+    }
+
+    /*
+     * NOTE: Imports from the entry are relative to the directory it was read
+     *       from.  The absolute path libsass uses for the entry cannot be
+     *       used, because it has been canonicalized, which does not work for
+     *       all Tcl filesystems.  Otherwise, the importing file was returned
+     *       by this importer or by another one.
+     */
+
+    if (sass_compiler_get_import_stack_size(compiler) > 1) {
+	Sass_Import_Entry lastPtr = sass_compiler_get_last_import(compiler);
+	const char *zLast = (lastPtr != NULL) ?
+	    sass_import_get_abs_path(lastPtr) : NULL;
+
+	if (zLast != NULL) {
+	    const char *zSlash = strrchr(zLast, '/');
+
+	    if (strncmp(zLast, SASS_VFS_PREFIX,
+		    strlen(SASS_VFS_PREFIX)) == 0) {
+		return NULL;
+	    }
+
+	    if (zSlash != NULL) {
+		zBase = zLast;
+		baseLength = (int)(zSlash - zLast) + 1;
+	    }
+	}
+    } else if (fsPtr->entryPathPtr != NULL) {
+	const char *zEntry = Tcl_GetString(fsPtr->entryPathPtr);
+	const char *zSlash = strrchr(zEntry, '/');
+
+	if (zSlash != NULL) {
+	    zBase = zEntry;
+	    baseLength = (int)(zSlash - zEntry) + 1;
+	}
+    }
+
+    if (ResolveImport(fsPtr, zBase, baseLength, zUrl, &foundPtr) != 0) {
+	Tcl_Obj *msgPtr = Tcl_NewStringObj("It's not clear which file to "
+	    "import for '@import \"", -1);
+
+	Tcl_IncrRefCount(msgPtr);
+	Tcl_AppendStringsToObj(msgPtr, zUrl, "\"'.", NULL);
+
+	list = sass_make_import_list(1);
+
+	if (list != NULL) {
+	    list[0] = sass_make_import_entry(zUrl, NULL, NULL);
+
+	    sass_import_set_error(list[0], Tcl_GetString(msgPtr),
+		(size_t)-1, (size_t)-1);
+	}
+
+	Tcl_DecrRefCount(msgPtr);
+	return list;
+    }
+
+    if (foundPtr == NULL)
+	return NULL;
+
+    zFound = Tcl_GetStringFromObj(foundPtr, &foundLength);
+
+    if ((foundLength > 5) && (strcmp(zFound + foundLength - 5,
+	    ".sass") == 0)) {
+	return NULL;
+    }
+
+    dataPtr = ReadFile(NULL, fsPtr, foundPtr);
+
+    if (dataPtr == NULL)
+	return NULL;
+
+    /*
+     * NOTE: The contents must be allocated via malloc(), because libsass
+     *       takes ownership of them.
+     */
+
+    zData = Tcl_GetByteArrayFromObj(dataPtr, &dataLength);
+    zSource = malloc(dataLength + 1);
+
+    if (zSource == NULL)
+	return NULL;
+
+    memcpy(zSource, zData, dataLength);
+    zSource[dataLength] = '\0';
+
+    list = sass_make_import_list(1);
+
+    if (list == NULL) {
+	free(zSource);
+	return NULL;
+    }
+
+    list[0] = sass_make_import(zUrl, zFound, zSource, NULL);
+    return list;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FsImporterTraceProc --
+ *
+ *	This function is the custom importer actually registered with
+ *	libsass for the Tcl virtual filesystem.  It calls FsImporterProc and
+ *	then records the lookup for [sass trace].
+ *
+ * Results:
+ *	The result of FsImporterProc.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_Import_List FsImporterTraceProc(
+    const char *zUrl,			/* IN: The URL being imported. */
+    Sass_Importer_Entry cb,		/* IN: The importer. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    Sass_Import_List list = FsImporterProc(zUrl, cb, compiler);
+
+    SASS_TRACE(SASS_TRACE_IMPORT, SASS_TRACE_IMPORTER_TCL_VFS, list != NULL);
+
+    return list;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFsCreate --
+ *
+ *	This function creates the importer state for one compilation that
+ *	uses the Tcl virtual filesystem layer.  The include paths are
+ *	copied.
+ *
+ * Results:
+ *	The new state.  It must be freed via SassFsDelete, after the
+ *	compilation is complete.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+SassFs *SassFsCreate(
+    const char *zIncludePath)		/* IN: Include paths, may be NULL. */
+{
+    SassFs *fsPtr = (SassFs *)ckalloc(sizeof(SassFs));
+
+    memset(fsPtr, 0, sizeof(SassFs));
+
+    if (zIncludePath != NULL) {
+	fsPtr->zIncludePath = ckalloc(strlen(zIncludePath) + 1);
+	strcpy(fsPtr->zIncludePath, zIncludePath);
+    }
+
+    Tcl_InitHashTable(&fsPtr->lookups, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&fsPtr->files, TCL_STRING_KEYS);
+
+    return fsPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFsMakeImporter --
+ *
+ *	This function creates the custom importer for the Tcl virtual
+ *	filesystem layer, using the specified state.
+ *
+ * Results:
+ *	The importer -OR- NULL if it could not be created.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Sass_Importer_Entry SassFsMakeImporter(
+    SassFs *fsPtr)			/* IN: The importer state. */
+{
+    return sass_make_importer(FsImporterTraceProc, SASS_FS_PRIORITY,
+	(void *)fsPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFsReadEntry --
+ *
+ *	This function reads the entry file of a compilation, using the Tcl
+ *	virtual filesystem layer.  Its directory is used to resolve the
+ *	imports within it.
+ *
+ * Results:
+ *	A standard Tcl result.  The contents, which are owned by the state,
+ *	are stored into the pzData argument, NUL terminated.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassFsReadEntry(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassFs *fsPtr,			/* IN/OUT: The importer state. */
+    const char *zPath,			/* IN: The entry file name. */
+    const char **pzData)		/* OUT: The contents. */
+{
+    Tcl_Obj *pathPtr = Tcl_NewStringObj(zPath, -1);
+    Tcl_Obj *normPtr;
+    Tcl_Obj *dataPtr;
+    int dataLength;
+
+    Tcl_IncrRefCount(pathPtr);
+    normPtr = Tcl_FSGetNormalizedPath(interp, pathPtr);
+
+    if (normPtr == NULL) {
+	Tcl_DecrRefCount(pathPtr);
+	return TCL_ERROR;
+    }
+
+    dataPtr = ReadFile(interp, fsPtr, normPtr);
+
+    if (dataPtr == NULL) {
+	Tcl_DecrRefCount(pathPtr);
+	return TCL_ERROR;
+    }
+
+    Tcl_IncrRefCount(normPtr);
+
+    if (fsPtr->entryPathPtr != NULL)
+	Tcl_DecrRefCount(fsPtr->entryPathPtr);
+
+    fsPtr->entryPathPtr = normPtr;
+    Tcl_DecrRefCount(pathPtr);
+
+    /*
+     * NOTE: Byte arrays are always followed by a NUL character, which is not
+     *       included in their length.
+     */
+
+    *pzData = (const char *)Tcl_GetByteArrayFromObj(dataPtr, &dataLength);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFsDelete --
+ *
+ *	This function frees importer state created by SassFsCreate,
+ *	including all the cached file contents.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassFsDelete(
+    SassFs *fsPtr)			/* IN: The importer state. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    if (fsPtr == NULL)
+	return;
+
+    for (hPtr = Tcl_FirstHashEntry(&fsPtr->lookups, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	Tcl_Obj *objPtr = (Tcl_Obj *)Tcl_GetHashValue(hPtr);
+
+	if (objPtr != NULL)
+	    Tcl_DecrRefCount(objPtr);
+    }
+
+    for (hPtr = Tcl_FirstHashEntry(&fsPtr->files, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	Tcl_DecrRefCount((Tcl_Obj *)Tcl_GetHashValue(hPtr));
+    }
+
+    Tcl_DeleteHashTable(&fsPtr->lookups);
+    Tcl_DeleteHashTable(&fsPtr->files);
+
+    if (fsPtr->entryPathPtr != NULL)
+	Tcl_DecrRefCount(fsPtr->entryPathPtr);
+
+    if (fsPtr->zIncludePath != NULL)
+	ckfree(fsPtr->zIncludePath);
+
+    ckfree((char *)fsPtr);
+}
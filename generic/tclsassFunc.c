@@ -0,0 +1,1459 @@
+/*
+ * tclsassFunc.c -- Tcl Package for libsass
+ *
+ * Implements the registry of custom Sass functions.  Functions implemented
+ * in Tcl are registered via [sass function register] and belong to the Tcl
+ * interpreter that registered them.  Functions implemented in C are added
+ * via SassFuncRegister and are shared by the whole process.  All of them are
+ * called through a single libsass callback, which converts the values from
+ * libsass to Tcl objects and back, without formatting and parsing them as
+ * Sass source, and keeps per-function statistics.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdlib.h>		/* NOTE: For strtod(). */
+#include <string.h>		/* NOTE: For strlen(), strchr(), memcpy(). */
+#include <math.h>		/* NOTE: For floor(), fabs(). */
+#include <stdio.h>		/* NOTE: For snprintf(). */
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "sass/context.h"	/* NOTE: For public Sass API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: This structure holds one registered function.  It is reference
+ *       counted, because it may be unregistered while a compilation that
+ *       uses it is still in progress.  The reference count and statistics
+ *       are protected by funcMutex.  For functions implemented in Tcl, the
+ *       Tcl objects may only be used by the thread that owns the Tcl
+ *       interpreter.
+ */
+
+typedef struct SassFunc {
+    int refCount;			/* Number of references. */
+    char *zSignature;			/* The Sass signature. */
+    char *zName;			/* The name, from the signature. */
+    SassFuncProc *xProc;		/* Implemented in C, or NULL. */
+    void *clientData;			/* Passed to xProc. */
+    Tcl_Interp *interp;			/* Implemented in Tcl, or NULL. */
+    Tcl_Obj *commandPtr;		/* The Tcl command prefix. */
+    Tcl_WideInt calls;			/* Number of calls. */
+    Tcl_WideInt errors;			/* Number of calls that failed. */
+    Tcl_WideInt microseconds;		/* Total time spent in calls. */
+} SassFunc;
+
+/*
+ * NOTE: This structure holds a set of registered functions, keyed by name.
+ *       The version changes whenever a function is added or removed.  It
+ *       is used within the compile cache key.
+ */
+
+typedef struct SassFuncTable {
+    int bInitialized;			/* Non-zero if the table is valid. */
+    Tcl_HashTable funcs;		/* Maps names to SassFunc. */
+    Tcl_WideInt version;		/* Version of the set of functions. */
+} SassFuncTable;
+
+/*
+ * NOTE: This structure holds the functions used by one compilation, with a
+ *       reference to each.
+ */
+
+struct SassFuncBinding {
+    int nFuncs;				/* Number of functions. */
+    SassFunc *apFuncs[1];		/* The functions. */
+};
+
+/*
+ * NOTE: These are the functions implemented in C, which are shared by the
+ *       whole process, and the counter used to generate versions for all
+ *       function tables.  They are protected by funcMutex.
+ */
+
+static SassFuncTable nativeFuncs = {
+    0
+};
+
+static Tcl_WideInt nextVersion = 0;
+
+TCL_DECLARE_MUTEX(funcMutex)
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static SassFuncTable *	GetFuncTable(Tcl_Interp *interp, int bCreate);
+static void		FuncTableDeleteProc(ClientData clientData,
+			    Tcl_Interp *interp);
+static char *		GetFuncName(const char *zSignature);
+static SassFunc *	NewFunc(const char *zSignature);
+static void		ReleaseFunc(SassFunc *funcPtr);
+static SassFunc *	AddFunc(SassFuncTable *tablePtr, SassFunc *funcPtr);
+static int		RemoveFunc(SassFuncTable *tablePtr,
+			    const char *zName);
+static void		ClearFuncTable(SassFuncTable *tablePtr);
+static Tcl_Obj *	GetNumberObj(double value, const char *zUnit);
+static Tcl_Obj *	GetObjFromValue(const union Sass_Value *valuePtr);
+static int		IsHexColor(const char *zValue, int length);
+static union Sass_Value *	GetValueFromString(const char *zValue,
+			    int length);
+static union Sass_Value *	GetValueFromObj(Tcl_Obj *objPtr);
+static union Sass_Value *	CallTclFunc(SassFunc *funcPtr,
+			    const union Sass_Value *argsPtr);
+static union Sass_Value *	CallFunc(SassFunc *funcPtr,
+			    const union Sass_Value *argsPtr,
+			    struct Sass_Compiler *compiler, int bWorker);
+static union Sass_Value *	FuncCallProc(const union Sass_Value *argsPtr,
+			    Sass_Function_Entry cb,
+			    struct Sass_Compiler *compiler);
+static union Sass_Value *	WorkerFuncCallProc(
+			    const union Sass_Value *argsPtr,
+			    Sass_Function_Entry cb,
+			    struct Sass_Compiler *compiler);
+static void		AppendStats(Tcl_Interp *interp, Tcl_Obj *listPtr,
+			    SassFuncTable *tablePtr);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetFuncTable --
+ *
+ *	This function returns the table of functions implemented in Tcl for
+ *	the specified Tcl interpreter, optionally creating it.
+ *
+ * Results:
+ *	The table -OR- NULL if it does not exist.
+ *
+ * Side effects:
+ *	The table may be created and associated with the Tcl interpreter.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassFuncTable *GetFuncTable(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int bCreate)			/* IN: Non-zero to create the table. */
+{
+    SassFuncTable *tablePtr;
+
+    tablePtr = (SassFuncTable *)Tcl_GetAssocData(interp, SASS_FUNC_DATA_NAME,
+	NULL);
+
+    if ((tablePtr == NULL) && bCreate) {
+	tablePtr = (SassFuncTable *)ckalloc(sizeof(SassFuncTable));
+	memset(tablePtr, 0, sizeof(SassFuncTable));
+	Tcl_InitHashTable(&tablePtr->funcs, TCL_STRING_KEYS);
+	tablePtr->bInitialized = 1;
+
+	Tcl_SetAssocData(interp, SASS_FUNC_DATA_NAME, FuncTableDeleteProc,
+	    tablePtr);
+    }
+
+    return tablePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FuncTableDeleteProc --
+ *
+ *	This function frees the table of functions implemented in Tcl for
+ *	a Tcl interpreter, when it is being deleted -OR- the package is
+ *	being unloaded from it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FuncTableDeleteProc(
+    ClientData clientData,		/* IN: The function table. */
+    Tcl_Interp *interp)			/* Not used. */
+{
+    SassFuncTable *tablePtr = (SassFuncTable *)clientData;
+
+    ClearFuncTable(tablePtr);
+    Tcl_DeleteHashTable(&tablePtr->funcs);
+    ckfree((char *)tablePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetFuncName --
+ *
+ *	This function extracts the name of a function from its signature,
+ *	i.e. everything before the opening parenthesis.  The signatures for
+ *	special functions, e.g. "*" or "@warn", have no parenthesis; their
+ *	name is the whole signature.
+ *
+ * Results:
+ *	The name, allocated via ckalloc -OR- NULL if it is empty.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *GetFuncName(
+    const char *zSignature)		/* IN: The function signature. */
+{
+    const char *zStart = zSignature;
+    const char *zEnd = strchr(zSignature, '(');
+    char *zName;
+
+    if (zEnd == NULL)
+	zEnd = zSignature + strlen(zSignature);
+
+    while ((zStart < zEnd) && ((*zStart == ' ') || (*zStart == '\t')))
+	zStart++;
+
+    while ((zEnd > zStart) && ((zEnd[-1] == ' ') || (zEnd[-1] == '\t')))
+	zEnd--;
+
+    if (zEnd == zStart)
+	return NULL;
+
+    zName = ckalloc((zEnd - zStart) + 1);
+    memcpy(zName, zStart, zEnd - zStart);
+    zName[zEnd - zStart] = '\0';
+
+    return zName;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewFunc --
+ *
+ *	This function creates a function for the specified signature, with
+ *	one reference.  The caller must set its implementation.
+ *
+ * Results:
+ *	The new function -OR- NULL if the signature has no name.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassFunc *NewFunc(
+    const char *zSignature)		/* IN: The function signature. */
+{
+    SassFunc *funcPtr;
+    char *zName = GetFuncName(zSignature);
+
+    if (zName == NULL)
+	return NULL;
+
+    funcPtr = (SassFunc *)ckalloc(sizeof(SassFunc));
+    memset(funcPtr, 0, sizeof(SassFunc));
+
+    funcPtr->refCount = 1;
+    funcPtr->zName = zName;
+    funcPtr->zSignature = ckalloc(strlen(zSignature) + 1);
+    strcpy(funcPtr->zSignature, zSignature);
+
+    return funcPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReleaseFunc --
+ *
+ *	This function releases a reference to a function.  The function is
+ *	freed when its last reference is released.  For functions that are
+ *	implemented in Tcl, this must be done by the thread that owns the
+ *	Tcl interpreter.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ReleaseFunc(
+    SassFunc *funcPtr)			/* IN: The function. */
+{
+    int refCount;
+
+    Tcl_MutexLock(&funcMutex);
+    refCount = --funcPtr->refCount;
+    Tcl_MutexUnlock(&funcMutex);
+
+    if (refCount > 0)
+	return;
+
+    if (funcPtr->commandPtr != NULL)
+	Tcl_DecrRefCount(funcPtr->commandPtr);
+
+    ckfree(funcPtr->zName);
+    ckfree(funcPtr->zSignature);
+    ckfree((char *)funcPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddFunc --
+ *
+ *	This function adds a function to the specified table, replacing
+ *	any existing function with the same name.  The reference held by
+ *	the caller is transferred to the table.  The caller must hold the
+ *	lock on funcMutex.
+ *
+ * Results:
+ *	The function replaced, if any.  The reference held by the table is
+ *	transferred to the caller, which must release it via ReleaseFunc,
+ *	after releasing the lock.
+ *
+ * Side effects:
+ *	The version of the table changes.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassFunc *AddFunc(
+    SassFuncTable *tablePtr,		/* IN/OUT: The function table. */
+    SassFunc *funcPtr)			/* IN: The function to add. */
+{
+    Tcl_HashEntry *hPtr;
+    SassFunc *oldPtr = NULL;
+    int isNew;
+
+    hPtr = Tcl_CreateHashEntry(&tablePtr->funcs, funcPtr->zName, &isNew);
+
+    if (!isNew)
+	oldPtr = (SassFunc *)Tcl_GetHashValue(hPtr);
+
+    Tcl_SetHashValue(hPtr, (ClientData)funcPtr);
+    tablePtr->version = ++nextVersion;
+
+    return oldPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RemoveFunc --
+ *
+ *	This function removes the named function from the specified table.
+ *	It must be called by the thread that owns the table.
+ *
+ * Results:
+ *	Zero if the function was removed, non-zero if it was not found.
+ *
+ * Side effects:
+ *	The version of the table changes.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int RemoveFunc(
+    SassFuncTable *tablePtr,		/* IN/OUT: The function table. */
+    const char *zName)			/* IN: The function name. */
+{
+    Tcl_HashEntry *hPtr;
+    SassFunc *funcPtr;
+
+    Tcl_MutexLock(&funcMutex);
+
+    hPtr = tablePtr->bInitialized ?
+	Tcl_FindHashEntry(&tablePtr->funcs, zName) : NULL;
+
+    if (hPtr == NULL) {
+	Tcl_MutexUnlock(&funcMutex);
+	return 1;
+    }
+
+    funcPtr = (SassFunc *)Tcl_GetHashValue(hPtr);
+    Tcl_DeleteHashEntry(hPtr);
+    tablePtr->version = ++nextVersion;
+
+    Tcl_MutexUnlock(&funcMutex);
+
+    ReleaseFunc(funcPtr);
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClearFuncTable --
+ *
+ *	This function removes all functions from the specified table.  It
+ *	must be called by the thread that owns the table.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ClearFuncTable(
+    SassFuncTable *tablePtr)		/* IN/OUT: The function table. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    if (!tablePtr->bInitialized)
+	return;
+
+    for (hPtr = Tcl_FirstHashEntry(&tablePtr->funcs, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	ReleaseFunc((SassFunc *)Tcl_GetHashValue(hPtr));
+	Tcl_DeleteHashEntry(hPtr);
+    }
+
+    Tcl_MutexLock(&funcMutex);
+    tablePtr->version = ++nextVersion;
+    Tcl_MutexUnlock(&funcMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetNumberObj --
+ *
+ *	This function converts a Sass number to a Tcl object.  Numbers
+ *	without a unit become integer or double objects.  Numbers with a
+ *	unit become strings, e.g. "10px".
+ *
+ * Results:
+ *	The new Tcl object, without a reference.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *GetNumberObj(
+    double value,			/* IN: The numeric value. */
+    const char *zUnit)			/* IN: The unit, may be NULL. */
+{
+    char buffer[TCL_DOUBLE_SPACE + TCL_INTEGER_SPACE];
+    int bIntegral = (floor(value) == value) && (fabs(value) < 1e15);
+    Tcl_Obj *objPtr;
+
+    if ((zUnit == NULL) || (zUnit[0] == '\0')) {
+	if (bIntegral)
+	    return Tcl_NewWideIntObj((Tcl_WideInt)value);
+
+	return Tcl_NewDoubleObj(value);
+    }
+
+    if (bIntegral) {
+	snprintf(buffer, sizeof(buffer), "%" TCL_LL_MODIFIER "d",
+	    (Tcl_WideInt)value);
+    } else {
+	Tcl_PrintDouble(NULL, value, buffer);
+    }
+
+    objPtr = Tcl_NewStringObj(buffer, -1);
+    Tcl_AppendToObj(objPtr, zUnit, -1);
+
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetObjFromValue --
+ *
+ *	This function converts a value from libsass to a Tcl object.  Lists
+ *	become Tcl lists and maps become Tcl dictionaries, with their items
+ *	converted recursively.  Booleans become "true" or "false", colors
+ *	become "#rrggbb" or "rgba(r, g, b, a)", and null becomes an empty
+ *	string.
+ *
+ * Results:
+ *	The new Tcl object, without a reference.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *GetObjFromValue(
+    const union Sass_Value *valuePtr)	/* IN: The value to convert. */
+{
+    switch (sass_value_get_tag(valuePtr)) {
+	case SASS_BOOLEAN: {
+	    return Tcl_NewStringObj(sass_boolean_get_value(valuePtr) ?
+		"true" : "false", -1);
+	}
+	case SASS_NUMBER: {
+	    return GetNumberObj(sass_number_get_value(valuePtr),
+		sass_number_get_unit(valuePtr));
+	}
+	case SASS_COLOR: {
+	    char buffer[4 * TCL_DOUBLE_SPACE + 20];
+	    double a = sass_color_get_a(valuePtr);
+	    int aRgb[3];
+	    int index;
+
+	    aRgb[0] = (int)floor(sass_color_get_r(valuePtr) + 0.5);
+	    aRgb[1] = (int)floor(sass_color_get_g(valuePtr) + 0.5);
+	    aRgb[2] = (int)floor(sass_color_get_b(valuePtr) + 0.5);
+
+	    for (index = 0; index < 3; index++) {
+		if (aRgb[index] < 0)
+		    aRgb[index] = 0;
+		else if (aRgb[index] > 255)
+		    aRgb[index] = 255;
+	    }
+
+	    if (a >= 1.0) {
+		snprintf(buffer, sizeof(buffer), "#%02x%02x%02x",
+		    aRgb[0], aRgb[1], aRgb[2]);
+	    } else {
+		char alpha[TCL_DOUBLE_SPACE];
+
+		Tcl_PrintDouble(NULL, a, alpha);
+
+		snprintf(buffer, sizeof(buffer), "rgba(%d, %d, %d, %s)",
+		    aRgb[0], aRgb[1], aRgb[2], alpha);
+	    }
+
+	    return Tcl_NewStringObj(buffer, -1);
+	}
+	case SASS_STRING: {
+	    return Tcl_NewStringObj(sass_string_get_value(valuePtr), -1);
+	}
+	case SASS_LIST: {
+	    size_t length = sass_list_get_length(valuePtr);
+	    Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+	    size_t index;
+
+	    for (index = 0; index < length; index++) {
+		Tcl_ListObjAppendElement(NULL, listPtr, GetObjFromValue(
+		    sass_list_get_value(valuePtr, index)));
+	    }
+
+	    return listPtr;
+	}
+	case SASS_MAP: {
+	    size_t length = sass_map_get_length(valuePtr);
+	    Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+	    size_t index;
+
+	    for (index = 0; index < length; index++) {
+		Tcl_ListObjAppendElement(NULL, listPtr, GetObjFromValue(
+		    sass_map_get_key(valuePtr, index)));
+		Tcl_ListObjAppendElement(NULL, listPtr, GetObjFromValue(
+		    sass_map_get_value(valuePtr, index)));
+	    }
+
+	    return listPtr;
+	}
+	case SASS_ERROR: {
+	    return Tcl_NewStringObj(sass_error_get_message(valuePtr), -1);
+	}
+	case SASS_WARNING: {
+	    return Tcl_NewStringObj(sass_warning_get_message(valuePtr), -1);
+	}
+	default: {
+	    return Tcl_NewObj();
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsHexColor --
+ *
+ *	This function checks if the specified string is a hexadecimal
+ *	color, i.e. "#" followed by 3, 4, 6, or 8 hexadecimal digits.
+ *
+ * Results:
+ *	Non-zero if the string is a hexadecimal color.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int IsHexColor(
+    const char *zValue,			/* IN: The string to check. */
+    int length)				/* IN: Length of the string. */
+{
+    int index;
+
+    if ((length != 4) && (length != 5) && (length != 7) && (length != 9))
+	return 0;
+
+    if (zValue[0] != '#')
+	return 0;
+
+    for (index = 1; index < length; index++) {
+	if (strchr("0123456789abcdefABCDEF", zValue[index]) == NULL)
+	    return 0;
+    }
+
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetValueFromString --
+ *
+ *	This function converts a string returned by a function implemented
+ *	in Tcl to a value for libsass.  Empty strings and "null" become
+ *	null, "true" and "false" become booleans, numbers with an optional
+ *	unit become numbers, hexadecimal colors become colors, and strings
+ *	within quotes become quoted strings.  Everything else becomes an
+ *	unquoted string, which is output as is.
+ *
+ * Results:
+ *	The new value, owned by the caller.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static union Sass_Value *GetValueFromString(
+    const char *zValue,			/* IN: The string to convert. */
+    int length)				/* IN: Length of the string. */
+{
+    char first = zValue[0];
+
+    if ((length == 0) || CheckString(length, zValue, "null"))
+	return sass_make_null();
+
+    if (CheckString(length, zValue, "true"))
+	return sass_make_boolean(true);
+
+    if (CheckString(length, zValue, "false"))
+	return sass_make_boolean(false);
+
+    if (((first >= '0') && (first <= '9')) || (first == '.') ||
+	    (first == '-') || (first == '+')) {
+	char *zEnd;
+	double value = strtod(zValue, &zEnd);
+	const char *zUnit = zEnd;
+
+	while ((zUnit < zValue + length) && (((*zUnit >= 'a') &&
+		(*zUnit <= 'z')) || ((*zUnit >= 'A') && (*zUnit <= 'Z')) ||
+		(*zUnit == '%'))) {
+	    zUnit++;
+	}
+
+	/*
+	 * NOTE: Hexadecimal and non-finite values accepted by strtod() are
+	 *       not Sass numbers.
+	 */
+
+	if ((zEnd != zValue) && (zUnit == zValue + length) &&
+		(strchr(zValue, 'x') == NULL) &&
+		(strchr(zValue, 'X') == NULL) && (value == value) &&
+		(fabs(value) <= 1e300)) {
+	    return sass_make_number(value, zEnd);
+	}
+    }
+
+    if (IsHexColor(zValue, length)) {
+	int nDigits = (length - 1 > 4) ? 2 : 1;
+	double aRgba[4] = {0.0, 0.0, 0.0, 255.0};
+	int index;
+
+	for (index = 0; index < (length - 1) / nDigits; index++) {
+	    char buffer[3] = {0};
+
+	    memcpy(buffer, zValue + 1 + index * nDigits, nDigits);
+
+	    aRgba[index] = (double)strtol(buffer, NULL, 16);
+
+	    if (nDigits == 1)
+		aRgba[index] *= 17.0;
+	}
+
+	return sass_make_color(aRgba[0], aRgba[1], aRgba[2],
+	    aRgba[3] / 255.0);
+    }
+
+    /*
+     * NOTE: The quotes are removed by libsass, which also handles any escape
+     *       sequences within them.
+     */
+
+    if ((length >= 2) && ((first == '"') || (first == '\'')) &&
+	    (zValue[length - 1] == first)) {
+	return sass_make_qstring(zValue);
+    }
+
+    return sass_make_string(zValue);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetValueFromObj --
+ *
+ *	This function converts a Tcl object returned by a function that is
+ *	implemented in Tcl to a value for libsass.  The internal type of the
+ *	Tcl object is checked first, so that lists, dictionaries, and
+ *	numbers are converted without using their string representation.
+ *	Lists become space separated Sass lists, with their elements
+ *	converted recursively.  Everything else is converted from its
+ *	string representation via GetValueFromString.
+ *
+ * Results:
+ *	The new value, owned by the caller.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static union Sass_Value *GetValueFromObj(
+    Tcl_Obj *objPtr)			/* IN: The Tcl object to convert. */
+{
+    const Tcl_ObjType *typePtr = objPtr->typePtr;
+    int length;
+    char *zValue;
+
+    if (typePtr != NULL) {
+	if ((typePtr == Tcl_GetObjType("dict")) ||
+		(typePtr == Tcl_GetObjType("list"))) {
+	    int objc;
+	    Tcl_Obj **objv;
+	    union Sass_Value *valuePtr;
+	    int index;
+	    int bMap = (typePtr != Tcl_GetObjType("list"));
+
+	    if (Tcl_ListObjGetElements(NULL, objPtr, &objc,
+		    &objv) != TCL_OK) {
+		return sass_make_error("could not convert list");
+	    }
+
+	    if (bMap) {
+		valuePtr = sass_make_map(objc / 2);
+
+		for (index = 0; index + 1 < objc; index += 2) {
+		    sass_map_set_key(valuePtr, index / 2,
+			GetValueFromObj(objv[index]));
+		    sass_map_set_value(valuePtr, index / 2,
+			GetValueFromObj(objv[index + 1]));
+		}
+
+		return valuePtr;
+	    }
+
+	    if (objc == 1)
+		return GetValueFromObj(objv[0]);
+
+	    valuePtr = sass_make_list(objc, SASS_SPACE, false);
+
+	    for (index = 0; index < objc; index++) {
+		sass_list_set_value(valuePtr, index,
+		    GetValueFromObj(objv[index]));
+	    }
+
+	    return valuePtr;
+	}
+
+	if ((typePtr == Tcl_GetObjType("int")) ||
+		(typePtr == Tcl_GetObjType("wideInt")) ||
+		(typePtr == Tcl_GetObjType("double"))) {
+	    double value;
+
+	    if (Tcl_GetDoubleFromObj(NULL, objPtr, &value) == TCL_OK)
+		return sass_make_number(value, "");
+	}
+    }
+
+    zValue = Tcl_GetStringFromObj(objPtr, &length);
+    return GetValueFromString(zValue, length);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CallTclFunc --
+ *
+ *	This function calls a function implemented in Tcl.  The arguments
+ *	from libsass are converted and appended to its command prefix,
+ *	which is then evaluated at the global level.  The result of the Tcl
+ *	interpreter is preserved.
+ *
+ * Results:
+ *	The value returned by the function -OR- a Sass error.
+ *
+ * Side effects:
+ *	Whatever the Tcl command does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static union Sass_Value *CallTclFunc(
+    SassFunc *funcPtr,			/* IN: The function to call. */
+    const union Sass_Value *argsPtr)	/* IN: The list of arguments. */
+{
+    Tcl_Interp *interp = funcPtr->interp;
+    Tcl_SavedResult savedResult;
+    union Sass_Value *valuePtr;
+    Tcl_Obj *commandPtr;
+    size_t length;
+    size_t index;
+    int code;
+
+    if (Tcl_InterpDeleted(interp))
+	return sass_make_error("interpreter was deleted");
+
+    commandPtr = Tcl_DuplicateObj(funcPtr->commandPtr);
+    Tcl_IncrRefCount(commandPtr);
+
+    length = ((argsPtr != NULL) && sass_value_is_list(argsPtr)) ?
+	sass_list_get_length(argsPtr) : 0;
+
+    for (index = 0; index < length; index++) {
+	Tcl_ListObjAppendElement(NULL, commandPtr,
+	    GetObjFromValue(sass_list_get_value(argsPtr, index)));
+    }
+
+    Tcl_Preserve(interp);
+    Tcl_SaveResult(interp, &savedResult);
+
+    code = Tcl_EvalObjEx(interp, commandPtr, TCL_EVAL_GLOBAL);
+
+    if (code == TCL_OK) {
+	valuePtr = GetValueFromObj(Tcl_GetObjResult(interp));
+    } else {
+	valuePtr = sass_make_error(Tcl_GetStringResult(interp));
+    }
+
+    Tcl_RestoreResult(interp, &savedResult);
+    Tcl_Release(interp);
+
+    Tcl_DecrRefCount(commandPtr);
+    return valuePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CallFunc --
+ *
+ *	This function calls a registered function and then updates its
+ *	statistics.  Functions implemented in Tcl cannot be called by
+ *	compilations that may be performed by the worker threads, which
+ *	includes the ones performed by the calling thread for [sass
+ *	compileBatch], so that the results do not depend on scheduling.
+ *
+ * Results:
+ *	The value returned by the function -OR- a Sass error.
+ *
+ * Side effects:
+ *	Whatever the function does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static union Sass_Value *CallFunc(
+    SassFunc *funcPtr,			/* IN: The function to call. */
+    const union Sass_Value *argsPtr,	/* IN: The list of arguments. */
+    struct Sass_Compiler *compiler,	/* IN: The current compiler. */
+    int bWorker)			/* IN: Non-zero for worker threads. */
+{
+    union Sass_Value *valuePtr;
+    Tcl_Time startTime;
+    Tcl_Time endTime;
+
+    Tcl_GetTime(&startTime);
+
+    if (funcPtr->xProc != NULL) {
+	valuePtr = funcPtr->xProc(argsPtr, funcPtr->clientData, compiler);
+
+	if (valuePtr == NULL)
+	    valuePtr = sass_make_null();
+    } else if (bWorker) {
+	Tcl_Obj *msgPtr = Tcl_NewStringObj("function \"", -1);
+
+	Tcl_IncrRefCount(msgPtr);
+
+	Tcl_AppendStringsToObj(msgPtr, funcPtr->zName, "\" is implemented "
+	    "in Tcl and cannot be called by a worker thread", NULL);
+
+	valuePtr = sass_make_error(Tcl_GetString(msgPtr));
+	Tcl_DecrRefCount(msgPtr);
+    } else {
+	valuePtr = CallTclFunc(funcPtr, argsPtr);
+    }
+
+    Tcl_GetTime(&endTime);
+
+    Tcl_MutexLock(&funcMutex);
+    funcPtr->calls++;
+
+    if (sass_value_is_error(valuePtr))
+	funcPtr->errors++;
+
+    funcPtr->microseconds += (Tcl_WideInt)(endTime.sec - startTime.sec) *
+	1000000 + (endTime.usec - startTime.usec);
+
+    Tcl_MutexUnlock(&funcMutex);
+
+    return valuePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FuncCallProc --
+ *
+ *	This function is the callback used by libsass for the registered
+ *	functions, when compiling on the thread that owns the Tcl
+ *	interpreter.
+ *
+ * Results:
+ *	The value returned by the function -OR- a Sass error.
+ *
+ * Side effects:
+ *	Whatever the function does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static union Sass_Value *FuncCallProc(
+    const union Sass_Value *argsPtr,	/* IN: The list of arguments. */
+    Sass_Function_Entry cb,		/* IN: The function entry. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    return CallFunc((SassFunc *)sass_function_get_cookie(cb), argsPtr,
+	compiler, 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WorkerFuncCallProc --
+ *
+ *	This function is the callback used by libsass for the registered
+ *	functions, when compiling via the worker threads.
+ *
+ * Results:
+ *	The value returned by the function -OR- a Sass error.
+ *
+ * Side effects:
+ *	Whatever the function does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static union Sass_Value *WorkerFuncCallProc(
+    const union Sass_Value *argsPtr,	/* IN: The list of arguments. */
+    Sass_Function_Entry cb,		/* IN: The function entry. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    return CallFunc((SassFunc *)sass_function_get_cookie(cb), argsPtr,
+	compiler, 1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFuncRegister --
+ *
+ *	This function registers a custom Sass function implemented in C.
+ *	It is available to all compilations in the process, including
+ *	those performed by the worker threads; therefore, it must be
+ *	thread-safe.  Any existing function implemented in C with the same
+ *	name is replaced.  Functions implemented in Tcl take precedence.
+ *
+ * Results:
+ *	Zero on success, non-zero if the signature has no name.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassFuncRegister(
+    const char *zSignature,		/* IN: The Sass signature. */
+    SassFuncProc *xProc,		/* IN: The implementation. */
+    void *clientData)			/* IN: Passed to xProc. */
+{
+    SassFunc *funcPtr;
+    SassFunc *oldPtr;
+
+    if ((zSignature == NULL) || (xProc == NULL))
+	return 1;
+
+    funcPtr = NewFunc(zSignature);
+
+    if (funcPtr == NULL)
+	return 1;
+
+    funcPtr->xProc = xProc;
+    funcPtr->clientData = clientData;
+
+    Tcl_MutexLock(&funcMutex);
+
+    if (!nativeFuncs.bInitialized) {
+	Tcl_InitHashTable(&nativeFuncs.funcs, TCL_STRING_KEYS);
+	nativeFuncs.bInitialized = 1;
+    }
+
+    oldPtr = AddFunc(&nativeFuncs, funcPtr);
+    Tcl_MutexUnlock(&funcMutex);
+
+    if (oldPtr != NULL)
+	ReleaseFunc(oldPtr);
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFuncUnregister --
+ *
+ *	This function unregisters a custom Sass function implemented in C.
+ *	Compilations already in progress may still call it.
+ *
+ * Results:
+ *	Zero if the function was removed, non-zero if it was not found.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassFuncUnregister(
+    const char *zName)			/* IN: The function name. */
+{
+    return RemoveFunc(&nativeFuncs, zName);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFuncBind --
+ *
+ *	This function sets the list of custom functions used by libsass
+ *	for one compilation, i.e. the ones implemented in C and the ones
+ *	implemented in Tcl for the specified Tcl interpreter.  The versions
+ *	of both sets of functions are appended to the compile cache key,
+ *	so that registering or unregistering a function invalidates the
+ *	cached results; however, the functions themselves are assumed to
+ *	always return the same values for the same arguments.  Since the
+ *	versions are only meaningful within this process, the results of
+ *	compilations using any functions are never added to (or taken
+ *	from) the shared memory table or the on-disk cache.  When the
+ *	compilation may be performed by the worker threads, the functions
+ *	implemented in Tcl report an error instead.
+ *
+ * Results:
+ *	The functions used -OR- NULL if there are none.  They must be
+ *	released via SassFuncUnbind, after the compilation is complete.
+ *
+ * Side effects:
+ *	The list is owned by the options, and then by the context.
+ *
+ *----------------------------------------------------------------------
+ */
+
+SassFuncBinding *SassFuncBind(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    struct Sass_Options *optsPtr,	/* IN/OUT: The context options. */
+    int bWorker,			/* IN: Non-zero for worker threads. */
+    Tcl_DString *keyPtr)		/* IN/OUT: The compile cache key. */
+{
+    SassFuncTable *aTables[2];
+    SassFuncBinding *bindingPtr;
+    Sass_Function_List list;
+    char buffer[2 * TCL_INTEGER_SPACE + 4];
+    int nFuncs = 0;
+    int index;
+
+    aTables[0] = &nativeFuncs;
+    aTables[1] = GetFuncTable(interp, 0);
+
+    Tcl_MutexLock(&funcMutex);
+
+    for (index = 0; index < 2; index++) {
+	if ((aTables[index] != NULL) && aTables[index]->bInitialized)
+	    nFuncs += aTables[index]->funcs.numEntries;
+    }
+
+    if (nFuncs == 0) {
+	Tcl_MutexUnlock(&funcMutex);
+	return NULL;
+    }
+
+    bindingPtr = (SassFuncBinding *)ckalloc(sizeof(SassFuncBinding) +
+	(nFuncs - 1) * sizeof(SassFunc *));
+
+    bindingPtr->nFuncs = 0;
+
+    for (index = 0; index < 2; index++) {
+	Tcl_HashEntry *hPtr;
+	Tcl_HashSearch search;
+
+	if ((aTables[index] == NULL) || !aTables[index]->bInitialized)
+	    continue;
+
+	for (hPtr = Tcl_FirstHashEntry(&aTables[index]->funcs, &search);
+		hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	    SassFunc *funcPtr = (SassFunc *)Tcl_GetHashValue(hPtr);
+
+	    funcPtr->refCount++;
+	    bindingPtr->apFuncs[bindingPtr->nFuncs++] = funcPtr;
+	}
+    }
+
+    snprintf(buffer, sizeof(buffer), "\002%" TCL_LL_MODIFIER "d.%"
+	TCL_LL_MODIFIER "d", nativeFuncs.version, (aTables[1] != NULL) ?
+	aTables[1]->version : (Tcl_WideInt)0);
+
+    Tcl_MutexUnlock(&funcMutex);
+
+    Tcl_DStringAppend(keyPtr, buffer, -1);
+
+    /*
+     * NOTE: The functions implemented in Tcl come last, so that libsass
+     *       uses them instead of the ones implemented in C with the same
+     *       name.
+     */
+
+    list = sass_make_function_list(bindingPtr->nFuncs);
+
+    if (list != NULL) {
+	for (index = 0; index < bindingPtr->nFuncs; index++) {
+	    SassFunc *funcPtr = bindingPtr->apFuncs[index];
+
+	    sass_function_set_list_entry(list, index, sass_make_function(
+		funcPtr->zSignature, bWorker ? WorkerFuncCallProc :
+		FuncCallProc, (void *)funcPtr));
+	}
+
+	sass_option_set_c_functions(optsPtr, list);
+    }
+
+    return bindingPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFuncUnbind --
+ *
+ *	This function releases the functions used by one compilation.  It
+ *	must be called by the thread that owns the Tcl interpreter.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassFuncUnbind(
+    SassFuncBinding *bindingPtr)	/* IN: The functions, may be NULL. */
+{
+    int index;
+
+    if (bindingPtr == NULL)
+	return;
+
+    for (index = 0; index < bindingPtr->nFuncs; index++)
+	ReleaseFunc(bindingPtr->apFuncs[index]);
+
+    ckfree((char *)bindingPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendStats --
+ *
+ *	This function appends the name and statistics of each function in
+ *	the specified table to the specified list.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void AppendStats(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *listPtr,			/* IN/OUT: The list of statistics. */
+    SassFuncTable *tablePtr)		/* IN: The function table. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    if ((tablePtr == NULL) || !tablePtr->bInitialized)
+	return;
+
+    for (hPtr = Tcl_FirstHashEntry(&tablePtr->funcs, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	SassFunc *funcPtr = (SassFunc *)Tcl_GetHashValue(hPtr);
+	Tcl_Obj *statsPtr = Tcl_NewListObj(0, NULL);
+
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewStringObj("type", -1));
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewStringObj((funcPtr->xProc != NULL) ? "c" : "tcl", -1));
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewStringObj("calls", -1));
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewWideIntObj(funcPtr->calls));
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewStringObj("errors", -1));
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewWideIntObj(funcPtr->errors));
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewStringObj("microseconds", -1));
+	Tcl_ListObjAppendElement(interp, statsPtr,
+	    Tcl_NewWideIntObj(funcPtr->microseconds));
+
+	Tcl_ListObjAppendElement(interp, listPtr,
+	    Tcl_NewStringObj(funcPtr->zName, -1));
+	Tcl_ListObjAppendElement(interp, listPtr, statsPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFuncObjCmd --
+ *
+ *	Handles the [sass function] sub-command, which registers and
+ *	unregisters custom Sass functions implemented in Tcl and queries
+ *	all the registered functions.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Functions may be registered or unregistered.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassFuncObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int option;
+
+    static const char *cmdOptions[] = {
+	"names", "register", "stats", "unregister", (char *) NULL
+    };
+
+    enum options {
+	OPT_NAMES, OPT_REGISTER, OPT_STATS, OPT_UNREGISTER
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassFuncObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_NAMES: {
+	    SassFuncTable *aTables[2];
+	    const char *zPattern = NULL;
+	    Tcl_Obj *listPtr;
+	    int index;
+
+	    if ((objc != 3) && (objc != 4)) {
+		Tcl_WrongNumArgs(interp, 3, objv, "?pattern?");
+		return TCL_ERROR;
+	    }
+
+	    if (objc == 4)
+		zPattern = Tcl_GetString(objv[3]);
+
+	    aTables[0] = &nativeFuncs;
+	    aTables[1] = GetFuncTable(interp, 0);
+	    listPtr = Tcl_NewListObj(0, NULL);
+
+	    Tcl_MutexLock(&funcMutex);
+
+	    for (index = 0; index < 2; index++) {
+		Tcl_HashEntry *hPtr;
+		Tcl_HashSearch search;
+
+		if ((aTables[index] == NULL) || !aTables[index]->bInitialized)
+		    continue;
+
+		for (hPtr = Tcl_FirstHashEntry(&aTables[index]->funcs,
+			&search); hPtr != NULL;
+			hPtr = Tcl_NextHashEntry(&search)) {
+		    const char *zName = Tcl_GetHashKey(&aTables[index]->funcs,
+			hPtr);
+
+		    if ((zPattern == NULL) ||
+			    Tcl_StringMatch(zName, zPattern)) {
+			Tcl_ListObjAppendElement(interp, listPtr,
+			    Tcl_NewStringObj(zName, -1));
+		    }
+		}
+	    }
+
+	    Tcl_MutexUnlock(&funcMutex);
+
+	    Tcl_SetObjResult(interp, listPtr);
+	    return TCL_OK;
+	}
+	case OPT_REGISTER: {
+	    SassFuncTable *tablePtr;
+	    SassFunc *funcPtr;
+	    SassFunc *oldPtr;
+	    int length;
+
+	    if (objc != 5) {
+		Tcl_WrongNumArgs(interp, 3, objv, "signature command");
+		return TCL_ERROR;
+	    }
+
+	    if (Tcl_ListObjLength(interp, objv[4], &length) != TCL_OK)
+		return TCL_ERROR;
+
+	    if (length == 0) {
+		Tcl_AppendResult(interp, "command cannot be empty\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    funcPtr = NewFunc(Tcl_GetString(objv[3]));
+
+	    if (funcPtr == NULL) {
+		Tcl_AppendResult(interp, "missing function name\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    funcPtr->interp = interp;
+	    funcPtr->commandPtr = Tcl_DuplicateObj(objv[4]);
+	    Tcl_IncrRefCount(funcPtr->commandPtr);
+
+	    tablePtr = GetFuncTable(interp, 1);
+
+	    Tcl_MutexLock(&funcMutex);
+	    oldPtr = AddFunc(tablePtr, funcPtr);
+	    Tcl_MutexUnlock(&funcMutex);
+
+	    if (oldPtr != NULL)
+		ReleaseFunc(oldPtr);
+
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(funcPtr->zName, -1));
+	    return TCL_OK;
+	}
+	case OPT_STATS: {
+	    Tcl_Obj *listPtr;
+
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    listPtr = Tcl_NewListObj(0, NULL);
+
+	    Tcl_MutexLock(&funcMutex);
+	    AppendStats(interp, listPtr, &nativeFuncs);
+	    AppendStats(interp, listPtr, GetFuncTable(interp, 0));
+	    Tcl_MutexUnlock(&funcMutex);
+
+	    Tcl_SetObjResult(interp, listPtr);
+	    return TCL_OK;
+	}
+	case OPT_UNREGISTER: {
+	    SassFuncTable *tablePtr;
+
+	    if (objc != 4) {
+		Tcl_WrongNumArgs(interp, 3, objv, "name");
+		return TCL_ERROR;
+	    }
+
+	    tablePtr = GetFuncTable(interp, 0);
+
+	    if ((tablePtr == NULL) ||
+		    (RemoveFunc(tablePtr, Tcl_GetString(objv[3])) != 0)) {
+		Tcl_AppendResult(interp, "no such function \"",
+		    Tcl_GetString(objv[3]), "\"\n", NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	default: {
+	    Tcl_AppendResult(interp, "bad option index\n", NULL);
+	    return TCL_ERROR;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassFuncFinalize --
+ *
+ *	This function frees all the functions implemented in C.  It is
+ *	called when the package is unloaded from the process, after the
+ *	worker threads have exited.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassFuncFinalize(void)
+{
+    if (nativeFuncs.bInitialized) {
+	ClearFuncTable(&nativeFuncs);
+	Tcl_DeleteHashTable(&nativeFuncs.funcs);
+	nativeFuncs.bInitialized = 0;
+    }
+
+    Tcl_MutexFinalize(&funcMutex);
+}
@@ -0,0 +1,1138 @@
+/*
+ * tclsassImport.c -- Tcl Package for libsass
+ *
+ * Implements the import cache, which is used by a custom importer to avoid
+ * most of the file system access performed by libsass for each @import.  It
+ * memoizes the resolution of each import to a file, including the imports
+ * that could not be resolved, and caches the contents of each imported file,
+ * keyed by its path and modification time.  Memoized resolutions are checked
+ * using the modification times of the directories searched, so that files
+ * added later are still found.  It is shared by all compilations within the
+ * process, including those performed by the worker threads.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdio.h>		/* NOTE: For fopen(), fread(). */
+#include <stdlib.h>		/* NOTE: For malloc(), free(). */
+#include <string.h>		/* NOTE: For strlen(), strncmp(), memcpy(). */
+#include <sys/types.h>		/* NOTE: For struct stat. */
+#include <sys/stat.h>		/* NOTE: For stat(). */
+#if defined(_WIN32)
+#include <direct.h>		/* NOTE: For _getcwd(). */
+#define getcwd			_getcwd
+#else
+#include <unistd.h>		/* NOTE: For getcwd(). */
+#endif
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "sass/context.h"	/* NOTE: For public Sass API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: This is the priority of the custom importer used for the import
+ *       cache.  It must be lower than the one used for the virtual file
+ *       system, so that virtual files take precedence.
+ */
+
+#ifndef SASS_IMPORT_PRIORITY
+  #define SASS_IMPORT_PRIORITY			(-1.0)
+#endif
+
+/*
+ * NOTE: This is the maximum number of bytes of file contents that will be
+ *       kept by the import cache.  Files are still imported via the cache
+ *       once it is full; however, their contents are not kept.
+ */
+
+#ifndef SASS_IMPORT_MAX_BYTES
+  #define SASS_IMPORT_MAX_BYTES			(16 * 1024 * 1024)
+#endif
+
+/*
+ * NOTE: This is the character used to separate the directories within the
+ *       "include_path" option, which is the same one used by libsass.
+ */
+
+#if defined(_WIN32)
+  #define SASS_PATH_SEPARATOR			';'
+#else
+  #define SASS_PATH_SEPARATOR			':'
+#endif
+
+/*
+ * NOTE: This is the state of one file or directory, as used to check if it
+ *       has changed.  A file or directory that does not exist has a state
+ *       that is all zeros.
+ */
+
+typedef struct SassImportState {
+    int bExists;			/* Non-zero if it exists. */
+    Tcl_WideInt mtime;			/* Modification time, seconds. */
+    long mtimeNsec;			/* Modification time, nanoseconds. */
+    Tcl_WideInt size;			/* Size, in bytes. */
+    Tcl_WideUInt inode;			/* Inode number. */
+} SassImportState;
+
+/*
+ * NOTE: This is the memoized resolution of one import.  The path is NULL if
+ *       it could not be resolved.  The directories are those searched, i.e.
+ *       those where adding a file could change the resolution.  The strings
+ *       are allocated along with the structure.
+ */
+
+typedef struct SassImportLookup {
+    int refCount;			/* Number of references. */
+    char *zPath;			/* The resolved path, if any. */
+    int nDirs;				/* Number of directories. */
+    char **azDirs;			/* The directories searched. */
+    SassImportState *aDirStates;	/* Their states, when searched. */
+} SassImportLookup;
+
+/*
+ * NOTE: This is the cached contents of one imported file.
+ */
+
+typedef struct SassImportFile {
+    int refCount;			/* Number of references. */
+    SassImportState state;		/* State of the file when read. */
+    size_t length;			/* Length of the contents. */
+    char zData[1];			/* The contents, NUL terminated. */
+} SassImportFile;
+
+/*
+ * NOTE: This structure holds the state of the import cache.  There is only
+ *       one instance of it per process.  It is protected by importMutex.
+ *       The include paths are kept until the package is unloaded, because
+ *       they are referred to by the importers of pending compilations.
+ */
+
+typedef struct SassImportCache {
+    int bInitialized;			/* Non-zero if the tables are valid. */
+    Tcl_HashTable includePaths;		/* Interned "include_path" values. */
+    Tcl_HashTable lookups;		/* Maps imports to SassImportLookup. */
+    Tcl_HashTable files;		/* Maps paths to SassImportFile. */
+    Tcl_WideInt bytes;			/* Bytes used by the file contents. */
+    Tcl_WideInt resolveHits;		/* Memoized resolutions used. */
+    Tcl_WideInt resolveMisses;		/* Imports resolved by libsass. */
+    Tcl_WideInt notFound;		/* Imports that were not resolved. */
+    Tcl_WideInt contentHits;		/* Cached file contents used. */
+    Tcl_WideInt contentMisses;		/* File contents read from disk. */
+} SassImportCache;
+
+static SassImportCache importCache = {
+    0
+};
+
+TCL_DECLARE_MUTEX(importMutex)
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static void		InitializeCache(void);
+static void		GetState(const char *zPath, SassImportState *statePtr);
+static int		IsSameState(const SassImportState *state1Ptr,
+			    const SassImportState *state2Ptr);
+static void		AppendDirName(Tcl_DString *dsPtr, const char *zPath);
+static SassImportLookup *	NewLookup(const char *zPath, Tcl_DString *dirsPtr,
+			    Tcl_DString *statesPtr, int nDirs);
+static void		ReleaseLookup(SassImportLookup *lookupPtr);
+static void		AddSearchDirs(Tcl_DString *dirsPtr,
+			    Tcl_DString *statesPtr, int *nDirsPtr,
+			    const char *zRoot, int rootLength,
+			    const char *zUrl);
+static SassImportLookup *	ResolveImport(struct Sass_Compiler *compiler,
+			    const char *zUrl, const char *zBaseDir,
+			    const char *zIncludePath);
+static char *		ReadImport(const char *zPath);
+static void		ClearCache(void);
+static Sass_Import_List	ImportCacheProc(const char *zUrl,
+			    Sass_Importer_Entry cb,
+			    struct Sass_Compiler *compiler);
+static Sass_Import_List	ImportCacheTraceProc(const char *zUrl,
+			    Sass_Importer_Entry cb,
+			    struct Sass_Compiler *compiler);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitializeCache --
+ *
+ *	This function initializes the tables of the import cache, if that
+ *	has not already been done.  The caller must hold the mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void InitializeCache(void)
+{
+    if (importCache.bInitialized)
+	return;
+
+    Tcl_InitHashTable(&importCache.includePaths, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&importCache.lookups, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&importCache.files, TCL_STRING_KEYS);
+    importCache.bInitialized = 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetState --
+ *
+ *	This function queries the current state of the specified file or
+ *	directory.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void GetState(
+    const char *zPath,			/* IN: The file or directory. */
+    SassImportState *statePtr)		/* OUT: Its current state. */
+{
+    struct stat statBuf;
+
+    memset(statePtr, 0, sizeof(SassImportState));
+
+    if (stat((zPath[0] != '\0') ? zPath : ".", &statBuf) != 0)
+	return;
+
+    statePtr->bExists = 1;
+    statePtr->mtime = (Tcl_WideInt)statBuf.st_mtime;
+    statePtr->size = (Tcl_WideInt)statBuf.st_size;
+    statePtr->inode = (Tcl_WideUInt)statBuf.st_ino;
+
+#if defined(__linux__)
+    statePtr->mtimeNsec = (long)statBuf.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    statePtr->mtimeNsec = (long)statBuf.st_mtimespec.tv_nsec;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsSameState --
+ *
+ *	This function compares two states of a file or directory.
+ *
+ * Results:
+ *	Non-zero if the states are the same.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int IsSameState(
+    const SassImportState *state1Ptr,	/* IN: The first state. */
+    const SassImportState *state2Ptr)	/* IN: The second state. */
+{
+    return (state1Ptr->bExists == state2Ptr->bExists) &&
+	(state1Ptr->mtime == state2Ptr->mtime) &&
+	(state1Ptr->mtimeNsec == state2Ptr->mtimeNsec) &&
+	(state1Ptr->size == state2Ptr->size) &&
+	(state1Ptr->inode == state2Ptr->inode);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendDirName --
+ *
+ *	This function appends the directory portion of the specified path,
+ *	including the trailing slash, to the specified Tcl_DString.  This
+ *	is the same as the dir_name function used by libsass.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void AppendDirName(
+    Tcl_DString *dsPtr,			/* IN/OUT: Where to append. */
+    const char *zPath)			/* IN: The path. */
+{
+    const char *zSlash = strrchr(zPath, '/');
+
+#if defined(_WIN32)
+    const char *zBackslash = strrchr(zPath, '\\');
+
+    if ((zSlash == NULL) || ((zBackslash != NULL) && (zBackslash > zSlash)))
+	zSlash = zBackslash;
+#endif
+
+    if (zSlash != NULL)
+	Tcl_DStringAppend(dsPtr, zPath, (int)(zSlash - zPath) + 1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewLookup --
+ *
+ *	This function creates a memoized resolution for one import, using
+ *	the specified resolved path, the specified directories, each one
+ *	NUL terminated, and their states, which must have been queried
+ *	prior to resolving the import.
+ *
+ * Results:
+ *	The new resolution, with a reference count of one -OR- NULL if it
+ *	could not be allocated.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassImportLookup *NewLookup(
+    const char *zPath,			/* IN: Resolved path, may be NULL. */
+    Tcl_DString *dirsPtr,		/* IN: The directories searched. */
+    Tcl_DString *statesPtr,		/* IN: Their states. */
+    int nDirs)				/* IN: Number of directories. */
+{
+    SassImportLookup *lookupPtr;
+    size_t pathLength = (zPath != NULL) ? strlen(zPath) + 1 : 0;
+    size_t dirsLength = (size_t)Tcl_DStringLength(dirsPtr);
+    char *zCursor;
+    int index;
+
+    lookupPtr = (SassImportLookup *)attemptckalloc(sizeof(SassImportLookup) +
+	nDirs * (sizeof(SassImportState) + sizeof(char *)) + dirsLength +
+	pathLength);
+
+    if (lookupPtr == NULL)
+	return NULL;
+
+    lookupPtr->refCount = 1;
+    lookupPtr->nDirs = nDirs;
+    lookupPtr->aDirStates = (SassImportState *)(lookupPtr + 1);
+    lookupPtr->azDirs = (char **)(lookupPtr->aDirStates + nDirs);
+    zCursor = (char *)(lookupPtr->azDirs + nDirs);
+
+    memcpy(lookupPtr->aDirStates, Tcl_DStringValue(statesPtr),
+	nDirs * sizeof(SassImportState));
+
+    memcpy(zCursor, Tcl_DStringValue(dirsPtr), dirsLength);
+
+    for (index = 0; index < nDirs; index++) {
+	lookupPtr->azDirs[index] = zCursor;
+	zCursor += strlen(zCursor) + 1;
+    }
+
+    if (zPath != NULL) {
+	lookupPtr->zPath = zCursor;
+	memcpy(zCursor, zPath, pathLength);
+    } else {
+	lookupPtr->zPath = NULL;
+    }
+
+    return lookupPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReleaseLookup --
+ *
+ *	This function releases one reference to the specified memoized
+ *	resolution.  The caller must hold the mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The resolution is freed when its last reference is released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ReleaseLookup(
+    SassImportLookup *lookupPtr)	/* IN: The resolution to release. */
+{
+    if (lookupPtr == NULL)
+	return;
+
+    if (--lookupPtr->refCount <= 0)
+	ckfree((char *)lookupPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddSearchDirs --
+ *
+ *	This function adds the directories that libsass searches for the
+ *	specified URL within the specified root directory, along with their
+ *	current states.  These are the root combined with the directory
+ *	portion of the URL and, for index files, with the whole URL.  An
+ *	empty root is the current directory.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The directories are queried.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void AddSearchDirs(
+    Tcl_DString *dirsPtr,		/* IN/OUT: The directories. */
+    Tcl_DString *statesPtr,		/* IN/OUT: Their states. */
+    int *nDirsPtr,			/* IN/OUT: Number of directories. */
+    const char *zRoot,			/* IN: The root directory. */
+    int rootLength,			/* IN: Length of root directory. */
+    const char *zUrl)			/* IN: The URL being imported. */
+{
+    Tcl_DString dir;
+    int pass;
+
+    Tcl_DStringInit(&dir);
+
+    for (pass = 0; pass < 2; pass++) {
+	SassImportState state;
+
+	Tcl_DStringSetLength(&dir, 0);
+	Tcl_DStringAppend(&dir, zRoot, rootLength);
+
+	if ((rootLength > 0) && (zRoot[rootLength - 1] != '/'))
+	    Tcl_DStringAppend(&dir, "/", 1);
+
+	if (pass == 0) {
+	    AppendDirName(&dir, zUrl);
+	} else {
+	    Tcl_DStringAppend(&dir, zUrl, -1);
+	}
+
+	GetState(Tcl_DStringValue(&dir), &state);
+
+	Tcl_DStringAppend(dirsPtr, Tcl_DStringValue(&dir),
+	    Tcl_DStringLength(&dir) + 1);
+
+	Tcl_DStringAppend(statesPtr, (const char *)&state,
+	    sizeof(SassImportState));
+
+	(*nDirsPtr)++;
+    }
+
+    Tcl_DStringFree(&dir);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResolveImport --
+ *
+ *	This function resolves one import using libsass, after querying the
+ *	state of each directory that it will search, i.e. those within the
+ *	base directory, the current directory, and each directory from the
+ *	"include_path" option.
+ *
+ * Results:
+ *	The new memoized resolution -OR- NULL if it could not be allocated.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassImportLookup *ResolveImport(
+    struct Sass_Compiler *compiler,	/* IN: The current compiler. */
+    const char *zUrl,			/* IN: The URL being imported. */
+    const char *zBaseDir,		/* IN: The base directory. */
+    const char *zIncludePath)		/* IN: The "include_path" option. */
+{
+    SassImportLookup *lookupPtr;
+    Tcl_DString dirs;
+    Tcl_DString states;
+    const char *zNext = zIncludePath;
+    char *zPath;
+    int nDirs = 0;
+
+    Tcl_DStringInit(&dirs);
+    Tcl_DStringInit(&states);
+
+    AddSearchDirs(&dirs, &states, &nDirs, zBaseDir, (int)strlen(zBaseDir),
+	zUrl);
+
+    AddSearchDirs(&dirs, &states, &nDirs, "", 0, zUrl);
+
+    while (zNext[0] != '\0') {
+	const char *zEnd = strchr(zNext, SASS_PATH_SEPARATOR);
+	int length = (zEnd != NULL) ? (int)(zEnd - zNext) : (int)strlen(zNext);
+
+	if (length > 0)
+	    AddSearchDirs(&dirs, &states, &nDirs, zNext, length, zUrl);
+
+	zNext += (zEnd != NULL) ? length + 1 : length;
+    }
+
+    zPath = sass_compiler_find_include(zUrl, compiler);
+
+    lookupPtr = NewLookup(((zPath != NULL) && (zPath[0] != '\0')) ?
+	zPath : NULL, &dirs, &states, nDirs);
+
+    if (zPath != NULL)
+	sass_free_memory(zPath);
+
+    Tcl_DStringFree(&states);
+    Tcl_DStringFree(&dirs);
+
+    return lookupPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadImport --
+ *
+ *	This function returns the contents of the specified file, using
+ *	the cached contents if the file has not changed since it was read.
+ *	Otherwise, the file is read and its contents are cached, if there
+ *	is enough room.
+ *
+ * Results:
+ *	The contents, allocated via malloc() -OR- NULL if the file could
+ *	not be read.
+ *
+ * Side effects:
+ *	The file may be read.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *ReadImport(
+    const char *zPath)			/* IN: The file to read. */
+{
+    SassImportState state;
+    SassImportFile *filePtr = NULL;
+    Tcl_HashEntry *hPtr;
+    char *zData = NULL;
+    FILE *pFile;
+    int isNew;
+
+    GetState(zPath, &state);
+
+    if (!state.bExists)
+	return NULL;
+
+    Tcl_MutexLock(&importMutex);
+    InitializeCache();
+    hPtr = Tcl_FindHashEntry(&importCache.files, zPath);
+
+    if (hPtr != NULL) {
+	filePtr = (SassImportFile *)Tcl_GetHashValue(hPtr);
+
+	if (IsSameState(&filePtr->state, &state)) {
+	    filePtr->refCount++;
+	    importCache.contentHits++;
+	} else {
+	    filePtr = NULL;
+	}
+    }
+
+    if (filePtr == NULL)
+	importCache.contentMisses++;
+
+    Tcl_MutexUnlock(&importMutex);
+
+    if (filePtr != NULL) {
+	zData = malloc(filePtr->length + 1);
+
+	if (zData != NULL)
+	    memcpy(zData, filePtr->zData, filePtr->length + 1);
+
+	Tcl_MutexLock(&importMutex);
+
+	if (--filePtr->refCount <= 0)
+	    ckfree((char *)filePtr);
+
+	Tcl_MutexUnlock(&importMutex);
+	return zData;
+    }
+
+    /*
+     * NOTE: The state was queried prior to reading the file; therefore, if
+     *       the file is changed while being read, it will simply be read
+     *       again next time.
+     */
+
+    pFile = fopen(zPath, "rb");
+
+    if (pFile == NULL)
+	return NULL;
+
+    filePtr = (SassImportFile *)attemptckalloc(sizeof(SassImportFile) +
+	(size_t)state.size);
+
+    if (filePtr != NULL) {
+	filePtr->refCount = 1;
+	filePtr->state = state;
+	filePtr->length = fread(filePtr->zData, 1, (size_t)state.size, pFile);
+	filePtr->zData[filePtr->length] = '\0';
+
+	zData = malloc(filePtr->length + 1);
+
+	if (zData != NULL)
+	    memcpy(zData, filePtr->zData, filePtr->length + 1);
+    }
+
+    fclose(pFile);
+
+    if (filePtr == NULL)
+	return NULL;
+
+    Tcl_MutexLock(&importMutex);
+    InitializeCache();
+
+    if (importCache.bytes + (Tcl_WideInt)filePtr->length <=
+	    SASS_IMPORT_MAX_BYTES) {
+	hPtr = Tcl_CreateHashEntry(&importCache.files, zPath, &isNew);
+
+	if (!isNew) {
+	    SassImportFile *oldPtr = (SassImportFile *)Tcl_GetHashValue(hPtr);
+
+	    importCache.bytes -= (Tcl_WideInt)oldPtr->length;
+
+	    if (--oldPtr->refCount <= 0)
+		ckfree((char *)oldPtr);
+	}
+
+	Tcl_SetHashValue(hPtr, (ClientData)filePtr);
+	importCache.bytes += (Tcl_WideInt)filePtr->length;
+    } else {
+	ckfree((char *)filePtr);
+    }
+
+    Tcl_MutexUnlock(&importMutex);
+
+    return zData;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassIsCssImport --
+ *
+ *	This function checks if the specified URL is for an import of plain
+ *	CSS, which libsass does not load, using the same checks as libsass.
+ *	These are URLs with a protocol, URLs starting with "//", and URLs
+ *	ending with ".css".  Custom importers must not handle them.
+ *
+ * Results:
+ *	Non-zero if the URL is for plain CSS.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassIsCssImport(
+    const char *zUrl)			/* IN: The URL being imported. */
+{
+    size_t urlLength = strlen(zUrl);
+    const char *zColon = strstr(zUrl, "://");
+
+    if ((strncmp(zUrl, "//", 2) == 0) || ((urlLength > 4) &&
+	    (strcmp(zUrl + urlLength - 4, ".css") == 0))) {
+	return 1;
+    }
+
+    if (zColon != NULL) {
+	const char *zChar;
+
+	for (zChar = zUrl; zChar < zColon; zChar++) {
+	    if ((*zChar == '/') || (*zChar == '.'))
+		break;
+	}
+
+	if (zChar == zColon)
+	    return 1;
+    }
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ImportCacheProc --
+ *
+ *	This function is the custom importer used by libsass to resolve
+ *	imports via the import cache.  Its cookie is the interned value of
+ *	the "include_path" option.  It may be called by any thread.
+ *
+ * Results:
+ *	The list of imports, with one entry -OR- NULL if the URL is for a
+ *	plain CSS import, could not be resolved, or was resolved to a file
+ *	using the indented syntax, in which case libsass handles it as
+ *	usual.
+ *
+ * Side effects:
+ *	Files and directories may be queried and files may be read.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_Import_List ImportCacheProc(
+    const char *zUrl,			/* IN: The URL being imported. */
+    Sass_Importer_Entry cb,		/* IN: The importer. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    Sass_Import_List list;
+    Sass_Import_Entry lastPtr;
+    SassImportLookup *lookupPtr = NULL;
+    Tcl_HashEntry *hPtr;
+    Tcl_DString key;
+    const char *zIncludePath;
+    const char *zLast = NULL;
+    char *zSource;
+    char cwd[1024];
+    size_t pathLength;
+    int isNew;
+    int index;
+
+    if ((zUrl == NULL) || (compiler == NULL) || SassIsCssImport(zUrl))
+	return NULL;
+
+    lastPtr = sass_compiler_get_last_import(compiler);
+
+    if (lastPtr != NULL)
+	zLast = sass_import_get_abs_path(lastPtr);
+
+    if ((zLast == NULL) || (strncmp(zLast, SASS_VFS_PREFIX,
+	    strlen(SASS_VFS_PREFIX)) == 0)) {
+	return NULL;
+    }
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+	return NULL;
+
+    zIncludePath = (const char *)sass_importer_get_cookie(cb);
+
+    /*
+     * NOTE: The resolution depends upon the current directory, the include
+     *       paths, the base directory, and the URL.  None of them contain
+     *       the separator used here.
+     */
+
+    Tcl_DStringInit(&key);
+    Tcl_DStringAppend(&key, cwd, -1);
+    Tcl_DStringAppend(&key, "\001", 1);
+    Tcl_DStringAppend(&key, zIncludePath, -1);
+    Tcl_DStringAppend(&key, "\001", 1);
+    AppendDirName(&key, zLast);
+    Tcl_DStringAppend(&key, "\001", 1);
+    Tcl_DStringAppend(&key, zUrl, -1);
+
+    Tcl_MutexLock(&importMutex);
+    InitializeCache();
+    hPtr = Tcl_FindHashEntry(&importCache.lookups, Tcl_DStringValue(&key));
+
+    if (hPtr != NULL) {
+	lookupPtr = (SassImportLookup *)Tcl_GetHashValue(hPtr);
+	lookupPtr->refCount++;
+    }
+
+    Tcl_MutexUnlock(&importMutex);
+
+    /*
+     * NOTE: The memoized resolution is still valid if none of the searched
+     *       directories have changed.
+     */
+
+    if (lookupPtr != NULL) {
+	for (index = 0; index < lookupPtr->nDirs; index++) {
+	    SassImportState state;
+
+	    GetState(lookupPtr->azDirs[index], &state);
+
+	    if (!IsSameState(&lookupPtr->aDirStates[index], &state))
+		break;
+	}
+
+	if (index < lookupPtr->nDirs) {
+	    Tcl_MutexLock(&importMutex);
+	    ReleaseLookup(lookupPtr);
+	    Tcl_MutexUnlock(&importMutex);
+
+	    lookupPtr = NULL;
+	}
+    }
+
+    if (lookupPtr != NULL) {
+	Tcl_MutexLock(&importMutex);
+	importCache.resolveHits++;
+	Tcl_MutexUnlock(&importMutex);
+    } else {
+	Tcl_DString baseDir;
+
+	Tcl_DStringInit(&baseDir);
+	AppendDirName(&baseDir, zLast);
+
+	lookupPtr = ResolveImport(compiler, zUrl, Tcl_DStringValue(&baseDir),
+	    zIncludePath);
+
+	Tcl_DStringFree(&baseDir);
+
+	Tcl_MutexLock(&importMutex);
+	importCache.resolveMisses++;
+
+	if (lookupPtr != NULL) {
+	    InitializeCache();
+
+	    hPtr = Tcl_CreateHashEntry(&importCache.lookups,
+		Tcl_DStringValue(&key), &isNew);
+
+	    if (!isNew)
+		ReleaseLookup((SassImportLookup *)Tcl_GetHashValue(hPtr));
+
+	    Tcl_SetHashValue(hPtr, (ClientData)lookupPtr);
+	    lookupPtr->refCount++;
+	}
+
+	Tcl_MutexUnlock(&importMutex);
+    }
+
+    Tcl_DStringFree(&key);
+
+    if (lookupPtr == NULL)
+	return NULL;
+
+    /*
+     * NOTE: When the import could not be resolved, let libsass handle it as
+     *       usual, so that it reports the error.  The same is done for files
+     *       using the indented syntax, because libsass only converts those
+     *       when it reads them itself.
+     */
+
+    pathLength = (lookupPtr->zPath != NULL) ? strlen(lookupPtr->zPath) : 0;
+
+    if ((pathLength > 5) &&
+	    (strcmp(lookupPtr->zPath + pathLength - 5, ".sass") == 0)) {
+	zSource = NULL;
+    } else if (pathLength > 0) {
+	zSource = ReadImport(lookupPtr->zPath);
+    } else {
+	zSource = NULL;
+    }
+
+    list = (zSource != NULL) ? sass_make_import_list(1) : NULL;
+
+    if (list != NULL) {
+	list[0] = sass_make_import(zUrl, lookupPtr->zPath, zSource, NULL);
+    } else if (zSource != NULL) {
+	free(zSource);
+    }
+
+    Tcl_MutexLock(&importMutex);
+
+    if (lookupPtr->zPath == NULL)
+	importCache.notFound++;
+
+    ReleaseLookup(lookupPtr);
+    Tcl_MutexUnlock(&importMutex);
+
+    return list;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ImportCacheTraceProc --
+ *
+ *	This function is the custom importer actually registered with
+ *	libsass for the import cache.  It calls ImportCacheProc and then
+ *	records the lookup for [sass trace].
+ *
+ * Results:
+ *	The result of ImportCacheProc.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_Import_List ImportCacheTraceProc(
+    const char *zUrl,			/* IN: The URL being imported. */
+    Sass_Importer_Entry cb,		/* IN: The importer. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    Sass_Import_List list = ImportCacheProc(zUrl, cb, compiler);
+
+    SASS_TRACE(SASS_TRACE_IMPORT, SASS_TRACE_IMPORTER_CACHE, list != NULL);
+
+    return list;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassImportMakeImporter --
+ *
+ *	This function creates the custom importer for the import cache, for
+ *	use with one compilation using the specified "include_path" option.
+ *
+ * Results:
+ *	The importer -OR- NULL if it could not be created.
+ *
+ * Side effects:
+ *	The "include_path" option value is interned.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Sass_Importer_Entry SassImportMakeImporter(
+    const char *zIncludePath)		/* IN: Include paths, may be NULL. */
+{
+    Tcl_HashEntry *hPtr;
+    const char *zInterned;
+    int isNew;
+
+    Tcl_MutexLock(&importMutex);
+    InitializeCache();
+
+    hPtr = Tcl_CreateHashEntry(&importCache.includePaths,
+	(zIncludePath != NULL) ? zIncludePath : "", &isNew);
+
+    zInterned = Tcl_GetHashKey(&importCache.includePaths, hPtr);
+    Tcl_MutexUnlock(&importMutex);
+
+    return sass_make_importer(ImportCacheTraceProc, SASS_IMPORT_PRIORITY,
+	(void *)zInterned);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClearCache --
+ *
+ *	This function removes all memoized resolutions and file contents
+ *	from the import cache and resets its statistics.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Entries still in use by a compilation are freed once it is done.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ClearCache(void)
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    Tcl_MutexLock(&importMutex);
+
+    if (importCache.bInitialized) {
+	for (hPtr = Tcl_FirstHashEntry(&importCache.lookups, &search);
+		hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	    ReleaseLookup((SassImportLookup *)Tcl_GetHashValue(hPtr));
+	}
+
+	for (hPtr = Tcl_FirstHashEntry(&importCache.files, &search);
+		hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	    SassImportFile *filePtr = (SassImportFile *)Tcl_GetHashValue(hPtr);
+
+	    if (--filePtr->refCount <= 0)
+		ckfree((char *)filePtr);
+	}
+
+	Tcl_DeleteHashTable(&importCache.lookups);
+	Tcl_DeleteHashTable(&importCache.files);
+	Tcl_InitHashTable(&importCache.lookups, TCL_STRING_KEYS);
+	Tcl_InitHashTable(&importCache.files, TCL_STRING_KEYS);
+    }
+
+    importCache.bytes = 0;
+    importCache.resolveHits = 0;
+    importCache.resolveMisses = 0;
+    importCache.notFound = 0;
+    importCache.contentHits = 0;
+    importCache.contentMisses = 0;
+
+    Tcl_MutexUnlock(&importMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassImportObjCmd --
+ *
+ *	Handles the [sass importcache] sub-command, which queries or clears
+ *	the import cache.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The import cache may be cleared.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassImportObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int option;
+
+    static const char *cmdOptions[] = {
+	"clear", "stats", (char *) NULL
+    };
+
+    enum options {
+	OPT_CLEAR, OPT_STATS
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassImportObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    if (objc != 3) {
+	Tcl_WrongNumArgs(interp, 3, objv, NULL);
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_CLEAR: {
+	    ClearCache();
+
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	case OPT_STATS: {
+	    SassImportCache stats;
+	    int nLookups;
+	    int nFiles;
+	    Tcl_Obj *listPtr;
+
+	    Tcl_MutexLock(&importMutex);
+	    memcpy(&stats, &importCache, sizeof(SassImportCache));
+
+	    nLookups = importCache.bInitialized ?
+		importCache.lookups.numEntries : 0;
+
+	    nFiles = importCache.bInitialized ?
+		importCache.files.numEntries : 0;
+
+	    Tcl_MutexUnlock(&importMutex);
+
+	    listPtr = Tcl_NewListObj(0, NULL);
+
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("lookups", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewIntObj(nLookups));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("files", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewIntObj(nFiles));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("bytes", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.bytes));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("resolveHits", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.resolveHits));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("resolveMisses", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.resolveMisses));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("notFound", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.notFound));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("contentHits", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.contentHits));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("contentMisses", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.contentMisses));
+
+	    Tcl_SetObjResult(interp, listPtr);
+	    return TCL_OK;
+	}
+	default: {
+	    Tcl_AppendResult(interp, "bad option index\n", NULL);
+	    return TCL_ERROR;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassImportFinalize --
+ *
+ *	This function frees all resources used by the import cache.  It is
+ *	called when the package is unloaded from the process, after the
+ *	worker threads have exited.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassImportFinalize(void)
+{
+    ClearCache();
+
+    Tcl_MutexLock(&importMutex);
+
+    if (importCache.bInitialized) {
+	Tcl_DeleteHashTable(&importCache.includePaths);
+	Tcl_DeleteHashTable(&importCache.lookups);
+	Tcl_DeleteHashTable(&importCache.files);
+	importCache.bInitialized = 0;
+    }
+
+    Tcl_MutexUnlock(&importMutex);
+    Tcl_MutexFinalize(&importMutex);
+}
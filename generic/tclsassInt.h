@@ -21,6 +21,8 @@
  * NOTE: The PACKAGE_TRACE macro is used to report important diagnostics when
  *       other means are not available.  Currently, this macro is enabled by
  *       default; however, it may be overridden via the compiler command line.
+ *       It is only meant for debugging builds, since it writes to stdout;
+ *       runtime events are recorded via the SASS_TRACE macro instead.
  */
 
 #ifndef PACKAGE_TRACE
@@ -93,6 +95,31 @@
 #define CheckString(len,arg,str) \
     (((len) == strlen((str))) && (strcmp((arg), (str)) == 0))
 
+/*
+ * NOTE: This macro returns the nanoseconds portion of the modification time
+ *       from a stat structure, on the platforms where it is available.  On
+ *       all other platforms, only the seconds portion will be compared.
+ */
+
+#if defined(__linux__)
+  #define STAT_MTIME_NSEC(s)			((long)(s)->st_mtim.tv_nsec)
+#elif defined(__APPLE__)
+  #define STAT_MTIME_NSEC(s)			((long)(s)->st_mtimespec.tv_nsec)
+#else
+  #define STAT_MTIME_NSEC(s)			(0L)
+#endif
+
+/*
+ * NOTE: This is the number of seconds before the start of a compilation
+ *       during which a modification of an included file is assumed to be
+ *       concurrent with it, since many file systems have coarse modification
+ *       times.  The state of such files is never recorded.
+ */
+
+#ifndef SASS_MTIME_WINDOW
+  #define SASS_MTIME_WINDOW			(1)
+#endif
+
 /*
  * NOTE: These are semi-generic function types, used for interfacing with
  *       various functions from the Tcl C API and the Sass C API.
@@ -101,4 +128,375 @@
 typedef int (fn_get_any) ();
 typedef void (fn_set_any) ();
 
+/*
+ * NOTE: When the package is not being compiled via TEA, the MODULE_SCOPE
+ *       macro may not be defined.  It is used to mark the functions that
+ *       are shared between the source files of this package and that are
+ *       not part of its public API.
+ */
+
+#ifndef MODULE_SCOPE
+  #define MODULE_SCOPE				extern
+#endif
+
+/*
+ * NOTE: This structure holds the results of a single compilation, detached
+ *       from the Sass_Context that produced them.  The string pointers are
+ *       not owned by this structure.  They may refer to memory owned by a
+ *       Sass_Context -OR- by an entry in the compile cache.  A NULL string
+ *       pointer means the associated value is not available, e.g. there is
+ *       no source map.
+ */
+
+typedef struct SassResult {
+    int errorStatus;			/* Zero means success. */
+    const char *zOutput;		/* The output string, if any. */
+    int outputLength;			/* Length of output string. */
+    const char *zSourceMap;		/* The source map string, if any. */
+    int sourceMapLength;		/* Length of source map string. */
+    const char *zErrorMessage;		/* The error message, if any. */
+    int errorMessageLength;		/* Length of error message. */
+    Tcl_WideInt errorLine;		/* Line number of the error. */
+    Tcl_WideInt errorColumn;		/* Column number of the error. */
+} SassResult;
+
+/*
+ * NOTE: This is an opaque entry within the compile cache.  Entries found by
+ *       the SassCacheFind function must be released via SassCacheRelease.
+ */
+
+typedef struct SassCacheEntry SassCacheEntry;
+
+/*
+ * NOTE: Private functions defined in "tclsassCache.c".
+ */
+
+MODULE_SCOPE SassCacheEntry *	SassCacheFind(const char *zKey, int keyLength,
+			    int bLocal);
+MODULE_SCOPE const SassResult *	SassCacheGetResult(SassCacheEntry *entryPtr);
+MODULE_SCOPE void	SassCacheRelease(SassCacheEntry *entryPtr);
+MODULE_SCOPE void	SassCacheStore(const char *zKey, int keyLength,
+			    const SassResult *resultPtr, char **azIncluded,
+			    const Tcl_Time *startTimePtr, int bLocal);
+MODULE_SCOPE int	SassCacheObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+MODULE_SCOPE void	SassCacheFinalize(void);
+MODULE_SCOPE Tcl_WideUInt	SassHashBytes(const char *zBytes, size_t nBytes);
+MODULE_SCOPE int	SassIsRecentTime(Tcl_WideInt sec, long nsec,
+			    const Tcl_Time *startTimePtr);
+
+/*
+ * NOTE: Private functions defined in "tclsassShm.c".
+ */
+
+MODULE_SCOPE int	SassShmOpen(Tcl_Interp *interp, const char *zPath,
+			    Tcl_WideInt nBytes);
+MODULE_SCOPE char *	SassShmGetConfig(Tcl_WideInt *nBytesPtr);
+MODULE_SCOPE int	SassShmFind(Tcl_WideUInt hash, char **ppData,
+			    size_t *pnBytes);
+MODULE_SCOPE int	SassShmStore(Tcl_WideUInt hash, const char *pData,
+			    size_t nBytes);
+MODULE_SCOPE void	SassShmCount(int bHit);
+MODULE_SCOPE void	SassShmGetStats(Tcl_WideInt *hitsPtr,
+			    Tcl_WideInt *missesPtr, Tcl_WideInt *storesPtr);
+MODULE_SCOPE void	SassShmFinalize(void);
+
+/*
+ * NOTE: This is the maximum number of threads that may be configured for the
+ *       worker thread pool -OR- requested for a batch of compilations.
+ */
+
+#ifndef SASS_POOL_MAX_THREADS
+  #define SASS_POOL_MAX_THREADS			(256)
+#endif
+
+/*
+ * NOTE: This is the type of the procedures used with the worker thread pool.
+ */
+
+typedef void (SassPoolProc) (ClientData clientData);
+
+/*
+ * NOTE: Private functions defined in "tclsassPool.c".
+ */
+
+MODULE_SCOPE int	SassPoolSubmit(Tcl_Interp *interp,
+			    SassPoolProc *workProc, SassPoolProc *doneProc,
+			    SassPoolProc *discardProc, ClientData clientData);
+MODULE_SCOPE void	SassPoolRunAll(int nThreads, SassPoolProc *workProc,
+			    ClientData *aClientData, int nItems);
+MODULE_SCOPE int	SassPoolObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+MODULE_SCOPE int	SassPoolPending(void);
+MODULE_SCOPE void	SassPoolFinalize(void);
+
+/*
+ * NOTE: This is the prefix of the absolute paths given to libsass for files
+ *       imported from the in-memory virtual file system.  It is used by the
+ *       compile cache to recognize them as well.
+ */
+
+#ifndef SASS_VFS_PREFIX
+  #define SASS_VFS_PREFIX			"vfs:"
+#endif
+
+/*
+ * NOTE: Private functions defined in "tclsassVfs.c".  The importer is only
+ *       declared for the source files that include the libsass headers.
+ */
+
+#ifdef SASS_C_FUNCTIONS_H
+MODULE_SCOPE Sass_Importer_Entry	SassVfsMakeImporter(void);
+#endif
+MODULE_SCOPE int	SassVfsGetState(const char *zPath,
+			    Tcl_WideInt *sizePtr, Tcl_WideUInt *hashPtr);
+MODULE_SCOPE int	SassVfsObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+MODULE_SCOPE void	SassVfsFinalize(void);
+
+/*
+ * NOTE: This is the opaque state of the importer used for the Tcl virtual
+ *       filesystem, which belongs to one compilation.
+ */
+
+typedef struct SassFs SassFs;
+
+/*
+ * NOTE: Private functions defined in "tclsassFs.c".  The importer is only
+ *       declared for the source files that include the libsass headers.
+ */
+
+MODULE_SCOPE SassFs *	SassFsCreate(const char *zIncludePath);
+#ifdef SASS_C_FUNCTIONS_H
+MODULE_SCOPE Sass_Importer_Entry	SassFsMakeImporter(SassFs *fsPtr);
+#endif
+MODULE_SCOPE int	SassFsReadEntry(Tcl_Interp *interp, SassFs *fsPtr,
+			    const char *zPath, const char **pzData);
+MODULE_SCOPE void	SassFsDelete(SassFs *fsPtr);
+
+/*
+ * NOTE: Private functions defined in "tclsassImport.c".  The importer is only
+ *       declared for the source files that include the libsass headers.
+ */
+
+#ifdef SASS_C_FUNCTIONS_H
+MODULE_SCOPE Sass_Importer_Entry	SassImportMakeImporter(
+				    const char *zIncludePath);
+#endif
+MODULE_SCOPE int	SassIsCssImport(const char *zUrl);
+MODULE_SCOPE int	SassImportObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+MODULE_SCOPE void	SassImportFinalize(void);
+
+/*
+ * NOTE: This is the type of the procedures implementing custom Sass functions
+ *       in C, which are registered via SassFuncRegister.  The arguments are
+ *       a Sass list.  The returned value is owned by libsass; a Sass error
+ *       value may be returned to fail the compilation.  They may be called
+ *       by any thread.
+ */
+
+#ifdef SASS_C_FUNCTIONS_H
+typedef union Sass_Value *(SassFuncProc) (const union Sass_Value *argsPtr,
+    void *clientData, struct Sass_Compiler *compiler);
+#endif
+
+/*
+ * NOTE: This is the name of the Tcl interpreter association data used to
+ *       store the custom functions implemented in Tcl.
+ */
+
+#define SASS_FUNC_DATA_NAME			PACKAGE_NAME "_functions"
+
+/*
+ * NOTE: This is the opaque set of custom functions used by one compilation.
+ */
+
+typedef struct SassFuncBinding SassFuncBinding;
+
+/*
+ * NOTE: Private functions defined in "tclsassFunc.c".  Those using the Sass
+ *       types are only declared for the source files that include the
+ *       libsass headers.
+ */
+
+#ifdef SASS_C_FUNCTIONS_H
+MODULE_SCOPE int	SassFuncRegister(const char *zSignature,
+			    SassFuncProc *xProc, void *clientData);
+MODULE_SCOPE SassFuncBinding *	SassFuncBind(Tcl_Interp *interp,
+				    struct Sass_Options *optsPtr, int bWorker,
+				    Tcl_DString *keyPtr);
+#endif
+MODULE_SCOPE int	SassFuncUnregister(const char *zName);
+MODULE_SCOPE void	SassFuncUnbind(SassFuncBinding *bindingPtr);
+MODULE_SCOPE int	SassFuncObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+MODULE_SCOPE void	SassFuncFinalize(void);
+
+/*
+ * NOTE: This is the opaque header encoded from one variables dictionary.  It
+ *       is reference counted; each reference must be released via the
+ *       SassVarsRelease function.
+ */
+
+typedef struct SassVars SassVars;
+
+/*
+ * NOTE: Private functions defined in "tclsassVars.c".  Those using the Sass
+ *       types are only declared for the source files that include the
+ *       libsass headers.
+ */
+
+MODULE_SCOPE SassVars *	SassVarsGetFromObj(Tcl_Interp *interp,
+			    Tcl_Obj *dictPtr);
+#ifdef SASS_C_FUNCTIONS_H
+MODULE_SCOPE void	SassVarsBind(SassVars *varsPtr,
+			    struct Sass_Options *optsPtr, Tcl_DString *keyPtr);
+#endif
+MODULE_SCOPE void	SassVarsRelease(SassVars *varsPtr);
+
+/*
+ * NOTE: Private functions defined in "tclsass.c".
+ */
+
+MODULE_SCOPE int	SassCompileFiles(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[], int nFiles,
+			    Tcl_Obj *CONST apFiles[], Tcl_Obj **apResults,
+			    Tcl_Obj **apIncluded);
+MODULE_SCOPE int	SassParseIncludes(Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+MODULE_SCOPE int	SassWriteFile(Tcl_Interp *interp, Tcl_Obj *pathPtr,
+			    const char *zData, int dataLength);
+
+/*
+ * NOTE: Private functions defined in "tclsassDeps.c".
+ */
+
+MODULE_SCOPE void	SassAddToList(Tcl_HashTable *tablePtr,
+			    const char *zKey, Tcl_Obj *valuePtr);
+MODULE_SCOPE void	SassRemoveFromList(Tcl_HashTable *tablePtr,
+			    const char *zKey, const char *zValue);
+MODULE_SCOPE int	SassDepsObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+
+/*
+ * NOTE: These are the counters kept by "tclsassStats.c", which are reported
+ *       by [sass stats].  The names used there must be kept in sync.
+ */
+
+enum Sass_Stat {
+  SASS_STAT_COMPILES_DATA,
+  SASS_STAT_COMPILES_FILE,
+  SASS_STAT_ERRORS,
+  SASS_STAT_INPUT_BYTES,
+  SASS_STAT_OUTPUT_BYTES,
+  SASS_STAT_CACHE_HITS,
+  SASS_STAT_CACHE_MISSES,
+  SASS_STAT_MAX
+};
+
+/*
+ * NOTE: These are the phases of a compilation whose latencies are recorded
+ *       by "tclsassStats.c".
+ */
+
+enum Sass_Phase {
+  SASS_PHASE_OPTIONS,
+  SASS_PHASE_COMPILE,
+  SASS_PHASE_RESULT,
+  SASS_PHASE_MAX
+};
+
+/*
+ * NOTE: Private data and functions defined in "tclsassStats.c".
+ */
+
+MODULE_SCOPE volatile int sassStatsFiles;
+
+MODULE_SCOPE Tcl_WideUInt	SassStatsNow(void);
+MODULE_SCOPE Tcl_WideUInt	SassStatsCpuNow(void);
+MODULE_SCOPE Tcl_WideInt	SassStatsHeapBytes(void);
+MODULE_SCOPE void	SassStatsCount(enum Sass_Stat stat,
+			    Tcl_WideUInt amount);
+MODULE_SCOPE Tcl_WideUInt	SassStatsRecord(enum Sass_Phase phase,
+			    Tcl_WideUInt startTime);
+MODULE_SCOPE int	SassStatsObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+
+/*
+ * NOTE: These are the binary trace events recorded by "tclsassTrace.c",
+ *       along with the meaning of their two arguments.  Cache keys are
+ *       identified by their hash.
+ */
+
+enum Sass_Trace_Event {
+  SASS_TRACE_COMPILE_START,	/* Context type, number of source bytes. */
+  SASS_TRACE_COMPILE_END,	/* Error status, number of output bytes. */
+  SASS_TRACE_CACHE_HIT,		/* Key hash, not used. */
+  SASS_TRACE_CACHE_MISS,	/* Key hash, not used. */
+  SASS_TRACE_CACHE_STORE,	/* Key hash, non-zero if stored. */
+  SASS_TRACE_IMPORT,		/* Sass_Trace_Importer, non-zero if found. */
+  SASS_TRACE_UNLOAD		/* Unload flags, return code. */
+};
+
+/*
+ * NOTE: These are the custom importers reported by SASS_TRACE_IMPORT.
+ */
+
+enum Sass_Trace_Importer {
+  SASS_TRACE_IMPORTER_VFS,
+  SASS_TRACE_IMPORTER_TCL_VFS,
+  SASS_TRACE_IMPORTER_CACHE
+};
+
+/*
+ * NOTE: The SASS_TRACE macro records a binary trace event into the ring
+ *       buffer of the calling thread, if tracing is enabled via [sass trace
+ *       on].  Otherwise, it only costs a load and a branch.
+ */
+
+#define SASS_TRACE(type, arg1, arg2) \
+    do { \
+	if (sassTraceEnabled) { \
+	    SassTraceRecord((type), (Tcl_WideUInt)(arg1), \
+		(Tcl_WideUInt)(arg2)); \
+	} \
+    } while (0)
+
+/*
+ * NOTE: Private data and functions defined in "tclsassTrace.c".
+ */
+
+MODULE_SCOPE volatile int sassTraceEnabled;
+
+MODULE_SCOPE void	SassTraceRecord(enum Sass_Trace_Event type,
+			    Tcl_WideUInt arg1, Tcl_WideUInt arg2);
+MODULE_SCOPE void	SassTraceFinalize(void);
+MODULE_SCOPE int	SassTraceObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+
+/*
+ * NOTE: This is the name of the Tcl interpreter association data used to
+ *       store the watches created by [sass watch].  Deleting it cancels all
+ *       of them.
+ */
+
+#define SASS_WATCH_DATA_NAME			PACKAGE_NAME "_watches"
+
+/*
+ * NOTE: Private functions defined in "tclsassWatch.c".
+ */
+
+MODULE_SCOPE int	SassWatchObjCmd(ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]);
+
 #endif /* _TCLSASS_INT_H_ */
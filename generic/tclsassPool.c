@@ -0,0 +1,841 @@
+/*
+ * tclsassPool.c -- Tcl Package for libsass
+ *
+ * Implements the pool of native worker threads used to compile stylesheets
+ * asynchronously, e.g. via [sass compile -command].  Work is submitted by a
+ * Tcl thread, performed by one of the worker threads, and then completed by
+ * an event queued back to the submitting thread, which runs when that thread
+ * services its event loop.  The worker threads do not use any interpreters.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdlib.h>		/* NOTE: For size_t. */
+#include <string.h>		/* NOTE: For memset(). */
+#if !defined(_WIN32)
+#include <unistd.h>		/* NOTE: For sysconf(). */
+#endif
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: This is the number of worker threads used when the number of CPUs
+ *       cannot be determined and no number has been configured.
+ */
+
+#ifndef SASS_POOL_DEFAULT_THREADS
+  #define SASS_POOL_DEFAULT_THREADS		(4)
+#endif
+
+/*
+ * NOTE: This is one unit of work submitted to the pool.
+ */
+
+typedef struct SassPoolJob {
+    SassPoolProc *workProc;		/* Called by a worker thread. */
+    SassPoolProc *doneProc;		/* Called by the submitting thread. */
+    SassPoolProc *discardProc;		/* Called instead, on shutdown. */
+    ClientData clientData;		/* Passed to all of the above. */
+    Tcl_ThreadId threadId;		/* The submitting thread. */
+    struct SassPoolJob *nextPtr;	/* Next job in the queue. */
+} SassPoolJob;
+
+/*
+ * NOTE: This is the event used to complete a job on the submitting thread.
+ */
+
+typedef struct SassPoolEvent {
+    Tcl_Event header;			/* Standard Tcl event header. */
+    SassPoolJob *jobPtr;		/* The job to complete. */
+} SassPoolEvent;
+
+/*
+ * NOTE: This structure holds the state of the pool.  There is only one
+ *       instance of it per process.  It is protected by poolMutex.
+ */
+
+typedef struct SassPool {
+    int maxThreads;			/* Configured number of threads. */
+    int nThreads;			/* Number of running threads. */
+    int nBusy;				/* Threads performing a job. */
+    int nQueued;			/* Jobs waiting for a thread. */
+    int nPending;			/* Jobs not completed or discarded. */
+    int bShutdown;			/* Non-zero if threads must exit. */
+    SassPoolJob *headPtr;		/* Oldest queued job. */
+    SassPoolJob *tailPtr;		/* Newest queued job. */
+    Tcl_WideInt submitted;		/* Jobs submitted to the pool. */
+    Tcl_WideInt completed;		/* Jobs performed by the threads. */
+    Tcl_Condition workCond;		/* Signaled when a job is queued. */
+    Tcl_Condition exitCond;		/* Signaled when a thread exits. */
+} SassPool;
+
+static SassPool pool = {
+    0, 0, 0, 0, 0, 0, NULL, NULL, 0, 0, NULL, NULL
+};
+
+TCL_DECLARE_MUTEX(poolMutex)
+
+/*
+ * NOTE: This structure holds the state of one call to SassPoolRunAll.  The
+ *       items are handed out, in order, to the threads running the batch.
+ */
+
+typedef struct SassPoolBatch {
+    SassPoolProc *workProc;		/* Called for each item. */
+    ClientData *aClientData;		/* The items. */
+    int nItems;				/* Number of items. */
+    int nextItem;			/* Next item to hand out. */
+    Tcl_Mutex mutex;			/* Protects nextItem. */
+} SassPoolBatch;
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static int		GetDefaultThreads(void);
+static int		StartThreads(void);
+static Tcl_ThreadCreateType PoolThreadProc(ClientData clientData);
+static int		PoolEventProc(Tcl_Event *evPtr, int flags);
+static int		DiscardEventProc(Tcl_Event *evPtr,
+			    ClientData clientData);
+static void		DiscardJob(SassPoolJob *jobPtr);
+static void		RunBatch(SassPoolBatch *batchPtr);
+static Tcl_ThreadCreateType BatchThreadProc(ClientData clientData);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDefaultThreads --
+ *
+ *	This function returns the number of worker threads to use when
+ *	none has been configured, which is the number of online CPUs.
+ *
+ * Results:
+ *	The number of worker threads.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int GetDefaultThreads(void)
+{
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+    long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nCpus > SASS_POOL_MAX_THREADS)
+	return SASS_POOL_MAX_THREADS;
+
+    if (nCpus > 0)
+	return (int)nCpus;
+#endif
+
+    return SASS_POOL_DEFAULT_THREADS;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartThreads --
+ *
+ *	This function starts worker threads until the configured number
+ *	of them are running.  The caller must hold the pool mutex.
+ *
+ * Results:
+ *	Zero on success, non-zero if no worker threads are running.
+ *
+ * Side effects:
+ *	Threads may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int StartThreads(void)
+{
+    if (pool.maxThreads <= 0)
+	pool.maxThreads = GetDefaultThreads();
+
+    while (pool.nThreads < pool.maxThreads) {
+	Tcl_ThreadId threadId;
+
+	if (Tcl_CreateThread(&threadId, PoolThreadProc, NULL,
+		TCL_THREAD_STACK_DEFAULT, TCL_THREAD_NOFLAGS) != TCL_OK) {
+	    break;
+	}
+
+	pool.nThreads++;
+    }
+
+    return (pool.nThreads > 0) ? 0 : -1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PoolThreadProc --
+ *
+ *	This function is the entry point for each worker thread.  It runs
+ *	queued jobs until the pool is shut down -OR- there are more worker
+ *	threads than configured.  After each job, an event is queued to
+ *	the submitting thread to complete it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the jobs do.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_ThreadCreateType PoolThreadProc(
+    ClientData clientData)		/* Not used. */
+{
+    Tcl_MutexLock(&poolMutex);
+
+    while (1) {
+	SassPoolJob *jobPtr;
+	SassPoolEvent *eventPtr;
+
+	while (!pool.bShutdown && (pool.nThreads <= pool.maxThreads) &&
+		(pool.headPtr == NULL)) {
+	    Tcl_ConditionWait(&pool.workCond, &poolMutex, NULL);
+	}
+
+	if (pool.bShutdown || (pool.nThreads > pool.maxThreads))
+	    break;
+
+	jobPtr = pool.headPtr;
+	pool.headPtr = jobPtr->nextPtr;
+
+	if (pool.headPtr == NULL)
+	    pool.tailPtr = NULL;
+
+	pool.nQueued--;
+	pool.nBusy++;
+	Tcl_MutexUnlock(&poolMutex);
+
+	jobPtr->workProc(jobPtr->clientData);
+
+	Tcl_MutexLock(&poolMutex);
+	pool.nBusy--;
+	pool.completed++;
+	Tcl_MutexUnlock(&poolMutex);
+
+	eventPtr = (SassPoolEvent *)ckalloc(sizeof(SassPoolEvent));
+	memset(eventPtr, 0, sizeof(SassPoolEvent));
+	eventPtr->header.proc = PoolEventProc;
+	eventPtr->jobPtr = jobPtr;
+
+	Tcl_ThreadQueueEvent(jobPtr->threadId, (Tcl_Event *)eventPtr,
+	    TCL_QUEUE_TAIL);
+
+	Tcl_ThreadAlert(jobPtr->threadId);
+	Tcl_MutexLock(&poolMutex);
+    }
+
+    pool.nThreads--;
+    Tcl_ConditionNotify(&pool.exitCond);
+    Tcl_MutexUnlock(&poolMutex);
+
+    /*
+     * NOTE: Returning would skip the thread exit handlers, e.g. the one
+     *       that frees the trace ring buffer of this thread.
+     */
+
+    Tcl_ExitThread(0);
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PoolEventProc --
+ *
+ *	This function is called by the event loop of the submitting thread
+ *	in order to complete a job that was performed by a worker thread.
+ *
+ * Results:
+ *	Non-zero if the event was handled.
+ *
+ * Side effects:
+ *	Whatever the completion procedure does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int PoolEventProc(
+    Tcl_Event *evPtr,			/* The event to handle. */
+    int flags)				/* Event loop flags. */
+{
+    SassPoolJob *jobPtr;
+
+    if (!(flags & TCL_FILE_EVENTS))
+	return 0;
+
+    jobPtr = ((SassPoolEvent *)evPtr)->jobPtr;
+    jobPtr->doneProc(jobPtr->clientData);
+    ckfree((char *)jobPtr);
+
+    Tcl_MutexLock(&poolMutex);
+    pool.nPending--;
+    Tcl_MutexUnlock(&poolMutex);
+
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DiscardJob --
+ *
+ *	This function discards a job that will never be completed, when
+ *	the pool is being shut down.  The discard procedure is only called
+ *	if the job was submitted by the current thread, since it may need
+ *	to use objects owned by that thread; otherwise, only the job itself
+ *	is freed.  The caller must hold the pool mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the discard procedure does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void DiscardJob(
+    SassPoolJob *jobPtr)		/* IN: The job to discard. */
+{
+    if ((jobPtr->discardProc != NULL) &&
+	    (jobPtr->threadId == Tcl_GetCurrentThread())) {
+	jobPtr->discardProc(jobPtr->clientData);
+    }
+
+    ckfree((char *)jobPtr);
+    pool.nPending--;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DiscardEventProc --
+ *
+ *	This function is called by Tcl_DeleteEvents for each event queued
+ *	to the current thread, when the pool is being shut down.  The jobs
+ *	of the events used to complete them are moved to the specified
+ *	list, so that they can be discarded after the events are deleted.
+ *
+ * Results:
+ *	Non-zero if the event should be deleted.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int DiscardEventProc(
+    Tcl_Event *evPtr,			/* The event to check. */
+    ClientData clientData)		/* IN/OUT: The list of jobs. */
+{
+    SassPoolJob **headPtrPtr = (SassPoolJob **)clientData;
+    SassPoolJob *jobPtr;
+
+    if (evPtr->proc != PoolEventProc)
+	return 0;
+
+    jobPtr = ((SassPoolEvent *)evPtr)->jobPtr;
+    jobPtr->nextPtr = *headPtrPtr;
+    *headPtrPtr = jobPtr;
+
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassPoolSubmit --
+ *
+ *	This function queues a job to be performed by the pool.  The work
+ *	procedure will be called by a worker thread.  Then, the completion
+ *	procedure will be called by the current thread, from its event
+ *	loop.  If the pool is shut down first, the discard procedure, if
+ *	any, is called instead, by the current thread, so that the job can
+ *	free its resources.  The worker threads are started when needed.
+ *
+ * Results:
+ *	A standard Tcl result.  If an error is returned, the job was not
+ *	queued and neither procedure will be called.
+ *
+ * Side effects:
+ *	Threads may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassPoolSubmit(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    SassPoolProc *workProc,		/* IN: Called by a worker thread. */
+    SassPoolProc *doneProc,		/* IN: Called by current thread. */
+    SassPoolProc *discardProc,		/* IN: Called on shutdown, or NULL. */
+    ClientData clientData)		/* IN: Passed to all procedures. */
+{
+    SassPoolJob *jobPtr;
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassPoolSubmit: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+#ifndef TCL_THREADS
+    Tcl_AppendResult(interp, "worker threads require a threaded Tcl\n", NULL);
+    return TCL_ERROR;
+#endif
+
+    jobPtr = (SassPoolJob *)attemptckalloc(sizeof(SassPoolJob));
+
+    if (jobPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: jobPtr\n", NULL);
+	return TCL_ERROR;
+    }
+
+    memset(jobPtr, 0, sizeof(SassPoolJob));
+    jobPtr->workProc = workProc;
+    jobPtr->doneProc = doneProc;
+    jobPtr->discardProc = discardProc;
+    jobPtr->clientData = clientData;
+    jobPtr->threadId = Tcl_GetCurrentThread();
+
+    Tcl_MutexLock(&poolMutex);
+
+    if (pool.bShutdown || (StartThreads() != 0)) {
+	Tcl_MutexUnlock(&poolMutex);
+	ckfree((char *)jobPtr);
+	Tcl_AppendResult(interp, "cannot start worker threads\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (pool.tailPtr != NULL) {
+	pool.tailPtr->nextPtr = jobPtr;
+    } else {
+	pool.headPtr = jobPtr;
+    }
+
+    pool.tailPtr = jobPtr;
+    pool.nQueued++;
+    pool.nPending++;
+    pool.submitted++;
+
+    Tcl_ConditionNotify(&pool.workCond);
+    Tcl_MutexUnlock(&poolMutex);
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RunBatch --
+ *
+ *	This function calls the work procedure for the next unclaimed item
+ *	of a batch until there are none left.  It is called by each thread
+ *	running a batch of items via SassPoolRunAll, including the thread
+ *	calling that function.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the work procedure does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void RunBatch(
+    SassPoolBatch *batchPtr)		/* IN: The batch to run. */
+{
+    while (1) {
+	int item;
+
+	Tcl_MutexLock(&batchPtr->mutex);
+	item = batchPtr->nextItem;
+
+	if (item < batchPtr->nItems)
+	    batchPtr->nextItem++;
+
+	Tcl_MutexUnlock(&batchPtr->mutex);
+
+	if (item >= batchPtr->nItems)
+	    break;
+
+	batchPtr->workProc(batchPtr->aClientData[item]);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BatchThreadProc --
+ *
+ *	This function is the entry point for each thread created to run a
+ *	batch of items via SassPoolRunAll.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the work procedure does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_ThreadCreateType BatchThreadProc(
+    ClientData clientData)		/* IN: The batch to run. */
+{
+    RunBatch((SassPoolBatch *)clientData);
+
+    /*
+     * NOTE: See PoolThreadProc about why the thread exits this way.
+     */
+
+    Tcl_ExitThread(0);
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassPoolRunAll --
+ *
+ *	This function calls the work procedure for each of the specified
+ *	items, concurrently, and waits for all of them to be done.  Unlike
+ *	SassPoolSubmit, it does not use the worker threads of the pool;
+ *	instead, it creates up to the specified number of threads for the
+ *	batch, one of which is the current thread.  If the number of
+ *	threads is zero, the configured pool size is used.  If threads
+ *	cannot be created, e.g. because Tcl was not built with threads
+ *	enabled, the items are processed by the current thread.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Threads may be created.  They have all exited upon return.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassPoolRunAll(
+    int nThreads,			/* IN: Maximum number of threads. */
+    SassPoolProc *workProc,		/* IN: Called for each item. */
+    ClientData *aClientData,		/* IN: The items. */
+    int nItems)				/* IN: Number of items. */
+{
+    SassPoolBatch batch;
+    Tcl_ThreadId *aThreadIds = NULL;
+    int nCreated = 0;
+    int index;
+
+    if (nItems <= 0)
+	return;
+
+    if (nThreads <= 0) {
+	Tcl_MutexLock(&poolMutex);
+
+	nThreads = (pool.maxThreads > 0) ?
+	    pool.maxThreads : GetDefaultThreads();
+
+	Tcl_MutexUnlock(&poolMutex);
+    }
+
+    if (nThreads > nItems)
+	nThreads = nItems;
+
+    memset(&batch, 0, sizeof(SassPoolBatch));
+    batch.workProc = workProc;
+    batch.aClientData = aClientData;
+    batch.nItems = nItems;
+
+#ifdef TCL_THREADS
+    if (nThreads > 1) {
+	aThreadIds = (Tcl_ThreadId *)attemptckalloc(
+	    sizeof(Tcl_ThreadId) * (nThreads - 1));
+    }
+
+    if (aThreadIds != NULL) {
+	for (index = 0; index < nThreads - 1; index++) {
+	    if (Tcl_CreateThread(&aThreadIds[nCreated], BatchThreadProc,
+		    &batch, TCL_THREAD_STACK_DEFAULT,
+		    TCL_THREAD_JOINABLE) != TCL_OK) {
+		break;
+	    }
+
+	    nCreated++;
+	}
+    }
+#endif
+
+    RunBatch(&batch);
+
+    for (index = 0; index < nCreated; index++) {
+	int result;
+
+	Tcl_JoinThread(aThreadIds[index], &result);
+    }
+
+    if (aThreadIds != NULL)
+	ckfree((char *)aThreadIds);
+
+    Tcl_MutexFinalize(&batch.mutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassPoolObjCmd --
+ *
+ *	Handles the [sass pool] sub-command.  The sub-commands supported
+ *	are "configure" and "stats".
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Worker threads may be created or asked to exit.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassPoolObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int option;
+
+    static const char *cmdOptions[] = {
+	"configure", "stats", (char *) NULL
+    };
+
+    enum options {
+	OPT_CONFIGURE, OPT_STATS
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassPoolObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_CONFIGURE: {
+	    int nThreads;
+
+	    if (objc == 3) {
+		Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+
+		Tcl_MutexLock(&poolMutex);
+
+		nThreads = (pool.maxThreads > 0) ?
+		    pool.maxThreads : GetDefaultThreads();
+
+		Tcl_MutexUnlock(&poolMutex);
+
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewStringObj("-threads", -1));
+
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewIntObj(nThreads));
+
+		Tcl_SetObjResult(interp, listPtr);
+		return TCL_OK;
+	    }
+
+	    if ((objc != 5) || (strcmp(Tcl_GetString(objv[3]),
+		    "-threads") != 0)) {
+		Tcl_WrongNumArgs(interp, 3, objv, "?-threads count?");
+		return TCL_ERROR;
+	    }
+
+	    if (Tcl_GetIntFromObj(interp, objv[4], &nThreads) != TCL_OK)
+		return TCL_ERROR;
+
+	    if ((nThreads < 1) || (nThreads > SASS_POOL_MAX_THREADS)) {
+		Tcl_AppendResult(interp, "thread count out of range\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    /*
+	     * NOTE: Extra threads are only started when work is submitted.
+	     *       Surplus threads exit once they finish their current job.
+	     */
+
+	    Tcl_MutexLock(&poolMutex);
+	    pool.maxThreads = nThreads;
+
+	    if (pool.nThreads > pool.maxThreads)
+		Tcl_ConditionNotify(&pool.workCond);
+
+	    Tcl_MutexUnlock(&poolMutex);
+
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	case OPT_STATS: {
+	    SassPool stats;
+	    Tcl_Obj *listPtr;
+
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    Tcl_MutexLock(&poolMutex);
+	    memcpy(&stats, &pool, sizeof(SassPool));
+	    Tcl_MutexUnlock(&poolMutex);
+
+	    listPtr = Tcl_NewListObj(0, NULL);
+
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("threads", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewIntObj(stats.nThreads));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("busy", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewIntObj(stats.nBusy));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("queued", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewIntObj(stats.nQueued));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("submitted", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.submitted));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("completed", -1));
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewWideIntObj(stats.completed));
+
+	    Tcl_SetObjResult(interp, listPtr);
+	    return TCL_OK;
+	}
+	default: {
+	    Tcl_AppendResult(interp, "bad option index\n", NULL);
+	    return TCL_ERROR;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassPoolPending --
+ *
+ *	This function returns the number of jobs submitted to the pool
+ *	whose completion procedures have not been called yet, i.e. they
+ *	are queued, being performed, or waiting for their events to be
+ *	handled.
+ *
+ * Results:
+ *	The number of pending jobs.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassPoolPending(void)
+{
+    int nPending;
+
+    Tcl_MutexLock(&poolMutex);
+    nPending = pool.nPending;
+    Tcl_MutexUnlock(&poolMutex);
+
+    return nPending;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassPoolFinalize --
+ *
+ *	This function asks all the worker threads to exit and waits for
+ *	them to do so.  Jobs that are still queued, and performed jobs
+ *	whose events have not been handled by the current thread yet, are
+ *	discarded; see DiscardJob.  It is called when the package is being
+ *	unloaded from the process.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassPoolFinalize(void)
+{
+    SassPoolJob *doneJobs = NULL;
+
+    Tcl_MutexLock(&poolMutex);
+    pool.bShutdown = 1;
+    Tcl_ConditionNotify(&pool.workCond);
+
+    while (pool.nThreads > 0) {
+	Tcl_ConditionNotify(&pool.workCond);
+	Tcl_ConditionWait(&pool.exitCond, &poolMutex, NULL);
+    }
+
+    while (pool.headPtr != NULL) {
+	SassPoolJob *jobPtr = pool.headPtr;
+
+	pool.headPtr = jobPtr->nextPtr;
+	DiscardJob(jobPtr);
+    }
+
+    pool.tailPtr = NULL;
+    pool.nQueued = 0;
+    Tcl_MutexUnlock(&poolMutex);
+
+    /*
+     * NOTE: The events queued to complete performed jobs would call into
+     *       this library, which may be unloaded; therefore, delete them.
+     *       Only the events queued to the current thread can be deleted.
+     */
+
+    Tcl_DeleteEvents(DiscardEventProc, (ClientData)&doneJobs);
+
+    Tcl_MutexLock(&poolMutex);
+
+    while (doneJobs != NULL) {
+	SassPoolJob *jobPtr = doneJobs;
+
+	doneJobs = jobPtr->nextPtr;
+	DiscardJob(jobPtr);
+    }
+
+    pool.bShutdown = 0;
+    Tcl_MutexUnlock(&poolMutex);
+
+    Tcl_ConditionFinalize(&pool.workCond);
+    Tcl_ConditionFinalize(&pool.exitCond);
+    Tcl_MutexFinalize(&poolMutex);
+}
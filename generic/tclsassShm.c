@@ -0,0 +1,798 @@
+/*
+ * tclsassShm.c -- Tcl Package for libsass
+ *
+ * Implements the shared memory table used by the compile cache in order to
+ * share results between multiple processes on the same host, e.g. the child
+ * processes of a prefork web server.  The table is stored in a file that is
+ * mapped into every process, e.g. one within "/dev/shm".  It contains opaque
+ * records, each identified by a 64-bit hash; the compile cache is responsible
+ * for verifying that a record actually matches the key it is looking for.
+ *
+ * Readers do not acquire any locks.  Each slot is protected by a sequence
+ * number, which is odd while the slot is being changed.  A reader copies a
+ * record and then checks that the sequence number did not change while it
+ * was doing so.  Writers are serialized by a process-local mutex and by an
+ * advisory file lock, which is released automatically if a process dies.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdlib.h>		/* NOTE: For size_t. */
+#include <string.h>		/* NOTE: For memcmp(), memcpy(), memset(). */
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: The shared memory table uses POSIX file locking and memory mapping
+ *       functions, as well as the GCC atomic built-in functions (which are
+ *       also supported by Clang).
+ */
+
+#if (defined(_WIN32) || !defined(__GNUC__)) && !defined(SASS_NO_SHARED_CACHE)
+  #define SASS_NO_SHARED_CACHE
+#endif
+
+#ifndef SASS_NO_SHARED_CACHE
+#include <errno.h>		/* NOTE: For errno, EINTR. */
+#include <fcntl.h>		/* NOTE: For open(), fcntl(). */
+#include <sched.h>		/* NOTE: For sched_yield(). */
+#include <unistd.h>		/* NOTE: For close(), ftruncate(). */
+#include <sys/mman.h>		/* NOTE: For mmap(), munmap(). */
+#include <sys/stat.h>		/* NOTE: For fstat(). */
+
+/*
+ * NOTE: These are the magic bytes at the start of every shared memory file.
+ *       The last byte is the version of the layout.  It must be bumped when
+ *       the layout of the SassShmHeader or SassShmSlot structures changes.
+ */
+
+#define SASS_SHM_MAGIC				"TclShm\000\001"
+#define SASS_SHM_MAGIC_SIZE			(8)
+
+/*
+ * NOTE: This is the number of bytes of record data per slot.  The number of
+ *       slots is derived from the size of the table using this value.
+ */
+
+#ifndef SASS_SHM_BYTES_PER_SLOT
+  #define SASS_SHM_BYTES_PER_SLOT		(8192)
+#endif
+
+/*
+ * NOTE: This is the maximum number of times a reader will retry reading a
+ *       slot that is being changed by a writer, before giving up.
+ */
+
+#ifndef SASS_SHM_MAX_RETRIES
+  #define SASS_SHM_MAX_RETRIES			(8)
+#endif
+
+/*
+ * NOTE: This macro rounds the specified size up to a multiple of eight.
+ */
+
+#define ROUND8(x)				(((x) + 7) & ~((Tcl_WideUInt)7))
+
+/*
+ * NOTE: This is the header at the start of the shared memory file.  It is
+ *       followed by the array of slots and then by the record data, which
+ *       is used as a circular buffer.  The statistics are updated using the
+ *       atomic built-in functions.
+ */
+
+typedef struct SassShmHeader {
+    char magic[SASS_SHM_MAGIC_SIZE];	/* See SASS_SHM_MAGIC. */
+    Tcl_WideUInt totalSize;		/* Size of the file, in bytes. */
+    Tcl_WideUInt nSlots;		/* Number of slots. */
+    Tcl_WideUInt dataOffset;		/* Offset of the record data. */
+    Tcl_WideUInt dataSize;		/* Size of the record data. */
+    Tcl_WideUInt head;			/* Next write offset, writers only. */
+    Tcl_WideUInt hits;			/* Lookups that found a record. */
+    Tcl_WideUInt misses;		/* Lookups that did not. */
+    Tcl_WideUInt stores;		/* Records added to the table. */
+} SassShmHeader;
+
+/*
+ * NOTE: This is one slot within the shared memory table.  The slot for a
+ *       given hash is the hash modulo the number of slots; storing a new
+ *       record replaces the one in its slot.
+ */
+
+typedef struct SassShmSlot {
+    unsigned int seq;			/* Sequence number, odd if changing. */
+    unsigned int reserved;		/* Padding, must be zero. */
+    Tcl_WideUInt hash;			/* Hash of the record key. */
+    Tcl_WideUInt offset;		/* Offset of the record data. */
+    Tcl_WideUInt length;		/* Length of record, zero if empty. */
+} SassShmSlot;
+
+/*
+ * NOTE: This is one mapping of a shared memory file into this process.  The
+ *       mappings are never unmapped while the package is loaded, because a
+ *       reader in another thread may still be using one; instead, replaced
+ *       mappings are kept on a list until the package is unloaded.
+ */
+
+typedef struct SassShmMap {
+    char *zPath;			/* Name of the shared memory file. */
+    int fd;				/* Open file, for advisory locking. */
+    size_t mapSize;			/* Size of the mapping. */
+    SassShmHeader *headerPtr;		/* Start of the mapping. */
+    SassShmSlot *aSlots;		/* Array of slots. */
+    char *pData;			/* Start of the record data. */
+    struct SassShmMap *nextPtr;		/* Next replaced mapping. */
+} SassShmMap;
+
+/*
+ * NOTE: This is the mapping currently in use, if any, and the list of the
+ *       replaced mappings.  They are protected by shmMutex, which is also
+ *       used to serialize writers within this process.
+ */
+
+static SassShmMap *currentMapPtr = NULL;
+static SassShmMap *oldMapsPtr = NULL;
+
+TCL_DECLARE_MUTEX(shmMutex)
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static int		LockFile(int fd, int type);
+static SassShmMap *	GetCurrentMap(void);
+static void		UnmapAll(SassShmMap *mapPtr);
+static void		InvalidateSlot(SassShmSlot *slotPtr);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LockFile --
+ *
+ *	This function acquires or releases an advisory lock on the first
+ *	byte of the specified file, waiting if necessary.
+ *
+ * Results:
+ *	Zero on success, non-zero on failure.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int LockFile(
+    int fd,				/* IN: The file to lock. */
+    int type)				/* IN: F_WRLCK -OR- F_UNLCK. */
+{
+    struct flock lock;
+
+    memset(&lock, 0, sizeof(struct flock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = 0;
+    lock.l_len = 1;
+
+    while (fcntl(fd, F_SETLKW, &lock) != 0) {
+	if (errno != EINTR)
+	    return -1;
+    }
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetCurrentMap --
+ *
+ *	This function returns the mapping currently in use, if any.  The
+ *	returned mapping remains valid until the package is unloaded.
+ *
+ * Results:
+ *	The mapping -OR- NULL if the shared memory table is disabled.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassShmMap *GetCurrentMap(void)
+{
+    SassShmMap *mapPtr;
+
+    Tcl_MutexLock(&shmMutex);
+    mapPtr = currentMapPtr;
+    Tcl_MutexUnlock(&shmMutex);
+
+    return mapPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UnmapAll --
+ *
+ *	This function unmaps and frees the specified mapping and all the
+ *	mappings that follow it on its list.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void UnmapAll(
+    SassShmMap *mapPtr)			/* IN: The first mapping to free. */
+{
+    while (mapPtr != NULL) {
+	SassShmMap *nextPtr = mapPtr->nextPtr;
+
+	munmap((void *)mapPtr->headerPtr, mapPtr->mapSize);
+	close(mapPtr->fd);
+	ckfree(mapPtr->zPath);
+	ckfree((char *)mapPtr);
+
+	mapPtr = nextPtr;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InvalidateSlot --
+ *
+ *	This function empties the specified slot, so that readers will no
+ *	longer use the record data it refers to.  The caller must hold the
+ *	writer locks.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void InvalidateSlot(
+    SassShmSlot *slotPtr)		/* IN: The slot to empty. */
+{
+    unsigned int seq = slotPtr->seq;
+
+    __atomic_store_n(&slotPtr->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slotPtr->length, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slotPtr->seq, seq + 2, __ATOMIC_RELEASE);
+}
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassShmOpen --
+ *
+ *	This function maps the specified shared memory file, creating and
+ *	initializing it with the specified size first if it is empty, and
+ *	then uses it for all subsequent lookups and stores.  If the file
+ *	has already been initialized, its existing size is used.  If the
+ *	file name is an empty string, the shared memory table is disabled.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The file may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassShmOpen(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    const char *zPath,			/* IN: The file name, or "". */
+    Tcl_WideInt nBytes)			/* IN: Size for a new file. */
+{
+#ifndef SASS_NO_SHARED_CACHE
+    SassShmMap *mapPtr;
+    struct stat statBuf;
+    SassShmHeader *headerPtr = MAP_FAILED;
+    size_t mapSize = 0;
+    int fd;
+    int bLocked = 0;
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassShmOpen: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if ((zPath == NULL) || (zPath[0] == '\0')) {
+	Tcl_MutexLock(&shmMutex);
+
+	if (currentMapPtr != NULL) {
+	    currentMapPtr->nextPtr = oldMapsPtr;
+	    oldMapsPtr = currentMapPtr;
+	    currentMapPtr = NULL;
+	}
+
+	Tcl_MutexUnlock(&shmMutex);
+	return TCL_OK;
+    }
+
+    fd = open(zPath, O_RDWR | O_CREAT, 0600);
+
+    if (fd < 0) {
+	Tcl_AppendResult(interp, "cannot open shared cache file\n", NULL);
+	return TCL_ERROR;
+    }
+
+    /*
+     * NOTE: Hold the writer lock while checking the size of the file, so
+     *       that only one process will initialize it.
+     */
+
+    if (LockFile(fd, F_WRLCK) != 0) {
+	Tcl_AppendResult(interp, "cannot lock shared cache file\n", NULL);
+	goto error;
+    }
+
+    bLocked = 1;
+
+    if (fstat(fd, &statBuf) != 0) {
+	Tcl_AppendResult(interp, "cannot query shared cache file\n", NULL);
+	goto error;
+    }
+
+    if (statBuf.st_size == 0) {
+	Tcl_WideUInt nSlots;
+
+	if (nBytes < SASS_SHM_BYTES_PER_SLOT * 8) {
+	    Tcl_AppendResult(interp, "shared cache size is too small\n", NULL);
+	    goto error;
+	}
+
+	if (ftruncate(fd, (off_t)nBytes) != 0) {
+	    Tcl_AppendResult(interp, "cannot resize shared cache file\n",
+		NULL);
+
+	    goto error;
+	}
+
+	mapSize = (size_t)nBytes;
+	headerPtr = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+
+	if (headerPtr == MAP_FAILED) {
+	    Tcl_AppendResult(interp, "cannot map shared cache file\n", NULL);
+	    goto error;
+	}
+
+	/*
+	 * NOTE: The new file is already filled with zeros.  The magic bytes
+	 *       are written last, after the rest of the header.
+	 */
+
+	nSlots = (Tcl_WideUInt)nBytes / SASS_SHM_BYTES_PER_SLOT;
+
+	headerPtr->totalSize = (Tcl_WideUInt)nBytes;
+	headerPtr->nSlots = nSlots;
+	headerPtr->dataOffset = ROUND8(sizeof(SassShmHeader) +
+	    nSlots * sizeof(SassShmSlot));
+	headerPtr->dataSize = headerPtr->totalSize - headerPtr->dataOffset;
+
+	memcpy(headerPtr->magic, SASS_SHM_MAGIC, SASS_SHM_MAGIC_SIZE);
+    } else {
+	mapSize = (size_t)statBuf.st_size;
+
+	if (mapSize < sizeof(SassShmHeader)) {
+	    Tcl_AppendResult(interp, "bad shared cache file\n", NULL);
+	    goto error;
+	}
+
+	headerPtr = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+
+	if (headerPtr == MAP_FAILED) {
+	    Tcl_AppendResult(interp, "cannot map shared cache file\n", NULL);
+	    goto error;
+	}
+
+	if ((memcmp(headerPtr->magic, SASS_SHM_MAGIC,
+		SASS_SHM_MAGIC_SIZE) != 0) ||
+		(headerPtr->totalSize != (Tcl_WideUInt)mapSize) ||
+		(headerPtr->nSlots == 0) ||
+		(headerPtr->dataOffset < sizeof(SassShmHeader) +
+		    headerPtr->nSlots * sizeof(SassShmSlot)) ||
+		(headerPtr->dataOffset + headerPtr->dataSize !=
+		    headerPtr->totalSize)) {
+	    Tcl_AppendResult(interp, "bad shared cache file\n", NULL);
+	    goto error;
+	}
+    }
+
+    LockFile(fd, F_UNLCK);
+    bLocked = 0;
+
+    mapPtr = (SassShmMap *)ckalloc(sizeof(SassShmMap));
+    memset(mapPtr, 0, sizeof(SassShmMap));
+
+    mapPtr->zPath = ckalloc(strlen(zPath) + 1);
+    strcpy(mapPtr->zPath, zPath);
+    mapPtr->fd = fd;
+    mapPtr->mapSize = mapSize;
+    mapPtr->headerPtr = headerPtr;
+    mapPtr->aSlots = (SassShmSlot *)(headerPtr + 1);
+    mapPtr->pData = (char *)headerPtr + headerPtr->dataOffset;
+
+    Tcl_MutexLock(&shmMutex);
+
+    if (currentMapPtr != NULL) {
+	currentMapPtr->nextPtr = oldMapsPtr;
+	oldMapsPtr = currentMapPtr;
+    }
+
+    currentMapPtr = mapPtr;
+    Tcl_MutexUnlock(&shmMutex);
+
+    return TCL_OK;
+
+error:
+    if (headerPtr != MAP_FAILED)
+	munmap((void *)headerPtr, mapSize);
+
+    if (bLocked)
+	LockFile(fd, F_UNLCK);
+
+    close(fd);
+    return TCL_ERROR;
+#else
+    if ((zPath == NULL) || (zPath[0] == '\0'))
+	return TCL_OK;
+
+    if (interp != NULL) {
+	Tcl_AppendResult(interp, "shared cache is not supported\n", NULL);
+    }
+
+    return TCL_ERROR;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassShmGetConfig --
+ *
+ *	This function returns the name and size of the shared memory file
+ *	currently in use.
+ *
+ * Results:
+ *	A copy of the file name -OR- NULL if the shared memory table is
+ *	disabled.  A non-NULL result must be freed by the caller via
+ *	ckfree.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *SassShmGetConfig(
+    Tcl_WideInt *nBytesPtr)		/* OUT: Size of the file. */
+{
+    char *zPath = NULL;
+
+#ifndef SASS_NO_SHARED_CACHE
+    SassShmMap *mapPtr = GetCurrentMap();
+
+    if (mapPtr != NULL) {
+	zPath = ckalloc(strlen(mapPtr->zPath) + 1);
+	strcpy(zPath, mapPtr->zPath);
+
+	if (nBytesPtr != NULL)
+	    *nBytesPtr = (Tcl_WideInt)mapPtr->mapSize;
+    }
+#endif
+
+    return zPath;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassShmFind --
+ *
+ *	This function attempts to find the record with the specified hash
+ *	in the shared memory table.  No locks are acquired.  The record is
+ *	copied and the copy is returned only if the slot did not change
+ *	while it was being copied.
+ *
+ * Results:
+ *	Non-zero if the record was found.  In that case, the copy must be
+ *	freed by the caller via ckfree.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassShmFind(
+    Tcl_WideUInt hash,			/* IN: Hash of the record key. */
+    char **ppData,			/* OUT: Copy of the record. */
+    size_t *pnBytes)			/* OUT: Length of the record. */
+{
+#ifndef SASS_NO_SHARED_CACHE
+    SassShmMap *mapPtr = GetCurrentMap();
+    SassShmHeader *headerPtr;
+    SassShmSlot *slotPtr;
+    int attempt;
+
+    if ((mapPtr == NULL) || (ppData == NULL) || (pnBytes == NULL))
+	return 0;
+
+    headerPtr = mapPtr->headerPtr;
+    slotPtr = &mapPtr->aSlots[hash % headerPtr->nSlots];
+
+    for (attempt = 0; attempt < SASS_SHM_MAX_RETRIES; attempt++) {
+	unsigned int seq1;
+	Tcl_WideUInt slotHash;
+	Tcl_WideUInt offset;
+	Tcl_WideUInt length;
+	char *pData;
+
+	seq1 = __atomic_load_n(&slotPtr->seq, __ATOMIC_ACQUIRE);
+
+	if (seq1 & 1) {
+	    sched_yield();
+	    continue;
+	}
+
+	slotHash = __atomic_load_n(&slotPtr->hash, __ATOMIC_RELAXED);
+	offset = __atomic_load_n(&slotPtr->offset, __ATOMIC_RELAXED);
+	length = __atomic_load_n(&slotPtr->length, __ATOMIC_RELAXED);
+
+	if ((length == 0) || (slotHash != hash) ||
+		(offset > headerPtr->dataSize) ||
+		(length > headerPtr->dataSize - offset)) {
+	    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	    if (__atomic_load_n(&slotPtr->seq, __ATOMIC_RELAXED) == seq1)
+		return 0;
+
+	    continue;
+	}
+
+	pData = attemptckalloc((size_t)length);
+
+	if (pData == NULL)
+	    return 0;
+
+	memcpy(pData, mapPtr->pData + offset, (size_t)length);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if (__atomic_load_n(&slotPtr->seq, __ATOMIC_RELAXED) == seq1) {
+	    *ppData = pData;
+	    *pnBytes = (size_t)length;
+	    return 1;
+	}
+
+	ckfree(pData);
+    }
+#endif
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassShmStore --
+ *
+ *	This function adds a copy of the specified record to the shared
+ *	memory table, replacing the record in its slot, if any.  Space is
+ *	allocated from the record data circularly; therefore, the oldest
+ *	records are overwritten first.  Slots that refer to overwritten
+ *	record data are emptied before it is overwritten.
+ *
+ * Results:
+ *	Zero on success, non-zero on failure.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassShmStore(
+    Tcl_WideUInt hash,			/* IN: Hash of the record key. */
+    const char *pData,			/* IN: The record to copy. */
+    size_t nBytes)			/* IN: Length of the record. */
+{
+#ifndef SASS_NO_SHARED_CACHE
+    SassShmMap *mapPtr;
+    SassShmHeader *headerPtr;
+    SassShmSlot *slotPtr;
+    Tcl_WideUInt start;
+    Tcl_WideUInt end;
+    Tcl_WideUInt index;
+    unsigned int seq;
+
+    if ((pData == NULL) || (nBytes == 0))
+	return -1;
+
+    Tcl_MutexLock(&shmMutex);
+    mapPtr = currentMapPtr;
+
+    if (mapPtr == NULL) {
+	Tcl_MutexUnlock(&shmMutex);
+	return -1;
+    }
+
+    headerPtr = mapPtr->headerPtr;
+
+    if (nBytes > headerPtr->dataSize) {
+	Tcl_MutexUnlock(&shmMutex);
+	return -1;
+    }
+
+    if (LockFile(mapPtr->fd, F_WRLCK) != 0) {
+	Tcl_MutexUnlock(&shmMutex);
+	return -1;
+    }
+
+    start = headerPtr->head;
+
+    if ((start > headerPtr->dataSize) ||
+	    (nBytes > headerPtr->dataSize - start)) {
+	start = 0;
+    }
+
+    end = start + nBytes;
+
+    for (index = 0; index < headerPtr->nSlots; index++) {
+	SassShmSlot *otherPtr = &mapPtr->aSlots[index];
+
+	if ((otherPtr->length > 0) && (otherPtr->offset < end) &&
+		(otherPtr->offset + otherPtr->length > start)) {
+	    InvalidateSlot(otherPtr);
+	}
+    }
+
+    slotPtr = &mapPtr->aSlots[hash % headerPtr->nSlots];
+    seq = slotPtr->seq;
+
+    __atomic_store_n(&slotPtr->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(mapPtr->pData + start, pData, nBytes);
+
+    __atomic_store_n(&slotPtr->hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&slotPtr->offset, start, __ATOMIC_RELAXED);
+    __atomic_store_n(&slotPtr->length, (Tcl_WideUInt)nBytes,
+	__ATOMIC_RELAXED);
+    __atomic_store_n(&slotPtr->seq, seq + 2, __ATOMIC_RELEASE);
+
+    headerPtr->head = ROUND8(end);
+    __atomic_fetch_add(&headerPtr->stores, 1, __ATOMIC_RELAXED);
+
+    LockFile(mapPtr->fd, F_UNLCK);
+    Tcl_MutexUnlock(&shmMutex);
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassShmCount --
+ *
+ *	This function updates the shared hit or miss count.  It is used
+ *	by the compile cache after it has verified a record.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassShmCount(
+    int bHit)				/* IN: Non-zero for a hit. */
+{
+#ifndef SASS_NO_SHARED_CACHE
+    SassShmMap *mapPtr = GetCurrentMap();
+
+    if (mapPtr == NULL)
+	return;
+
+    if (bHit) {
+	__atomic_fetch_add(&mapPtr->headerPtr->hits, 1, __ATOMIC_RELAXED);
+    } else {
+	__atomic_fetch_add(&mapPtr->headerPtr->misses, 1, __ATOMIC_RELAXED);
+    }
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassShmGetStats --
+ *
+ *	This function returns the statistics for the shared memory table,
+ *	which are shared by all the processes using it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassShmGetStats(
+    Tcl_WideInt *hitsPtr,		/* OUT: Lookups that found a record. */
+    Tcl_WideInt *missesPtr,		/* OUT: Lookups that did not. */
+    Tcl_WideInt *storesPtr)		/* OUT: Records added. */
+{
+    *hitsPtr = 0;
+    *missesPtr = 0;
+    *storesPtr = 0;
+
+#ifndef SASS_NO_SHARED_CACHE
+    {
+	SassShmMap *mapPtr = GetCurrentMap();
+
+	if (mapPtr != NULL) {
+	    SassShmHeader *headerPtr = mapPtr->headerPtr;
+
+	    *hitsPtr = (Tcl_WideInt)__atomic_load_n(&headerPtr->hits,
+		__ATOMIC_RELAXED);
+	    *missesPtr = (Tcl_WideInt)__atomic_load_n(&headerPtr->misses,
+		__ATOMIC_RELAXED);
+	    *storesPtr = (Tcl_WideInt)__atomic_load_n(&headerPtr->stores,
+		__ATOMIC_RELAXED);
+	}
+    }
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassShmFinalize --
+ *
+ *	This function unmaps all the shared memory files.  It is called
+ *	when the package is being unloaded from the process.  The files
+ *	themselves are not removed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassShmFinalize(void)
+{
+#ifndef SASS_NO_SHARED_CACHE
+    Tcl_MutexLock(&shmMutex);
+    UnmapAll(currentMapPtr);
+    currentMapPtr = NULL;
+    UnmapAll(oldMapsPtr);
+    oldMapsPtr = NULL;
+    Tcl_MutexUnlock(&shmMutex);
+    Tcl_MutexFinalize(&shmMutex);
+#endif
+}
@@ -0,0 +1,720 @@
+/*
+ * tclsassStats.c -- Tcl Package for libsass
+ *
+ * Implements the runtime metrics reported by [sass stats].  They are kept for
+ * the whole process, since compilations may run on any thread.  Counters are
+ * updated via relaxed atomic operations, so that they are cheap enough to be
+ * always enabled; a snapshot is therefore not guaranteed to be consistent
+ * across counters.  The latency of each phase of a compilation is recorded
+ * into a histogram with buckets whose upper bounds are powers of two, in
+ * microseconds, from which the p50 and p99 latencies may be estimated.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdio.h>		/* NOTE: For snprintf(). */
+#include <string.h>		/* NOTE: For strcmp(). */
+#if !defined(_WIN32)
+#include <time.h>		/* NOTE: For clock_gettime(). */
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>		/* NOTE: For mallinfo2(). */
+#endif
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: The GCC atomic built-in functions (which are also supported by Clang)
+ *       are used when available; otherwise, a mutex protects the counters.
+ */
+
+#if defined(__GNUC__)
+  #define STATS_ADD(p, n)		__atomic_fetch_add((p), (n), \
+					    __ATOMIC_RELAXED)
+  #define STATS_LOAD(p)			__atomic_load_n((p), __ATOMIC_RELAXED)
+  #define STATS_EXCHANGE(p)		__atomic_exchange_n((p), 0, \
+					    __ATOMIC_RELAXED)
+#else
+  TCL_DECLARE_MUTEX(statsMutex)
+
+  #define STATS_ADD(p, n)		do { Tcl_MutexLock(&statsMutex); \
+					    *(p) += (n); \
+					    Tcl_MutexUnlock(&statsMutex); \
+					} while (0)
+  #define STATS_LOAD(p)			LoadCounter((p))
+  #define STATS_EXCHANGE(p)		ExchangeCounter((p))
+#endif
+
+/*
+ * NOTE: The heap usage reported by [sass compile -profile] is only available
+ *       via the mallinfo2() function of glibc 2.33 or later.
+ */
+
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+  #if __GLIBC_PREREQ(2, 33)
+    #define HAVE_MALLINFO2		(1)
+  #endif
+#endif
+
+/*
+ * NOTE: This is the number of buckets within each latency histogram.  The
+ *       upper bound of bucket N is 2^N microseconds, except for the last
+ *       one, which holds everything else.
+ */
+
+#ifndef SASS_STATS_BUCKETS
+  #define SASS_STATS_BUCKETS			(26)
+#endif
+
+/*
+ * NOTE: This structure holds the latency histogram for one phase.  The sum
+ *       is in nanoseconds.  The count is only filled in by snapshots.
+ */
+
+typedef struct SassStatsHistogram {
+    Tcl_WideUInt count;			/* Number of recorded latencies. */
+    Tcl_WideUInt sum;			/* Sum of the recorded latencies. */
+    Tcl_WideUInt aBuckets[SASS_STATS_BUCKETS]; /* Count per bucket. */
+} SassStatsHistogram;
+
+/*
+ * NOTE: These are the metrics for the whole process.
+ */
+
+static Tcl_WideUInt aCounters[SASS_STAT_MAX];
+static SassStatsHistogram aHistograms[SASS_PHASE_MAX];
+
+/*
+ * NOTE: When this flag is set, via [sass stats -files 1], the size of the
+ *       source file of each file context is added to the "inputBytes"
+ *       counter, which costs an extra stat() call per compile.  Otherwise,
+ *       only the source strings of data contexts are counted.  The flag
+ *       is read without locking.
+ */
+
+volatile int sassStatsFiles = 0;
+
+/*
+ * NOTE: These are the names of the counters and phases, as reported by
+ *       [sass stats].  They must be kept in sync with the Sass_Stat and
+ *       Sass_Phase enumerations.
+ */
+
+static const char *azCounterNames[] = {
+    "compilesData", "compilesFile", "errors", "inputBytes", "outputBytes",
+    "cacheHits", "cacheMisses"
+};
+
+static const char *azPhaseNames[] = {
+    "options", "compile", "result"
+};
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+#if !defined(__GNUC__)
+static Tcl_WideUInt	LoadCounter(Tcl_WideUInt *counterPtr);
+static Tcl_WideUInt	ExchangeCounter(Tcl_WideUInt *counterPtr);
+#endif
+static void		GetSnapshot(int bReset, Tcl_WideUInt *aValues,
+			    SassStatsHistogram *aPhases);
+static Tcl_WideInt	GetQuantile(const SassStatsHistogram *histPtr,
+			    double quantile);
+static Tcl_Obj *	NewStatsDict(const Tcl_WideUInt *aValues,
+			    const SassStatsHistogram *aPhases);
+static Tcl_Obj *	NewStatsPrometheus(const Tcl_WideUInt *aValues,
+			    const SassStatsHistogram *aPhases);
+
+#if !defined(__GNUC__)
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadCounter --
+ *
+ *	This function reads a counter while holding the statistics mutex.
+ *
+ * Results:
+ *	The value of the counter.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideUInt LoadCounter(
+    Tcl_WideUInt *counterPtr)		/* IN: The counter to read. */
+{
+    Tcl_WideUInt value;
+
+    Tcl_MutexLock(&statsMutex);
+    value = *counterPtr;
+    Tcl_MutexUnlock(&statsMutex);
+
+    return value;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExchangeCounter --
+ *
+ *	This function reads and then resets a counter while holding the
+ *	statistics mutex.
+ *
+ * Results:
+ *	The previous value of the counter.
+ *
+ * Side effects:
+ *	The counter is reset to zero.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideUInt ExchangeCounter(
+    Tcl_WideUInt *counterPtr)		/* IN/OUT: The counter to reset. */
+{
+    Tcl_WideUInt value;
+
+    Tcl_MutexLock(&statsMutex);
+    value = *counterPtr;
+    *counterPtr = 0;
+    Tcl_MutexUnlock(&statsMutex);
+
+    return value;
+}
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassStatsNow --
+ *
+ *	This function returns the current time of a monotonic clock, for
+ *	measuring latencies.  When no monotonic clock is available, the
+ *	wall clock is used instead.
+ *
+ * Results:
+ *	The current time, in nanoseconds.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideUInt SassStatsNow(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == 0) {
+	return (Tcl_WideUInt)now.tv_sec * 1000000000 +
+	    (Tcl_WideUInt)now.tv_nsec;
+    }
+#endif
+
+    {
+	Tcl_Time now;
+
+	Tcl_GetTime(&now);
+
+	return (Tcl_WideUInt)now.sec * 1000000000 +
+	    (Tcl_WideUInt)now.usec * 1000;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassStatsCpuNow --
+ *
+ *	This function returns the CPU time consumed by the calling thread,
+ *	for profiling a compilation.
+ *
+ * Results:
+ *	The CPU time, in nanoseconds, or zero if it is unavailable.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideUInt SassStatsCpuNow(void)
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0) {
+	return (Tcl_WideUInt)now.tv_sec * 1000000000 +
+	    (Tcl_WideUInt)now.tv_nsec;
+    }
+#endif
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassStatsHeapBytes --
+ *
+ *	This function returns the number of bytes currently allocated via
+ *	the C library heap, including large blocks allocated via mmap().
+ *	With glibc, only the main arena is included, which is the one used
+ *	by the main thread.
+ *
+ * Results:
+ *	The number of bytes, or -1 if it is unavailable.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideInt SassStatsHeapBytes(void)
+{
+#if defined(HAVE_MALLINFO2)
+    struct mallinfo2 info = mallinfo2();
+
+    return (Tcl_WideInt)info.uordblks + (Tcl_WideInt)info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassStatsCount --
+ *
+ *	This function adds the specified amount to a counter.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassStatsCount(
+    enum Sass_Stat stat,		/* IN: The counter to update. */
+    Tcl_WideUInt amount)		/* IN: The amount to add. */
+{
+    STATS_ADD(&aCounters[stat], amount);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassStatsRecord --
+ *
+ *	This function records the latency of one phase, from the specified
+ *	start time, as returned by SassStatsNow, until now.
+ *
+ * Results:
+ *	The current time, in nanoseconds, so that the next phase may start
+ *	from there.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideUInt SassStatsRecord(
+    enum Sass_Phase phase,		/* IN: The phase to record. */
+    Tcl_WideUInt startTime)		/* IN: Start time, in nanoseconds. */
+{
+    SassStatsHistogram *histPtr = &aHistograms[phase];
+    Tcl_WideUInt now = SassStatsNow();
+    Tcl_WideUInt elapsed = (now > startTime) ? now - startTime : 0;
+    Tcl_WideUInt bound = 1000;
+    int index = 0;
+
+    while ((elapsed > bound) && (index < SASS_STATS_BUCKETS - 1)) {
+	bound <<= 1;
+	index++;
+    }
+
+    STATS_ADD(&histPtr->aBuckets[index], 1);
+    STATS_ADD(&histPtr->sum, elapsed);
+
+    return now;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetSnapshot --
+ *
+ *	This function copies all the metrics, optionally resetting them
+ *	at the same time.  Each value is reset atomically; therefore, no
+ *	update is lost.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The metrics may be reset.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void GetSnapshot(
+    int bReset,				/* IN: Non-zero to reset them. */
+    Tcl_WideUInt *aValues,		/* OUT: The counters. */
+    SassStatsHistogram *aPhases)	/* OUT: The histograms. */
+{
+    int index;
+    int bucket;
+
+    for (index = 0; index < SASS_STAT_MAX; index++) {
+	aValues[index] = bReset ? STATS_EXCHANGE(&aCounters[index]) :
+	    STATS_LOAD(&aCounters[index]);
+    }
+
+    for (index = 0; index < SASS_PHASE_MAX; index++) {
+	SassStatsHistogram *histPtr = &aHistograms[index];
+	SassStatsHistogram *copyPtr = &aPhases[index];
+
+	/*
+	 * NOTE: The count is derived from the buckets, so that it matches
+	 *       them even while latencies are being recorded concurrently.
+	 */
+
+	copyPtr->count = 0;
+
+	for (bucket = 0; bucket < SASS_STATS_BUCKETS; bucket++) {
+	    copyPtr->aBuckets[bucket] = bReset ?
+		STATS_EXCHANGE(&histPtr->aBuckets[bucket]) :
+		STATS_LOAD(&histPtr->aBuckets[bucket]);
+
+	    copyPtr->count += copyPtr->aBuckets[bucket];
+	}
+
+	copyPtr->sum = bReset ? STATS_EXCHANGE(&histPtr->sum) :
+	    STATS_LOAD(&histPtr->sum);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetQuantile --
+ *
+ *	This function estimates a quantile of the latencies recorded by a
+ *	histogram, as the upper bound of the bucket holding it.  For the
+ *	last bucket, which has no upper bound, the lower one is used.
+ *
+ * Results:
+ *	The estimated quantile, in microseconds, or zero if nothing was
+ *	recorded.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideInt GetQuantile(
+    const SassStatsHistogram *histPtr,	/* IN: The histogram. */
+    double quantile)			/* IN: The quantile, e.g. 0.99. */
+{
+    Tcl_WideUInt rank;
+    Tcl_WideUInt total = 0;
+    int bucket;
+
+    if (histPtr->count == 0)
+	return 0;
+
+    rank = (Tcl_WideUInt)(quantile * (double)histPtr->count + 0.5);
+
+    if (rank < 1)
+	rank = 1;
+
+    for (bucket = 0; bucket < SASS_STATS_BUCKETS - 1; bucket++) {
+	total += histPtr->aBuckets[bucket];
+
+	if (total >= rank)
+	    break;
+    }
+
+    if (bucket == SASS_STATS_BUCKETS - 1)
+	bucket--;
+
+    return (Tcl_WideInt)1 << bucket;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewStatsDict --
+ *
+ *	This function formats a snapshot of the metrics as a dictionary.
+ *	The latencies are in microseconds.  Only the buckets that are not
+ *	empty are included, keyed by their upper bounds; the last bucket,
+ *	which has no upper bound, is keyed by "+Inf".
+ *
+ * Results:
+ *	A new dictionary, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NewStatsDict(
+    const Tcl_WideUInt *aValues,	/* IN: The counters. */
+    const SassStatsHistogram *aPhases)	/* IN: The histograms. */
+{
+    Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+    Tcl_Obj *latencyPtr = Tcl_NewListObj(0, NULL);
+    int index;
+    int bucket;
+
+    for (index = 0; index < SASS_STAT_MAX; index++) {
+	Tcl_ListObjAppendElement(NULL, listPtr,
+	    Tcl_NewStringObj(azCounterNames[index], -1));
+	Tcl_ListObjAppendElement(NULL, listPtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt)aValues[index]));
+    }
+
+    for (index = 0; index < SASS_PHASE_MAX; index++) {
+	const SassStatsHistogram *histPtr = &aPhases[index];
+	Tcl_Obj *phasePtr = Tcl_NewListObj(0, NULL);
+	Tcl_Obj *bucketsPtr = Tcl_NewListObj(0, NULL);
+
+	for (bucket = 0; bucket < SASS_STATS_BUCKETS; bucket++) {
+	    if (histPtr->aBuckets[bucket] == 0)
+		continue;
+
+	    Tcl_ListObjAppendElement(NULL, bucketsPtr,
+		(bucket < SASS_STATS_BUCKETS - 1) ?
+		Tcl_NewWideIntObj((Tcl_WideInt)1 << bucket) :
+		Tcl_NewStringObj("+Inf", -1));
+	    Tcl_ListObjAppendElement(NULL, bucketsPtr,
+		Tcl_NewWideIntObj((Tcl_WideInt)histPtr->aBuckets[bucket]));
+	}
+
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewStringObj("count", -1));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt)histPtr->count));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewStringObj("sum", -1));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt)(histPtr->sum / 1000)));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewStringObj("p50", -1));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewWideIntObj(GetQuantile(histPtr, 0.50)));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewStringObj("p99", -1));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewWideIntObj(GetQuantile(histPtr, 0.99)));
+	Tcl_ListObjAppendElement(NULL, phasePtr,
+	    Tcl_NewStringObj("buckets", -1));
+	Tcl_ListObjAppendElement(NULL, phasePtr, bucketsPtr);
+
+	Tcl_ListObjAppendElement(NULL, latencyPtr,
+	    Tcl_NewStringObj(azPhaseNames[index], -1));
+	Tcl_ListObjAppendElement(NULL, latencyPtr, phasePtr);
+    }
+
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewStringObj("latency", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr, latencyPtr);
+
+    return listPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewStatsPrometheus --
+ *
+ *	This function formats a snapshot of the metrics using the text
+ *	exposition format of Prometheus.  The counters are reported as
+ *	"tclsass_*_total" metrics and the latencies as the histogram
+ *	"tclsass_phase_duration_seconds", labeled by phase, with
+ *	cumulative buckets.
+ *
+ * Results:
+ *	A new string, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NewStatsPrometheus(
+    const Tcl_WideUInt *aValues,	/* IN: The counters. */
+    const SassStatsHistogram *aPhases)	/* IN: The histograms. */
+{
+    Tcl_Obj *textPtr = Tcl_NewObj();
+    char buffer[200];
+    int index;
+    int bucket;
+
+    static const char *azMetrics[] = {
+	"compiles", "compiles", "errors", "input_bytes", "output_bytes",
+	"cache_hits", "cache_misses"
+    };
+
+    static const char *azHelp[] = {
+	"Stylesheets compiled, by context type.",
+	NULL,
+	"Compilations that failed.",
+	"Bytes of source data and files compiled.",
+	"Bytes of output produced.",
+	"Compile cache lookups that found a result.",
+	"Compile cache lookups that did not."
+    };
+
+    static const char *azLabels[] = {
+	"{type=\"data\"}", "{type=\"file\"}", "", "", "", "", ""
+    };
+
+    for (index = 0; index < SASS_STAT_MAX; index++) {
+	if (azHelp[index] != NULL) {
+	    snprintf(buffer, sizeof(buffer),
+		"# HELP tclsass_%s_total %s\n# TYPE tclsass_%s_total counter\n",
+		azMetrics[index], azHelp[index], azMetrics[index]);
+
+	    Tcl_AppendToObj(textPtr, buffer, -1);
+	}
+
+	snprintf(buffer, sizeof(buffer), "tclsass_%s_total%s %" TCL_LL_MODIFIER
+	    "u\n", azMetrics[index], azLabels[index], aValues[index]);
+
+	Tcl_AppendToObj(textPtr, buffer, -1);
+    }
+
+    Tcl_AppendToObj(textPtr,
+	"# HELP tclsass_phase_duration_seconds Latency of each phase of a "
+	"compilation.\n# TYPE tclsass_phase_duration_seconds histogram\n", -1);
+
+    for (index = 0; index < SASS_PHASE_MAX; index++) {
+	const SassStatsHistogram *histPtr = &aPhases[index];
+	Tcl_WideUInt total = 0;
+
+	for (bucket = 0; bucket < SASS_STATS_BUCKETS; bucket++) {
+	    total += histPtr->aBuckets[bucket];
+
+	    if (bucket < SASS_STATS_BUCKETS - 1) {
+		snprintf(buffer, sizeof(buffer),
+		    "tclsass_phase_duration_seconds_bucket{phase=\"%s\","
+		    "le=\"%.6f\"} %" TCL_LL_MODIFIER "u\n", azPhaseNames[index],
+		    (double)((Tcl_WideInt)1 << bucket) / 1000000.0, total);
+	    } else {
+		snprintf(buffer, sizeof(buffer),
+		    "tclsass_phase_duration_seconds_bucket{phase=\"%s\","
+		    "le=\"+Inf\"} %" TCL_LL_MODIFIER "u\n",
+		    azPhaseNames[index], total);
+	    }
+
+	    Tcl_AppendToObj(textPtr, buffer, -1);
+	}
+
+	snprintf(buffer, sizeof(buffer),
+	    "tclsass_phase_duration_seconds_sum{phase=\"%s\"} %.9f\n"
+	    "tclsass_phase_duration_seconds_count{phase=\"%s\"} %"
+	    TCL_LL_MODIFIER "u\n", azPhaseNames[index],
+	    (double)histPtr->sum / 1000000000.0, azPhaseNames[index], total);
+
+	Tcl_AppendToObj(textPtr, buffer, -1);
+    }
+
+    return textPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassStatsObjCmd --
+ *
+ *	Handles the [sass stats] sub-command, which returns the runtime
+ *	metrics, either as a dictionary or in the text exposition format
+ *	of Prometheus.  With -reset, the metrics are also reset.  With
+ *	-files, the counting of source file sizes is enabled or disabled.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The metrics may be reset.  The source file size flag may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassStatsObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    Tcl_WideUInt aValues[SASS_STAT_MAX];
+    SassStatsHistogram aPhases[SASS_PHASE_MAX];
+    int bReset = 0;
+    int bPrometheus = 0;
+    int bFiles;
+    int index;
+
+    static const char *formats[] = {
+	"dict", "prometheus", (char *) NULL
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassStatsObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    for (index = 2; index < objc; index++) {
+	const char *zArg = Tcl_GetString(objv[index]);
+
+	if (strcmp(zArg, "-reset") == 0) {
+	    bReset = 1;
+	    continue;
+	}
+
+	if ((strcmp(zArg, "-format") == 0) && ((index + 1) < objc)) {
+	    if (Tcl_GetIndexFromObj(interp, objv[++index], formats, "format",
+		    0, &bPrometheus) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    continue;
+	}
+
+	if ((strcmp(zArg, "-files") == 0) && ((index + 1) < objc)) {
+	    if (Tcl_GetBooleanFromObj(interp, objv[++index],
+		    &bFiles) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    sassStatsFiles = bFiles;
+	    continue;
+	}
+
+	Tcl_WrongNumArgs(interp, 2, objv,
+	    "?-reset? ?-format dict|prometheus? ?-files boolean?");
+
+	return TCL_ERROR;
+    }
+
+    GetSnapshot(bReset, aValues, aPhases);
+
+    Tcl_SetObjResult(interp, bPrometheus ?
+	NewStatsPrometheus(aValues, aPhases) : NewStatsDict(aValues, aPhases));
+
+    return TCL_OK;
+}
@@ -0,0 +1,26 @@
+/*
+ * tclsassStubInit.c -- Tcl Package for libsass
+ *
+ * The stubs table of this package.  The part between the markers is
+ * generated from "tclsass.decls" by the Tcl "genStubs.tcl" tool, via "make
+ * genstubs".
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "tclsass.h"		/* NOTE: For public package API. */
+
+/* !BEGIN!: Do not edit below this line. */
+
+const SassStubs sassStubs = {
+    TCL_STUB_MAGIC,
+    0,
+    Sass_CompileEx, /* 0 */
+    Sass_FreeResult, /* 1 */
+    Sass_RegisterFunction, /* 2 */
+    Sass_UnregisterFunction, /* 3 */
+};
+
+/* !END!: Do not edit above this line. */
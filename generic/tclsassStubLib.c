@@ -0,0 +1,67 @@
+/*
+ * tclsassStubLib.c -- Tcl Package for libsass
+ *
+ * The stub library of this package.  Other extensions that use the public
+ * API of this package should link against it, instead of the package itself,
+ * and then call Sass_InitStubs.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifndef USE_SASS_STUBS
+#define USE_SASS_STUBS
+#endif
+
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "tclsass.h"		/* NOTE: For public package API. */
+
+/*
+ * NOTE: This is the stubs table of this package, set by Sass_InitStubs.
+ */
+
+const SassStubs *sassStubsPtr = NULL;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Sass_InitStubs --
+ *
+ *	This function requires this package within the specified Tcl
+ *	interpreter and then stores the address of its stubs table, so
+ *	that the public functions of this package may be called.
+ *
+ * Results:
+ *	The version of this package -OR- NULL on failure, in which case
+ *	the Tcl interpreter result contains the reason.
+ *
+ * Side effects:
+ *	The package may be loaded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+const char *Sass_InitStubs(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    const char *zVersion,		/* IN: The package version required. */
+    int exact)				/* IN: Non-zero for exact version. */
+{
+    const char *zActual;
+    ClientData clientData = NULL;
+
+    zActual = Tcl_PkgRequireEx(interp, "sass", zVersion, exact, &clientData);
+
+    if (zActual == NULL)
+	return NULL;
+
+    if ((clientData == NULL) ||
+	    (((const SassStubs *)clientData)->magic != TCL_STUB_MAGIC)) {
+	Tcl_AppendResult(interp,
+	    "package \"sass\" does not provide a stubs table\n", NULL);
+
+	return NULL;
+    }
+
+    sassStubsPtr = (const SassStubs *)clientData;
+    return zActual;
+}
@@ -0,0 +1,1016 @@
+/*
+ * tclsassTrace.c -- Tcl Package for libsass
+ *
+ * Implements the binary trace events controlled by [sass trace].  Each thread
+ * records fixed-size events into its own ring buffer, without any locking,
+ * and only the thread that owns a ring buffer ever writes to it.  Readers
+ * hold the trace mutex and discard any events that may have been overwritten
+ * while they were being copied.  When a thread exits, its undrained events
+ * are moved to a shared ring buffer and its own ring buffer is freed.  When
+ * tracing is disabled, which is the default, recording an event costs a
+ * single load and branch.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdio.h>		/* NOTE: For snprintf(). */
+#include <stdlib.h>		/* NOTE: For qsort(). */
+#include <string.h>		/* NOTE: For memcpy(), strcmp(). */
+#if defined(_WIN32)
+#include <process.h>		/* NOTE: For _getpid(). */
+#define getpid			_getpid
+#else
+#include <unistd.h>		/* NOTE: For getpid(). */
+#endif
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: The GCC atomic built-in functions (which are also supported by Clang)
+ *       are used to publish the events of a ring buffer; otherwise, volatile
+ *       accesses are used, which only have the needed ordering on x86 with
+ *       MSVC.
+ */
+
+#if defined(__GNUC__)
+  #define TRACE_LOAD(p)			__atomic_load_n((p), __ATOMIC_ACQUIRE)
+  #define TRACE_STORE(p, v)		__atomic_store_n((p), (v), \
+					    __ATOMIC_RELEASE)
+  #define TRACE_FENCE()			__atomic_thread_fence( \
+					    __ATOMIC_ACQUIRE)
+#else
+  #define TRACE_LOAD(p)			(*(volatile Tcl_WideUInt *)(p))
+  #define TRACE_STORE(p, v)		(*(volatile Tcl_WideUInt *)(p) = (v))
+  #define TRACE_FENCE()
+#endif
+
+/*
+ * NOTE: This is the default number of events within each ring buffer, which
+ *       is used until [sass trace on -size] is used.  Sizes are rounded up to
+ *       a power of two.
+ */
+
+#ifndef SASS_TRACE_SIZE
+  #define SASS_TRACE_SIZE			(4096)
+#endif
+
+#ifndef SASS_TRACE_MAX_SIZE
+  #define SASS_TRACE_MAX_SIZE			(16777216)
+#endif
+
+/*
+ * NOTE: This structure holds one trace event.  Its meaning depends on the
+ *       event type, see the Sass_Trace_Event enumeration.
+ */
+
+typedef struct SassTraceEvent {
+    Tcl_WideUInt time;			/* Monotonic time, in nanoseconds. */
+    Tcl_WideUInt arg1;			/* First argument. */
+    Tcl_WideUInt arg2;			/* Second argument. */
+    unsigned int type;			/* The Sass_Trace_Event value. */
+    unsigned int threadId;		/* Ring buffer that recorded it. */
+} SassTraceEvent;
+
+/*
+ * NOTE: This structure holds the ring buffer of one thread.  The head is
+ *       the total number of events ever written and is only modified by
+ *       the owning thread.  The tail is the number of events drained, and
+ *       it is only used while holding the trace mutex, as is the array of
+ *       events when it is replaced.  The ring buffer for exited threads
+ *       has no owner; it is only modified while holding the trace mutex.
+ */
+
+typedef struct SassTraceRing {
+    Tcl_WideUInt head;			/* Number of events written. */
+    Tcl_WideUInt tail;			/* Number of events drained. */
+    Tcl_WideUInt drainHead;		/* Head used by DrainEvents. */
+    Tcl_WideUInt dropped;		/* Events overwritten, not drained. */
+    unsigned int size;			/* Number of events, power of two. */
+    unsigned int threadId;		/* Small number identifying thread. */
+    Tcl_ThreadId owner;			/* The thread that writes to it. */
+    SassTraceEvent *aEvents;		/* The events. */
+    struct SassTraceRing *nextPtr;	/* Next ring buffer, for readers. */
+} SassTraceRing;
+
+/*
+ * NOTE: This structure holds the per-thread trace state.  The generation is
+ *       the one in effect when the ring buffer was last checked; if it has
+ *       changed, the ring buffer may need to be resized or recreated.
+ */
+
+typedef struct SassTraceThread {
+    SassTraceRing *ringPtr;		/* Ring buffer for this thread. */
+    int generation;			/* When ring buffer was checked. */
+} SassTraceThread;
+
+/*
+ * NOTE: This is the process-wide trace state.  All of it, except the flag,
+ *       is protected by the trace mutex.  The flag is read without locking
+ *       by the SASS_TRACE macro.
+ */
+
+volatile int sassTraceEnabled = 0;
+
+static Tcl_ThreadDataKey traceDataKey;
+TCL_DECLARE_MUTEX(traceMutex)
+static volatile int traceGeneration = 1;
+static unsigned int traceSize = SASS_TRACE_SIZE;
+static unsigned int traceThreads = 0;
+static SassTraceRing *traceRings = NULL;
+static SassTraceRing *traceExited = NULL;
+
+/*
+ * NOTE: These are the names of the event types and their arguments, as
+ *       reported by [sass trace dump].  They must be kept in sync with the
+ *       Sass_Trace_Event enumeration.
+ */
+
+static const char *azEventNames[] = {
+    "compileStart", "compileEnd", "cacheHit", "cacheMiss", "cacheStore",
+    "import", "unload"
+};
+
+static const char *azArgNames[][2] = {
+    {"type", "inputBytes"}, {"errorStatus", "outputBytes"}, {"key", NULL},
+    {"key", NULL}, {"key", "stored"}, {"importer", "found"},
+    {"flags", "code"}
+};
+
+static const char *azImporterNames[] = {
+    "vfs", "tclvfs", "importcache"
+};
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static SassTraceRing *	GetRing(SassTraceThread *threadPtr);
+static void		TraceThreadExitProc(ClientData clientData);
+static int		ResizeRing(SassTraceRing *ringPtr);
+static int		DrainEvents(SassTraceEvent **aEventsPtr);
+static int		CompareEvents(const void *pOne, const void *pTwo);
+static Tcl_Obj *	NewArgObj(const SassTraceEvent *eventPtr, int index);
+static Tcl_Obj *	NewEventsDict(const SassTraceEvent *aEvents,
+			    int nEvents);
+static Tcl_Obj *	NewEventsChrome(const SassTraceEvent *aEvents,
+			    int nEvents);
+static Tcl_Obj *	NewTraceStatus(void);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetRing --
+ *
+ *	This function returns the ring buffer for the calling thread,
+ *	creating or resizing it first if the trace generation changed
+ *	since it was last checked.  Resizing discards the events in the
+ *	ring buffer that were not drained yet.
+ *
+ * Results:
+ *	The ring buffer -OR- NULL if it could not be allocated.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassTraceRing *GetRing(
+    SassTraceThread *threadPtr)		/* IN/OUT: The per-thread state. */
+{
+    SassTraceRing *ringPtr;
+
+    if (threadPtr->generation == traceGeneration)
+	return threadPtr->ringPtr;
+
+    Tcl_MutexLock(&traceMutex);
+
+    /*
+     * NOTE: The ring buffer is only reused if it is still in the list, since
+     *       SassTraceFinalize frees all of them.
+     */
+
+    for (ringPtr = traceRings; ringPtr != NULL; ringPtr = ringPtr->nextPtr) {
+	if ((ringPtr == threadPtr->ringPtr) &&
+		(ringPtr->owner == Tcl_GetCurrentThread())) {
+	    break;
+	}
+    }
+
+    if (ringPtr == NULL) {
+	ringPtr = (SassTraceRing *)attemptckalloc(sizeof(SassTraceRing));
+
+	if (ringPtr == NULL) {
+	    Tcl_MutexUnlock(&traceMutex);
+	    return NULL;
+	}
+
+	memset(ringPtr, 0, sizeof(SassTraceRing));
+	ringPtr->threadId = ++traceThreads;
+	ringPtr->owner = Tcl_GetCurrentThread();
+	ringPtr->nextPtr = traceRings;
+	traceRings = ringPtr;
+
+	/*
+	 * NOTE: Without this, the ring buffers of worker threads would
+	 *       accumulate until the package is unloaded.
+	 */
+
+	Tcl_CreateThreadExitHandler(TraceThreadExitProc, NULL);
+    }
+
+    ResizeRing(ringPtr);
+
+    threadPtr->ringPtr = ringPtr;
+    threadPtr->generation = traceGeneration;
+    Tcl_MutexUnlock(&traceMutex);
+
+    return (ringPtr->aEvents != NULL) ? ringPtr : NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResizeRing --
+ *
+ *	This function reallocates the events of a ring buffer if its size
+ *	differs from the current trace size, discarding the events that
+ *	were not drained yet.  The caller must hold the trace mutex.
+ *
+ * Results:
+ *	Zero on success, non-zero if the events could not be allocated,
+ *	in which case the ring buffer is left unchanged.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int ResizeRing(
+    SassTraceRing *ringPtr)		/* IN/OUT: The ring buffer. */
+{
+    SassTraceEvent *aEvents;
+
+    if (ringPtr->size == traceSize)
+	return 0;
+
+    aEvents = (SassTraceEvent *)attemptckalloc(
+	traceSize * sizeof(SassTraceEvent));
+
+    if (aEvents == NULL)
+	return -1;
+
+    if (ringPtr->aEvents != NULL)
+	ckfree((char *)ringPtr->aEvents);
+
+    ringPtr->aEvents = aEvents;
+    ringPtr->size = traceSize;
+    ringPtr->tail = ringPtr->head;
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TraceThreadExitProc --
+ *
+ *	This function is called when a thread that recorded events exits.
+ *	It moves the events of its ring buffer that were not drained yet
+ *	to the shared ring buffer for exited threads, which keeps only the
+ *	most recent ones, and then frees its ring buffer.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void TraceThreadExitProc(
+    ClientData clientData)		/* Not used. */
+{
+    SassTraceThread *threadPtr;
+    SassTraceRing **ringPtrPtr;
+    SassTraceRing *ringPtr;
+    Tcl_WideUInt first;
+
+    threadPtr = (SassTraceThread *)Tcl_GetThreadData(&traceDataKey,
+	sizeof(SassTraceThread));
+
+    Tcl_MutexLock(&traceMutex);
+
+    /*
+     * NOTE: The ring buffer may have been freed already, by the function
+     *       SassTraceFinalize.
+     */
+
+    for (ringPtrPtr = &traceRings; *ringPtrPtr != NULL;
+	    ringPtrPtr = &(*ringPtrPtr)->nextPtr) {
+	if ((*ringPtrPtr == threadPtr->ringPtr) &&
+		((*ringPtrPtr)->owner == Tcl_GetCurrentThread())) {
+	    break;
+	}
+    }
+
+    ringPtr = *ringPtrPtr;
+
+    if (ringPtr == NULL) {
+	Tcl_MutexUnlock(&traceMutex);
+	return;
+    }
+
+    *ringPtrPtr = ringPtr->nextPtr;
+
+    /*
+     * NOTE: The ring buffer for exited threads is kept at the end of the
+     *       list, since new ring buffers are added at the start, so that
+     *       the readers handle it like any other.
+     */
+
+    if (traceExited == NULL) {
+	traceExited = (SassTraceRing *)attemptckalloc(sizeof(SassTraceRing));
+
+	if (traceExited != NULL) {
+	    memset(traceExited, 0, sizeof(SassTraceRing));
+
+	    for (ringPtrPtr = &traceRings; *ringPtrPtr != NULL;
+		    ringPtrPtr = &(*ringPtrPtr)->nextPtr) {
+		/* do nothing */
+	    }
+
+	    *ringPtrPtr = traceExited;
+	}
+    }
+
+    first = ringPtr->tail;
+
+    if (ringPtr->head - first > ringPtr->size)
+	first = ringPtr->head - ringPtr->size;
+
+    if ((traceExited != NULL) && (ResizeRing(traceExited) == 0)) {
+	traceExited->dropped += ringPtr->dropped + (first - ringPtr->tail);
+
+	for (; first < ringPtr->head; first++) {
+	    memcpy(&traceExited->aEvents[traceExited->head &
+		(traceExited->size - 1)], &ringPtr->aEvents[first &
+		(ringPtr->size - 1)], sizeof(SassTraceEvent));
+
+	    traceExited->head++;
+	}
+    }
+
+    if (ringPtr->aEvents != NULL)
+	ckfree((char *)ringPtr->aEvents);
+
+    ckfree((char *)ringPtr);
+
+    threadPtr->ringPtr = NULL;
+    threadPtr->generation = 0;
+    Tcl_MutexUnlock(&traceMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassTraceRecord --
+ *
+ *	This function records one event into the ring buffer for the
+ *	calling thread, overwriting the oldest event if it is full.  It
+ *	should only be called via the SASS_TRACE macro.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassTraceRecord(
+    enum Sass_Trace_Event type,		/* IN: The event type. */
+    Tcl_WideUInt arg1,			/* IN: First argument. */
+    Tcl_WideUInt arg2)			/* IN: Second argument. */
+{
+    SassTraceThread *threadPtr;
+    SassTraceRing *ringPtr;
+    SassTraceEvent *eventPtr;
+    Tcl_WideUInt head;
+
+    threadPtr = (SassTraceThread *)Tcl_GetThreadData(&traceDataKey,
+	sizeof(SassTraceThread));
+
+    ringPtr = GetRing(threadPtr);
+
+    if (ringPtr == NULL)
+	return;
+
+    head = ringPtr->head;
+    eventPtr = &ringPtr->aEvents[head & (ringPtr->size - 1)];
+
+    eventPtr->time = SassStatsNow();
+    eventPtr->arg1 = arg1;
+    eventPtr->arg2 = arg2;
+    eventPtr->type = (unsigned int)type;
+    eventPtr->threadId = ringPtr->threadId;
+
+    TRACE_STORE(&ringPtr->head, head + 1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DrainEvents --
+ *
+ *	This function copies the events that were not drained yet from
+ *	all the ring buffers and marks them as drained.  The events are
+ *	sorted by time.  Events that were overwritten before they could
+ *	be copied are counted as dropped, as reported by [sass trace
+ *	status].
+ *
+ * Results:
+ *	The number of events.  The array of events must be freed by the
+ *	caller via ckfree.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int DrainEvents(
+    SassTraceEvent **aEventsPtr)	/* OUT: The copied events. */
+{
+    SassTraceRing *ringPtr;
+    SassTraceEvent *aEvents;
+    Tcl_WideUInt total = 0;
+    int nEvents = 0;
+
+    Tcl_MutexLock(&traceMutex);
+
+    /*
+     * NOTE: Only the events recorded before the heads are loaded here are
+     *       drained, so that the array is sized for the pending events,
+     *       not for all the ring buffers.
+     */
+
+    for (ringPtr = traceRings; ringPtr != NULL; ringPtr = ringPtr->nextPtr) {
+	Tcl_WideUInt count;
+
+	ringPtr->drainHead = TRACE_LOAD(&ringPtr->head);
+	count = ringPtr->drainHead - ringPtr->tail;
+	total += (count < ringPtr->size) ? count : ringPtr->size;
+    }
+
+    aEvents = (SassTraceEvent *)ckalloc(
+	(total > 0 ? total : 1) * sizeof(SassTraceEvent));
+
+    for (ringPtr = traceRings; ringPtr != NULL; ringPtr = ringPtr->nextPtr) {
+	Tcl_WideUInt head = ringPtr->drainHead;
+	Tcl_WideUInt first = ringPtr->tail;
+	Tcl_WideUInt index;
+	int nCopied = nEvents;
+
+	if (ringPtr->size == 0)
+	    continue;
+
+	if (head - first > ringPtr->size)
+	    first = head - ringPtr->size;
+
+	for (index = first; index < head; index++) {
+	    memcpy(&aEvents[nEvents++],
+		&ringPtr->aEvents[index & (ringPtr->size - 1)],
+		sizeof(SassTraceEvent));
+	}
+
+	/*
+	 * NOTE: The owning thread may have overwritten some of the copied
+	 *       events in the meantime, including the one it may be writing
+	 *       now.  Those are discarded.
+	 */
+
+	TRACE_FENCE();
+	index = TRACE_LOAD(&ringPtr->head);
+
+	if (index + 1 - first > ringPtr->size) {
+	    Tcl_WideUInt nStale = index + 1 - first - ringPtr->size;
+
+	    if (nStale > head - first)
+		nStale = head - first;
+
+	    memmove(&aEvents[nCopied], &aEvents[nCopied + nStale],
+		(size_t)(nEvents - nCopied - nStale) * sizeof(SassTraceEvent));
+
+	    nEvents -= (int)nStale;
+	}
+
+	ringPtr->dropped += (head - ringPtr->tail) -
+	    (Tcl_WideUInt)(nEvents - nCopied);
+
+	ringPtr->tail = head;
+    }
+
+    Tcl_MutexUnlock(&traceMutex);
+
+    qsort(aEvents, (size_t)nEvents, sizeof(SassTraceEvent), CompareEvents);
+
+    *aEventsPtr = aEvents;
+    return nEvents;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareEvents --
+ *
+ *	This function compares two events by time, for qsort.  Events with
+ *	the same time are ordered by thread.
+ *
+ * Results:
+ *	Negative, zero, or positive.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CompareEvents(
+    const void *pOne,			/* IN: The first event. */
+    const void *pTwo)			/* IN: The second event. */
+{
+    const SassTraceEvent *onePtr = (const SassTraceEvent *)pOne;
+    const SassTraceEvent *twoPtr = (const SassTraceEvent *)pTwo;
+
+    if (onePtr->time != twoPtr->time)
+	return (onePtr->time < twoPtr->time) ? -1 : 1;
+
+    if (onePtr->threadId != twoPtr->threadId)
+	return (onePtr->threadId < twoPtr->threadId) ? -1 : 1;
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewArgObj --
+ *
+ *	This function returns the value of one argument of an event, as
+ *	reported by [sass trace dump].  Cache keys are reported by their
+ *	hash, in hexadecimal, and importers by their names.
+ *
+ * Results:
+ *	The new object, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NewArgObj(
+    const SassTraceEvent *eventPtr,	/* IN: The event. */
+    int index)				/* IN: Zero or one. */
+{
+    Tcl_WideUInt value = (index == 0) ? eventPtr->arg1 : eventPtr->arg2;
+    const char *zName = azArgNames[eventPtr->type][index];
+    char buffer[24] = {0};
+
+    if (strcmp(zName, "key") == 0) {
+	snprintf(buffer, sizeof(buffer) - 1, "%016" TCL_LL_MODIFIER "x",
+	    value);
+
+	return Tcl_NewStringObj(buffer, -1);
+    }
+
+    if ((strcmp(zName, "importer") == 0) &&
+	    (value < sizeof(azImporterNames) / sizeof(azImporterNames[0]))) {
+	return Tcl_NewStringObj(azImporterNames[value], -1);
+    }
+
+    if (strcmp(zName, "type") == 0)
+	return Tcl_NewStringObj((value == 1) ? "file" : "data", -1);
+
+    return Tcl_NewWideIntObj((Tcl_WideInt)value);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewEventsDict --
+ *
+ *	This function returns a list containing one dictionary for each
+ *	of the specified events, with its time, thread, event type, and
+ *	named arguments.
+ *
+ * Results:
+ *	The new list object, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NewEventsDict(
+    const SassTraceEvent *aEvents,	/* IN: The events. */
+    int nEvents)			/* IN: Number of events. */
+{
+    Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+    int index;
+    int arg;
+
+    for (index = 0; index < nEvents; index++) {
+	const SassTraceEvent *eventPtr = &aEvents[index];
+	Tcl_Obj *eventObjPtr = Tcl_NewListObj(0, NULL);
+
+	Tcl_ListObjAppendElement(NULL, eventObjPtr,
+	    Tcl_NewStringObj("time", -1));
+	Tcl_ListObjAppendElement(NULL, eventObjPtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt)eventPtr->time));
+	Tcl_ListObjAppendElement(NULL, eventObjPtr,
+	    Tcl_NewStringObj("thread", -1));
+	Tcl_ListObjAppendElement(NULL, eventObjPtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt)eventPtr->threadId));
+	Tcl_ListObjAppendElement(NULL, eventObjPtr,
+	    Tcl_NewStringObj("event", -1));
+	Tcl_ListObjAppendElement(NULL, eventObjPtr,
+	    Tcl_NewStringObj(azEventNames[eventPtr->type], -1));
+
+	for (arg = 0; arg < 2; arg++) {
+	    if (azArgNames[eventPtr->type][arg] == NULL)
+		continue;
+
+	    Tcl_ListObjAppendElement(NULL, eventObjPtr,
+		Tcl_NewStringObj(azArgNames[eventPtr->type][arg], -1));
+	    Tcl_ListObjAppendElement(NULL, eventObjPtr,
+		NewArgObj(eventPtr, arg));
+	}
+
+	Tcl_ListObjAppendElement(NULL, listPtr, eventObjPtr);
+    }
+
+    return listPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewEventsChrome --
+ *
+ *	This function formats the specified events using the JSON trace
+ *	event format of Chrome, i.e. for chrome://tracing and Perfetto.
+ *	Compilations become duration events, named "compile", while the
+ *	other events become thread-scoped instant events.  The timestamps
+ *	are in microseconds, with three decimal places, so that they keep
+ *	nanosecond resolution.
+ *
+ * Results:
+ *	The new string object, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NewEventsChrome(
+    const SassTraceEvent *aEvents,	/* IN: The events. */
+    int nEvents)			/* IN: Number of events. */
+{
+    Tcl_Obj *textPtr = Tcl_NewStringObj("{\"traceEvents\":[", -1);
+    int pid = (int)getpid();
+    int index;
+    int arg;
+
+    for (index = 0; index < nEvents; index++) {
+	const SassTraceEvent *eventPtr = &aEvents[index];
+	const char *zName = azEventNames[eventPtr->type];
+	const char *zPhase = "i";
+	char buffer[160] = {0};
+
+	if (eventPtr->type == SASS_TRACE_COMPILE_START) {
+	    zName = "compile";
+	    zPhase = "B";
+	} else if (eventPtr->type == SASS_TRACE_COMPILE_END) {
+	    zName = "compile";
+	    zPhase = "E";
+	}
+
+	snprintf(buffer, sizeof(buffer) - 1,
+	    "%s{\"name\":\"%s\",\"cat\":\"sass\",\"ph\":\"%s\","
+	    "\"ts\":%" TCL_LL_MODIFIER "u.%03u,\"pid\":%d,\"tid\":%u,%s"
+	    "\"args\":{", (index > 0) ? "," : "", zName, zPhase,
+	    eventPtr->time / 1000, (unsigned int)(eventPtr->time % 1000),
+	    pid, eventPtr->threadId, (zPhase[0] == 'i') ? "\"s\":\"t\"," : "");
+
+	Tcl_AppendToObj(textPtr, buffer, -1);
+
+	for (arg = 0; arg < 2; arg++) {
+	    Tcl_Obj *valuePtr;
+	    Tcl_WideInt value;
+	    const char *zValue;
+
+	    if (azArgNames[eventPtr->type][arg] == NULL)
+		continue;
+
+	    valuePtr = NewArgObj(eventPtr, arg);
+	    Tcl_IncrRefCount(valuePtr);
+	    zValue = Tcl_GetString(valuePtr);
+
+	    /*
+	     * NOTE: Argument values never need escaping.  Names are quoted,
+	     *       as are cache keys, which are hexadecimal.
+	     */
+
+	    if ((strcmp(azArgNames[eventPtr->type][arg], "key") == 0) ||
+		    (Tcl_GetWideIntFromObj(NULL, valuePtr,
+		    &value) != TCL_OK)) {
+		Tcl_AppendStringsToObj(textPtr, (arg > 0) ? ",\"" : "\"",
+		    azArgNames[eventPtr->type][arg], "\":\"", zValue, "\"",
+		    NULL);
+	    } else {
+		Tcl_AppendStringsToObj(textPtr, (arg > 0) ? ",\"" : "\"",
+		    azArgNames[eventPtr->type][arg], "\":", zValue, NULL);
+	    }
+
+	    Tcl_DecrRefCount(valuePtr);
+	}
+
+	Tcl_AppendToObj(textPtr, "}}", -1);
+    }
+
+    Tcl_AppendToObj(textPtr, "],\"displayTimeUnit\":\"ns\"}", -1);
+
+    return textPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewTraceStatus --
+ *
+ *	This function returns a dictionary describing the trace state,
+ *	i.e. whether tracing is enabled, the size of new ring buffers,
+ *	the number of ring buffers, the number of events that were not
+ *	drained yet, and the number of events that were dropped, i.e.
+ *	overwritten before they could be drained.
+ *
+ * Results:
+ *	The new list object, with a reference count of zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *NewTraceStatus(void)
+{
+    Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+    SassTraceRing *ringPtr;
+    Tcl_WideUInt pending = 0;
+    Tcl_WideUInt dropped = 0;
+    int nRings = 0;
+    unsigned int size;
+
+    Tcl_MutexLock(&traceMutex);
+    size = traceSize;
+
+    for (ringPtr = traceRings; ringPtr != NULL; ringPtr = ringPtr->nextPtr) {
+	Tcl_WideUInt count = TRACE_LOAD(&ringPtr->head) - ringPtr->tail;
+
+	if (count > ringPtr->size) {
+	    dropped += count - ringPtr->size;
+	    count = ringPtr->size;
+	}
+
+	pending += count;
+	dropped += ringPtr->dropped;
+
+	if (ringPtr != traceExited)
+	    nRings++;
+    }
+
+    Tcl_MutexUnlock(&traceMutex);
+
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewStringObj("enabled", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewIntObj(sassTraceEnabled ? 1 : 0));
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewStringObj("size", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewWideIntObj(size));
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewStringObj("threads", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewIntObj(nRings));
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewStringObj("pending", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewWideIntObj((Tcl_WideInt)pending));
+    Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewStringObj("dropped", -1));
+    Tcl_ListObjAppendElement(NULL, listPtr,
+	Tcl_NewWideIntObj((Tcl_WideInt)dropped));
+
+    return listPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassTraceFinalize --
+ *
+ *	This function disables tracing and frees all the ring buffers.  It
+ *	should only be called when the package is being unloaded from the
+ *	process, when no other threads are compiling.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassTraceFinalize(void)
+{
+    SassTraceRing *ringPtr;
+
+    sassTraceEnabled = 0;
+
+    Tcl_MutexLock(&traceMutex);
+    traceGeneration++;
+
+    while (traceRings != NULL) {
+	ringPtr = traceRings;
+	traceRings = ringPtr->nextPtr;
+
+	if (ringPtr->aEvents != NULL)
+	    ckfree((char *)ringPtr->aEvents);
+
+	ckfree((char *)ringPtr);
+    }
+
+    traceExited = NULL;
+    Tcl_MutexUnlock(&traceMutex);
+
+    /*
+     * NOTE: The handlers of the other threads find nothing to do, since
+     *       their ring buffers are gone.
+     */
+
+    Tcl_DeleteThreadExitHandler(TraceThreadExitProc, NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassTraceObjCmd --
+ *
+ *	Handles the [sass trace] sub-command and its sub-commands, which
+ *	enable and disable tracing, report its state, and drain the
+ *	recorded events.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Tracing may be enabled or disabled.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassTraceObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int option;
+
+    static const char *cmdOptions[] = {
+	"dump", "off", "on", "status", (char *) NULL
+    };
+
+    enum options {
+	OPT_DUMP, OPT_OFF, OPT_ON, OPT_STATUS
+    };
+
+    static const char *formats[] = {
+	"dict", "chrome", (char *) NULL
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassTraceObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_DUMP: {
+	    SassTraceEvent *aEvents;
+	    int bChrome = 0;
+	    int nEvents;
+
+	    if ((objc != 3) && ((objc != 5) ||
+		    (strcmp(Tcl_GetString(objv[3]), "-format") != 0))) {
+		Tcl_WrongNumArgs(interp, 3, objv, "?-format dict|chrome?");
+		return TCL_ERROR;
+	    }
+
+	    if ((objc == 5) && (Tcl_GetIndexFromObj(interp, objv[4], formats,
+		    "format", 0, &bChrome) != TCL_OK)) {
+		return TCL_ERROR;
+	    }
+
+	    nEvents = DrainEvents(&aEvents);
+
+	    Tcl_SetObjResult(interp, bChrome ?
+		NewEventsChrome(aEvents, nEvents) :
+		NewEventsDict(aEvents, nEvents));
+
+	    ckfree((char *)aEvents);
+	    return TCL_OK;
+	}
+	case OPT_OFF: {
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    sassTraceEnabled = 0;
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	case OPT_ON: {
+	    int size = SASS_TRACE_SIZE;
+	    unsigned int roundedSize = 1;
+
+	    if ((objc != 3) && ((objc != 5) ||
+		    (strcmp(Tcl_GetString(objv[3]), "-size") != 0))) {
+		Tcl_WrongNumArgs(interp, 3, objv, "?-size events?");
+		return TCL_ERROR;
+	    }
+
+	    if ((objc == 5) && (Tcl_GetIntFromObj(interp, objv[4],
+		    &size) != TCL_OK)) {
+		return TCL_ERROR;
+	    }
+
+	    if ((size < 1) || (size > SASS_TRACE_MAX_SIZE)) {
+		char buffer[80] = {0};
+
+		snprintf(buffer, sizeof(buffer) - 1,
+		    "size must be between 1 and %d\n", SASS_TRACE_MAX_SIZE);
+
+		Tcl_AppendResult(interp, buffer, NULL);
+		return TCL_ERROR;
+	    }
+
+	    while (roundedSize < (unsigned int)size)
+		roundedSize <<= 1;
+
+	    /*
+	     * NOTE: Each thread resizes its own ring buffer when it records
+	     *       its next event, since only it may write to it.
+	     */
+
+	    Tcl_MutexLock(&traceMutex);
+
+	    if (roundedSize != traceSize) {
+		traceSize = roundedSize;
+		traceGeneration++;
+	    }
+
+	    Tcl_MutexUnlock(&traceMutex);
+
+	    sassTraceEnabled = 1;
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	case OPT_STATUS: {
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    Tcl_SetObjResult(interp, NewTraceStatus());
+	    return TCL_OK;
+	}
+    }
+
+    return TCL_ERROR;
+}
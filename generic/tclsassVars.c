@@ -0,0 +1,462 @@
+/*
+ * tclsassVars.c -- Tcl Package for libsass
+ *
+ * Implements the -variables option of the [sass compile] sub-command.  The
+ * variables dictionary is encoded once, as Sass variable definitions, and
+ * the result is cached within the internal representation of its Tcl object.
+ * It is given to libsass via a custom header, which is parsed before the
+ * source itself; therefore, the source is never copied or modified.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdlib.h>		/* NOTE: For malloc(). */
+#include <string.h>		/* NOTE: For memcpy(). */
+#include <stdio.h>		/* NOTE: For snprintf(). */
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "sass/context.h"	/* NOTE: For public Sass API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: This is the path given to libsass for the header containing the
+ *       variable definitions.  It is used within error messages.  Headers
+ *       are not reported as included files; therefore, the compile cache
+ *       never tries to check it.
+ */
+
+#ifndef SASS_VARS_PATH
+  #define SASS_VARS_PATH			PACKAGE_NAME ":variables"
+#endif
+
+/*
+ * NOTE: This structure holds the encoded header for one variables
+ *       dictionary.  It is reference counted because it may be shared by
+ *       any number of Tcl objects and compilations in progress.  It is
+ *       never modified after being created; therefore, the worker threads
+ *       may read it without locking.
+ */
+
+struct SassVars {
+    int refCount;			/* Number of references to this. */
+    char *zHeader;			/* The variable definitions. */
+    int headerLength;			/* Length of above, without NUL. */
+};
+
+/*
+ * NOTE: This Tcl object type caches the encoded header for a variables
+ *       dictionary passed via the -variables option, so that using the
+ *       same Tcl object again does not require encoding it again.  The
+ *       string representation is never invalidated; therefore, no procedure
+ *       is needed to update it.
+ */
+
+static void		FreeVarsInternalRep(Tcl_Obj *objPtr);
+static void		DupVarsInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *dupPtr);
+
+static Tcl_ObjType sassVariablesType = {
+    "sassVariables",			/* name */
+    FreeVarsInternalRep,		/* freeIntRepProc */
+    DupVarsInternalRep,			/* dupIntRepProc */
+    NULL,				/* updateStringProc */
+    NULL				/* setFromAnyProc */
+};
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static int		IsVarName(const char *zName, int nameLength);
+static SassVars *	NewVars(Tcl_Interp *interp, Tcl_Obj *dictPtr);
+static Sass_Import_List	HeaderProc(const char *zPath,
+			    Sass_Importer_Entry cb,
+			    struct Sass_Compiler *compiler);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsVarName --
+ *
+ *	This function checks whether the specified string is a valid Sass
+ *	variable name, without the leading dollar sign.  Non-ASCII
+ *	characters are always allowed, as they are by libsass.
+ *
+ * Results:
+ *	Non-zero if the name is valid.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int IsVarName(
+    const char *zName,			/* IN: The name to check. */
+    int nameLength)			/* IN: Length of the name. */
+{
+    int index;
+
+    if ((nameLength == 0) || ((zName[0] >= '0') && (zName[0] <= '9')))
+	return 0;
+
+    for (index = 0; index < nameLength; index++) {
+	unsigned char c = (unsigned char)zName[index];
+
+	if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+		((c >= '0') && (c <= '9')) || (c == '-') || (c == '_') ||
+		(c >= 0x80)) {
+	    continue;
+	}
+
+	return 0;
+    }
+
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewVars --
+ *
+ *	This function encodes the specified variables dictionary as Sass
+ *	variable definitions, one per line, in dictionary order.  Each
+ *	name may have a leading dollar sign.  Each value is Sass source;
+ *	an empty value means null.
+ *
+ * Results:
+ *	The new header, with a reference count of one -OR- NULL on
+ *	failure.
+ *
+ * Side effects:
+ *	The internal representation of the Tcl object may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassVars *NewVars(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *dictPtr)			/* IN: The variables dictionary. */
+{
+    SassVars *varsPtr = NULL;
+    Tcl_DString header;
+    int objc;
+    Tcl_Obj **objv;
+    int index;
+
+    if (Tcl_ListObjGetElements(interp, dictPtr, &objc, &objv) != TCL_OK)
+	return NULL;
+
+    if (objc % 2 != 0) {
+	Tcl_AppendResult(interp,
+	    "variables must be a dictionary of names and values\n", NULL);
+
+	return NULL;
+    }
+
+    Tcl_DStringInit(&header);
+
+    for (index = 0; index < objc; index += 2) {
+	int nameLength;
+	int valueLength;
+	const char *zName;
+	const char *zValue;
+
+	zName = Tcl_GetStringFromObj(objv[index], &nameLength);
+	zValue = Tcl_GetStringFromObj(objv[index + 1], &valueLength);
+
+	if ((nameLength > 0) && (zName[0] == '$')) {
+	    zName++;
+	    nameLength--;
+	}
+
+	if (!IsVarName(zName, nameLength)) {
+	    Tcl_AppendResult(interp, "bad variable name \"",
+		Tcl_GetString(objv[index]), "\"\n", NULL);
+
+	    goto done;
+	}
+
+	if (valueLength == 0) {
+	    zValue = "null";
+	    valueLength = 4;
+	}
+
+	Tcl_DStringAppend(&header, "$", 1);
+	Tcl_DStringAppend(&header, zName, nameLength);
+	Tcl_DStringAppend(&header, ": ", 2);
+	Tcl_DStringAppend(&header, zValue, valueLength);
+	Tcl_DStringAppend(&header, ";\n", 2);
+    }
+
+    varsPtr = (SassVars *)attemptckalloc(sizeof(SassVars));
+
+    if (varsPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: varsPtr\n", NULL);
+	goto done;
+    }
+
+    varsPtr->headerLength = Tcl_DStringLength(&header);
+    varsPtr->zHeader = attemptckalloc(varsPtr->headerLength + 1);
+
+    if (varsPtr->zHeader == NULL) {
+	ckfree((char *)varsPtr);
+	varsPtr = NULL;
+
+	Tcl_AppendResult(interp, "out of memory: zHeader\n", NULL);
+	goto done;
+    }
+
+    memcpy(varsPtr->zHeader, Tcl_DStringValue(&header),
+	varsPtr->headerLength + 1);
+
+    varsPtr->refCount = 1;
+
+done:
+    Tcl_DStringFree(&header);
+
+    return varsPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeVarsInternalRep --
+ *
+ *	This function releases the header cached within the internal
+ *	representation of a Tcl object of the "sassVariables" type.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FreeVarsInternalRep(
+    Tcl_Obj *objPtr)			/* IN: The Tcl object. */
+{
+    SassVarsRelease((SassVars *)objPtr->internalRep.otherValuePtr);
+    objPtr->internalRep.otherValuePtr = NULL;
+    objPtr->typePtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DupVarsInternalRep --
+ *
+ *	This function shares the header cached within the internal
+ *	representation of a Tcl object of the "sassVariables" type with a
+ *	copy of that object.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void DupVarsInternalRep(
+    Tcl_Obj *srcPtr,			/* IN: The original Tcl object. */
+    Tcl_Obj *dupPtr)			/* OUT: The copied Tcl object. */
+{
+    SassVars *varsPtr;
+
+    varsPtr = (SassVars *)srcPtr->internalRep.otherValuePtr;
+    varsPtr->refCount++;
+
+    dupPtr->internalRep.otherValuePtr = varsPtr;
+    dupPtr->typePtr = &sassVariablesType;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HeaderProc --
+ *
+ *	This function is the custom header used by libsass to parse the
+ *	variable definitions before the source.  It may be called by any
+ *	thread.
+ *
+ * Results:
+ *	A list containing the header import -OR- NULL if out of memory.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_Import_List HeaderProc(
+    const char *zPath,			/* IN: The entry path, unused. */
+    Sass_Importer_Entry cb,		/* IN: The header entry. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    SassVars *varsPtr = (SassVars *)sass_importer_get_cookie(cb);
+    Sass_Import_List list;
+    char *zSource;
+
+    /*
+     * NOTE: The source is owned by libsass, which frees it; therefore, it
+     *       must be allocated via malloc, for every compilation.
+     */
+
+    zSource = malloc(varsPtr->headerLength + 1);
+
+    if (zSource == NULL)
+	return NULL;
+
+    memcpy(zSource, varsPtr->zHeader, varsPtr->headerLength + 1);
+
+    list = sass_make_import_list(1);
+
+    if (list == NULL) {
+	free(zSource);
+	return NULL;
+    }
+
+    list[0] = sass_make_import_entry(SASS_VARS_PATH, zSource, NULL);
+    return list;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassVarsGetFromObj --
+ *
+ *	This function returns the encoded header for the specified
+ *	variables dictionary.  If the Tcl object already has one cached
+ *	within its internal representation, it is used as is.  Otherwise,
+ *	a new one is created and cached there, replacing any other internal
+ *	representation.  Failures are not cached.
+ *
+ * Results:
+ *	The header, with a new reference that must be released via
+ *	SassVarsRelease -OR- NULL on failure.
+ *
+ * Side effects:
+ *	The internal representation of the Tcl object may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+SassVars *SassVarsGetFromObj(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    Tcl_Obj *dictPtr)			/* IN: The variables dictionary. */
+{
+    SassVars *varsPtr;
+
+    if (dictPtr->typePtr != &sassVariablesType) {
+	/*
+	 * NOTE: The string representation must be valid before the internal
+	 *       representation is replaced, since it cannot be regenerated.
+	 */
+
+	Tcl_GetString(dictPtr);
+
+	varsPtr = NewVars(interp, dictPtr);
+
+	if (varsPtr == NULL)
+	    return NULL;
+
+	if ((dictPtr->typePtr != NULL) &&
+		(dictPtr->typePtr->freeIntRepProc != NULL)) {
+	    dictPtr->typePtr->freeIntRepProc(dictPtr);
+	}
+
+	dictPtr->internalRep.otherValuePtr = varsPtr;
+	dictPtr->typePtr = &sassVariablesType;
+    }
+
+    varsPtr = (SassVars *)dictPtr->internalRep.otherValuePtr;
+    varsPtr->refCount++;
+
+    return varsPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassVarsBind --
+ *
+ *	This function sets the custom header used by libsass to define
+ *	the variables for one compilation.  The length of the header and
+ *	the header itself are appended to the compile cache key, so that
+ *	different sets of variables can never share a cached result.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The header list is owned by the options, and then by the context.
+ *	The caller must keep its reference to the header until the
+ *	compilation is complete.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassVarsBind(
+    SassVars *varsPtr,			/* IN: The encoded header. */
+    struct Sass_Options *optsPtr,	/* IN/OUT: The context options. */
+    Tcl_DString *keyPtr)		/* IN/OUT: The compile cache key. */
+{
+    Sass_Importer_Entry entry;
+    Sass_Importer_List list;
+    char buffer[TCL_INTEGER_SPACE + 4];
+
+    snprintf(buffer, sizeof(buffer), "\003%d.", varsPtr->headerLength);
+
+    Tcl_DStringAppend(keyPtr, buffer, -1);
+    Tcl_DStringAppend(keyPtr, varsPtr->zHeader, varsPtr->headerLength);
+
+    entry = sass_make_importer(HeaderProc, 0, (void *)varsPtr);
+
+    if (entry == NULL)
+	return;
+
+    list = sass_make_importer_list(1);
+
+    if (list == NULL) {
+	sass_delete_importer(entry);
+	return;
+    }
+
+    sass_importer_set_list_entry(list, 0, entry);
+    sass_option_set_c_headers(optsPtr, list);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassVarsRelease --
+ *
+ *	This function releases a reference to an encoded header, freeing
+ *	it when there are no more references.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassVarsRelease(
+    SassVars *varsPtr)			/* IN: The header, may be NULL. */
+{
+    if (varsPtr == NULL)
+	return;
+
+    if (--varsPtr->refCount > 0)
+	return;
+
+    ckfree(varsPtr->zHeader);
+    ckfree((char *)varsPtr);
+}
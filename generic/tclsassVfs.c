@@ -0,0 +1,718 @@
+/*
+ * tclsassVfs.c -- Tcl Package for libsass
+ *
+ * Implements the in-memory virtual file system used to resolve imports, e.g.
+ * partials that are generated at runtime, without any disk access.  Files
+ * are added via [sass vfs add] and are visible to all compilations in the
+ * process, including those performed by the worker threads.  They are found
+ * through a custom importer that is checked before the include paths.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdlib.h>		/* NOTE: For malloc(), free(). */
+#include <string.h>		/* NOTE: For strlen(), strncmp(), memcpy(). */
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "sass/context.h"	/* NOTE: For public Sass API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+/*
+ * NOTE: This is the priority of the custom importer used for the virtual
+ *       file system.  Importers with a higher priority are checked first.
+ */
+
+#ifndef SASS_VFS_PRIORITY
+  #define SASS_VFS_PRIORITY			(0.0)
+#endif
+
+/*
+ * NOTE: This is the content of one file within the virtual file system.  It
+ *       is immutable once added; replacing a file creates a new one.  It is
+ *       reference counted so that it can be copied without holding the VFS
+ *       mutex.
+ */
+
+typedef struct SassVfsFile {
+    int refCount;			/* Number of references. */
+    Tcl_WideUInt hash;			/* Hash of the contents. */
+    size_t length;			/* Length of the contents. */
+    char zData[1];			/* The contents, NUL terminated. */
+} SassVfsFile;
+
+/*
+ * NOTE: This structure holds the state of the virtual file system.  There is
+ *       only one instance of it per process.  It is protected by vfsMutex.
+ */
+
+typedef struct SassVfs {
+    int bInitialized;			/* Non-zero if the table is valid. */
+    Tcl_HashTable files;		/* Maps names to SassVfsFile. */
+} SassVfs;
+
+static SassVfs vfs = {
+    0
+};
+
+TCL_DECLARE_MUTEX(vfsMutex)
+
+/*
+ * NOTE: These are the prefixes and extensions tried, in order, when the name
+ *       being imported does not match a file exactly.  They are the same as
+ *       the ones used by libsass when resolving imports on disk.
+ */
+
+static const char *azPrefixes[] = {
+    "_", "", (char *) NULL
+};
+
+static const char *azExtensions[] = {
+    ".scss", ".sass", ".css", (char *) NULL
+};
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static SassVfsFile *	FindFile(const char *zName, int nameLength);
+static SassVfsFile *	ResolveFile(Tcl_DString *pathPtr,
+			    const char *zBase, int baseLength,
+			    const char *zUrl);
+static void		ReleaseFile(SassVfsFile *filePtr);
+static void		ClearFiles(void);
+static Sass_Import_List	VfsImporterProc(const char *zUrl,
+			    Sass_Importer_Entry cb,
+			    struct Sass_Compiler *compiler);
+static Sass_Import_List	VfsImporterTraceProc(const char *zUrl,
+			    Sass_Importer_Entry cb,
+			    struct Sass_Compiler *compiler);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindFile --
+ *
+ *	This function looks up the file with the specified name within the
+ *	virtual file system.  The caller must hold the VFS mutex.
+ *
+ * Results:
+ *	The file -OR- NULL if it does not exist.  No reference is added.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassVfsFile *FindFile(
+    const char *zName,			/* IN: The name to find. */
+    int nameLength)			/* IN: Length of the name. */
+{
+    Tcl_HashEntry *hPtr;
+
+    if (!vfs.bInitialized || (nameLength <= 0))
+	return NULL;
+
+    hPtr = Tcl_FindHashEntry(&vfs.files, zName);
+
+    if (hPtr == NULL)
+	return NULL;
+
+    return (SassVfsFile *)Tcl_GetHashValue(hPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResolveFile --
+ *
+ *	This function attempts to resolve the specified URL, relative to
+ *	the specified base directory, to a file within the virtual file
+ *	system.  The URL is tried as is; then, if the last component has
+ *	no extension, with the well-known prefixes and extensions for Sass
+ *	partials and stylesheets.  The caller must hold the VFS mutex.
+ *
+ * Results:
+ *	The file -OR- NULL if it does not exist.  A reference is added to
+ *	the file, which must be released via ReleaseFile.
+ *
+ * Side effects:
+ *	The name of the file is placed into the specified Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassVfsFile *ResolveFile(
+    Tcl_DString *pathPtr,		/* OUT: The name of the file found. */
+    const char *zBase,			/* IN: Base directory, may be NULL. */
+    int baseLength,			/* IN: Length of base directory. */
+    const char *zUrl)			/* IN: The URL being imported. */
+{
+    SassVfsFile *filePtr;
+    const char *zTail;
+    int dirLength;
+    int iPrefix;
+    int iExtension;
+
+    Tcl_DStringSetLength(pathPtr, 0);
+
+    if (zBase != NULL)
+	Tcl_DStringAppend(pathPtr, zBase, baseLength);
+
+    dirLength = Tcl_DStringLength(pathPtr);
+    Tcl_DStringAppend(pathPtr, zUrl, -1);
+
+    filePtr = FindFile(Tcl_DStringValue(pathPtr), Tcl_DStringLength(pathPtr));
+
+    if (filePtr != NULL) {
+	filePtr->refCount++;
+	return filePtr;
+    }
+
+    zTail = strrchr(zUrl, '/');
+    zTail = (zTail != NULL) ? zTail + 1 : zUrl;
+
+    if ((zTail[0] == '\0') || (strchr(zTail, '.') != NULL))
+	return NULL;
+
+    dirLength += (int)(zTail - zUrl);
+
+    for (iPrefix = 0; azPrefixes[iPrefix] != NULL; iPrefix++) {
+	for (iExtension = 0; azExtensions[iExtension] != NULL; iExtension++) {
+	    Tcl_DStringSetLength(pathPtr, dirLength);
+	    Tcl_DStringAppend(pathPtr, azPrefixes[iPrefix], -1);
+	    Tcl_DStringAppend(pathPtr, zTail, -1);
+	    Tcl_DStringAppend(pathPtr, azExtensions[iExtension], -1);
+
+	    filePtr = FindFile(Tcl_DStringValue(pathPtr),
+		Tcl_DStringLength(pathPtr));
+
+	    if (filePtr != NULL) {
+		filePtr->refCount++;
+		return filePtr;
+	    }
+	}
+    }
+
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReleaseFile --
+ *
+ *	This function releases one reference to the specified file.  The
+ *	caller must hold the VFS mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The file is freed when its last reference is released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ReleaseFile(
+    SassVfsFile *filePtr)		/* IN: The file to release. */
+{
+    if (filePtr == NULL)
+	return;
+
+    if (--filePtr->refCount <= 0)
+	ckfree((char *)filePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * VfsImporterProc --
+ *
+ *	This function is the custom importer used by libsass to resolve
+ *	imports from the virtual file system.  Imports within a file from
+ *	the virtual file system are resolved relative to its directory
+ *	first.  It may be called by any thread.
+ *
+ * Results:
+ *	The list of imports, with one entry -OR- NULL if the URL could not
+ *	be resolved, in which case libsass will try the next importer and
+ *	then the include paths.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_Import_List VfsImporterProc(
+    const char *zUrl,			/* IN: The URL being imported. */
+    Sass_Importer_Entry cb,		/* IN: The importer, not used. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    Sass_Import_List list;
+    Sass_Import_Entry lastPtr;
+    SassVfsFile *filePtr = NULL;
+    Tcl_DString path;
+    const char *zBase = NULL;
+    int baseLength = 0;
+    char *zSource;
+
+    if (zUrl == NULL)
+	return NULL;
+
+    /*
+     * NOTE: When the import came from a file within the virtual file system,
+     *       use its directory as the base.  Its absolute path includes the
+     *       prefix, which is skipped here.
+     */
+
+    lastPtr = (compiler != NULL) ?
+	sass_compiler_get_last_import(compiler) : NULL;
+
+    if (lastPtr != NULL) {
+	const char *zLast = sass_import_get_abs_path(lastPtr);
+
+	if ((zLast != NULL) && (strncmp(zLast, SASS_VFS_PREFIX,
+		strlen(SASS_VFS_PREFIX)) == 0)) {
+	    const char *zSlash;
+
+	    zLast += strlen(SASS_VFS_PREFIX);
+	    zSlash = strrchr(zLast, '/');
+
+	    if (zSlash != NULL) {
+		zBase = zLast;
+		baseLength = (int)(zSlash - zLast) + 1;
+	    }
+	}
+    }
+
+    Tcl_DStringInit(&path);
+    Tcl_DStringAppend(&path, SASS_VFS_PREFIX, -1);
+
+    Tcl_MutexLock(&vfsMutex);
+
+    if (vfs.bInitialized && (vfs.files.numEntries > 0)) {
+	Tcl_DString name;
+
+	Tcl_DStringInit(&name);
+
+	if (zBase != NULL)
+	    filePtr = ResolveFile(&name, zBase, baseLength, zUrl);
+
+	if (filePtr == NULL)
+	    filePtr = ResolveFile(&name, NULL, 0, zUrl);
+
+	if (filePtr != NULL) {
+	    Tcl_DStringAppend(&path, Tcl_DStringValue(&name),
+		Tcl_DStringLength(&name));
+	}
+
+	Tcl_DStringFree(&name);
+    }
+
+    Tcl_MutexUnlock(&vfsMutex);
+
+    if (filePtr == NULL) {
+	Tcl_DStringFree(&path);
+	return NULL;
+    }
+
+    /*
+     * NOTE: The contents are copied outside of the mutex, which is safe due
+     *       to the reference held.  They must be allocated via malloc(),
+     *       because libsass takes ownership of them.
+     */
+
+    zSource = malloc(filePtr->length + 1);
+
+    if (zSource != NULL)
+	memcpy(zSource, filePtr->zData, filePtr->length + 1);
+
+    Tcl_MutexLock(&vfsMutex);
+    ReleaseFile(filePtr);
+    Tcl_MutexUnlock(&vfsMutex);
+
+    if (zSource == NULL) {
+	Tcl_DStringFree(&path);
+	return NULL;
+    }
+
+    list = sass_make_import_list(1);
+
+    if (list == NULL) {
+	free(zSource);
+	Tcl_DStringFree(&path);
+	return NULL;
+    }
+
+    list[0] = sass_make_import(zUrl, Tcl_DStringValue(&path), zSource, NULL);
+    Tcl_DStringFree(&path);
+
+    return list;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * VfsImporterTraceProc --
+ *
+ *	This function is the custom importer actually registered with
+ *	libsass for the in-memory virtual file system.  It calls
+ *	VfsImporterProc and then records the lookup for [sass trace].
+ *
+ * Results:
+ *	The result of VfsImporterProc.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_Import_List VfsImporterTraceProc(
+    const char *zUrl,			/* IN: The URL being imported. */
+    Sass_Importer_Entry cb,		/* IN: The importer. */
+    struct Sass_Compiler *compiler)	/* IN: The current compiler. */
+{
+    Sass_Import_List list = VfsImporterProc(zUrl, cb, compiler);
+
+    SASS_TRACE(SASS_TRACE_IMPORT, SASS_TRACE_IMPORTER_VFS, list != NULL);
+
+    return list;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassVfsMakeImporter --
+ *
+ *	This function creates the custom importer for the virtual file
+ *	system, for use with one compilation.  When the virtual file system
+ *	is empty, no importer is needed.
+ *
+ * Results:
+ *	The importer -OR- NULL if there is nothing to import.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Sass_Importer_Entry SassVfsMakeImporter(void)
+{
+    int nFiles;
+
+    Tcl_MutexLock(&vfsMutex);
+    nFiles = vfs.bInitialized ? vfs.files.numEntries : 0;
+    Tcl_MutexUnlock(&vfsMutex);
+
+    if (nFiles == 0)
+	return NULL;
+
+    return sass_make_importer(VfsImporterTraceProc, SASS_VFS_PRIORITY, NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassVfsGetState --
+ *
+ *	This function queries the size and hash of the contents of the
+ *	specified file within the virtual file system, using its absolute
+ *	path, i.e. including the prefix.  It is used by the compile cache
+ *	to validate the files included by a cached result.
+ *
+ * Results:
+ *	Zero if the file was found, non-zero otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassVfsGetState(
+    const char *zPath,			/* IN: The absolute path. */
+    Tcl_WideInt *sizePtr,		/* OUT: Size of the contents. */
+    Tcl_WideUInt *hashPtr)		/* OUT: Hash of the contents. */
+{
+    SassVfsFile *filePtr;
+    int prefixLength = (int)strlen(SASS_VFS_PREFIX);
+
+    if ((zPath == NULL) || (strncmp(zPath, SASS_VFS_PREFIX,
+	    (size_t)prefixLength) != 0)) {
+	return -1;
+    }
+
+    zPath += prefixLength;
+
+    Tcl_MutexLock(&vfsMutex);
+    filePtr = FindFile(zPath, (int)strlen(zPath));
+
+    if (filePtr != NULL) {
+	*sizePtr = (Tcl_WideInt)filePtr->length;
+	*hashPtr = filePtr->hash;
+    }
+
+    Tcl_MutexUnlock(&vfsMutex);
+
+    return (filePtr != NULL) ? 0 : -1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassVfsObjCmd --
+ *
+ *	Handles the [sass vfs] sub-command, which manages the files within
+ *	the virtual file system.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Files may be added to or removed from the virtual file system.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassVfsObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    int option;
+
+    static const char *cmdOptions[] = {
+	"add", "clear", "names", "remove", (char *) NULL
+    };
+
+    enum options {
+	OPT_ADD, OPT_CLEAR, OPT_NAMES, OPT_REMOVE
+    };
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassVfsObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if (objc < 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[2], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_ADD: {
+	    Tcl_HashEntry *hPtr;
+	    SassVfsFile *filePtr;
+	    const char *zName;
+	    const char *zData;
+	    int nameLength;
+	    int dataLength;
+	    int isNew;
+
+	    if (objc != 5) {
+		Tcl_WrongNumArgs(interp, 3, objv, "name contents");
+		return TCL_ERROR;
+	    }
+
+	    zName = Tcl_GetStringFromObj(objv[3], &nameLength);
+
+	    if (nameLength == 0) {
+		Tcl_AppendResult(interp, "file name cannot be empty\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    zData = Tcl_GetStringFromObj(objv[4], &dataLength);
+
+	    filePtr = (SassVfsFile *)attemptckalloc(
+		sizeof(SassVfsFile) + dataLength);
+
+	    if (filePtr == NULL) {
+		Tcl_AppendResult(interp, "out of memory: filePtr\n", NULL);
+		return TCL_ERROR;
+	    }
+
+	    filePtr->refCount = 1;
+	    filePtr->length = (size_t)dataLength;
+	    memcpy(filePtr->zData, zData, (size_t)dataLength);
+	    filePtr->zData[dataLength] = '\0';
+
+	    filePtr->hash = SassHashBytes(filePtr->zData,
+		(size_t)dataLength);
+
+	    Tcl_MutexLock(&vfsMutex);
+
+	    if (!vfs.bInitialized) {
+		Tcl_InitHashTable(&vfs.files, TCL_STRING_KEYS);
+		vfs.bInitialized = 1;
+	    }
+
+	    hPtr = Tcl_CreateHashEntry(&vfs.files, zName, &isNew);
+
+	    if (!isNew)
+		ReleaseFile((SassVfsFile *)Tcl_GetHashValue(hPtr));
+
+	    Tcl_SetHashValue(hPtr, (ClientData)filePtr);
+	    Tcl_MutexUnlock(&vfsMutex);
+
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	case OPT_CLEAR: {
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    ClearFiles();
+
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	case OPT_NAMES: {
+	    Tcl_HashEntry *hPtr;
+	    Tcl_HashSearch search;
+	    Tcl_Obj *listPtr;
+	    const char *zPattern = NULL;
+
+	    if ((objc != 3) && (objc != 4)) {
+		Tcl_WrongNumArgs(interp, 3, objv, "?pattern?");
+		return TCL_ERROR;
+	    }
+
+	    if (objc == 4)
+		zPattern = Tcl_GetString(objv[3]);
+
+	    listPtr = Tcl_NewListObj(0, NULL);
+
+	    Tcl_MutexLock(&vfsMutex);
+
+	    if (vfs.bInitialized) {
+		for (hPtr = Tcl_FirstHashEntry(&vfs.files, &search);
+			hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+		    const char *zName = Tcl_GetHashKey(&vfs.files, hPtr);
+
+		    if ((zPattern != NULL) &&
+			    !Tcl_StringMatch(zName, zPattern)) {
+			continue;
+		    }
+
+		    Tcl_ListObjAppendElement(interp, listPtr,
+			Tcl_NewStringObj(zName, -1));
+		}
+	    }
+
+	    Tcl_MutexUnlock(&vfsMutex);
+
+	    Tcl_SetObjResult(interp, listPtr);
+	    return TCL_OK;
+	}
+	case OPT_REMOVE: {
+	    Tcl_HashEntry *hPtr = NULL;
+	    const char *zName;
+
+	    if (objc != 4) {
+		Tcl_WrongNumArgs(interp, 3, objv, "name");
+		return TCL_ERROR;
+	    }
+
+	    zName = Tcl_GetString(objv[3]);
+
+	    Tcl_MutexLock(&vfsMutex);
+
+	    if (vfs.bInitialized)
+		hPtr = Tcl_FindHashEntry(&vfs.files, zName);
+
+	    if (hPtr != NULL) {
+		ReleaseFile((SassVfsFile *)Tcl_GetHashValue(hPtr));
+		Tcl_DeleteHashEntry(hPtr);
+	    }
+
+	    Tcl_MutexUnlock(&vfsMutex);
+
+	    if (hPtr == NULL) {
+		Tcl_AppendResult(interp, "no such virtual file \"", zName,
+		    "\"\n", NULL);
+
+		return TCL_ERROR;
+	    }
+
+	    Tcl_ResetResult(interp);
+	    return TCL_OK;
+	}
+	default: {
+	    Tcl_AppendResult(interp, "bad option index\n", NULL);
+	    return TCL_ERROR;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClearFiles --
+ *
+ *	This function removes all files from the virtual file system.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Files still in use by a compilation are freed once it is done.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ClearFiles(void)
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    Tcl_MutexLock(&vfsMutex);
+
+    if (vfs.bInitialized) {
+	for (hPtr = Tcl_FirstHashEntry(&vfs.files, &search); hPtr != NULL;
+		hPtr = Tcl_NextHashEntry(&search)) {
+	    ReleaseFile((SassVfsFile *)Tcl_GetHashValue(hPtr));
+	}
+
+	Tcl_DeleteHashTable(&vfs.files);
+	vfs.bInitialized = 0;
+    }
+
+    Tcl_MutexUnlock(&vfsMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassVfsFinalize --
+ *
+ *	This function frees all resources used by the virtual file system.
+ *	It is called when the package is unloaded from the process, after
+ *	the worker threads have exited.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	All files are removed from the virtual file system.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void SassVfsFinalize(void)
+{
+    ClearFiles();
+    Tcl_MutexFinalize(&vfsMutex);
+}
@@ -0,0 +1,878 @@
+/*
+ * tclsassWatch.c -- Tcl Package for libsass
+ *
+ * Implements [sass watch], which recompiles entry point stylesheets when the
+ * files they include change.  Changes are detected via the Linux inotify API,
+ * integrated with the Tcl event loop as a file handler.  The folders holding
+ * the included files are watched, rather than the files themselves, because
+ * editors often replace a file by renaming a new one over it.  A reverse
+ * dependency index maps each included file, as reported by libsass, to the
+ * entry points that included it, directly or not.  Changes are coalesced and
+ * debounced by a timer; when it fires, all the affected entry points are
+ * compiled as one batch and their results are delivered to the callback.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <stdio.h>		/* NOTE: For snprintf(). */
+#include <stdlib.h>		/* NOTE: For size_t. */
+#include <string.h>		/* NOTE: For memset(), strcmp(), strrchr(). */
+#if defined(__linux__)
+#include <errno.h>		/* NOTE: For errno. */
+#include <unistd.h>		/* NOTE: For read(), close(). */
+#include <sys/inotify.h>	/* NOTE: For inotify_init1(), etc. */
+#endif
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "pkgVersion.h"		/* NOTE: Package version information. */
+#include "tclsassInt.h"		/* NOTE: For private package API. */
+
+#if defined(__linux__)
+
+/*
+ * NOTE: This is the default number of milliseconds to wait, after the last
+ *       change, before the affected entry points are compiled.  It may be
+ *       changed for each watch via the -delay option.
+ */
+
+#ifndef SASS_WATCH_DEFAULT_DELAY
+  #define SASS_WATCH_DEFAULT_DELAY		(100)
+#endif
+
+/*
+ * NOTE: These are the inotify events that may indicate a changed file within
+ *       a watched folder.
+ */
+
+#define SASS_WATCH_EVENTS \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ATTRIB)
+
+/*
+ * NOTE: This structure holds the state of one watch.  The entry points are
+ *       normalized paths.  The included files are paths reported by libsass,
+ *       which always include the entry point itself.  It is preserved while
+ *       the callback is being evaluated, since that may cancel the watch.
+ */
+
+typedef struct SassWatch {
+    Tcl_Interp *interp;			/* Interpreter for the callback. */
+    Tcl_Obj *tokenPtr;			/* Watch token, for the callback. */
+    Tcl_Obj *commandPtr;		/* The callback command prefix. */
+    Tcl_Obj *optionsPtr;		/* The compile options, as a list. */
+    int delay;				/* Debounce delay, in milliseconds. */
+    int fd;				/* The inotify file descriptor. */
+    Tcl_HashTable folders;		/* Maps watch descriptors to folders. */
+    Tcl_HashTable folderNames;		/* Set of the watched folders. */
+    Tcl_HashTable entries;		/* Maps entry points to includes. */
+    Tcl_HashTable files;		/* Maps included files to entries. */
+    Tcl_HashTable failed;		/* Set of entries that failed. */
+    Tcl_HashTable pending;		/* Set of entries to be compiled. */
+    Tcl_TimerToken timer;		/* Debounce timer, if pending. */
+    int bDeleted;			/* Non-zero once it is cancelled. */
+} SassWatch;
+
+/*
+ * NOTE: This structure holds the watches for one Tcl interpreter, keyed by
+ *       their tokens.
+ */
+
+typedef struct SassWatchTable {
+    Tcl_HashTable watches;		/* Maps tokens to watches. */
+    int nextId;				/* Used to generate tokens. */
+} SassWatchTable;
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static SassWatchTable *	GetWatchTable(Tcl_Interp *interp, int bCreate);
+static void		WatchTableDeleteProc(ClientData clientData,
+			    Tcl_Interp *interp);
+static void		AddFolder(SassWatch *watchPtr, const char *zFile);
+static void		SetIncluded(SassWatch *watchPtr, Tcl_Obj *entryPtr,
+			    Tcl_Obj *includedPtr);
+static void		AddPending(SassWatch *watchPtr, const char *zEntry);
+static void		WatchFileProc(ClientData clientData, int mask);
+static void		WatchTimerProc(ClientData clientData);
+static void		CancelWatch(SassWatch *watchPtr);
+static void		FreeWatch(char *clientData);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetWatchTable --
+ *
+ *	This function returns the table of watches for the specified Tcl
+ *	interpreter, optionally creating it.
+ *
+ * Results:
+ *	The table -OR- NULL if it does not exist.
+ *
+ * Side effects:
+ *	The table may be created and associated with the Tcl interpreter.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SassWatchTable *GetWatchTable(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    int bCreate)			/* IN: Non-zero to create the table. */
+{
+    SassWatchTable *tablePtr;
+
+    tablePtr = (SassWatchTable *)Tcl_GetAssocData(interp,
+	SASS_WATCH_DATA_NAME, NULL);
+
+    if ((tablePtr == NULL) && bCreate) {
+	tablePtr = (SassWatchTable *)ckalloc(sizeof(SassWatchTable));
+	memset(tablePtr, 0, sizeof(SassWatchTable));
+	Tcl_InitHashTable(&tablePtr->watches, TCL_STRING_KEYS);
+
+	Tcl_SetAssocData(interp, SASS_WATCH_DATA_NAME, WatchTableDeleteProc,
+	    tablePtr);
+    }
+
+    return tablePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WatchTableDeleteProc --
+ *
+ *	This function cancels all the watches for a Tcl interpreter and
+ *	frees its table, when it is being deleted -OR- the package is
+ *	being unloaded from it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void WatchTableDeleteProc(
+    ClientData clientData,		/* IN: The watch table. */
+    Tcl_Interp *interp)			/* Not used. */
+{
+    SassWatchTable *tablePtr = (SassWatchTable *)clientData;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    for (hPtr = Tcl_FirstHashEntry(&tablePtr->watches, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	CancelWatch((SassWatch *)Tcl_GetHashValue(hPtr));
+    }
+
+    Tcl_DeleteHashTable(&tablePtr->watches);
+    ckfree((char *)tablePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddFolder --
+ *
+ *	This function starts watching the folder holding the specified
+ *	file, unless it is already being watched.  Failures are ignored,
+ *	e.g. for files from the in-memory virtual file system.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	An inotify watch may be added.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void AddFolder(
+    SassWatch *watchPtr,		/* IN/OUT: The watch. */
+    const char *zFile)			/* IN: The included file. */
+{
+    const char *zSlash = strrchr(zFile, '/');
+    Tcl_DString folder;
+    Tcl_HashEntry *hPtr;
+    int wd;
+    int bNew;
+
+    if (zSlash == NULL)
+	return;
+
+    Tcl_DStringInit(&folder);
+
+    if (zSlash == zFile)
+	Tcl_DStringAppend(&folder, "/", 1);
+    else
+	Tcl_DStringAppend(&folder, zFile, (int)(zSlash - zFile));
+
+    hPtr = Tcl_CreateHashEntry(&watchPtr->folderNames,
+	Tcl_DStringValue(&folder), &bNew);
+
+    if (!bNew)
+	goto done;
+
+    wd = inotify_add_watch(watchPtr->fd, Tcl_DStringValue(&folder),
+	SASS_WATCH_EVENTS | IN_ONLYDIR);
+
+    if (wd < 0) {
+	Tcl_DeleteHashEntry(hPtr);
+	goto done;
+    }
+
+    Tcl_SetHashValue(hPtr, NULL);
+
+    /*
+     * NOTE: The same watch descriptor is returned for a folder that is
+     *       already watched under another name, e.g. via a symbolic link.
+     *       The first name is kept.
+     */
+
+    hPtr = Tcl_CreateHashEntry(&watchPtr->folders, (char *)(size_t)wd,
+	&bNew);
+
+    if (bNew) {
+	char *zFolder = ckalloc(Tcl_DStringLength(&folder) + 1);
+
+	strcpy(zFolder, Tcl_DStringValue(&folder));
+	Tcl_SetHashValue(hPtr, zFolder);
+    }
+
+done:
+    Tcl_DStringFree(&folder);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetIncluded --
+ *
+ *	This function updates the reverse dependency index after an entry
+ *	point was compiled.  When the compilation failed, the list of
+ *	included files is NULL; the previous list is kept, so that fixing
+ *	any of those files triggers another compilation, and the entry
+ *	point is marked as failed, so that creating a missing file does
+ *	as well.  The entry point itself is always included.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Inotify watches may be added.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void SetIncluded(
+    SassWatch *watchPtr,		/* IN/OUT: The watch. */
+    Tcl_Obj *entryPtr,			/* IN: The entry point. */
+    Tcl_Obj *includedPtr)		/* IN: Included files, or NULL. */
+{
+    const char *zEntry = Tcl_GetString(entryPtr);
+    Tcl_HashEntry *hPtr;
+    Tcl_Obj *oldPtr;
+    int objc;
+    Tcl_Obj **objv;
+    int bNew;
+    int index;
+
+    hPtr = Tcl_CreateHashEntry(&watchPtr->entries, zEntry, &bNew);
+    oldPtr = bNew ? NULL : (Tcl_Obj *)Tcl_GetHashValue(hPtr);
+
+    if (includedPtr == NULL) {
+	Tcl_CreateHashEntry(&watchPtr->failed, zEntry, &bNew);
+
+	if (oldPtr != NULL)
+	    return;
+
+	includedPtr = Tcl_NewListObj(1, &entryPtr);
+    } else {
+	Tcl_HashEntry *failedPtr = Tcl_FindHashEntry(&watchPtr->failed,
+	    zEntry);
+
+	if (failedPtr != NULL)
+	    Tcl_DeleteHashEntry(failedPtr);
+
+	if (oldPtr != NULL) {
+	    Tcl_ListObjGetElements(NULL, oldPtr, &objc, &objv);
+
+	    for (index = 0; index < objc; index++) {
+		SassRemoveFromList(&watchPtr->files, Tcl_GetString(objv[index]),
+		    zEntry);
+	    }
+	}
+    }
+
+    Tcl_IncrRefCount(includedPtr);
+    Tcl_ListObjGetElements(NULL, includedPtr, &objc, &objv);
+
+    for (index = 0; index < objc; index++) {
+	SassAddToList(&watchPtr->files, Tcl_GetString(objv[index]), entryPtr);
+	AddFolder(watchPtr, Tcl_GetString(objv[index]));
+    }
+
+    /*
+     * NOTE: The path of the entry point itself may differ from the one
+     *       reported by libsass, e.g. due to symbolic links.
+     */
+
+    SassAddToList(&watchPtr->files, zEntry, entryPtr);
+    AddFolder(watchPtr, zEntry);
+
+    if (oldPtr != NULL)
+	Tcl_DecrRefCount(oldPtr);
+
+    Tcl_SetHashValue(hPtr, includedPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddPending --
+ *
+ *	This function marks an entry point as needing to be compiled and
+ *	then (re)starts the debounce timer, so that the compilation only
+ *	happens once no more changes have been seen for the delay.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A timer handler is created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void AddPending(
+    SassWatch *watchPtr,		/* IN/OUT: The watch. */
+    const char *zEntry)			/* IN: The entry point. */
+{
+    int bNew;
+
+    Tcl_CreateHashEntry(&watchPtr->pending, zEntry, &bNew);
+
+    if (watchPtr->timer != NULL)
+	Tcl_DeleteTimerHandler(watchPtr->timer);
+
+    watchPtr->timer = Tcl_CreateTimerHandler(watchPtr->delay,
+	WatchTimerProc, watchPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WatchFileProc --
+ *
+ *	This function is called by the event loop when the inotify file
+ *	descriptor of a watch is readable.  It reads all the queued events
+ *	and marks the entry points that included each changed file as
+ *	pending.  A changed file that is not included by anything may be
+ *	one that was missing, so the entry points that failed are marked
+ *	as pending too.  If the event queue overflowed, all entry points
+ *	are marked as pending.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The debounce timer may be (re)started.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void WatchFileProc(
+    ClientData clientData,		/* IN: The watch. */
+    int mask)				/* Not used. */
+{
+    SassWatch *watchPtr = (SassWatch *)clientData;
+    char buffer[4096]
+	__attribute__ ((aligned(__alignof__(struct inotify_event))));
+    Tcl_DString path;
+    ssize_t nRead;
+
+    Tcl_DStringInit(&path);
+
+    while ((nRead = read(watchPtr->fd, buffer, sizeof(buffer))) > 0) {
+	char *pEvent = buffer;
+
+	while (pEvent < buffer + nRead) {
+	    const struct inotify_event *eventPtr;
+	    Tcl_HashEntry *hPtr;
+	    Tcl_HashSearch search;
+
+	    eventPtr = (const struct inotify_event *)pEvent;
+	    pEvent += sizeof(struct inotify_event) + eventPtr->len;
+
+	    if (eventPtr->mask & IN_Q_OVERFLOW) {
+		for (hPtr = Tcl_FirstHashEntry(&watchPtr->entries, &search);
+			hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+		    AddPending(watchPtr,
+			Tcl_GetHashKey(&watchPtr->entries, hPtr));
+		}
+
+		continue;
+	    }
+
+	    if (eventPtr->len == 0)
+		continue;
+
+	    hPtr = Tcl_FindHashEntry(&watchPtr->folders,
+		(char *)(size_t)eventPtr->wd);
+
+	    if (hPtr == NULL)
+		continue;
+
+	    Tcl_DStringSetLength(&path, 0);
+	    Tcl_DStringAppend(&path, (char *)Tcl_GetHashValue(hPtr), -1);
+
+	    if (strcmp(Tcl_DStringValue(&path), "/") != 0)
+		Tcl_DStringAppend(&path, "/", 1);
+
+	    Tcl_DStringAppend(&path, eventPtr->name, -1);
+	    hPtr = Tcl_FindHashEntry(&watchPtr->files,
+		Tcl_DStringValue(&path));
+
+	    if (hPtr != NULL) {
+		int objc;
+		Tcl_Obj **objv;
+		int index;
+
+		Tcl_ListObjGetElements(NULL, (Tcl_Obj *)Tcl_GetHashValue(hPtr),
+		    &objc, &objv);
+
+		for (index = 0; index < objc; index++)
+		    AddPending(watchPtr, Tcl_GetString(objv[index]));
+
+		continue;
+	    }
+
+	    for (hPtr = Tcl_FirstHashEntry(&watchPtr->failed, &search);
+		    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+		AddPending(watchPtr, Tcl_GetHashKey(&watchPtr->failed, hPtr));
+	    }
+	}
+    }
+
+    Tcl_DStringFree(&path);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WatchTimerProc --
+ *
+ *	This function is called by the event loop once the debounce delay
+ *	has elapsed.  It compiles all the pending entry points as one batch
+ *	and updates the reverse dependency index.  Then, for each entry
+ *	point, it evaluates the callback at the global level, with the
+ *	watch token, the entry point, and the result dictionary appended
+ *	to it.  Errors are reported as background errors.  The callback
+ *	may cancel the watch, in which case the remaining results are
+ *	discarded.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the callback does.  Worker threads may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void WatchTimerProc(
+    ClientData clientData)		/* IN: The watch. */
+{
+    SassWatch *watchPtr = (SassWatch *)clientData;
+    Tcl_Interp *interp = watchPtr->interp;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    Tcl_Obj **apEntries = NULL;
+    Tcl_Obj **apResults = NULL;
+    Tcl_Obj **apIncluded = NULL;
+    int nEntries = 0;
+    int optc;
+    Tcl_Obj **optv;
+    int index;
+
+    watchPtr->timer = NULL;
+
+    if (watchPtr->pending.numEntries == 0)
+	return;
+
+    apEntries = (Tcl_Obj **)ckalloc(
+	sizeof(Tcl_Obj *) * watchPtr->pending.numEntries * 3);
+
+    apResults = apEntries + watchPtr->pending.numEntries;
+    apIncluded = apResults + watchPtr->pending.numEntries;
+
+    for (hPtr = Tcl_FirstHashEntry(&watchPtr->pending, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	apEntries[nEntries] = Tcl_NewStringObj(
+	    Tcl_GetHashKey(&watchPtr->pending, hPtr), -1);
+
+	Tcl_IncrRefCount(apEntries[nEntries]);
+	nEntries++;
+    }
+
+    Tcl_DeleteHashTable(&watchPtr->pending);
+    Tcl_InitHashTable(&watchPtr->pending, TCL_STRING_KEYS);
+
+    Tcl_Preserve(watchPtr);
+    Tcl_Preserve(interp);
+
+    Tcl_ListObjGetElements(NULL, watchPtr->optionsPtr, &optc, &optv);
+
+    if (SassCompileFiles(interp, optc, optv, nEntries, apEntries, apResults,
+	    apIncluded) != TCL_OK) {
+	Tcl_BackgroundError(interp);
+	goto done;
+    }
+
+    for (index = 0; index < nEntries; index++)
+	SetIncluded(watchPtr, apEntries[index], apIncluded[index]);
+
+    for (index = 0; index < nEntries; index++) {
+	if (!watchPtr->bDeleted && !Tcl_InterpDeleted(interp)) {
+	    Tcl_Obj *scriptPtr = Tcl_DuplicateObj(watchPtr->commandPtr);
+	    int code;
+
+	    Tcl_IncrRefCount(scriptPtr);
+
+	    code = Tcl_ListObjAppendElement(interp, scriptPtr,
+		watchPtr->tokenPtr);
+
+	    if (code == TCL_OK) {
+		code = Tcl_ListObjAppendElement(interp, scriptPtr,
+		    apEntries[index]);
+	    }
+
+	    if (code == TCL_OK) {
+		code = Tcl_ListObjAppendElement(interp, scriptPtr,
+		    apResults[index]);
+	    }
+
+	    if (code == TCL_OK)
+		code = Tcl_EvalObjEx(interp, scriptPtr, TCL_EVAL_GLOBAL);
+
+	    if (code != TCL_OK)
+		Tcl_BackgroundError(interp);
+
+	    Tcl_DecrRefCount(scriptPtr);
+	}
+
+	Tcl_DecrRefCount(apResults[index]);
+
+	if (apIncluded[index] != NULL)
+	    Tcl_DecrRefCount(apIncluded[index]);
+    }
+
+    Tcl_ResetResult(interp);
+
+done:
+    for (index = 0; index < nEntries; index++)
+	Tcl_DecrRefCount(apEntries[index]);
+
+    ckfree((char *)apEntries);
+
+    Tcl_Release(interp);
+    Tcl_Release(watchPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CancelWatch --
+ *
+ *	This function stops a watch, i.e. it removes its file handler and
+ *	timer and closes its inotify file descriptor.  The watch itself is
+ *	freed once it is no longer preserved.  The caller must remove it
+ *	from the table of watches.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void CancelWatch(
+    SassWatch *watchPtr)		/* IN: The watch to cancel. */
+{
+    watchPtr->bDeleted = 1;
+
+    if (watchPtr->timer != NULL) {
+	Tcl_DeleteTimerHandler(watchPtr->timer);
+	watchPtr->timer = NULL;
+    }
+
+    if (watchPtr->fd >= 0) {
+	Tcl_DeleteFileHandler(watchPtr->fd);
+	close(watchPtr->fd);
+	watchPtr->fd = -1;
+    }
+
+    Tcl_EventuallyFree(watchPtr, FreeWatch);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeWatch --
+ *
+ *	This function frees a cancelled watch and everything it owns.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FreeWatch(
+    char *clientData)			/* IN: The watch to free. */
+{
+    SassWatch *watchPtr = (SassWatch *)clientData;
+    Tcl_HashTable *apTables[2];
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    int index;
+
+    for (hPtr = Tcl_FirstHashEntry(&watchPtr->folders, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	ckfree((char *)Tcl_GetHashValue(hPtr));
+    }
+
+    apTables[0] = &watchPtr->entries;
+    apTables[1] = &watchPtr->files;
+
+    for (index = 0; index < 2; index++) {
+	for (hPtr = Tcl_FirstHashEntry(apTables[index], &search);
+		hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	    Tcl_DecrRefCount((Tcl_Obj *)Tcl_GetHashValue(hPtr));
+	}
+    }
+
+    Tcl_DeleteHashTable(&watchPtr->folders);
+    Tcl_DeleteHashTable(&watchPtr->folderNames);
+    Tcl_DeleteHashTable(&watchPtr->entries);
+    Tcl_DeleteHashTable(&watchPtr->files);
+    Tcl_DeleteHashTable(&watchPtr->failed);
+    Tcl_DeleteHashTable(&watchPtr->pending);
+
+    Tcl_DecrRefCount(watchPtr->optionsPtr);
+    Tcl_DecrRefCount(watchPtr->commandPtr);
+    Tcl_DecrRefCount(watchPtr->tokenPtr);
+
+    ckfree((char *)watchPtr);
+}
+
+#endif /* defined(__linux__) */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SassWatchObjCmd --
+ *
+ *	This function handles the [sass watch] sub-command.  It starts a
+ *	new watch and returns its token, or cancels one.  The options are
+ *	the same as for [sass compile], except -cache, -result, and the
+ *	ones for writing the output, along with -command, which is the
+ *	required callback, and -delay, which is the debounce delay in
+ *	milliseconds.  The entry points are compiled right away, via the
+ *	event loop, in order to build the reverse dependency index.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Watches may be created or cancelled.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int SassWatchObjCmd(
+    ClientData clientData,	/* Not used. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+#if defined(__linux__)
+    SassWatchTable *tablePtr;
+    SassWatch *watchPtr;
+    Tcl_HashEntry *hPtr;
+    Tcl_Obj *commandPtr = NULL;
+    Tcl_Obj *optionsPtr;
+    int delay = SASS_WATCH_DEFAULT_DELAY;
+    int optc;
+    Tcl_Obj **optv;
+    char buffer[TCL_INTEGER_SPACE + 10];
+    int bNew;
+    int index;
+
+    if (interp == NULL) {
+	PACKAGE_TRACE(("SassWatchObjCmd: no Tcl interpreter\n"));
+	return TCL_ERROR;
+    }
+
+    if ((objc == 4) && (strcmp(Tcl_GetString(objv[2]), "cancel") == 0)) {
+	tablePtr = GetWatchTable(interp, 0);
+
+	hPtr = (tablePtr != NULL) ? Tcl_FindHashEntry(&tablePtr->watches,
+	    Tcl_GetString(objv[3])) : NULL;
+
+	if (hPtr == NULL) {
+	    Tcl_AppendResult(interp, "invalid watch token \"",
+		Tcl_GetString(objv[3]), "\"\n", NULL);
+
+	    return TCL_ERROR;
+	}
+
+	CancelWatch((SassWatch *)Tcl_GetHashValue(hPtr));
+	Tcl_DeleteHashEntry(hPtr);
+
+	return TCL_OK;
+    }
+
+    optionsPtr = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(optionsPtr);
+
+    for (index = 2; index < objc; index++) {
+	const char *zArg = Tcl_GetString(objv[index]);
+
+	if (strcmp(zArg, "--") == 0) {
+	    index++;
+	    break;
+	}
+
+	if (zArg[0] != '-')
+	    break;
+
+	if ((index + 1) >= objc) {
+	    Tcl_AppendResult(interp, "missing value for option \"", zArg,
+		"\"\n", NULL);
+
+	    goto error;
+	}
+
+	if (strcmp(zArg, "-command") == 0) {
+	    commandPtr = objv[++index];
+	    continue;
+	}
+
+	if (strcmp(zArg, "-delay") == 0) {
+	    if (Tcl_GetIntFromObj(interp, objv[++index], &delay) != TCL_OK)
+		goto error;
+
+	    if (delay < 0) {
+		Tcl_AppendResult(interp, "delay out of range\n", NULL);
+		goto error;
+	    }
+
+	    continue;
+	}
+
+	Tcl_ListObjAppendElement(NULL, optionsPtr, objv[index++]);
+	Tcl_ListObjAppendElement(NULL, optionsPtr, objv[index]);
+    }
+
+    if ((commandPtr == NULL) || (index >= objc)) {
+	Tcl_WrongNumArgs(interp, 2, objv,
+	    "?options? -command callback entry ?entry ...?");
+
+	goto error;
+    }
+
+    /*
+     * NOTE: Check the options now, rather than when the entry points are
+     *       compiled by the event loop.
+     */
+
+    Tcl_ListObjGetElements(NULL, optionsPtr, &optc, &optv);
+
+    if (SassCompileFiles(interp, optc, optv, 0, NULL, NULL,
+	    NULL) != TCL_OK) {
+	goto error;
+    }
+
+    watchPtr = (SassWatch *)attemptckalloc(sizeof(SassWatch));
+
+    if (watchPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: watchPtr\n", NULL);
+	goto error;
+    }
+
+    memset(watchPtr, 0, sizeof(SassWatch));
+    watchPtr->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (watchPtr->fd < 0) {
+	Tcl_SetErrno(errno);
+
+	Tcl_AppendResult(interp, "error creating inotify instance: ",
+	    Tcl_PosixError(interp), "\n", NULL);
+
+	ckfree((char *)watchPtr);
+	goto error;
+    }
+
+    tablePtr = GetWatchTable(interp, 1);
+    snprintf(buffer, sizeof(buffer), "sassWatch%d", ++tablePtr->nextId);
+
+    watchPtr->interp = interp;
+    watchPtr->tokenPtr = Tcl_NewStringObj(buffer, -1);
+    Tcl_IncrRefCount(watchPtr->tokenPtr);
+    watchPtr->commandPtr = commandPtr;
+    Tcl_IncrRefCount(watchPtr->commandPtr);
+    watchPtr->optionsPtr = optionsPtr;
+    watchPtr->delay = delay;
+
+    Tcl_InitHashTable(&watchPtr->folders, TCL_ONE_WORD_KEYS);
+    Tcl_InitHashTable(&watchPtr->folderNames, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&watchPtr->entries, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&watchPtr->files, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&watchPtr->failed, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&watchPtr->pending, TCL_STRING_KEYS);
+
+    hPtr = Tcl_CreateHashEntry(&tablePtr->watches, buffer, &bNew);
+    Tcl_SetHashValue(hPtr, watchPtr);
+
+    Tcl_CreateFileHandler(watchPtr->fd, TCL_READABLE, WatchFileProc,
+	watchPtr);
+
+    /*
+     * NOTE: The entry points are normalized, so that they do not depend on
+     *       the current directory when they are compiled later.  They are
+     *       all compiled once the event loop is entered.
+     */
+
+    for (; index < objc; index++) {
+	Tcl_Obj *entryPtr = Tcl_FSGetNormalizedPath(interp, objv[index]);
+
+	if (entryPtr == NULL)
+	    entryPtr = objv[index];
+
+	SetIncluded(watchPtr, entryPtr, NULL);
+	AddPending(watchPtr, Tcl_GetString(entryPtr));
+    }
+
+    Tcl_DeleteTimerHandler(watchPtr->timer);
+    watchPtr->timer = Tcl_CreateTimerHandler(0, WatchTimerProc, watchPtr);
+
+    Tcl_SetObjResult(interp, watchPtr->tokenPtr);
+    return TCL_OK;
+
+error:
+    Tcl_DecrRefCount(optionsPtr);
+    return TCL_ERROR;
+#else
+    Tcl_AppendResult(interp,
+	"watching files is not supported on this platform\n", NULL);
+
+    return TCL_ERROR;
+#endif
+}
@@ -0,0 +1,316 @@
+#
+# bench.tcl -- Tcl Package for libsass
+#
+# Runs the benchmark suite, i.e. compiles the generated corpora using each
+# context type and output style, and reports the throughput and latency of
+# the [sass compile] sub-command in a machine-readable format, so that the
+# results of different versions can be compared.  It is normally run via
+# "make bench", e.g.:
+#
+#     make bench BENCHFLAGS="-quick -output bench.json"
+#
+# See the file "license.terms" for information on usage and redistribution
+# of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+
+source [file join [file dirname [info script]] corpus.tcl]
+
+namespace eval ::tclsass::bench {
+  #
+  # NOTE: These are the default settings, which may be changed via the
+  #       command line options of the same names.
+  #
+  variable settings
+  array set settings [list \
+      -corpus $corpusKinds -types [list data file] \
+      -styles [list nested expanded compact compressed] \
+      -sizes [list 1 10 50] -time 2000 -iterations 5 -maxIterations 1000 \
+      -format json -output "" -directory "" -load ""]
+
+  variable usage [join [list \
+      "usage: bench.tcl ?-quick? ?-corpus list? ?-types list?" \
+      "?-styles list? ?-sizes megabytes? ?-time milliseconds?" \
+      "?-iterations count? ?-maxIterations count? ?-format json|csv?" \
+      "?-output fileName? ?-directory directory? ?-load script?"] " "]
+
+  #
+  # NOTE: This procedure returns the specified quantile of a sorted list of
+  #       samples, using the nearest-rank method.
+  #
+  proc quantile { samples fraction } {
+    set count [llength $samples]
+    set rank [expr {int(ceil($fraction * $count)) - 1}]
+
+    if {$rank < 0} then {
+      set rank 0
+    }
+
+    return [lindex $samples $rank]
+  }
+
+  #
+  # NOTE: This procedure quotes a string for use within JSON.
+  #
+  proc jsonString { value } {
+    set map [list \\ \\\\ \" \\\" \n \\n \r \\r \t \\t]
+    return \"[string map $map $value]\"
+  }
+
+  #
+  # NOTE: This procedure compiles the specified source repeatedly, after one
+  #       compilation to warm up, until both the minimum number of iterations
+  #       and the time budget are reached -OR- the maximum number of
+  #       iterations is reached.  It returns the result dictionary for one
+  #       benchmark case.
+  #
+  proc runCase { options source } {
+    variable settings
+
+    set result [eval [list sass compile] $options [list $source]]
+
+    if {[dictValue $result errorStatus] != 0} then {
+      return [list error [dictValue $result errorMessage]]
+    }
+
+    set outputBytes [string length [dictValue $result outputString]]
+    set samples [list]; set total 0
+    set budget [expr {$settings(-time) * 1000}]
+
+    while {[llength $samples] < $settings(-maxIterations)} {
+      if {[llength $samples] >= $settings(-iterations) && \
+          $total >= $budget} then {
+        break
+      }
+
+      set start [clock clicks -microseconds]
+      eval [list sass compile] $options [list $source]
+      set elapsed [expr {[clock clicks -microseconds] - $start}]
+
+      lappend samples $elapsed; incr total $elapsed
+    }
+
+    set count [llength $samples]
+    set samples [lsort -integer $samples]
+    set seconds [expr {$total / 1000000.0}]
+
+    if {$seconds <= 0} then {
+      set seconds 0.000001
+    }
+
+    return [list iterations $count outputBytes $outputBytes \
+        minMicroseconds [lindex $samples 0] \
+        meanMicroseconds [expr {$total / $count}] \
+        p50Microseconds [quantile $samples 0.50] \
+        p99Microseconds [quantile $samples 0.99] \
+        maxMicroseconds [lindex $samples end] \
+        compilesPerSecond [format %.2f [expr {$count / $seconds}]] \
+        outputBytesPerSecond [expr {wide($outputBytes * $count / $seconds)}]]
+  }
+
+  #
+  # NOTE: This procedure returns the list of corpora to use, as triplets of
+  #       name, directory, and entry file, generating them as needed.
+  #
+  proc makeCorpora { root } {
+    variable settings
+
+    set corpora [list]
+
+    foreach kind $settings(-corpus) {
+      if {$kind eq "large"} then {
+        foreach megabytes $settings(-sizes) {
+          set name large-${megabytes}mb
+          set directory [file join $root $name]
+
+          puts stderr "generating corpus \"$name\"..."
+
+          lappend corpora $name $directory \
+              [makeCorpus $directory $kind $megabytes]
+        }
+      } else {
+        set directory [file join $root $kind]
+
+        puts stderr "generating corpus \"$kind\"..."
+
+        lappend corpora $kind $directory [makeCorpus $directory $kind]
+      }
+    }
+
+    return $corpora
+  }
+
+  #
+  # NOTE: This procedure formats the results as JSON, i.e. an object with
+  #       information about the environment and an array of results, one
+  #       for each case.
+  #
+  proc formatJson { environment results } {
+    set fields [list]
+
+    foreach {name value} $environment {
+      lappend fields "[jsonString $name]: [jsonString $value]"
+    }
+
+    set cases [list]
+
+    foreach case $results {
+      set members [list]
+
+      foreach {name value} $case {
+        if {[string is double -strict $value]} then {
+          lappend members "[jsonString $name]: $value"
+        } else {
+          lappend members "[jsonString $name]: [jsonString $value]"
+        }
+      }
+
+      lappend cases "    \{[join $members {, }]\}"
+    }
+
+    return "\{\n  [join $fields ",\n  "],\n  \"results\": \[\n[join \
+        $cases ",\n"]\n  \]\n\}"
+  }
+
+  #
+  # NOTE: This procedure formats the results as CSV, with a header line.
+  #       The environment is not included.
+  #
+  proc formatCsv { results } {
+    set columns [list corpus type style inputBytes iterations outputBytes \
+        minMicroseconds meanMicroseconds p50Microseconds p99Microseconds \
+        maxMicroseconds compilesPerSecond outputBytesPerSecond error]
+
+    set lines [list [join $columns ,]]
+
+    foreach case $results {
+      set values [list]
+
+      foreach column $columns {
+        set value [dictValue $case $column]
+
+        if {[regexp {[,"\n]} $value]} then {
+          set value \"[string map [list \" \"\"] $value]\"
+        }
+
+        lappend values $value
+      }
+
+      lappend lines [join $values ,]
+    }
+
+    return [join $lines \n]
+  }
+
+  #
+  # NOTE: This procedure runs the whole benchmark suite and writes the
+  #       results, according to the settings.
+  #
+  proc main { argv } {
+    variable settings
+    variable usage
+
+    for {set index 0} {$index < [llength $argv]} {incr index} {
+      set arg [lindex $argv $index]
+
+      if {$arg eq "-quick"} then {
+        array set settings [list -sizes [list 1] -time 250 -iterations 3]
+        continue
+      }
+
+      if {![info exists settings($arg)] || \
+          $index + 1 >= [llength $argv]} then {
+        error $usage
+      }
+
+      set settings($arg) [lindex $argv [incr index]]
+    }
+
+    if {[lsearch -exact [list json csv] $settings(-format)] == -1} then {
+      error "bad format \"$settings(-format)\": must be json or csv"
+    }
+
+    if {[string length $settings(-load)] > 0} then {
+      uplevel #0 $settings(-load)
+    }
+
+    package require sass
+
+    #
+    # NOTE: The corpora are generated into a temporary directory, which is
+    #       removed afterward, unless a directory was specified.
+    #
+    if {[string length $settings(-directory)] > 0} then {
+      set root $settings(-directory); set keep 1
+    } else {
+      set root [file join [pwd] tclsass-bench-[pid]]; set keep 0
+    }
+
+    set results [list]
+
+    if {[catch {
+      foreach {name directory entry} [makeCorpora $root] {
+        set data [read [set channel [open $entry]]]; close $channel
+
+        foreach type $settings(-types) {
+          foreach style $settings(-styles) {
+            set options [list output_style $style include_path $directory]
+
+            if {$type eq "file"} then {
+              lappend options input_path $entry
+              set source $entry
+            } else {
+              set source $data
+            }
+
+            puts stderr "running $name, -type $type, $style..."
+
+            lappend results [concat [list corpus $name type $type \
+                style $style inputBytes [string length $data]] \
+                [runCase [list -type $type -options $options] $source]]
+          }
+        }
+      }
+    } error]} then {
+      set code 1
+    } else {
+      set code 0
+    }
+
+    if {!$keep} then {
+      file delete -force $root
+    }
+
+    if {$code != 0} then {
+      error $error
+    }
+
+    set version [sass version]
+
+    set environment [list tclsass [package present sass] \
+        libsass [dictValue $version libsass] tcl [info patchlevel] \
+        platform $::tcl_platform(os)-$::tcl_platform(machine) \
+        timestamp [clock format [clock seconds] \
+        -format %Y-%m-%dT%H:%M:%SZ -gmt 1]]
+
+    if {$settings(-format) eq "csv"} then {
+      set text [formatCsv $results]
+    } else {
+      set text [formatJson $environment $results]
+    }
+
+    if {[string length $settings(-output)] > 0} then {
+      writeFile $settings(-output) $text\n
+    } else {
+      puts stdout $text
+    }
+  }
+}
+
+if {[info exists argv0] && \
+    [file tail $argv0] eq [file tail [info script]]} then {
+  if {[catch {::tclsass::bench::main $argv} error]} then {
+    puts stderr $error
+    exit 1
+  }
+
+  exit 0
+}
@@ -0,0 +1,264 @@
+#
+# corpus.tcl -- Tcl Package for libsass
+#
+# Generates the synthetic SCSS corpora used by the benchmark suite.  Each
+# corpus is written to its own directory and has one entry file, which may
+# import any number of partials from that directory.
+#
+# See the file "license.terms" for information on usage and redistribution
+# of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+
+namespace eval ::tclsass::bench {
+  #
+  # NOTE: These are the kinds of corpora that can be generated.  Except for
+  #       "large", whose output size is specified in megabytes, they are all
+  #       generated with a fixed size.
+  #
+  variable corpusKinds [list imports mixins maps large]
+
+  #
+  # NOTE: This procedure returns the value of the specified name within the
+  #       specified dictionary, which may be a plain list.
+  #
+  proc dictValue { dictionary name } {
+    foreach {key value} $dictionary {
+      if {$key eq $name} then {
+        return $value
+      }
+    }
+
+    return ""
+  }
+
+  #
+  # NOTE: This procedure writes the specified data to a file, replacing it.
+  #
+  proc writeFile { fileName data } {
+    set channel [open $fileName {WRONLY CREAT TRUNC}]
+    fconfigure $channel -translation lf -encoding utf-8
+    puts -nonewline $channel $data
+    close $channel
+  }
+
+  #
+  # NOTE: This procedure returns a deterministic color for an integer, so
+  #       that every run generates the same corpora.
+  #
+  proc color { value } {
+    return [format #%06x [expr {($value * 2654435761) & 0xFFFFFF}]]
+  }
+
+  #
+  # NOTE: This procedure generates a tree of partials that are imported by
+  #       each other, to the specified depth and with the specified number
+  #       of children per partial.  Every partial defines a variable, a
+  #       placeholder, a mixin, and a rule that uses all three.  The shared
+  #       "_base.scss" partial is imported by every partial, as a typical
+  #       settings file would be.
+  #
+  proc makeImports { directory {depth 6} {fanout 3} } {
+    writeFile [file join $directory _base.scss] [join [list \
+        "\$base-unit: 4px;" \
+        "\$base-font: Helvetica, Arial, sans-serif;" \
+        "@function units(\$n) { @return \$n * \$base-unit; }" \
+        ""] \n]
+
+    set nodes [list 0]; set next 1; set entry ""
+
+    for {set level 0} {$level < $depth} {incr level} {
+      set children [list]
+
+      foreach node $nodes {
+        set imports [list "\"base\""]
+
+        if {$level < $depth - 1} then {
+          for {set index 0} {$index < $fanout} {incr index} {
+            lappend imports "\"n$next\""
+            lappend children $next
+            incr next
+          }
+        }
+
+        set data [join [list \
+            "@import [join $imports {, }];" \
+            "\$color-$node: [color $node];" \
+            "%box-$node { margin: units([expr {$node % 7}]); }" \
+            "@mixin theme-${node}(\$size) {" \
+            "  color: \$color-$node;" \
+            "  padding: units(\$size);" \
+            "  font-family: \$base-font;" \
+            "}" \
+            ".block-$node {" \
+            "  @include theme-${node}([expr {$node % 5 + 1}]);" \
+            "  @extend %box-$node;" \
+            "  &:hover { color: darken(\$color-$node, 10%); }" \
+            "  .item-$node { border: 1px solid lighten(\$color-$node, 20%); }" \
+            "}" \
+            ""] \n]
+
+        if {$node == 0} then {
+          set entry [file join $directory main.scss]
+          writeFile $entry $data
+        } else {
+          writeFile [file join $directory _n$node.scss] $data
+        }
+      }
+
+      set nodes $children
+    }
+
+    return $entry
+  }
+
+  #
+  # NOTE: This procedure generates a stylesheet that makes heavy use of
+  #       mixins with content blocks and arguments, as well as placeholder
+  #       selectors that are extended by many rules, which is expensive for
+  #       libsass to resolve.
+  #
+  proc makeMixins { directory {mixins 60} {rules 1500} } {
+    set lines [list \
+        "@mixin respond(\$width) {" \
+        "  @media (min-width: \$width) { @content; }" \
+        "}"]
+
+    for {set index 0} {$index < $mixins} {incr index} {
+      lappend lines \
+          "%base-$index { display: block; margin: ${index}px; }" \
+          "@mixin look-${index}(\$a, \$b: [color $index]) {" \
+          "  padding: \$a \$a * 2;" \
+          "  background-color: \$b;" \
+          "  @include respond([expr {320 + $index * 8}]px) {" \
+          "    padding: \$a * 3;" \
+          "  }" \
+          "}"
+    }
+
+    for {set index 0} {$index < $rules} {incr index} {
+      set one [expr {$index % $mixins}]
+      set two [expr {($index * 7) % $mixins}]
+
+      lappend lines \
+          ".rule-$index, .alt-$index > a {" \
+          "  @extend %base-$one;" \
+          "  @extend %base-$two;" \
+          "  @include look-${one}([expr {$index % 9 + 1}]px);" \
+          "  &.is-active { @include look-${two}(2px, red); }" \
+          "}"
+    }
+
+    set entry [file join $directory main.scss]
+    writeFile $entry [join $lines \n]\n
+
+    return $entry
+  }
+
+  #
+  # NOTE: This procedure generates a stylesheet based on large, nested maps,
+  #       which are iterated and looked up, as design token stylesheets do.
+  #
+  proc makeMaps { directory {entries 400} } {
+    set pairs [list]
+
+    for {set index 0} {$index < $entries} {incr index} {
+      lappend pairs [format \
+          "  token-%d: (color: %s, size: %dpx, weight: %d, name: \"t%d\")" \
+          $index [color $index] [expr {$index % 48 + 8}] \
+          [expr {($index % 9 + 1) * 100}] $index]
+    }
+
+    set lines [list \
+        "\$tokens: (" [join $pairs ",\n"] ");" \
+        "@function token(\$key, \$field) {" \
+        "  @return map-get(map-get(\$tokens, \$key), \$field);" \
+        "}" \
+        "@each \$key, \$token in \$tokens {" \
+        "  .#{\$key} {" \
+        "    color: map-get(\$token, color);" \
+        "    font-size: map-get(\$token, size);" \
+        "    font-weight: map-get(\$token, weight);" \
+        "    &::after { content: map-get(\$token, name); }" \
+        "  }" \
+        "}" \
+        "\$merged: ();" \
+        "@for \$i from 0 to [expr {$entries / 4}] {" \
+        "  \$merged: map-merge(\$merged, (k#{\$i}: token(token-#{\$i}, size)));" \
+        "}" \
+        ".summary { count: length(\$merged); last: map-get(\$merged," \
+        "  k[expr {$entries / 4 - 1}]); }"]
+
+    set entry [file join $directory main.scss]
+    writeFile $entry [join $lines \n]\n
+
+    return $entry
+  }
+
+  #
+  # NOTE: This procedure returns the source for the "large" corpus, given
+  #       the number of rows.  Half of the rows are literal, so that parsing
+  #       is measured as well; the rest are generated by a loop.
+  #
+  proc largeSource { rows } {
+    set lines [list \
+        "\$rows: $rows;" \
+        "@mixin cell(\$i) {" \
+        "  margin: (\$i % 8) * 1px;" \
+        "  width: percentage((\$i % 100) / 100);" \
+        "}"]
+
+    set literal [expr {$rows / 2}]
+
+    for {set index 0} {$index < $literal} {incr index} {
+      lappend lines ".row-$index { color: [color $index];\
+          .cell { @include cell($index); } }"
+    }
+
+    lappend lines \
+        "@for \$i from $literal to \$rows {" \
+        "  .row-#{\$i} { color: mix(red, blue, percentage(\$i / \$rows));" \
+        "    .cell { @include cell(\$i); } }" \
+        "}"
+
+    return [join $lines \n]\n
+  }
+
+  #
+  # NOTE: This procedure generates a stylesheet whose "expanded" output is
+  #       approximately the specified number of megabytes.  The number of
+  #       rows is calibrated by compiling a small sample first.
+  #
+  proc makeLarge { directory megabytes } {
+    set sample 1000
+
+    set result [sass compile -options [list output_style expanded] \
+        [largeSource $sample]]
+
+    set bytes [string length [dictValue $result outputString]]
+    set rows [expr {int($megabytes * 1048576.0 * $sample / $bytes)}]
+
+    set entry [file join $directory main.scss]
+    writeFile $entry [largeSource $rows]
+
+    return $entry
+  }
+
+  #
+  # NOTE: This procedure generates one corpus into the specified directory,
+  #       which is created if necessary, and returns the name of its entry
+  #       file.
+  #
+  proc makeCorpus { directory kind {megabytes 1} } {
+    file mkdir $directory
+
+    switch -exact -- $kind {
+      imports {return [makeImports $directory]}
+      mixins {return [makeMixins $directory]}
+      maps {return [makeMaps $directory]}
+      large {return [makeLarge $directory $megabytes]}
+      default {
+        error "unknown corpus \"$kind\", must be: [join \
+            $::tclsass::bench::corpusKinds {, }]"
+      }
+    }
+  }
+}
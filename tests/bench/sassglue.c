@@ -0,0 +1,800 @@
+/*
+ * sassglue.c -- Tcl Package for libsass
+ *
+ * Implements a standalone microbenchmark for the overhead of the Tcl binding,
+ * i.e. the glue code that [sass compile] runs around the call into libsass.
+ * This program includes "tclsass.c", so that its static functions can be
+ * called directly, and is linked with the other objects of the package and
+ * with libsass, Tcl, and the Tcl stubs library.  The package is initialized
+ * within an embedded Tcl interpreter.  Each stage is timed separately, in
+ * batches, and the calls to the C allocator are counted, so that the cost of
+ * the glue can be compared with that of the real libsass compile.  It is
+ * normally run via "make bench-glue", e.g.:
+ *
+ *     make bench-glue GLUEFLAGS="-iterations 100000"
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tclsass.c"		/* NOTE: For the static functions. */
+
+/*
+ * NOTE: This is the number of calls made per batch.  Any setup needed by a
+ *       stage, e.g. creating a context to be deleted, is done for the whole
+ *       batch before it is timed, and undone afterward.
+ */
+
+#ifndef GLUE_BATCH_SIZE
+  #define GLUE_BATCH_SIZE			(256)
+#endif
+
+#ifndef GLUE_ITERATIONS
+  #define GLUE_ITERATIONS			(20480)
+#endif
+
+/*
+ * NOTE: These are the stages that are timed, in the order they are run by
+ *       [sass compile].  The last two are the whole glue with a no-op compile,
+ *       i.e. without calling sass_compile_*_context(), and the whole command,
+ *       with the real libsass compile.
+ */
+
+enum Glue_Stage {
+    GLUE_MAKE_OPTIONS,			/* sass_make_options() */
+    GLUE_PROCESS_OPTIONS,		/* ProcessContextOptions() */
+    GLUE_STRDUP,			/* strdup() of the source */
+    GLUE_NEW_CONTEXT,			/* NewContext(), including the above */
+    GLUE_COMPILE,			/* sass_compile_*_context() */
+    GLUE_SET_RESULT,			/* SetResultFromContext() */
+    GLUE_DELETE_CONTEXT,		/* DeleteContext() */
+    GLUE_NOOP_TOTAL,			/* All of the glue, no-op compile */
+    GLUE_COMMAND,			/* [sass compile], via Tcl_EvalObjv() */
+    GLUE_MAX				/* Number of stages, not a stage. */
+};
+
+static const char *azStageNames[] = {
+    "sass_make_options", "ProcessContextOptions", "strdup", "NewContext",
+    "libsass compile", "SetResultFromContext", "DeleteContext",
+    "glue, no-op compile", "sass compile", NULL
+};
+
+/*
+ * NOTE: This structure holds the state for one batch of calls.  The settings
+ *       are always initialized, so that they can always be released.
+ */
+
+typedef struct GlueBatch {
+    Tcl_Interp *interp;			/* The embedded Tcl interpreter. */
+    int objc;				/* Number of [sass compile] arguments. */
+    Tcl_Obj **objv;			/* The [sass compile] arguments. */
+    const char *zSource;		/* The source string or file. */
+    struct Sass_Options *apOpts[GLUE_BATCH_SIZE];
+    SassCompileSettings aSettings[GLUE_BATCH_SIZE];
+    struct Sass_Context *apCtx[GLUE_BATCH_SIZE];
+    char *azDup[GLUE_BATCH_SIZE];
+} GlueBatch;
+
+/*
+ * NOTE: When using glibc, the C allocator is wrapped in order to count the
+ *       allocations made by each stage, including those made by libsass and
+ *       by the C++ runtime.  Since Tcl uses its own per-thread allocator in
+ *       threaded builds, most Tcl_Alloc() calls are served from its caches
+ *       and are not counted.
+ */
+
+#if defined(__GLIBC__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static Tcl_WideUInt allocCount = 0;
+
+void *malloc(
+    size_t size)
+{
+    allocCount++;
+    return __libc_malloc(size);
+}
+
+void *calloc(
+    size_t count,
+    size_t size)
+{
+    allocCount++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(
+    void *ptr,
+    size_t size)
+{
+    allocCount++;
+    return __libc_realloc(ptr, size);
+}
+
+#define GLUE_ALLOC_COUNT()		(allocCount)
+#else
+#define GLUE_ALLOC_COUNT()		(0)
+#endif
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static void		InitSettings(SassCompileSettings *settingsPtr);
+static void		FreeSettings(SassCompileSettings *settingsPtr);
+static int		MakeOptions(GlueBatch *batchPtr, int index);
+static int		MakeContext(GlueBatch *batchPtr, int index,
+			    int bCompile);
+static void		CompileGlueContext(enum Sass_Context_Type type,
+			    struct Sass_Context *ctxPtr);
+static void		ResetBatch(GlueBatch *batchPtr);
+static int		SetupStage(GlueBatch *batchPtr,
+			    enum Glue_Stage stage);
+static int		RunStage(GlueBatch *batchPtr, enum Glue_Stage stage);
+static int		CompareDoubles(const void *pLeft,
+			    const void *pRight);
+static int		TimeStage(GlueBatch *batchPtr, enum Glue_Stage stage,
+			    int rounds, double *nsPtr, double *allocsPtr);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitSettings --
+ *
+ *	This function initializes the specified settings, the same way
+ *	that SassObjCmd does.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void InitSettings(
+    SassCompileSettings *settingsPtr)	/* OUT: The settings to init. */
+{
+    memset(settingsPtr, 0, sizeof(SassCompileSettings));
+    settingsPtr->type = SASS_CONTEXT_NULL;
+    Tcl_DStringInit(&settingsPtr->key);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeSettings --
+ *
+ *	This function releases everything owned by the specified settings,
+ *	the same way that SassObjCmd does, and then initializes them again.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void FreeSettings(
+    SassCompileSettings *settingsPtr)	/* IN/OUT: The settings to free. */
+{
+    Tcl_DStringFree(&settingsPtr->key);
+
+    if (settingsPtr->sourceMapFilePtr != NULL)
+	Tcl_DecrRefCount(settingsPtr->sourceMapFilePtr);
+
+    if (settingsPtr->fsPtr != NULL)
+	SassFsDelete(settingsPtr->fsPtr);
+
+    if (settingsPtr->funcsPtr != NULL)
+	SassFuncUnbind(settingsPtr->funcsPtr);
+
+    if (settingsPtr->varsPtr != NULL)
+	SassVarsRelease(settingsPtr->varsPtr);
+
+    InitSettings(settingsPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MakeOptions --
+ *
+ *	This function creates the options for the specified call within the
+ *	batch and processes the [sass compile] arguments into them.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int MakeOptions(
+    GlueBatch *batchPtr,		/* IN/OUT: The batch. */
+    int index)				/* IN: The call within the batch. */
+{
+    int argIndex = 2; /* NOTE: Start right after "sass compile". */
+
+    batchPtr->apOpts[index] = sass_make_options();
+
+    if (batchPtr->apOpts[index] == NULL) {
+	Tcl_AppendResult(batchPtr->interp, "out of memory: optsPtr\n", NULL);
+	return TCL_ERROR;
+    }
+
+    return ProcessContextOptions(batchPtr->interp, batchPtr->objc,
+	batchPtr->objv, &argIndex, &batchPtr->aSettings[index],
+	batchPtr->apOpts[index]);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MakeContext --
+ *
+ *	This function creates the context for the specified call within the
+ *	batch, optionally compiling it as well.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The options are owned by the context.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int MakeContext(
+    GlueBatch *batchPtr,		/* IN/OUT: The batch. */
+    int index,				/* IN: The call within the batch. */
+    int bCompile)			/* IN: Non-zero to compile it. */
+{
+    enum Sass_Context_Type type;
+    Tcl_WideUInt dataLength;
+    const char *zError = NULL;
+
+    if (MakeOptions(batchPtr, index) != TCL_OK)
+	return TCL_ERROR;
+
+    type = batchPtr->aSettings[index].type;
+
+    batchPtr->apCtx[index] = NewContext(type, &batchPtr->apOpts[index],
+	batchPtr->zSource, &batchPtr->azDup[index], &dataLength, &zError);
+
+    if (batchPtr->apCtx[index] == NULL) {
+	Tcl_AppendResult(batchPtr->interp, zError, NULL);
+	return TCL_ERROR;
+    }
+
+    if (bCompile)
+	CompileGlueContext(type, batchPtr->apCtx[index]);
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileGlueContext --
+ *
+ *	This function compiles the specified context using libsass, without
+ *	any of the glue used by CompileContext.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void CompileGlueContext(
+    enum Sass_Context_Type type,	/* IN: The context type. */
+    struct Sass_Context *ctxPtr)	/* IN/OUT: The context to compile. */
+{
+    if (type == SASS_CONTEXT_FILE)
+	sass_compile_file_context((struct Sass_File_Context *)ctxPtr);
+    else
+	sass_compile_data_context((struct Sass_Data_Context *)ctxPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResetBatch --
+ *
+ *	This function frees everything created for the batch, whether by
+ *	the setup of a stage or by the stage itself.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void ResetBatch(
+    GlueBatch *batchPtr)		/* IN/OUT: The batch. */
+{
+    int index;
+
+    for (index = 0; index < GLUE_BATCH_SIZE; index++) {
+	if (batchPtr->apCtx[index] != NULL) {
+	    /*
+	     * NOTE: The source copy is owned by the context, unless the
+	     *       TCLSASS_CALLER_FREE option is used, in which case it
+	     *       is freed by DeleteContext.
+	     */
+
+	    DeleteContext(batchPtr->aSettings[index].type,
+		batchPtr->apCtx[index], batchPtr->azDup[index]);
+	} else if (batchPtr->azDup[index] != NULL) {
+	    free(batchPtr->azDup[index]);
+	}
+
+	batchPtr->apCtx[index] = NULL;
+	batchPtr->azDup[index] = NULL;
+
+	DeleteOptions(batchPtr->apOpts[index]);
+	batchPtr->apOpts[index] = NULL;
+
+	FreeSettings(&batchPtr->aSettings[index]);
+    }
+
+    Tcl_ResetResult(batchPtr->interp);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetupStage --
+ *
+ *	This function prepares the batch for the specified stage, i.e. does
+ *	all of the preceding stages for every call within the batch.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int SetupStage(
+    GlueBatch *batchPtr,		/* IN/OUT: The batch. */
+    enum Glue_Stage stage)		/* IN: The stage to prepare for. */
+{
+    int index;
+    int code = TCL_OK;
+
+    for (index = 0; index < GLUE_BATCH_SIZE; index++) {
+	switch (stage) {
+	    case GLUE_PROCESS_OPTIONS: {
+		batchPtr->apOpts[index] = sass_make_options();
+
+		if (batchPtr->apOpts[index] == NULL) {
+		    Tcl_AppendResult(batchPtr->interp,
+			"out of memory: optsPtr\n", NULL);
+
+		    code = TCL_ERROR;
+		}
+		break;
+	    }
+	    case GLUE_NEW_CONTEXT: {
+		code = MakeOptions(batchPtr, index);
+		break;
+	    }
+	    case GLUE_COMPILE: {
+		code = MakeContext(batchPtr, index, 0);
+		break;
+	    }
+	    case GLUE_SET_RESULT:
+	    case GLUE_DELETE_CONTEXT: {
+		code = MakeContext(batchPtr, index, 1);
+		break;
+	    }
+	    default: {
+		break;
+	    }
+	}
+
+	if (code != TCL_OK)
+	    break;
+    }
+
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RunStage --
+ *
+ *	This function runs the specified stage for every call within the
+ *	batch.  This is the part that is timed.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The result of the Tcl interpreter is reset.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int RunStage(
+    GlueBatch *batchPtr,		/* IN/OUT: The batch. */
+    enum Glue_Stage stage)		/* IN: The stage to run. */
+{
+    Tcl_Interp *interp = batchPtr->interp;
+    Tcl_Time startTime;
+    Tcl_WideUInt dataLength;
+    SassResult result;
+    const char *zError = NULL;
+    int index;
+
+    Tcl_GetTime(&startTime);
+
+    for (index = 0; index < GLUE_BATCH_SIZE; index++) {
+	SassCompileSettings *settingsPtr = &batchPtr->aSettings[index];
+
+	switch (stage) {
+	    case GLUE_MAKE_OPTIONS: {
+		batchPtr->apOpts[index] = sass_make_options();
+		break;
+	    }
+	    case GLUE_PROCESS_OPTIONS: {
+		int argIndex = 2;
+
+		if (ProcessContextOptions(interp, batchPtr->objc,
+			batchPtr->objv, &argIndex, settingsPtr,
+			batchPtr->apOpts[index]) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+		break;
+	    }
+	    case GLUE_STRDUP: {
+		batchPtr->azDup[index] = strdup(batchPtr->zSource);
+		break;
+	    }
+	    case GLUE_NEW_CONTEXT: {
+		batchPtr->apCtx[index] = NewContext(settingsPtr->type,
+		    &batchPtr->apOpts[index], batchPtr->zSource,
+		    &batchPtr->azDup[index], &dataLength, &zError);
+
+		if (batchPtr->apCtx[index] == NULL) {
+		    Tcl_AppendResult(interp, zError, NULL);
+		    return TCL_ERROR;
+		}
+		break;
+	    }
+	    case GLUE_COMPILE: {
+		CompileGlueContext(settingsPtr->type,
+		    batchPtr->apCtx[index]);
+		break;
+	    }
+	    case GLUE_SET_RESULT: {
+		GetResultFromContext(batchPtr->apCtx[index], &result);
+
+		if (SetResultFromContext(interp, batchPtr->apCtx[index],
+			&result, NULL, 0, &startTime,
+			settingsPtr) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+
+		Tcl_ResetResult(interp);
+		break;
+	    }
+	    case GLUE_DELETE_CONTEXT: {
+		DeleteContext(settingsPtr->type, batchPtr->apCtx[index],
+		    batchPtr->azDup[index]);
+
+		batchPtr->apCtx[index] = NULL;
+		batchPtr->azDup[index] = NULL;
+		break;
+	    }
+	    case GLUE_NOOP_TOTAL: {
+		enum Sass_Context_Type type;
+
+		if (MakeContext(batchPtr, index, 0) != TCL_OK)
+		    return TCL_ERROR;
+
+		type = settingsPtr->type;
+
+		GetResultFromContext(batchPtr->apCtx[index], &result);
+
+		if (SetResultFromContext(interp, batchPtr->apCtx[index],
+			&result, NULL, 0, &startTime,
+			settingsPtr) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+
+		Tcl_ResetResult(interp);
+
+		DeleteContext(type, batchPtr->apCtx[index],
+		    batchPtr->azDup[index]);
+
+		batchPtr->apCtx[index] = NULL;
+		batchPtr->azDup[index] = NULL;
+
+		FreeSettings(settingsPtr);
+		break;
+	    }
+	    case GLUE_COMMAND: {
+		if (Tcl_EvalObjv(interp, batchPtr->objc, batchPtr->objv,
+			0) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+
+		Tcl_ResetResult(interp);
+		break;
+	    }
+	    default: {
+		Tcl_AppendResult(interp, "bad stage\n", NULL);
+		return TCL_ERROR;
+	    }
+	}
+    }
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareDoubles --
+ *
+ *	This function compares two doubles, for use with qsort().
+ *
+ * Results:
+ *	Negative, zero, or positive.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CompareDoubles(
+    const void *pLeft,			/* IN: The first double. */
+    const void *pRight)			/* IN: The second double. */
+{
+    double left = *(const double *)pLeft;
+    double right = *(const double *)pRight;
+
+    return (left < right) ? -1 : (left > right) ? 1 : 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimeStage --
+ *
+ *	This function times the specified stage over the specified number
+ *	of batches, after one batch to warm up.  Only the calls made by
+ *	the stage itself are timed and counted, not its setup.
+ *
+ * Results:
+ *	A standard Tcl result.  The median time per call, over all of the
+ *	batches, and the mean number of allocations per call are returned.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int TimeStage(
+    GlueBatch *batchPtr,		/* IN/OUT: The batch. */
+    enum Glue_Stage stage,		/* IN: The stage to time. */
+    int rounds,				/* IN: The number of batches. */
+    double *nsPtr,			/* OUT: Nanoseconds per call. */
+    double *allocsPtr)			/* OUT: Allocations per call. */
+{
+    double *aNs;
+    Tcl_WideUInt allocs = 0;
+    int round;
+    int code = TCL_OK;
+
+    aNs = (double *)ckalloc(rounds * sizeof(double));
+
+    for (round = -1; round < rounds; round++) {
+	Tcl_WideUInt startTime;
+	Tcl_WideUInt startAllocs;
+
+	code = SetupStage(batchPtr, stage);
+
+	if (code != TCL_OK)
+	    break;
+
+	startAllocs = GLUE_ALLOC_COUNT();
+	startTime = SassStatsNow();
+
+	code = RunStage(batchPtr, stage);
+
+	if (round >= 0) {
+	    aNs[round] = (double)(SassStatsNow() - startTime) /
+		GLUE_BATCH_SIZE;
+
+	    allocs += GLUE_ALLOC_COUNT() - startAllocs;
+	}
+
+	if (code != TCL_OK)
+	    break;
+
+	ResetBatch(batchPtr);
+    }
+
+    if (code == TCL_OK) {
+	qsort(aNs, rounds, sizeof(double), CompareDoubles);
+
+	*nsPtr = aNs[rounds / 2];
+	*allocsPtr = (double)allocs / ((double)rounds * GLUE_BATCH_SIZE);
+    }
+
+    ckfree((char *)aNs);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * main --
+ *
+ *	This function is the entry point of the program.  It creates the
+ *	embedded Tcl interpreter, initializes the package within it, times
+ *	every stage, and reports the results on standard output.
+ *
+ * Results:
+ *	Zero on success, non-zero on failure.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int main(
+    int argc,				/* Number of arguments. */
+    char **argv)			/* The array of arguments. */
+{
+    Tcl_Interp *interp;
+    GlueBatch *batchPtr;
+    const char *zType = "data";
+    const char *zOptions = "output_style compressed";
+    const char *zSource = ".a { color: red; .b { margin: 1px 2px; } }";
+    int iterations = GLUE_ITERATIONS;
+    int rounds;
+    int argIndex;
+    int index;
+    double aNs[GLUE_MAX];
+    double aAllocs[GLUE_MAX];
+    int code = TCL_OK;
+
+    for (argIndex = 1; argIndex < argc; argIndex++) {
+	if ((argIndex + 1 < argc) &&
+		(strcmp(argv[argIndex], "-iterations") == 0)) {
+	    iterations = atoi(argv[++argIndex]);
+	} else if ((argIndex + 1 < argc) &&
+		(strcmp(argv[argIndex], "-type") == 0)) {
+	    zType = argv[++argIndex];
+	} else if ((argIndex + 1 < argc) &&
+		(strcmp(argv[argIndex], "-options") == 0)) {
+	    zOptions = argv[++argIndex];
+	} else if ((argIndex + 1 == argc) && (argv[argIndex][0] != '-')) {
+	    zSource = argv[argIndex];
+	} else {
+	    fprintf(stderr, "usage: %s ?-iterations count? "
+		"?-type data|file? ?-options dictionary? ?source?\n",
+		argv[0]);
+
+	    return 1;
+	}
+    }
+
+    if (iterations < GLUE_BATCH_SIZE)
+	iterations = GLUE_BATCH_SIZE;
+
+    rounds = iterations / GLUE_BATCH_SIZE;
+
+    /*
+     * NOTE: The Tcl stubs table cannot be used until it is initialized via
+     *       the new Tcl interpreter; therefore, that must be created via the
+     *       real function.
+     */
+
+    Tcl_FindExecutable(argv[0]);
+    interp = (Tcl_CreateInterp)();
+
+    if ((interp == NULL) ||
+	    (Tcl_InitStubs(interp, PACKAGE_TCL_VERSION, 0) == NULL)) {
+	fprintf(stderr, "%s: Tcl stubs were not initialized\n", argv[0]);
+	return 1;
+    }
+
+    if (Sass_Init(interp) != TCL_OK) {
+	fprintf(stderr, "%s: %s\n", argv[0], Tcl_GetStringResult(interp));
+	return 1;
+    }
+
+    batchPtr = (GlueBatch *)ckalloc(sizeof(GlueBatch));
+    memset(batchPtr, 0, sizeof(GlueBatch));
+
+    for (index = 0; index < GLUE_BATCH_SIZE; index++)
+	InitSettings(&batchPtr->aSettings[index]);
+
+    /*
+     * NOTE: The same argument objects are used for every call, as they are
+     *       for a [sass compile] within a procedure body; therefore, the
+     *       options dictionary is only validated once.
+     */
+
+    batchPtr->interp = interp;
+    batchPtr->zSource = zSource;
+    batchPtr->objc = 7;
+    batchPtr->objv = (Tcl_Obj **)ckalloc(7 * sizeof(Tcl_Obj *));
+    batchPtr->objv[0] = Tcl_NewStringObj(COMMAND_NAME, -1);
+    batchPtr->objv[1] = Tcl_NewStringObj("compile", -1);
+    batchPtr->objv[2] = Tcl_NewStringObj("-type", -1);
+    batchPtr->objv[3] = Tcl_NewStringObj(zType, -1);
+    batchPtr->objv[4] = Tcl_NewStringObj("-options", -1);
+    batchPtr->objv[5] = Tcl_NewStringObj(zOptions, -1);
+    batchPtr->objv[6] = Tcl_NewStringObj(zSource, -1);
+
+    for (index = 0; index < batchPtr->objc; index++)
+	Tcl_IncrRefCount(batchPtr->objv[index]);
+
+    for (index = 0; index < GLUE_MAX; index++) {
+	code = TimeStage(batchPtr, (enum Glue_Stage)index, rounds,
+	    &aNs[index], &aAllocs[index]);
+
+	if (code != TCL_OK) {
+	    fprintf(stderr, "%s: %s: %s\n", argv[0], azStageNames[index],
+		Tcl_GetStringResult(interp));
+
+	    break;
+	}
+    }
+
+    if (code == TCL_OK) {
+	printf("libsass %s, %d calls per stage, %d byte %s source\n\n",
+	    libsass_version(), rounds * GLUE_BATCH_SIZE,
+	    (int)strlen(zSource), zType);
+
+	printf("%-24s %12s %12s\n", "stage", "ns/call", "allocs/call");
+
+	for (index = 0; index < GLUE_MAX; index++) {
+	    printf("%-24s %12.1f %12.2f\n", azStageNames[index], aNs[index],
+		aAllocs[index]);
+	}
+
+#if !defined(__GLIBC__)
+	printf("\nallocations are only counted when using glibc\n");
+#endif
+    }
+
+    ResetBatch(batchPtr);
+
+    for (index = 0; index < batchPtr->objc; index++)
+	Tcl_DecrRefCount(batchPtr->objv[index]);
+
+    ckfree((char *)batchPtr->objv);
+    ckfree((char *)batchPtr);
+
+    Tcl_DeleteInterp(interp);
+    Tcl_Finalize();
+
+    return (code == TCL_OK) ? 0 : 1;
+}
@@ -0,0 +1,492 @@
+/*
+ * sassstubs.c -- Tcl Package for libsass
+ *
+ * Implements a small test extension that uses the public C API of this
+ * package only via its stubs table, exactly as other extensions would, i.e.
+ * it defines USE_SASS_STUBS, is linked against the stub library, and calls
+ * Sass_InitStubs.  It provides the [sassstubs] command, which is used by the
+ * test suite.  The results of Sass_CompileEx are kept, by name, until they
+ * are freed, so that the lifetime of their borrowed strings can be checked
+ * from Tcl.  It is normally built and loaded via "make test".
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifndef USE_SASS_STUBS
+#define USE_SASS_STUBS
+#endif
+
+#include <stdio.h>		/* NOTE: For snprintf(). */
+#include <stdlib.h>		/* NOTE: For malloc(), free(). */
+#include <string.h>		/* NOTE: For memset(), strlen(). */
+#include "sass.h"		/* NOTE: For public libsass API. */
+#include "tcl.h"		/* NOTE: For public Tcl API. */
+#include "tclsass.h"		/* NOTE: For public package API. */
+
+/*
+ * NOTE: This is the name of the Sass function registered by the
+ *       [sassstubs register] sub-command.  It returns its numeric argument
+ *       multiplied by two.
+ */
+
+#define STUBS_FUNCTION_NAME		"stubs-twice"
+#define STUBS_FUNCTION_SIGNATURE	STUBS_FUNCTION_NAME "($n)"
+
+/*
+ * NOTE: This is the per-interpreter state of the [sassstubs] command, i.e.
+ *       the results that have not been freed yet, keyed by their names.
+ */
+
+typedef struct StubsState {
+    Tcl_HashTable results;		/* Sass_CompileResult, by name. */
+    int nextId;				/* Used to name the next result. */
+} StubsState;
+
+/*
+ * NOTE: Private functions defined in this file.
+ */
+
+static union Sass_Value *TwiceProc(const union Sass_Value *argsPtr,
+			    void *clientData, struct Sass_Compiler *compiler);
+static Sass_CompileResult *GetResultFromObj(Tcl_Interp *interp,
+			    StubsState *statePtr, Tcl_Obj *objPtr,
+			    Tcl_HashEntry **pHPtr);
+static int		CompileStubsObjCmd(Tcl_Interp *interp,
+			    StubsState *statePtr, int objc,
+			    Tcl_Obj *CONST objv[]);
+static int		StubsObjCmd(ClientData clientData, Tcl_Interp *interp,
+			    int objc, Tcl_Obj *CONST objv[]);
+static void		StubsObjCmdDeleteProc(ClientData clientData);
+
+/*
+ * NOTE: This is the public function of this test extension.
+ */
+
+DLLEXPORT int		Sassstubs_Init(Tcl_Interp *interp);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TwiceProc --
+ *
+ *	This function implements the Sass function registered by the
+ *	[sassstubs register] sub-command.
+ *
+ * Results:
+ *	The argument multiplied by two -OR- a Sass error value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static union Sass_Value *TwiceProc(
+    const union Sass_Value *argsPtr,	/* IN: The Sass list of arguments. */
+    void *clientData,			/* Not used. */
+    struct Sass_Compiler *compiler)	/* Not used. */
+{
+    const union Sass_Value *valuePtr;
+
+    if (sass_list_get_length(argsPtr) != 1)
+	return sass_make_error("wrong # args");
+
+    valuePtr = sass_list_get_value(argsPtr, 0);
+
+    if (!sass_value_is_number(valuePtr))
+	return sass_make_error("expected a number");
+
+    return sass_make_number(sass_number_get_value(valuePtr) * 2,
+	sass_number_get_unit(valuePtr));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetResultFromObj --
+ *
+ *	This function looks up a result kept by the [sassstubs] command
+ *	by its name.
+ *
+ * Results:
+ *	The result -OR- NULL if it was not found, in which case the Tcl
+ *	interpreter result contains the reason.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Sass_CompileResult *GetResultFromObj(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    StubsState *statePtr,		/* IN: The command state. */
+    Tcl_Obj *objPtr,			/* IN: The name of the result. */
+    Tcl_HashEntry **pHPtr)		/* OUT: Its hash table entry. */
+{
+    Tcl_HashEntry *hPtr;
+
+    hPtr = Tcl_FindHashEntry(&statePtr->results, Tcl_GetString(objPtr));
+
+    if (hPtr == NULL) {
+	Tcl_AppendResult(interp, "result \"", Tcl_GetString(objPtr),
+	    "\" not found\n", NULL);
+
+	return NULL;
+    }
+
+    *pHPtr = hPtr;
+    return (Sass_CompileResult *)Tcl_GetHashValue(hPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileStubsObjCmd --
+ *
+ *	Handles the [sassstubs compile] sub-command, which compiles the
+ *	source via the Sass_CompileEx function and keeps the result.
+ *
+ * Results:
+ *	A standard Tcl result.  Upon success, the Tcl interpreter result
+ *	is the name of the kept result.
+ *
+ * Side effects:
+ *	The compile cache may be used.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int CompileStubsObjCmd(
+    Tcl_Interp *interp,			/* Current Tcl interpreter. */
+    StubsState *statePtr,		/* IN/OUT: The command state. */
+    int objc,				/* Number of arguments. */
+    Tcl_Obj *CONST objv[])		/* The array of arguments. */
+{
+    int index;
+    int type = SASS_COMPILE_TYPE_DATA;
+    int flags = 0;
+    Tcl_Obj *optionsPtr = NULL;
+    Sass_CompileResult *resultPtr;
+    Tcl_HashEntry *hPtr;
+    int isNew;
+    char zName[TCL_INTEGER_SPACE + 7];
+
+    static const char *types[] = {
+	"data", "file", (char *) NULL
+    };
+
+    for (index = 2; index < objc - 1; index++) {
+	const char *zArg = Tcl_GetString(objv[index]);
+
+	if (strcmp(zArg, "-cache") == 0) {
+	    flags |= SASS_COMPILE_CACHE;
+	    continue;
+	}
+
+	if ((strcmp(zArg, "-type") == 0) && ((index + 2) < objc)) {
+	    int typeIndex;
+
+	    if (Tcl_GetIndexFromObj(interp, objv[++index], types, "type",
+		    0, &typeIndex) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+
+	    type = (typeIndex == 0) ?
+		SASS_COMPILE_TYPE_DATA : SASS_COMPILE_TYPE_FILE;
+
+	    continue;
+	}
+
+	if ((strcmp(zArg, "-options") == 0) && ((index + 2) < objc)) {
+	    optionsPtr = objv[++index];
+	    continue;
+	}
+
+	break;
+    }
+
+    if (index != objc - 1) {
+	Tcl_WrongNumArgs(interp, 2, objv,
+	    "?-cache? ?-type data|file? ?-options dict? source");
+
+	return TCL_ERROR;
+    }
+
+    resultPtr = (Sass_CompileResult *)malloc(sizeof(Sass_CompileResult));
+
+    if (resultPtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: resultPtr\n", NULL);
+	return TCL_ERROR;
+    }
+
+    if (Sass_CompileEx(interp, type, Tcl_GetString(objv[index]), -1,
+	    optionsPtr, flags, resultPtr) != TCL_OK) {
+	/*
+	 * NOTE: Upon error, there is nothing to free, since the result was
+	 *       cleared.
+	 */
+
+	if (resultPtr->internalPtr != NULL)
+	    Tcl_AppendResult(interp, "result was not cleared\n", NULL);
+
+	free(resultPtr);
+	return TCL_ERROR;
+    }
+
+    snprintf(zName, sizeof(zName), "result%d", ++statePtr->nextId);
+
+    hPtr = Tcl_CreateHashEntry(&statePtr->results, zName, &isNew);
+    Tcl_SetHashValue(hPtr, (ClientData)resultPtr);
+
+    Tcl_SetObjResult(interp, Tcl_NewStringObj(zName, -1));
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StubsObjCmd --
+ *
+ *	Handles the [sassstubs] command.  Its sub-commands are:
+ *
+ *	compile ?-cache? ?-type data|file? ?-options dict? source
+ *	    Compiles via Sass_CompileEx and returns the result name.
+ *	result name
+ *	    Returns the fields of the result, as a dictionary, using the
+ *	    strings borrowed from it.
+ *	free name
+ *	    Frees the result via Sass_FreeResult, twice, and returns
+ *	    non-zero if it was cleared.
+ *	register
+ *	    Registers the "stubs-twice" function via Sass_RegisterFunction.
+ *	unregister
+ *	    Unregisters it via Sass_UnregisterFunction.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The public functions of the package are called.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int StubsObjCmd(
+    ClientData clientData,	/* The command state. */
+    Tcl_Interp *interp,		/* Current Tcl interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *CONST objv[])	/* The array of arguments. */
+{
+    StubsState *statePtr = (StubsState *)clientData;
+    Sass_CompileResult *resultPtr;
+    Tcl_HashEntry *hPtr;
+    int option;
+
+    static const char *cmdOptions[] = {
+	"compile", "free", "register", "result", "unregister", (char *) NULL
+    };
+
+    enum options {
+	OPT_COMPILE, OPT_FREE, OPT_REGISTER, OPT_RESULT, OPT_UNREGISTER
+    };
+
+    if (objc < 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "option ?arg ...?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetIndexFromObj(interp, objv[1], cmdOptions, "option", 0,
+	    &option) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    switch ((enum options)option) {
+	case OPT_COMPILE: {
+	    return CompileStubsObjCmd(interp, statePtr, objc, objv);
+	}
+	case OPT_FREE: {
+	    int bCleared;
+
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 2, objv, "name");
+		return TCL_ERROR;
+	    }
+
+	    resultPtr = GetResultFromObj(interp, statePtr, objv[2], &hPtr);
+
+	    if (resultPtr == NULL)
+		return TCL_ERROR;
+
+	    Sass_FreeResult(resultPtr);
+
+	    bCleared = (resultPtr->zOutput == NULL) &&
+		(resultPtr->zSourceMap == NULL) &&
+		(resultPtr->zErrorMessage == NULL) &&
+		(resultPtr->internalPtr == NULL);
+
+	    /*
+	     * NOTE: Freeing the same result again must be a harmless no-op.
+	     */
+
+	    Sass_FreeResult(resultPtr);
+
+	    free(resultPtr);
+	    Tcl_DeleteHashEntry(hPtr);
+
+	    Tcl_SetObjResult(interp, Tcl_NewBooleanObj(bCleared));
+	    return TCL_OK;
+	}
+	case OPT_REGISTER:
+	case OPT_UNREGISTER: {
+	    int rc;
+
+	    if (objc != 2) {
+		Tcl_WrongNumArgs(interp, 2, objv, NULL);
+		return TCL_ERROR;
+	    }
+
+	    if (option == OPT_REGISTER) {
+		rc = Sass_RegisterFunction(STUBS_FUNCTION_SIGNATURE,
+		    TwiceProc, NULL);
+	    } else {
+		rc = Sass_UnregisterFunction(STUBS_FUNCTION_NAME);
+	    }
+
+	    Tcl_SetObjResult(interp, Tcl_NewIntObj(rc));
+	    return TCL_OK;
+	}
+	case OPT_RESULT: {
+	    Tcl_Obj *listPtr;
+
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 2, objv, "name");
+		return TCL_ERROR;
+	    }
+
+	    resultPtr = GetResultFromObj(interp, statePtr, objv[2], &hPtr);
+
+	    if (resultPtr == NULL)
+		return TCL_ERROR;
+
+	    listPtr = Tcl_NewListObj(0, NULL);
+
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewStringObj("errorStatus", -1));
+
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		Tcl_NewIntObj(resultPtr->errorStatus));
+
+	    if (resultPtr->zOutput != NULL) {
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewStringObj("outputString", -1));
+
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewStringObj(resultPtr->zOutput,
+		    resultPtr->outputLength));
+	    }
+
+	    if (resultPtr->zErrorMessage != NULL) {
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewStringObj("errorMessage", -1));
+
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewStringObj(resultPtr->zErrorMessage,
+		    resultPtr->errorMessageLength));
+
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewStringObj("errorLine", -1));
+
+		Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewWideIntObj(resultPtr->errorLine));
+	    }
+
+	    Tcl_SetObjResult(interp, listPtr);
+	    return TCL_OK;
+	}
+    }
+
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StubsObjCmdDeleteProc --
+ *
+ *	This function frees the state of the [sassstubs] command, along
+ *	with any results that were not freed yet.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void StubsObjCmdDeleteProc(
+    ClientData clientData)	/* The command state. */
+{
+    StubsState *statePtr = (StubsState *)clientData;
+    Tcl_HashSearch search;
+    Tcl_HashEntry *hPtr;
+
+    for (hPtr = Tcl_FirstHashEntry(&statePtr->results, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	Sass_CompileResult *resultPtr;
+
+	resultPtr = (Sass_CompileResult *)Tcl_GetHashValue(hPtr);
+	Sass_FreeResult(resultPtr);
+	free(resultPtr);
+    }
+
+    Tcl_DeleteHashTable(&statePtr->results);
+    free(statePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Sassstubs_Init --
+ *
+ *	This function initializes the test extension for the specified
+ *	Tcl interpreter, which requires the package via its stubs table.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The package may be loaded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+DLLEXPORT int Sassstubs_Init(
+    Tcl_Interp *interp)			/* Current Tcl interpreter. */
+{
+    StubsState *statePtr;
+
+    if ((interp == NULL) || !Tcl_InitStubs(interp, "8.4", 0))
+	return TCL_ERROR;
+
+    if (Sass_InitStubs(interp, PACKAGE_VERSION, 1) == NULL)
+	return TCL_ERROR;
+
+    statePtr = (StubsState *)malloc(sizeof(StubsState));
+
+    if (statePtr == NULL) {
+	Tcl_AppendResult(interp, "out of memory: statePtr\n", NULL);
+	return TCL_ERROR;
+    }
+
+    memset(statePtr, 0, sizeof(StubsState));
+    Tcl_InitHashTable(&statePtr->results, TCL_STRING_KEYS);
+
+    Tcl_CreateObjCommand(interp, "sassstubs", StubsObjCmd, statePtr,
+	StubsObjCmdDeleteProc);
+
+    return Tcl_PkgProvide(interp, "sassstubs", PACKAGE_VERSION);
+}